@@ -0,0 +1,48 @@
+// alloc_counter.cpp
+#include "alloc_counter.h"
+#include <stddef.h>
+
+#ifdef ALLOC_COUNTER_WRAP
+
+static uint32_t allocations = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+}
+
+bool allocCounterEnabled() {
+  return true;
+}
+
+uint32_t allocCount() {
+  return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+
+#else
+
+bool allocCounterEnabled() {
+  return false;
+}
+
+uint32_t allocCount() {
+  return 0;
+}
+
+#endif
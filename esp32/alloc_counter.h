@@ -0,0 +1,18 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stdint.h>
+
+// Counts heap allocations (malloc/calloc/realloc, and therefore new/String/
+// ArduinoJson) when the firmware is built with ALLOC_COUNTER_WRAP defined and
+// linked with the matching wrap flags, e.g. in platformio.ini:
+//
+//   build_flags = -DALLOC_COUNTER_WRAP
+//                 -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+//
+// The count is global across tasks. Without the flags allocCounterEnabled()
+// is false and allocCount() stays 0.
+bool allocCounterEnabled();
+uint32_t allocCount();
+
+#endif
@@ -0,0 +1,276 @@
+// backup.cpp
+#include <Adafruit_Fingerprint.h>
+#include <atomic>
+#include "backup.h"
+#include "spsc_queue.h"
+#include "fingerprint.h"
+#include "fingerprint_index.h"
+#include "hash_index.h"
+#include "station_store.h"
+#include "messaging.h"
+#include "buffer_pool.h"
+
+extern Adafruit_Fingerprint finger;
+
+// --- Backup ---
+// The sensor task fills one chunk a template per step, each into a pool block,
+// and posts it to the network task, which publishes it and frees the chunk and
+// its blocks. chunkBusy is the handover: set by the sensor task when it takes
+// a chunk, cleared by the network task once the chunk is out.
+static BackupChunk chunks[BACKUP_BUFFERS];
+static std::atomic<bool> chunkBusy[BACKUP_BUFFERS];
+static std::atomic<uint16_t> ackedChunks{ 0 };  // written by the network task
+
+struct BackupJob {
+  bool active;
+  uint16_t cursor;  // next slot to read, 0 once the library is exhausted
+  uint16_t seq;     // next chunk number
+  uint16_t acked;   // chunks acknowledged so far
+  int8_t fill;      // buffer being filled, -1 if none
+  uint16_t sent, failed;
+  uint32_t startMs, lastAckMs;
+  uint16_t chunkStart[BACKUP_WINDOW];  // first slot of each unacknowledged chunk
+};
+
+static BackupJob backup;
+
+bool backupBegin(uint16_t from) {
+  if (!occupancyValid()) occupancyRefresh();
+  uint16_t first = occupancyNext(from ? from : 1);
+  if (first == 0) {
+    publishEnrolmentStatusf(STATUS_ERROR, "Backup: no templates from ID %u", (unsigned)from);
+    return false;
+  }
+  backup = {};
+  backup.active = true;
+  backup.cursor = first;
+  backup.fill = -1;
+  backup.startMs = backup.lastAckMs = millis();
+  ackedChunks.store(0, std::memory_order_release);
+  Serial.printf("Backup started at ID %u (%u templates stored)\n", (unsigned)first, (unsigned)occupancyCount());
+  publishEnrolmentStatusf(STATUS_STARTED, "Backup started at ID %u", (unsigned)first);
+  return true;
+}
+
+static void releaseChunkData(BackupChunk& c) {
+  for (uint8_t i = 0; i < c.count; ++i) poolRelease(c.data[i]);
+  c.count = 0;
+}
+
+static int8_t freeChunk() {
+  for (uint8_t i = 0; i < BACKUP_BUFFERS; ++i) {
+    if (!chunkBusy[i].load(std::memory_order_acquire)) return i;
+  }
+  return -1;
+}
+
+// Where a new backup should start to pick up everything not acknowledged
+static uint16_t backupResumePoint() {
+  if (backup.acked == backup.seq) return backup.cursor;
+  return backup.chunkStart[backup.acked % BACKUP_WINDOW];
+}
+
+static void backupFinish(const char* outcome) {
+  if (backup.fill >= 0) {
+    releaseChunkData(chunks[backup.fill]);
+    chunkBusy[backup.fill].store(false, std::memory_order_release);  // never posted
+    backup.fill = -1;
+  }
+  backup.active = false;
+
+  uint32_t elapsedMs = millis() - backup.startMs;
+  float rate = elapsedMs ? backup.sent * 1000.0f / (float)elapsedMs : 0.0f;
+  char summary[128];
+  int n = snprintf(summary, sizeof(summary), "Backup %s: %u templates in %u chunks, %u unreadable, %lu ms (%.1f templates/s)",
+                   outcome, (unsigned)backup.sent, (unsigned)backup.seq, (unsigned)backup.failed,
+                   (unsigned long)elapsedMs, rate);
+  uint16_t resume = backupResumePoint();
+  if (resume != 0 && n > 0 && (size_t)n < sizeof(summary)) {
+    snprintf(summary + n, sizeof(summary) - n, ", resume from ID %u", (unsigned)resume);
+  }
+  Serial.println(summary);
+  publishEnrolmentStatus(STATUS_SUCCESS, summary);
+}
+
+bool backupStep() {
+  if (!backup.active) return false;
+  uint32_t now = millis();
+  uint16_t acked = ackedChunks.load(std::memory_order_acquire);
+  if (acked != backup.acked && (uint16_t)(acked - backup.acked) <= (uint16_t)(backup.seq - backup.acked)) {
+    backup.acked = acked;
+    backup.lastAckMs = now;
+  }
+
+  if (backup.fill < 0) {
+    // flow control: a window of unacknowledged chunks, and a free buffer
+    int8_t index = freeChunk();
+    if ((uint16_t)(backup.seq - backup.acked) >= BACKUP_WINDOW || index < 0) {
+      if (now - backup.lastAckMs < BACKUP_ACK_TIMEOUT_MS) return true;
+      backupFinish("stalled");
+      return false;
+    }
+    chunkBusy[index].store(true, std::memory_order_relaxed);
+    backup.fill = index;
+    BackupChunk& c = chunks[index];
+    c.seq = backup.seq;
+    c.count = 0;
+    backup.chunkStart[backup.seq % BACKUP_WINDOW] = backup.cursor;
+    backup.seq++;
+  }
+
+  // one slot per step
+  BackupChunk& c = chunks[backup.fill];
+  if (backup.cursor != 0) {
+    uint8_t* block = poolAcquire(POOL_BACKUP);
+    if (!block) return true;  // the network task frees the blocks of a published chunk
+    if (fetchTemplate(backup.cursor, block, 2)) {
+      c.data[c.count] = block;
+      c.ids[c.count++] = backup.cursor;
+      backup.sent++;
+    } else {
+      poolRelease(block);
+      backup.failed++;
+      publishEnrolmentStatusf(STATUS_PROGRESS, "Backup: template %u unreadable, skipped", (unsigned)backup.cursor);
+    }
+    backup.cursor = occupancyNext(backup.cursor + 1);
+  }
+  if (c.count < BACKUP_PER_CHUNK && backup.cursor != 0) return true;
+
+  c.next = backup.cursor;
+  c.done = backup.cursor == 0;
+  bool done = c.done;
+  publishBackupChunk(backup.fill);  // the buffer belongs to the network task now
+  backup.fill = -1;
+  if (done) {
+    backupFinish("complete");
+    return false;
+  }
+  return true;
+}
+
+void backupAbort() {
+  if (backup.active) backupFinish("cancelled");
+}
+
+const BackupChunk& backupChunk(uint8_t index) {
+  return chunks[index];
+}
+
+void backupChunkReleased(uint8_t index) {
+  releaseChunkData(chunks[index]);
+  chunkBusy[index].store(false, std::memory_order_release);
+}
+
+void backupAck(uint16_t seq) {
+  ackedChunks.store(seq + 1, std::memory_order_release);
+}
+
+// --- Restore ---
+// Decoded templates cross from the network task in restoreQueue, each in a
+// pool block that the sensor task releases once it is done with the entry.
+// Entries carry the tag of their restore; leftovers of a cancelled one are skipped.
+static SpscQueue<RestoreTemplate, RESTORE_SLOTS> restoreQueue;
+static uint8_t restoreTag = 0;  // network task
+
+struct RestoreJob {
+  bool active;
+  uint8_t tag;
+  uint16_t stored, failed;
+  uint32_t startMs, lastDataMs;
+};
+
+static RestoreJob restore;
+static RestoreTemplate restoreItem;  // sensor task only
+
+uint8_t restoreNextTag() {
+  if (++restoreTag == 0) ++restoreTag;
+  return restoreTag;
+}
+
+uint8_t restoreCurrentTag() {
+  return restoreTag;
+}
+
+size_t restoreQueueRoom() {
+  size_t room = restoreQueue.capacity() - restoreQueue.size();
+  return min(room, (size_t)poolFree());
+}
+
+bool restoreQueuePush(const RestoreTemplate& item) {
+  return restoreQueue.push(item);
+}
+
+void restoreBegin(uint8_t tag) {
+  restore = {};
+  restore.active = true;
+  restore.tag = tag;
+  restore.startMs = restore.lastDataMs = millis();
+  Serial.println("Restore started");
+  publishEnrolmentStatus(STATUS_STARTED, "Restore started");
+}
+
+static void restoreFinish(const char* outcome) {
+  restore.active = false;
+  uint32_t elapsedMs = millis() - restore.startMs;
+  float rate = elapsedMs ? restore.stored * 1000.0f / (float)elapsedMs : 0.0f;
+  char summary[128];
+  snprintf(summary, sizeof(summary), "Restore %s: %u stored, %u failed in %lu ms (%.1f templates/s)", outcome,
+           (unsigned)restore.stored, (unsigned)restore.failed, (unsigned long)elapsedMs, rate);
+  Serial.println(summary);
+  storeCommit();
+  publishEnrolmentStatus(STATUS_SUCCESS, summary);
+  publishEnrolmentCount();
+}
+
+// Store one template and bring the indexes up to date. The hash of the
+// uploaded bytes is the hash a later download would produce.
+static void restoreTemplate(const RestoreTemplate& item) {
+  if ((item.flags & RESTORE_INVALID) || !item.data || item.id > finger.capacity || !storeTemplate(item.id, item.data)) {
+    restore.failed++;
+    publishEnrolmentStatusf(STATUS_PROGRESS, "Restore: template %u not stored", (unsigned)item.id);
+    return;
+  }
+  uint8_t hash[32];
+  hashTemplateRaw(item.data, TEMPLATE_PAYLOAD_SIZE, hash);
+  bool existed = occupancyIsSet(item.id);
+  occupancyMark(item.id, true);
+  hashIndexSet(item.id, hash);
+  if (!existed) {
+    enrolledCount++;
+    storeSetCount(enrolledCount);
+  }
+  restore.stored++;
+}
+
+bool restoreStep() {
+  if (!restore.active) return false;
+  if (!restoreQueue.pop(restoreItem)) {
+    if (millis() - restore.lastDataMs < RESTORE_IDLE_TIMEOUT_MS) return true;
+    restoreFinish("stalled");
+    return false;
+  }
+  restore.lastDataMs = millis();
+  if (restoreItem.tag != restore.tag) {
+    poolRelease(restoreItem.data);
+    return true;
+  }
+
+  if (restoreItem.id != 0 || (restoreItem.flags & RESTORE_INVALID)) restoreTemplate(restoreItem);
+  poolRelease(restoreItem.data);
+  bool done = restoreItem.flags & RESTORE_DONE;
+  if (restoreItem.flags & RESTORE_END_OF_CHUNK) {
+    publishRestoreAck(restoreItem.seq, restore.stored, restore.failed, done);
+  }
+  if (done) {
+    restoreFinish("complete");
+    return false;
+  }
+  return true;
+}
+
+void restoreAbort() {
+  if (!restore.active) return;
+  // drop what is still queued; the sender gets no ack for it
+  while (restoreQueue.pop(restoreItem)) poolRelease(restoreItem.data);
+  restoreFinish("cancelled");
+}
@@ -0,0 +1,69 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <Arduino.h>
+#include "fingerprint_util.h"
+
+// Full-library backup and restore of the raw 512-byte templates over MQTT.
+//
+// Backup streams the occupied slots in chunks of BACKUP_PER_CHUNK templates on
+// esp32/fingerprint/backup. Every chunk carries a sequence number and `next`,
+// the slot the following chunk starts at (0 after the last one); the receiver
+// acknowledges with {"action":"backup-ack","seq":n} and the device keeps up to
+// BACKUP_WINDOW chunks unacknowledged, so template reads overlap the round
+// trips. An interrupted backup resumes with {"action":"backup","from":next}.
+//
+// Restore is the reverse: {"action":"restore","seq":n,"templates":[{"id":..,
+// "data":"<base64>"},..],"done":true} on the command topic, seq 0 starting a new
+// restore. Templates are uploaded (DownChar) and stored on the sensor task and
+// each message is acknowledged once its templates are stored, so the sender can
+// keep RESTORE_SLOTS templates in flight. Two templates fit one command in the
+// 2048-byte MQTT buffer.
+#define BACKUP_PER_CHUNK 4           // templates per backup message
+#define BACKUP_BUFFERS 2             // chunks handed to the network task
+#define BACKUP_WINDOW 4              // chunks published but not yet acknowledged
+#define BACKUP_ACK_TIMEOUT_MS 30000  // no ack for this long: stop and report the resume point
+#define RESTORE_SLOTS 8              // decoded templates waiting for the sensor
+#define RESTORE_IDLE_TIMEOUT_MS 30000
+
+struct BackupChunk {
+  uint16_t seq;
+  uint16_t next;  // first slot of the next chunk, 0 after the last
+  bool done;
+  uint8_t count;
+  uint16_t ids[BACKUP_PER_CHUNK];
+  uint8_t* data[BACKUP_PER_CHUNK];  // pool blocks, released with the chunk
+};
+
+enum RestoreFlags : uint8_t {
+  RESTORE_END_OF_CHUNK = 1,  // acknowledge seq after this entry
+  RESTORE_DONE = 2,          // last entry of the restore
+  RESTORE_INVALID = 4        // template did not decode; counted as failed
+};
+
+struct RestoreTemplate {
+  uint8_t tag;    // restore this entry belongs to
+  uint8_t flags;  // RestoreFlags
+  uint16_t seq;
+  uint16_t id;    // 0: flags only
+  uint8_t* data;  // pool block, released by the sensor task; null if invalid or flags only
+};
+
+// Sensor task: bulk jobs (see BulkJob in station_tasks.h)
+bool backupBegin(uint16_t from);  // false when no occupied slot is left from there
+bool backupStep();
+void backupAbort();
+void restoreBegin(uint8_t tag);
+bool restoreStep();
+void restoreAbort();
+
+// Network task
+const BackupChunk& backupChunk(uint8_t index);
+void backupChunkReleased(uint8_t index);  // published (or dropped); the buffer is free again
+void backupAck(uint16_t seq);             // chunks up to and including seq arrived
+uint8_t restoreNextTag();                 // tag for a new restore, never 0
+uint8_t restoreCurrentTag();              // 0 before the first restore
+size_t restoreQueueRoom();  // queue places with a pool block to go with them
+bool restoreQueuePush(const RestoreTemplate& item);  // on false the caller keeps the block
+
+#endif
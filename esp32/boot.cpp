@@ -0,0 +1,190 @@
+// boot.cpp
+#include <Adafruit_Fingerprint.h>
+#include <atomic>
+#include <esp_system.h>
+#include "boot.h"
+#include "sensor_link.h"
+#include "station_store.h"
+#include "fingerprint_index.h"
+#include "hash_index.h"
+#include "messaging.h"
+#include "connection.h"
+
+extern Adafruit_Fingerprint finger;
+extern uint16_t enrolledCount;  // from fingerprint.cpp
+
+static BootPhaseTiming phases[BOOT_PHASE_COUNT];
+static std::atomic<uint8_t> mode{ MODE_BOOTING };
+static std::atomic<bool> storeLoaded{ false };  // set by the store task
+
+// sensor task
+static bool storeAdopted = false;
+static bool sensorPowered = false;  // finger.begin() done
+static bool linkUp = false;
+static uint32_t nextSensorTryMs = 0;
+static uint16_t sensorTries = 0;
+
+// network task
+static uint8_t reportedMode = MODE_BOOTING;
+
+static void phaseEnd(BootPhase phase) {
+  phases[phase].endMs = millis();
+  if (phases[phase].endMs == 0) phases[phase].endMs = 1;  // 0 means still running
+}
+
+static void loadStore() {
+  storeBegin();
+  phaseEnd(BOOT_STORE);
+  storeLoaded.store(true, std::memory_order_release);
+}
+
+static void storeTask(void*) {
+  loadStore();
+  vTaskDelete(nullptr);
+}
+
+void bootBegin() {
+  uint32_t now = millis();
+  for (BootPhaseTiming& p : phases) p = { now, 0 };
+  if (xTaskCreatePinnedToCore(storeTask, "store", BOOT_STORE_STACK, nullptr, 1, nullptr, BOOT_STORE_CORE) != pdPASS) {
+    loadStore();  // no room for the task: load in place
+  }
+}
+
+bool bootStoreReady() {
+  if (storeAdopted) return true;
+  if (!storeLoaded.load(std::memory_order_acquire)) return false;
+  // the store belongs to the sensor task from here on
+  storeAdopted = true;
+  enrolledCount = storeState().enrolledCount;
+  Serial.printf("Loaded enrolledCount: %u\n", (unsigned)enrolledCount);
+  return true;
+}
+
+static void enterDegraded() {
+  nextSensorTryMs = millis() + BOOT_SENSOR_RETRY_MS;
+  if (mode.load(std::memory_order_relaxed) == MODE_DEGRADED) return;
+  mode.store(MODE_DEGRADED, std::memory_order_release);
+  Serial.printf("Fingerprint sensor not found :( degraded mode, retrying every %u s\n",
+                (unsigned)(BOOT_SENSOR_RETRY_MS / 1000));
+  publishEnrolmentStatusf(STATUS_ERROR, "Fingerprint sensor not found; station degraded, retrying every %u s",
+                          (unsigned)(BOOT_SENSOR_RETRY_MS / 1000));
+}
+
+// Occupancy and hash index need the sensor and the loaded store
+static void buildIndexes() {
+  sensorLinkSave();
+  if (occupancyRefresh() && occupancyCount() != enrolledCount) {
+    Serial.printf("enrolledCount %u disagrees with sensor index %u; using sensor\n", (unsigned)enrolledCount,
+                  (unsigned)occupancyCount());
+    enrolledCount = occupancyCount();
+    storeSetCount(enrolledCount);
+  }
+  hashIndexBegin();
+  phaseEnd(BOOT_INDEX);
+
+  bool wasDegraded = mode.load(std::memory_order_relaxed) == MODE_DEGRADED;
+  mode.store(MODE_READY, std::memory_order_release);
+  Serial.printf("Station verify-ready %lu ms after reset\n", (unsigned long)phases[BOOT_INDEX].endMs);
+  if (wasDegraded) {
+    publishEnrolmentStatus(STATUS_SUCCESS, "Fingerprint sensor found; station ready");
+    publishEnrolmentCount();
+  }
+}
+
+bool bootSensorStep() {
+  if (mode.load(std::memory_order_relaxed) == MODE_READY) return true;
+
+  if (!linkUp) {
+    if (sensorTries > 0 && (int32_t)(millis() - nextSensorTryMs) < 0) return false;
+    if (!sensorPowered) {
+      finger.begin(SENSOR_LINK_DEFAULT_BAUD);  // includes the sensor's power-up wait
+      sensorPowered = true;
+    }
+    sensorTries++;
+    // the stored rate saves a scan if the store is in by now; no need to wait for it
+    uint32_t preferred = bootStoreReady() ? storeState().linkBaud : 0;
+    if (!sensorLinkBegin(preferred)) {  // also reads capacity, packet length, baud rate
+      enterDegraded();
+      return false;
+    }
+    Serial.println("Found fingerprint sensor!");
+    linkUp = true;
+    phaseEnd(BOOT_SENSOR);
+    phases[BOOT_INDEX].startMs = millis();
+  }
+
+  if (!bootStoreReady()) return false;
+  buildIndexes();
+  return true;
+}
+
+StationMode stationMode() {
+  return (StationMode)mode.load(std::memory_order_acquire);
+}
+
+const char* stationModeToString(StationMode m) {
+  switch (m) {
+    case MODE_BOOTING: return "booting";
+    case MODE_READY: return "ready";
+    case MODE_DEGRADED: return "degraded";
+    default: return "unknown";
+  }
+}
+
+const BootPhaseTiming& bootPhase(BootPhase phase) {
+  return phases[phase];
+}
+
+const char* bootPhaseName(BootPhase phase) {
+  switch (phase) {
+    case BOOT_STORE: return "store";
+    case BOOT_SENSOR: return "sensor";
+    case BOOT_INDEX: return "index";
+    case BOOT_WIFI: return "wifi";
+    case BOOT_MQTT: return "mqtt";
+    default: return "unknown";
+  }
+}
+
+const char* bootResetReason() {
+  switch (esp_reset_reason()) {
+    case ESP_RST_POWERON: return "poweron";
+    case ESP_RST_BROWNOUT: return "brownout";
+    case ESP_RST_SW: return "software";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT: return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deepsleep";
+    case ESP_RST_EXT: return "external";
+    default: return "other";
+  }
+}
+
+void bootNetworkTick() {
+  if (phases[BOOT_WIFI].endMs == 0 && wifiLinkState() == LINK_UP) phaseEnd(BOOT_WIFI);
+  if (!connectionUp()) return;
+  if (phases[BOOT_MQTT].endMs == 0) phaseEnd(BOOT_MQTT);
+
+  uint8_t current = mode.load(std::memory_order_acquire);
+  if (current != reportedMode && sendBootReport()) reportedMode = current;
+}
+
+void bootPrint() {
+  StationMode m = stationMode();
+  Serial.printf("Boot: %s after %s reset\n", stationModeToString(m), bootResetReason());
+  for (uint8_t i = 0; i < BOOT_PHASE_COUNT; ++i) {
+    const BootPhaseTiming& p = phases[i];
+    if (p.endMs) {
+      Serial.printf("  %-7s %6lu -> %6lu ms (%lu ms)\n", bootPhaseName((BootPhase)i), (unsigned long)p.startMs,
+                    (unsigned long)p.endMs, (unsigned long)(p.endMs - p.startMs));
+    } else {
+      Serial.printf("  %-7s %6lu -> (running)\n", bootPhaseName((BootPhase)i), (unsigned long)p.startMs);
+    }
+  }
+  if (m == MODE_DEGRADED) {
+    Serial.printf("  sensor bring-up tried %u time(s), next in %ld ms\n", (unsigned)sensorTries,
+                  (long)(int32_t)(nextSensorTryMs - millis()));
+  }
+}
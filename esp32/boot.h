@@ -0,0 +1,65 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <Arduino.h>
+
+// Staged boot. setup() only opens the UARTs, reads the station ID and starts
+// the tasks; the slow parts then run side by side:
+//  - store task (one-shot): LittleFS mount, snapshot load and journal replay
+//  - sensor task: sensor power-up and link negotiation, then, once the store
+//    is in, the occupancy and hash indexes
+//  - network task: Wi-Fi association, TLS and MQTT (connection.cpp)
+// Verify requests are taken as soon as the sensor side is done; requests that
+// arrive earlier wait in the pending list. The network catches up on its own.
+//
+// A sensor that does not answer puts the station in degraded mode instead of
+// halting it: the CLI, the store and MQTT keep running, sensor requests are
+// refused with an error status, the shared work queue is left to other
+// stations, and bring-up is retried every BOOT_SENSOR_RETRY_MS.
+#define BOOT_SENSOR_RETRY_MS 30000
+#define BOOT_STORE_STACK 6144
+#define BOOT_STORE_CORE 1  // next to the sensor task, which mostly waits on the UART
+
+enum BootPhase : uint8_t {
+  BOOT_STORE,    // store task: storeBegin()
+  BOOT_SENSOR,   // finger.begin() (sensor power-up) and link negotiation
+  BOOT_INDEX,    // occupancy refresh and hash index; ends verify-ready
+  BOOT_WIFI,     // association
+  BOOT_MQTT,     // first MQTT connect (TLS included)
+  BOOT_PHASE_COUNT
+};
+
+enum StationMode : uint8_t {
+  MODE_BOOTING,
+  MODE_READY,
+  MODE_DEGRADED  // no sensor
+};
+
+// millis() at the start and end of a phase; endMs is 0 while it runs
+struct BootPhaseTiming {
+  uint32_t startMs;
+  uint32_t endMs;
+};
+
+// setup(): start the store task and the phase clocks
+void bootBegin();
+
+// Sensor task, at the top of every step. True once the station is ready;
+// until then it moves the sensor bring-up on (retrying in degraded mode).
+bool bootSensorStep();
+// Sensor task: the store has been loaded and handed over (store, CLI, enrolledCount)
+bool bootStoreReady();
+
+// Network task: marks the network phases and publishes a boot report (on the
+// health topic) once MQTT is up and whenever the mode changes afterwards.
+void bootNetworkTick();
+
+StationMode stationMode();  // any task
+const char* stationModeToString(StationMode mode);
+const BootPhaseTiming& bootPhase(BootPhase phase);
+const char* bootPhaseName(BootPhase phase);
+const char* bootResetReason();
+// Serial CLI `boot` and the `info` summary
+void bootPrint();
+
+#endif
@@ -0,0 +1,74 @@
+// buffer_pool.cpp
+#include "buffer_pool.h"
+#include <atomic>
+
+static_assert(POOL_BLOCKS < 32, "one bit per block in the used mask");
+
+static constexpr uint32_t ALL_BLOCKS = (1u << POOL_BLOCKS) - 1;
+
+alignas(4) static uint8_t blocks[POOL_BLOCKS][POOL_BLOCK_SIZE];
+static std::atomic<uint32_t> used{ 0 };  // bit i: block i is out
+static std::atomic<uint8_t> owners[POOL_BLOCKS];
+static std::atomic<uint8_t> peak{ 0 };
+static std::atomic<uint32_t> acquired{ 0 };
+static std::atomic<uint32_t> failures{ 0 };
+
+uint8_t* poolAcquire(PoolOwner owner) {
+  uint32_t cur = used.load(std::memory_order_relaxed);
+  for (;;) {
+    uint32_t freeBits = ~cur & ALL_BLOCKS;
+    if (freeBits == 0) {
+      failures.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    uint32_t bit = freeBits & (~freeBits + 1);  // lowest free block
+    if (used.compare_exchange_weak(cur, cur | bit, std::memory_order_acquire, std::memory_order_relaxed)) {
+      uint8_t index = __builtin_ctz(bit);
+      owners[index].store(owner, std::memory_order_relaxed);
+      acquired.fetch_add(1, std::memory_order_relaxed);
+      uint8_t out = __builtin_popcount(cur | bit);
+      uint8_t seen = peak.load(std::memory_order_relaxed);
+      while (out > seen && !peak.compare_exchange_weak(seen, out, std::memory_order_relaxed)) continue;
+      return blocks[index];
+    }
+  }
+}
+
+void poolRelease(uint8_t* block) {
+  if (!block) return;
+  size_t index = (size_t)(block - blocks[0]) / POOL_BLOCK_SIZE;
+  if (index >= POOL_BLOCKS) return;
+  owners[index].store(POOL_FREE, std::memory_order_relaxed);
+  used.fetch_and(~(1u << index), std::memory_order_release);
+}
+
+uint8_t poolFree() {
+  return POOL_BLOCKS - __builtin_popcount(used.load(std::memory_order_relaxed));
+}
+
+PoolOwner poolOwner(uint8_t index) {
+  if (index >= POOL_BLOCKS || !(used.load(std::memory_order_relaxed) & (1u << index))) return POOL_FREE;
+  return (PoolOwner)owners[index].load(std::memory_order_relaxed);
+}
+
+const char* poolOwnerName(PoolOwner owner) {
+  switch (owner) {
+    case POOL_FREE: return "free";
+    case POOL_BULK_DOWNLOAD: return "bulk";
+    case POOL_DOWNLOAD: return "download";
+    case POOL_SESSION: return "session";
+    case POOL_BACKUP: return "backup";
+    case POOL_RESTORE: return "restore";
+    case POOL_BENCH: return "bench";
+    default: return "unknown";
+  }
+}
+
+PoolStats poolStats() {
+  PoolStats s;
+  s.inUse = POOL_BLOCKS - poolFree();
+  s.peak = peak.load(std::memory_order_relaxed);
+  s.acquired = acquired.load(std::memory_order_relaxed);
+  s.failures = failures.load(std::memory_order_relaxed);
+  return s;
+}
@@ -0,0 +1,60 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// One compile-time pool for the template-sized buffers of the sensor, hashing
+// and backup/restore paths. A block is borrowed for one call (PoolBuffer) or
+// for the life of a job and handed back; a block passed to the other task
+// with its data (backup chunk, restore queue) is released by the receiver.
+// Acquire and release are lock-free and work from either task.
+//
+// Budget: one bulk job at a time (backup: BACKUP_BUFFERS x BACKUP_PER_CHUNK,
+// restore: RESTORE_SLOTS, bulk download: 1) plus one single-template user on
+// the sensor task (download, enroll session, benches), and a spare.
+#define POOL_BLOCK_SIZE 512  // TEMPLATE_PAYLOAD_SIZE
+#define POOL_BLOCKS 10
+
+enum PoolOwner : uint8_t {
+  POOL_FREE,
+  POOL_BULK_DOWNLOAD,  // one block for the whole job
+  POOL_DOWNLOAD,       // download-template
+  POOL_SESSION,        // enroll-session deferred download
+  POOL_BACKUP,         // a template waiting in a backup chunk
+  POOL_RESTORE,        // a decoded template waiting in the restore queue
+  POOL_BENCH,
+  POOL_OWNER_COUNT
+};
+
+struct PoolStats {
+  uint8_t inUse;
+  uint8_t peak;       // most blocks out at once since boot
+  uint32_t acquired;
+  uint32_t failures;  // acquire found every block out
+};
+
+// nullptr when every block is out
+uint8_t* poolAcquire(PoolOwner owner);
+void poolRelease(uint8_t* block);  // nullptr is ignored
+uint8_t poolFree();
+PoolOwner poolOwner(uint8_t index);  // POOL_FREE if block index is not out
+const char* poolOwnerName(PoolOwner owner);
+PoolStats poolStats();
+
+// A block held for one scope; check it before use
+class PoolBuffer {
+public:
+  explicit PoolBuffer(PoolOwner owner) : data_(poolAcquire(owner)) {}
+  ~PoolBuffer() { poolRelease(data_); }
+  PoolBuffer(const PoolBuffer&) = delete;
+  PoolBuffer& operator=(const PoolBuffer&) = delete;
+
+  uint8_t* get() const { return data_; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+private:
+  uint8_t* data_;
+};
+
+#endif
@@ -0,0 +1,590 @@
+// command_dispatch.cpp
+#include <Adafruit_Fingerprint.h>
+#include <ctype.h>
+#include "command_dispatch.h"
+#include "station_tasks.h"
+#include "messaging.h"
+#include "fingerprint.h"
+#include "fingerprint_index.h"
+#include "hash_index.h"
+#include "enroll_session.h"
+#include "backup.h"
+#include "buffer_pool.h"
+#include "memory_report.h"
+#include "text_codec.h"
+#include "sensor_link.h"
+#include "station_store.h"
+#include "station_id.h"
+#include "connection.h"
+#include "boot.h"
+#include "soak.h"
+#include "latency.h"
+#include "alloc_counter.h"
+
+extern Adafruit_Fingerprint finger;
+
+static CommandStats stats;
+
+// --- Arguments ---
+
+bool CommandArgs::has(const char* key, uint8_t pos) const {
+  if (words_) return pos < count_;
+  return !obj_[key].isNull();
+}
+
+uint32_t CommandArgs::num(const char* key, uint8_t pos, uint32_t def) const {
+  if (words_) return pos < count_ ? strtoul(words_[pos], nullptr, 10) : def;
+  JsonVariantConst v = obj_[key];
+  return v.isNull() ? def : v.as<uint32_t>();
+}
+
+const char* CommandArgs::str(const char* key, uint8_t pos) const {
+  if (words_) return pos < count_ ? words_[pos] : "";
+  return obj_[key] | "";
+}
+
+bool CommandArgs::flag(const char* key) const {
+  if (!words_) return obj_[key] | false;
+  for (uint8_t i = 0; i < count_; ++i) {
+    if (strcmp(words_[i], key) == 0) return true;
+  }
+  return false;
+}
+
+JsonArrayConst CommandArgs::list(const char* key) const {
+  if (words_) return JsonArrayConst();
+  return obj_[key].as<JsonArrayConst>();
+}
+
+// --- Helpers ---
+
+// MQTT commands cross to the sensor task through the command queue; CLI lines
+// already run there and go straight to its pending list. False (and the busy
+// reply sent) if there was no room.
+static bool toSensor(const SensorCommand& cmd, CommandSource src) {
+  if (src == SRC_MQTT) {
+    if (submitSensorCommand(cmd)) return true;
+    publishEnrolmentStatus(STATUS_BUSY, "Sensor busy: command queue full");
+  } else if (acceptSensorCommand(cmd)) {
+    return true;
+  } else {
+    Serial.println("Too many pending requests");
+  }
+  return false;
+}
+
+static SensorCommand sensorCommand(SensorCommandType type) {
+  SensorCommand cmd = {};
+  cmd.type = type;
+  cmd.retries = 3;
+  cmd.request = currentRequest();  // set by the dispatcher
+  return cmd;
+}
+
+// --- Handlers (alphabetical, like the table) ---
+
+// {"from":id} resumes an interrupted backup at that slot
+static void onBackup(const CommandArgs& args, CommandSource src) {
+  SensorCommand cmd = sensorCommand(CMD_BACKUP);
+  cmd.id = args.num("from", 0, 1);
+  Serial.printf("Fingerprint: Backup request from ID %u\n", (unsigned)cmd.id);
+  toSensor(cmd, src);
+}
+
+// Handled here on the network task; the backup job picks the ack up
+static void onBackupAck(const CommandArgs& args, CommandSource) {
+  if (args.has("seq", 0)) backupAck(args.num("seq", 0, 0));
+}
+
+static void onBoot(const CommandArgs&, CommandSource) {
+  bootPrint();
+}
+
+static void onCancel(const CommandArgs& args, CommandSource src) {
+  SensorCommand cmd = sensorCommand(CMD_CANCEL);
+  cmd.all = args.flag("all");
+  if (src == SRC_MQTT) {
+    submitSensorCancel(cmd.all, cmd.request);  // out of band, never busy
+  } else {
+    acceptSensorCommand(cmd);
+  }
+}
+
+static void onCount(const CommandArgs&, CommandSource) {
+  if (finger.getTemplateCount() == FINGERPRINT_OK) {
+    Serial.print("Sensor reports templateCount = ");
+    Serial.println(finger.templateCount);
+  } else {
+    Serial.println("getTemplateCount() failed");
+  }
+  Serial.print("Persisted enrolledCount = ");
+  Serial.println(enrolledCount);
+}
+
+static void onDelall(const CommandArgs& args, CommandSource) {
+  if (!args.flag("confirm")) {
+    Serial.println("This is dangerous. To proceed type: delall confirm");
+    return;
+  }
+  Serial.println("Emptying fingerprint database (finger.emptyDatabase()) now.");
+  uint8_t r = finger.emptyDatabase();
+  if (r == FINGERPRINT_OK) {
+    occupancyClearAll();
+    hashIndexClearAll();
+    enrolledCount = 0;
+    storeSetCount(enrolledCount);
+    storeCommit();
+    publishEnrolmentCount();
+    publishEnrolmentStatus(STATUS_SUCCESS, "Database emptied (delall confirm)");
+    Serial.println("emptyDatabase: OK. enrolledCount reset to 0.");
+  } else {
+    Serial.printf("emptyDatabase failed with code %u\n", (unsigned)r);
+    publishEnrolmentStatus(STATUS_ERROR, "emptyDatabase failed");
+  }
+}
+
+static void onDelete(const CommandArgs& args, CommandSource) {
+  uint16_t id = args.num("userId", 0, 0);
+  if (id == 0) {
+    Serial.println("Usage: delete <id> (1..capacity)");
+    return;
+  }
+  deleteTemplateId(id);
+}
+
+static void onDownload(const CommandArgs& args, CommandSource src) {
+  SensorCommand cmd = sensorCommand(CMD_DOWNLOAD_TEMPLATE);
+  cmd.id = args.num("userId", 0, 0);
+  if (cmd.id == 0) {
+    if (src == SRC_MQTT) publishEnrolmentStatus(STATUS_ERROR, "Invalid userId for download-template");
+    else Serial.println("Usage: download <id> (1..capacity)");
+    return;
+  }
+  Serial.printf("Fingerprint: Download template request for ID %u\n", (unsigned)cmd.id);
+  toSensor(cmd, src);
+}
+
+static void onDownloadAll(const CommandArgs& args, CommandSource src) {
+  SensorCommand cmd = sensorCommand(CMD_DOWNLOAD_ALL);
+  // the CLI walks the whole library, MQTT keeps its old default
+  cmd.max = args.num("max", 0, src == SRC_SERIAL ? finger.capacity : 20);
+  cmd.retries = args.num("retries", 1, 3);
+  toSensor(cmd, src);
+}
+
+static void onEndSession(const CommandArgs&, CommandSource src) {
+  toSensor(sensorCommand(CMD_END_SESSION), src);
+}
+
+static void onEnroll(const CommandArgs& args, CommandSource src) {
+  SensorCommand cmd = sensorCommand(CMD_ENROLL);
+  cmd.id = args.num("userId", 0, 0);  // 0 => next free slot
+  Serial.println("Fingerprint: Enroll request");
+  toSensor(cmd, src);
+}
+
+// {"userIds":[..]} enrolls those IDs in order; {"count":n} / "session n" allocates
+// free slots (0 or absent: until stopped); "session stop" ends it
+static void onEnrollSession(const CommandArgs& args, CommandSource src) {
+  if (args.flag("stop")) {
+    onEndSession(args, src);
+    return;
+  }
+  SensorCommand cmd = sensorCommand(CMD_ENROLL_SESSION);
+  JsonArrayConst ids = args.list("userIds");
+  if (!ids.isNull()) {
+    // only the network task may fill the session's ID queue
+    cmd.tag = enrollSessionNextTag();
+    for (JsonVariantConst v : ids) {
+      uint16_t id = v | 0;
+      if (id == 0) continue;
+      if (!enrollSessionQueueId(cmd.tag, id)) {
+        publishEnrolmentStatusf(STATUS_ERROR, "Enroll session: list truncated after %u IDs", (unsigned)cmd.max);
+        break;
+      }
+      cmd.max++;
+    }
+    if (cmd.max == 0) {
+      publishEnrolmentStatus(STATUS_ERROR, "Enroll session: empty userIds");
+      return;
+    }
+  } else {
+    cmd.max = args.num("count", 0, 0);
+  }
+  Serial.printf("Fingerprint: Enroll session request (%u %s)\n", (unsigned)cmd.max, cmd.tag ? "listed IDs" : "voters");
+  toSensor(cmd, src);
+}
+
+static void onEnrolledCount(const CommandArgs&, CommandSource src) {
+  if (src == SRC_MQTT) publishEnrolmentCount();
+  else Serial.printf("Persisted enrolledCount = %u\n", (unsigned)enrolledCount);
+}
+
+static void onHelp(const CommandArgs&, CommandSource) {
+  commandPrintHelp();
+}
+
+static void onInfo(const CommandArgs&, CommandSource) {
+  Serial.println("=== Sensor Info ===");
+  Serial.print("Capacity: ");
+  Serial.println(finger.capacity);
+  Serial.print("TemplateCount(raw): ");
+  if (finger.getTemplateCount() == FINGERPRINT_OK) Serial.println(finger.templateCount);
+  else Serial.println("unknown");
+  Serial.print("Packet length: ");
+  Serial.println(finger.packet_len);
+  Serial.print("Baud rate: ");
+  Serial.println(finger.baud_rate);
+  Serial.printf("Link (negotiated): %lu baud, %u-byte packets\n", (unsigned long)sensorLinkBaud(),
+                (unsigned)sensorLinkPacketLen());
+  const StoreStats& ss = storeStats();
+  Serial.printf("Store: %lu batches, %lu records, journal %lu bytes, %lu compactions, %lu failed commits, "
+                "last commit %lu us, boot replay %lu records (%lu torn bytes)\n",
+                (unsigned long)ss.batches, (unsigned long)ss.records, (unsigned long)ss.journalBytes,
+                (unsigned long)ss.compactions, (unsigned long)ss.failedCommits, (unsigned long)ss.lastCommitUs,
+                (unsigned long)ss.replayed, (unsigned long)ss.tornBytes);
+  Serial.printf("MQTT messages built: %lu, heap allocations while building: %s%lu\n",
+                (unsigned long)messagingPublishCount(), allocCounterEnabled() ? "" : "(counter off) ",
+                (unsigned long)messagingPublishAllocations());
+  Serial.printf("Commands: mqtt=%lu serial=%lu unknown=%lu rejected=%lu, heap allocations while dispatching: %s%lu, "
+                "mqtt dispatch p50 %lu us\n",
+                (unsigned long)stats.mqtt, (unsigned long)stats.serial, (unsigned long)stats.unknown,
+                (unsigned long)stats.rejected, allocCounterEnabled() ? "" : "(counter off) ",
+                (unsigned long)stats.allocations, (unsigned long)latencyPercentile(LAT_COMMAND, 50));
+  const ConnectionStats& cs = connectionStats();
+  Serial.printf("Station: %s (%s), shared work queue %s (%lu answered busy)\n", stationId(),
+                stationModeToString(stationMode()), connectionTakingWork() ? "subscribed" : "not subscribed",
+                (unsigned long)stats.workBusy);
+  Serial.printf("Link: wifi=%s mqtt=%s drops wifi=%lu mqtt=%lu, last outage %lu ms, next backoff %lu ms\n",
+                linkStateToString(wifiLinkState()), linkStateToString(mqttLinkState()), (unsigned long)cs.wifiDrops,
+                (unsigned long)cs.mqttDrops, (unsigned long)cs.lastOutageMs, (unsigned long)cs.backoffMs);
+  Serial.printf("MQTT connects: %lu/%lu attempts (%lu TLS resumed), last %lu ms (tls %lu ms), min %lu, max %lu, "
+                "avg %lu ms\n",
+                (unsigned long)cs.connects, (unsigned long)cs.attempts, (unsigned long)cs.resumed,
+                (unsigned long)cs.lastConnectMs, (unsigned long)cs.lastTlsMs, (unsigned long)(cs.connects ? cs.minConnectMs : 0),
+                (unsigned long)cs.maxConnectMs, (unsigned long)(cs.connects ? cs.totalConnectMs / cs.connects : 0));
+  const OutboxStats& ob = messagingOutboxStats();
+  Serial.printf("Outbox: depth=%u high=%u queued=%lu flushed=%lu coalesced=%lu dropped=%lu deferred=%lu "
+                "event-drops=%lu\n",
+                (unsigned)ob.depth, (unsigned)ob.highWater, (unsigned long)ob.queued, (unsigned long)ob.flushed,
+                (unsigned long)ob.coalesced, (unsigned long)ob.dropped, (unsigned long)ob.deferred,
+                (unsigned long)messagingEventDrops());
+  enrollSessionPrint();
+  Serial.printf("Wire format: %s\n", messagingWireFormat() == WIRE_BINARY ? "binary" : "json");
+  for (int f = WIRE_JSON; f <= WIRE_BINARY; ++f) {
+    const WireStats& ws = messagingWireStats((WireFormat)f);
+    Serial.printf("  %-6s msgs=%lu bytes=%lu avg=%lu B encode=%lu us\n", f == WIRE_BINARY ? "binary" : "json",
+                  (unsigned long)ws.messages, (unsigned long)ws.bytes,
+                  (unsigned long)(ws.messages ? ws.bytes / ws.messages : 0), (unsigned long)ws.encodeMicros);
+  }
+}
+
+static void onHashBench(const CommandArgs& args, CommandSource) {
+  templateHashBench(args.num("id", 0, 0), args.num("samples", 1, 3));
+}
+
+static void onLinkBench(const CommandArgs& args, CommandSource) {
+  sensorLinkBench(args.num("samples", 0, 3));
+}
+
+// CLI: print on the sensor task. MQTT: published from the network task.
+static void onMem(const CommandArgs&, CommandSource src) {
+  if (src == SRC_SERIAL) memoryPrint();
+  else publishMemoryReport();
+}
+
+static void onProbe(const CommandArgs& args, CommandSource src) {
+  SensorCommand cmd = sensorCommand(CMD_PROBE);
+  cmd.all = args.flag("deep");
+  toSensor(cmd, src);
+}
+
+static void onResetEnrollments(const CommandArgs&, CommandSource src) {
+  Serial.println("Resetting all enrollments...");
+  toSensor(sensorCommand(CMD_RESET_ENROLLMENTS), src);
+}
+
+// {"seq":n,"templates":[{"id":..,"data":"<base64>"},..],"done":true}; seq 0
+// starts a restore. The templates are decoded here into pool blocks and queued
+// for the sensor task, which acknowledges seq once they are stored.
+static void onRestore(const CommandArgs& args, CommandSource src) {
+  RestoreTemplate item = {};
+  uint16_t seq = args.num("seq", 0, 0);
+  JsonArrayConst templates = args.list("templates");
+  bool done = args.flag("done");
+  size_t n = templates.size();
+  if (restoreQueueRoom() < (n ? n : 1)) {
+    publishEnrolmentStatusf(STATUS_BUSY, "Restore: buffer full, resend seq %u", (unsigned)seq);
+    return;
+  }
+  if (seq == 0) {
+    SensorCommand cmd = sensorCommand(CMD_RESTORE);
+    cmd.tag = restoreNextTag();
+    if (!toSensor(cmd, src)) return;  // the backend resends seq 0
+  } else if (restoreCurrentTag() == 0) {
+    publishEnrolmentStatus(STATUS_ERROR, "Restore: no restore started (seq 0 starts one)");
+    return;
+  }
+
+  size_t i = 0;
+  for (JsonObjectConst t : templates) {
+    item.tag = restoreCurrentTag();
+    item.seq = seq;
+    item.id = t["id"] | 0;
+    item.flags = ++i == n ? RESTORE_END_OF_CHUNK | (done ? RESTORE_DONE : 0) : 0;
+    item.data = item.id ? poolAcquire(POOL_RESTORE) : nullptr;
+    const char* data = t["data"] | "";
+    if (!item.data || base64Decode(data, strlen(data), item.data, POOL_BLOCK_SIZE) != TEMPLATE_PAYLOAD_SIZE) {
+      poolRelease(item.data);
+      item.data = nullptr;
+      item.flags |= RESTORE_INVALID;
+    }
+    if (!restoreQueuePush(item)) poolRelease(item.data);
+  }
+  if (n == 0) {  // nothing to store, only the ack (and the end of the restore)
+    item.tag = restoreCurrentTag();
+    item.seq = seq;
+    item.id = 0;
+    item.data = nullptr;
+    item.flags = RESTORE_END_OF_CHUNK | (done ? RESTORE_DONE : 0);
+    restoreQueuePush(item);
+  }
+}
+
+// Only the acknowledgement: "format" itself is applied for every command
+static void onSetFormat(const CommandArgs&, CommandSource) {
+  publishEnrolmentStatusf(STATUS_SUCCESS, "Wire format: %s", messagingWireFormat() == WIRE_BINARY ? "binary" : "json");
+}
+
+// Console only, like the other benches: a load test has no business on a
+// station's work or broadcast topic
+static void onSoak(const CommandArgs& args, CommandSource) {
+  if (args.flag("stop")) {
+    soakRequest(0, 0);
+  } else if (args.has("minutes", 0)) {
+    soakRequest(args.num("minutes", 0, 0), args.num("perMinute", 1, SOAK_RATE_DEFAULT));
+  } else {
+    soakPrint();
+  }
+}
+
+// "station <id>" saves a new ID, "station mac" goes back to the MAC-derived one;
+// both apply after a restart
+static void onStation(const CommandArgs& args, CommandSource) {
+  const char* newId = args.str("id", 0);
+  if (!*newId) {
+    Serial.printf("Station %s, client ID %s, commands on %s, shared work queue %s\n", stationId(), stationClientId(),
+                  stationTopic(TOPIC_FP_COMMAND), connectionTakingWork() ? "subscribed" : "not subscribed (offline)");
+    return;
+  }
+  bool mac = strcmp(newId, "mac") == 0;
+  if (stationSetId(mac ? "" : newId)) {
+    Serial.printf("Station ID %s saved, restart to apply\n", mac ? "from MAC" : newId);
+  } else {
+    Serial.printf("Invalid station ID (letters, digits, '-' and '_', up to %u characters)\n", STATION_ID_MAX - 1);
+  }
+}
+
+static void onStats(const CommandArgs& args, CommandSource) {
+  if (args.flag("reset")) {
+    latencyReset();
+    Serial.println("Latency histograms cleared");
+  } else {
+    latencyPrint();
+  }
+}
+
+static void onSync(const CommandArgs& args, CommandSource src) {
+  SensorCommand cmd = sensorCommand(CMD_SYNC);
+  cmd.id = args.num("node", 0, 0);
+  if (src == SRC_SERIAL) {
+    uint8_t root[32];
+    char rootHex[2 * sizeof(root) + 1];
+    hashIndexRoot(root);
+    rootHex[hexEncode(root, sizeof(root), rootHex)] = '\0';
+    Serial.printf("Hash index root: %s, %u slot(s) without a known hash\n", rootHex, (unsigned)hashIndexUnknownCount());
+  }
+  toSensor(cmd, src);
+}
+
+static void onVerify(const CommandArgs& args, CommandSource src) {
+  SensorCommand cmd = sensorCommand(CMD_VERIFY);
+  // optional search window, e.g. the slots of one polling station
+  cmd.id = args.num("start", 0, 0);
+  cmd.max = args.num("count", 1, 0);
+  Serial.println("Fingerprint: Verify request");
+  toSensor(cmd, src);
+}
+
+// --- Action table ---
+
+typedef void (*CommandHandler)(const CommandArgs& args, CommandSource src);
+
+struct CommandAction {
+  const char* name;
+  uint8_t sources;
+  CommandHandler handler;
+  const char* help;  // nullptr: alias, not listed by help
+};
+
+// Sorted by name (checked at compile time) for the binary search below.
+// Single letters are the old quick keys.
+static constexpr CommandAction ACTIONS[] = {
+  { "backup", SRC_ANY, onBackup, "backup [from]        - stream every stored template to esp32/fingerprint/backup" },
+  { "backup-ack", SRC_MQTT, onBackupAck, nullptr },
+  { "boot", SRC_SERIAL, onBoot, "boot                 - station mode, reset reason and boot phase timings" },
+  { "c", SRC_SERIAL, onCancel, nullptr },
+  { "cancel", SRC_ANY, onCancel, "cancel [all]         - cancel running enroll/verify (all: also pending, ends session)" },
+  { "count", SRC_SERIAL, onCount, "count                - getTemplateCount() and persisted count" },
+  { "delall", SRC_SERIAL, onDelall, "delall confirm       - empty DB (dangerous)" },
+  { "delete", SRC_SERIAL, onDelete, "delete <id>          - delete template id" },
+  { "download", SRC_ANY, onDownload, "download <id>        - download & publish template for id" },
+  { "download-all", SRC_ANY, onDownloadAll, "download-all [max]   - bulk download templates" },
+  { "download-template", SRC_ANY, onDownload, nullptr },
+  { "download-templates", SRC_ANY, onDownloadAll, nullptr },
+  { "e", SRC_SERIAL, onEnroll, nullptr },
+  { "end-session", SRC_ANY, onEndSession, nullptr },
+  { "enroll", SRC_ANY, onEnroll, "enroll [id]          - run enroll flow for id, or the next free id" },
+  { "enroll-session", SRC_ANY, onEnrollSession, nullptr },
+  { "enrolled-count", SRC_ANY, onEnrolledCount, "enrolled-count       - prints enrolledCount (persisted)" },
+  { "hashbench", SRC_SERIAL, onHashBench, "hashbench [id] [n]   - time receive-then-hash vs streamed SHA-256 per template" },
+  { "help", SRC_SERIAL, onHelp, "help                 - show this" },
+  { "info", SRC_SERIAL, onInfo, "info                 - sensor info" },
+  { "linkbench", SRC_SERIAL, onLinkBench, "linkbench [n]        - time getImage/template download per baud & packet size" },
+  { "mem", SRC_ANY, onMem, "mem                  - buffer pool, heap and task stack headroom" },
+  { "p", SRC_SERIAL, onProbe, nullptr },
+  { "probe", SRC_SERIAL, onProbe, "probe [deep]         - read occupancy index and list used slots (deep: load each)" },
+  { "reset-enrollments", SRC_ANY, onResetEnrollments, nullptr },
+  { "restore", SRC_MQTT, onRestore, nullptr },
+  { "session", SRC_ANY, onEnrollSession, "session [n|stop]     - enroll session: n voters into free slots (none: until stopped)" },
+  { "set-format", SRC_MQTT, onSetFormat, nullptr },
+  { "soak", SRC_SERIAL, onSoak, "soak [min [n]|stop]  - heap trend; load test: n commands/min for min minutes" },
+  { "station", SRC_SERIAL, onStation, "station [id|mac]     - station ID and topics; set a new ID (applies after restart)" },
+  { "stats", SRC_SERIAL, onStats, "stats [reset]        - latency histograms (p50/p95/p99/max) per operation" },
+  { "sync", SRC_ANY, onSync, "sync [node]          - print hash-index root, publish a sync reply for node" },
+  { "t", SRC_SERIAL, onDownloadAll, nullptr },
+  { "v", SRC_SERIAL, onVerify, nullptr },
+  { "verify", SRC_ANY, onVerify, "verify [start count] - run verify flow, optionally over a slot window" },
+};
+
+static constexpr size_t ACTION_COUNT = sizeof(ACTIONS) / sizeof(ACTIONS[0]);
+
+static constexpr bool nameLess(const char* a, const char* b) {
+  return (*a && *a == *b) ? nameLess(a + 1, b + 1) : (unsigned char)*a < (unsigned char)*b;
+}
+
+static constexpr bool actionsSorted(size_t i) {
+  return i >= ACTION_COUNT || (nameLess(ACTIONS[i - 1].name, ACTIONS[i].name) && actionsSorted(i + 1));
+}
+
+static_assert(actionsSorted(1), "ACTIONS must be sorted by name");
+
+static const CommandAction* findAction(const char* name) {
+  size_t lo = 0, hi = ACTION_COUNT;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    int c = strcmp(name, ACTIONS[mid].name);
+    if (c == 0) return &ACTIONS[mid];
+    if (c < 0) hi = mid;
+    else lo = mid + 1;
+  }
+  return nullptr;
+}
+
+// --- Transports ---
+
+static StaticJsonDocument<COMMAND_DOC_CAPACITY> commandDoc;  // network task only
+
+void dispatchJsonCommand(char* payload, size_t len, bool work) {
+  LatencyScope timing(LAT_COMMAND);
+  uint32_t allocStart = allocCount();
+  stats.mqtt++;
+
+  // char* input: ArduinoJson parses in place and keeps pointers into payload.
+  // When that is PubSubClient's buffer any publish would overwrite it, so
+  // replies wait in the outbox until the command has been handled.
+  OutboxHold hold;
+  DeserializationError err = deserializeJson(commandDoc, payload, len);
+  if (err) {
+    Serial.printf("Failed to parse fingerprint command JSON: %s\n", err.c_str());
+    stats.rejected++;
+    return;
+  }
+  JsonObjectConst obj = commandDoc.as<JsonObjectConst>();
+  // every reply to this command, here or from the sensor task, carries its rid
+  RequestScope request(requestTagNew(obj["rid"] | 0u));
+  const char* name = obj["action"] | "";
+
+  // The broker hands shared work round-robin, whether this station has room
+  // or not; the backend puts work answered busy back on the queue
+  if (work && sensorBacklog() >= STATION_WORK_BACKLOG) {
+    publishEnrolmentStatus(STATUS_BUSY, "Station busy: work backlog full");
+    stats.workBusy++;
+    return;
+  }
+
+  // Optional wire-format negotiation; applies to everything published afterwards
+  const char* format = obj["format"] | "";
+  if (strcmp(format, "binary") == 0) {
+    messagingSetWireFormat(WIRE_BINARY);
+  } else if (strcmp(format, "json") == 0) {
+    messagingSetWireFormat(WIRE_JSON);
+  } else if (*format) {
+    publishEnrolmentStatusf(STATUS_ERROR, "Unknown wire format: %s", format);
+    stats.rejected++;
+    return;
+  }
+
+  const CommandAction* action = findAction(name);
+  if (!action) {
+    Serial.printf("Unknown fingerprint action: %s\n", name);
+    stats.unknown++;
+  } else if (!(action->sources & SRC_MQTT)) {
+    Serial.printf("Action %s is only available on the serial CLI\n", name);
+    stats.rejected++;
+  } else {
+    action->handler(CommandArgs(obj), SRC_MQTT);
+  }
+  stats.allocations += allocCount() - allocStart;
+}
+
+void dispatchCommandLine(char* line) {
+  char* words[COMMAND_MAX_WORDS];
+  uint8_t count = 0;
+  for (char* p = line; *p && count < COMMAND_MAX_WORDS;) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') *p++ = '\0';
+    if (!*p) break;
+    words[count++] = p;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\r') p++;
+  }
+  if (count == 0) return;
+  stats.serial++;
+  RequestScope request(requestTagNew(0));  // timings only
+
+  for (char* c = words[0]; *c; ++c) *c = tolower((unsigned char)*c);
+  const CommandAction* action = findAction(words[0]);
+  if (!action) {
+    Serial.printf("Unknown command: '%s'. Type 'help' for options.\n", words[0]);
+    stats.unknown++;
+    return;
+  }
+  if (!(action->sources & SRC_SERIAL)) {
+    Serial.printf("'%s' is only available over MQTT\n", words[0]);
+    stats.rejected++;
+    return;
+  }
+  action->handler(CommandArgs(words + 1, count - 1), SRC_SERIAL);
+}
+
+const CommandStats& commandStats() {
+  return stats;
+}
+
+void commandPrintHelp() {
+  Serial.println(F("Serial commands:"));
+  for (const CommandAction& a : ACTIONS) {
+    if (!a.help || !(a.sources & SRC_SERIAL)) continue;
+    Serial.print("  ");
+    Serial.println(a.help);
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef COMMAND_DISPATCH_H
+#define COMMAND_DISPATCH_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// One action table for both command transports:
+//  - MQTT: {"action":"verify","start":1,"count":200} on esp32/fingerprint/command
+//  - serial CLI: "verify 1 200"
+// Arguments are read by name from the JSON object or by position from the
+// words after the CLI command, so each handler is written once. JSON is
+// parsed in place (zero-copy) into a fixed-capacity document and CLI lines
+// are split in place; nothing is allocated per command. An MQTT command may
+// also carry "rid", which its replies echo (request_tag.h).
+enum CommandSource : uint8_t {
+  SRC_MQTT = 1,    // network task
+  SRC_SERIAL = 2,  // sensor task
+  SRC_ANY = SRC_MQTT | SRC_SERIAL
+};
+
+#define COMMAND_MAX_WORDS 4  // CLI command plus up to three arguments
+#define COMMAND_LINE_MAX 96
+// enroll-session lists are the largest command
+#define COMMAND_DOC_CAPACITY (JSON_OBJECT_SIZE(8) + JSON_ARRAY_SIZE(256))
+
+class CommandArgs {
+public:
+  explicit CommandArgs(JsonObjectConst obj) : obj_(obj) {}
+  CommandArgs(char* const* words, uint8_t count) : words_(words), count_(count) {}
+
+  bool has(const char* key, uint8_t pos) const;
+  uint32_t num(const char* key, uint8_t pos, uint32_t def) const;
+  const char* str(const char* key, uint8_t pos) const;  // "" if absent
+  // JSON: "key": true. CLI: any argument word equal to key (e.g. "cancel all").
+  bool flag(const char* key) const;
+  // JSON arrays only; null for CLI arguments
+  JsonArrayConst list(const char* key) const;
+
+private:
+  JsonObjectConst obj_;
+  char* const* words_ = nullptr;
+  uint8_t count_ = 0;
+};
+
+struct CommandStats {
+  uint32_t mqtt;         // dispatched MQTT commands
+  uint32_t serial;       // dispatched CLI lines
+  uint32_t unknown;      // no such action
+  uint32_t rejected;     // malformed JSON, or action not offered on that transport
+  uint32_t workBusy;     // shared work answered busy: the backlog was full
+  uint32_t allocations;  // heap allocations while dispatching MQTT commands
+};
+
+// Network task. Parses payload in place (the buffer is modified, never
+// written past len) and runs the action's handler. work: it came from the
+// shared work topic, and is answered busy while the sensor's backlog is full.
+void dispatchJsonCommand(char* payload, size_t len, bool work = false);
+
+// Sensor task. Splits line in place and runs the action's handler.
+void dispatchCommandLine(char* line);
+
+const CommandStats& commandStats();
+void commandPrintHelp();
+
+#endif
@@ -0,0 +1,203 @@
+// connection.cpp
+#define MQTT_MAX_PACKET_SIZE 2048
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <esp_system.h>
+#include "secrets.h"
+#include "connection.h"
+#include "tls_client.h"
+#include "messaging.h"
+#include "station_id.h"
+#include "station_tasks.h"
+
+#define BACKOFF_MIN_MS 1000
+#define BACKOFF_MAX_MS 60000
+#define WIFI_RETRY_MS 15000         // give the driver's auto-reconnect this long first
+#define TLS_HANDSHAKE_TIMEOUT_S 10   // TCP connect + handshake, stepped by connectionTick()
+#define MQTT_SOCKET_TIMEOUT_S 5      // CONNACK wait, the one blocking part of an attempt
+
+extern TlsClient wifiClient;
+extern PubSubClient client;
+
+static LinkState wifiState = LINK_DOWN;
+static LinkState mqttState = LINK_DOWN;
+static ConnectionStats stats = { 0, 0, 0, 0, 0, 0, 0, 0, UINT32_MAX, 0, 0, 0, BACKOFF_MIN_MS };
+static uint32_t nextAttemptMs = 0;
+static uint32_t attemptStartMs = 0;
+static uint32_t wifiLostMs = 0;
+static uint32_t linkLostMs = 0;  // start of the current outage, 0 while up
+static bool workSubscribed = false;
+
+const char* linkStateToString(LinkState state) {
+  switch (state) {
+    case LINK_DOWN: return "down";
+    case LINK_WAITING: return "waiting";
+    case LINK_CONNECTING: return "connecting";
+    case LINK_UP: return "up";
+    default: return "unknown";
+  }
+}
+
+// Equal jitter in [backoff/2, backoff] so a fleet of stations does not
+// reconnect in lockstep after a broker restart.
+static uint32_t jittered(uint32_t backoff) {
+  return backoff / 2 + esp_random() % (backoff / 2 + 1);
+}
+
+static void scheduleRetry(uint32_t now) {
+  uint32_t wait = jittered(stats.backoffMs);
+  nextAttemptMs = now + wait;
+  mqttState = LINK_WAITING;
+  Serial.printf("MQTT retry in %lu ms\n", (unsigned long)wait);
+  stats.backoffMs = min<uint32_t>(stats.backoffMs * 2, BACKOFF_MAX_MS);
+}
+
+// Opens the socket; the TCP connect and TLS handshake then advance in
+// pollConnect() on every tick, so events keep flowing into the outbox meanwhile.
+static void tryConnect() {
+  mqttState = LINK_CONNECTING;
+  stats.attempts++;
+  attemptStartMs = millis();
+  Serial.println("Attempting MQTT connection...");
+  if (!wifiClient.connectStart(MQTT_SERVER, MQTT_PORT)) {
+    stats.failures++;
+    Serial.println("MQTT: could not open a socket to the broker");
+    scheduleRetry(millis());
+  }
+}
+
+static void pollConnect() {
+  TlsStep step = wifiClient.connectPoll();
+  if (step == TLS_STEP_PENDING) return;
+  if (step == TLS_STEP_FAILED) {
+    stats.failures++;
+    Serial.printf("TLS connect failed after %lu ms\n", (unsigned long)(millis() - attemptStartMs));
+    scheduleRetry(millis());
+    return;
+  }
+  uint32_t tlsMs = millis() - attemptStartMs;
+
+  // PubSubClient skips its own socket connect when the client is already
+  // connected. Per-station client ID: two stations with the same ID would keep
+  // taking over each other's session.
+  if (!client.connect(stationClientId(), MQTT_USERNAME, MQTT_PASSWORD)) {
+    stats.failures++;
+    Serial.printf("MQTT connect failed, rc=%d\n", client.state());
+    wifiClient.stop();
+    scheduleRetry(millis());
+    return;
+  }
+
+  uint32_t elapsed = millis() - attemptStartMs;
+  stats.connects++;
+  if (wifiClient.resumed()) stats.resumed++;
+  stats.lastTlsMs = tlsMs;
+  stats.lastConnectMs = elapsed;
+  stats.totalConnectMs += elapsed;
+  if (elapsed < stats.minConnectMs) stats.minConnectMs = elapsed;
+  if (elapsed > stats.maxConnectMs) stats.maxConnectMs = elapsed;
+  if (linkLostMs) {
+    stats.lastOutageMs = millis() - linkLostMs;
+    linkLostMs = 0;
+  }
+  stats.backoffMs = BACKOFF_MIN_MS;
+  mqttState = LINK_UP;
+  Serial.printf("MQTT connected (tls %lu ms%s, total %lu ms)\n", (unsigned long)tlsMs,
+                wifiClient.resumed() ? ", session resumed" : "", (unsigned long)elapsed);
+
+  // Own commands, fleet-wide broadcasts and the shared work topic
+  client.subscribe(stationTopic(TOPIC_FP_COMMAND));
+  client.subscribe(STATION_BROADCAST_TOPIC);
+  workSubscribed = client.subscribe(STATION_WORK_SHARE, 1);
+}
+
+// The station stays in the shared subscription's rotation for the whole
+// session, full backlog or not: with no station subscribed the broker would
+// discard QoS 1 work. Work that arrives while the backlog is full is answered
+// busy instead (dispatchJsonCommand()), so the backend queues it again. Only a
+// subscribe the broker did not take is retried here.
+static void updateWorkSubscription() {
+  if (!workSubscribed) workSubscribed = client.subscribe(STATION_WORK_SHARE, 1);
+}
+
+void connectionBegin() {
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  wifiState = LINK_CONNECTING;
+  wifiLostMs = millis();
+  linkLostMs = millis();
+
+  wifiClient.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT_S);
+  client.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+}
+
+void connectionTick() {
+  uint32_t now = millis();
+
+  // --- Wi-Fi ---
+  bool wifiUp = WiFi.status() == WL_CONNECTED;
+  if (wifiUp && wifiState != LINK_UP) {
+    wifiState = LINK_UP;
+    Serial.printf("WiFi connected after %lu ms\n", (unsigned long)(now - wifiLostMs));
+    nextAttemptMs = now;  // no reason to wait for the broker
+  } else if (!wifiUp && wifiState == LINK_UP) {
+    wifiState = LINK_CONNECTING;
+    stats.wifiDrops++;
+    wifiLostMs = now;
+    Serial.println("WiFi lost, waiting for auto-reconnect");
+  } else if (!wifiUp && now - wifiLostMs >= WIFI_RETRY_MS) {
+    Serial.println("WiFi still down, restarting association");
+    WiFi.disconnect();
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    wifiLostMs = now;
+  }
+
+  // --- MQTT ---
+  if (client.connected()) {
+    client.loop();
+    if (client.connected()) updateWorkSubscription();
+    return;
+  }
+  if (mqttState == LINK_UP) {
+    stats.mqttDrops++;
+    Serial.printf("MQTT connection lost, rc=%d\n", client.state());
+    mqttState = LINK_DOWN;
+    nextAttemptMs = now;
+  }
+  if (!linkLostMs) linkLostMs = now;
+  if (wifiState != LINK_UP) {
+    if (mqttState == LINK_CONNECTING) wifiClient.stop();
+    mqttState = LINK_DOWN;
+    return;
+  }
+  if (mqttState == LINK_CONNECTING) pollConnect();
+  else if ((int32_t)(now - nextAttemptMs) >= 0) tryConnect();
+}
+
+void connectionDrop() {
+  if (mqttState != LINK_UP) return;
+  Serial.println("MQTT: dropping the connection on request");
+  client.disconnect();
+  wifiClient.stop();  // the next tick counts the drop and reconnects (TLS included)
+}
+
+bool connectionUp() {
+  return mqttState == LINK_UP && client.connected();
+}
+
+LinkState wifiLinkState() {
+  return wifiState;
+}
+
+LinkState mqttLinkState() {
+  return mqttState;
+}
+
+bool connectionTakingWork() {
+  return workSubscribed;
+}
+
+const ConnectionStats& connectionStats() {
+  return stats;
+}
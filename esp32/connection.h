@@ -0,0 +1,49 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <Arduino.h>
+
+// Background Wi-Fi + MQTT connection manager (network task). A connect attempt
+// is stepped across ticks (tls_client.h); only the wait for the broker's
+// CONNACK blocks, for at most a few seconds. Meanwhile the firmware keeps
+// running and publishes wait in the outbound queue (messaging.cpp).
+
+enum LinkState : uint8_t {
+  LINK_DOWN,
+  LINK_WAITING,     // backing off before the next attempt
+  LINK_CONNECTING,
+  LINK_UP
+};
+
+struct ConnectionStats {
+  uint32_t wifiDrops;
+  uint32_t mqttDrops;
+  uint32_t attempts;       // MQTT connect attempts (TLS + CONNECT)
+  uint32_t failures;
+  uint32_t connects;
+  uint32_t resumed;        // of those, TLS handshakes that reused the last session
+  uint32_t lastTlsMs;      // TCP + TLS handshake of the last successful attempt
+  uint32_t lastConnectMs;  // whole attempt: TLS + MQTT CONNECT/CONNACK
+  uint32_t minConnectMs;
+  uint32_t maxConnectMs;
+  uint32_t totalConnectMs;
+  uint32_t lastOutageMs;   // link lost -> MQTT back up
+  uint32_t backoffMs;      // current delay before the next attempt
+};
+
+// setup(): start Wi-Fi association and return at once
+void connectionBegin();
+// Network task: advance the state machines by one step
+void connectionTick();
+// Network task: close the MQTT session and its TLS socket as a broker restart
+// would; the next tick reconnects through the usual backoff (soak.h)
+void connectionDrop();
+
+bool connectionUp();
+LinkState wifiLinkState();
+LinkState mqttLinkState();
+bool connectionTakingWork();  // subscribed to the shared work topic
+const char* linkStateToString(LinkState state);
+const ConnectionStats& connectionStats();
+
+#endif
@@ -0,0 +1,239 @@
+// enroll_session.cpp
+#include "enroll_session.h"
+#include "spsc_queue.h"
+#include "fingerprint.h"
+#include "fingerprint_index.h"
+#include "hash_index.h"
+#include "messaging.h"
+#include "buffer_pool.h"
+
+// IDs from an enroll-session command; the tag tells the sensor task which
+// session they belong to, leftovers of a cancelled or dropped one are skipped.
+struct SessionId {
+  uint8_t tag;
+  uint16_t id;
+};
+
+static SpscQueue<SessionId, SESSION_MAX_IDS> idQueue;
+static uint8_t nextTag = 0;  // network task
+
+static bool active = false;
+static bool stopping = false;
+static uint8_t tag = 0;
+static uint16_t listLeft = 0;  // list mode: IDs still to take from idQueue
+static uint16_t autoLeft = 0;  // auto mode: voters still to enroll
+static bool autoMode = false;
+static bool openEnded = false;  // auto mode with no count
+
+static bool voterStarted = false;
+static uint16_t voterId = 0;
+static uint8_t voterAttempts = 0;
+
+// Enrolled slots waiting for their template download (ring)
+static uint16_t deferred[SESSION_DEFERRED];
+static uint8_t deferredHead = 0;
+static uint8_t deferredCount = 0;
+static uint8_t batchPending = 0;  // hashes added since the last flush
+
+static uint16_t enrolled = 0, failed = 0, skipped = 0, downloadFailed = 0;
+static uint32_t startMs = 0;
+
+bool enrollSessionQueueId(uint8_t sessionTag, uint16_t id) {
+  return idQueue.push({ sessionTag, id });
+}
+
+uint8_t enrollSessionNextTag() {
+  if (++nextTag == 0) ++nextTag;  // 0 means auto-allocate
+  return nextTag;
+}
+
+bool enrollSessionActive() {
+  return active;
+}
+
+static float votersPerHour() {
+  uint32_t elapsedMs = millis() - startMs;
+  return elapsedMs ? enrolled * 3600000.0f / (float)elapsedMs : 0.0f;
+}
+
+bool enrollSessionStart(uint8_t sessionTag, uint16_t count) {
+  if (active) return false;
+  active = true;
+  stopping = false;
+  tag = sessionTag;
+  autoMode = sessionTag == 0;
+  listLeft = autoMode ? 0 : count;
+  autoLeft = autoMode ? count : 0;
+  openEnded = autoMode && count == 0;
+  voterStarted = false;
+  voterId = 0;
+  voterAttempts = 0;
+  deferredHead = deferredCount = batchPending = 0;
+  enrolled = failed = skipped = downloadFailed = 0;
+  startMs = millis();
+
+  templateBatchBegin();
+  if (autoMode) {
+    if (openEnded) publishEnrolmentStatus(STATUS_STARTED, "Enroll session started (free slots, until stopped)");
+    else publishEnrolmentStatusf(STATUS_STARTED, "Enroll session started: %u voters, free slots", (unsigned)count);
+  } else {
+    publishEnrolmentStatusf(STATUS_STARTED, "Enroll session started: %u listed IDs", (unsigned)count);
+  }
+  return true;
+}
+
+// Next ID of this session's list; stale entries of earlier sessions are dropped
+static uint16_t takeListedId() {
+  SessionId entry;
+  while (listLeft > 0 && idQueue.pop(entry)) {
+    if (entry.tag != tag) continue;
+    listLeft--;
+    if (entry.id != 0) return entry.id;
+  }
+  listLeft = 0;  // list was cut short (queue overflow on the network side)
+  return 0;
+}
+
+// ID for the next voter, 0 when the session has no more voters
+static uint16_t nextVoterId() {
+  if (stopping) return 0;
+  if (voterId != 0 && voterAttempts < SESSION_MAX_ATTEMPTS) return voterId;  // same voter, another try
+  voterAttempts = 0;
+  if (!autoMode) return voterId = takeListedId();
+  if (!openEnded && autoLeft == 0) return voterId = 0;
+  // deferred slots are already marked occupied, so they are not handed out twice
+  voterId = occupancyNextFree(1);
+  if (voterId == 0) publishEnrolmentStatus(STATUS_PROGRESS, "Enroll session: no free template slot");
+  return voterId;
+}
+
+static void finishVoter() {
+  switch (lastFlowOutcome()) {
+    case OUTCOME_OK:
+      enrolled++;
+      deferred[(deferredHead + deferredCount) % SESSION_DEFERRED] = voterId;
+      deferredCount++;
+      if (autoMode && !openEnded) autoLeft--;
+      voterId = 0;
+      break;
+    case OUTCOME_NO_FINGER:
+      break;  // nobody came: keep waiting with the same ID
+    case OUTCOME_CANCELLED:
+      // operator skipped this voter
+      skipped++;
+      if (autoMode && !openEnded) autoLeft--;
+      voterId = 0;
+      break;
+    default:
+      failed++;
+      if (++voterAttempts < SESSION_MAX_ATTEMPTS) break;
+      Serial.printf("Session: skipping ID %u after %u attempts\n", (unsigned)voterId, (unsigned)voterAttempts);
+      skipped++;
+      if (autoMode && !openEnded) autoLeft--;
+      voterId = 0;
+      break;
+  }
+}
+
+// One deferred template: download, hash, index, add to the batch
+static void downloadDeferred() {
+  PoolBuffer templateBuf(POOL_SESSION);
+  if (!templateBuf) return;  // every block is out; the download waits for the next tick
+  uint16_t id = deferred[deferredHead];
+  deferredHead = (deferredHead + 1) % SESSION_DEFERRED;
+  deferredCount--;
+
+  uint8_t hash[32];
+  if (!fetchTemplate(id, templateBuf.get(), 2, hash)) {
+    downloadFailed++;  // hash stays unknown in the index; a sync picks it up later
+    publishEnrolmentStatusf(STATUS_PROGRESS, "Template download failed for ID %u", (unsigned)id);
+    return;
+  }
+  hashIndexSet(id, hash);
+  templateBatchAdd(id, hash);
+  if (++batchPending >= SESSION_RESULT_BATCH) {
+    batchPending = 0;
+    templateBatchFlush();
+    publishEnrolmentStatusf(STATUS_PROGRESS, "Session: %u enrolled, %u failed (%.0f voters/h)", (unsigned)enrolled,
+                            (unsigned)failed, votersPerHour());
+  }
+}
+
+static void finishSession() {
+  templateBatchFlush();
+  uint32_t elapsedS = (millis() - startMs) / 1000;
+  char summary[128];
+  snprintf(summary, sizeof(summary), "Enroll session done: %u enrolled, %u failed, %u skipped in %lus (%.0f voters/h)",
+           (unsigned)enrolled, (unsigned)failed, (unsigned)skipped, (unsigned long)elapsedS, votersPerHour());
+  Serial.println(summary);
+  if (downloadFailed) Serial.printf("Session: %u template downloads failed\n", (unsigned)downloadFailed);
+  publishEnrolmentStatus(STATUS_SUCCESS, summary);
+  active = false;
+}
+
+void enrollSessionTick(bool yield) {
+  if (!active) return;
+
+  if (fingerprintFlowActive()) {
+    if (!voterStarted) return;  // a verify let in between voters
+    if (yield && fingerprintAwaitingFinger()) {
+      Serial.println("Session: making way for a verify");
+      cancelFingerprintFlow();
+      voterStarted = false;  // not a voter outcome; the same ID is offered again
+      return;
+    }
+    // The sensor is only polled for a finger until the next voter shows up;
+    // fetch one enrolled template in between
+    if (deferredCount > 0 && fingerprintAwaitingFinger()) downloadDeferred();
+    return;
+  }
+
+  if (voterStarted) {
+    voterStarted = false;
+    finishVoter();
+  }
+  if (yield) return;
+
+  // keep a bounded backlog: catch up before the next voter if it is full
+  if (deferredCount == SESSION_DEFERRED) {
+    downloadDeferred();
+    return;
+  }
+
+  uint16_t id = nextVoterId();
+  if (id != 0) {
+    Serial.printf("Session: voter %u, ID %u\n", (unsigned)(enrolled + skipped + 1), (unsigned)id);
+    voterStarted = startEnrollment(id, true);
+    return;
+  }
+
+  // no more voters: the sensor is free, drain the backlog
+  if (deferredCount > 0) {
+    downloadDeferred();
+    return;
+  }
+  finishSession();
+}
+
+void enrollSessionStop() {
+  if (!active) {
+    publishEnrolmentStatus(STATUS_ERROR, "No enroll session running");
+    return;
+  }
+  stopping = true;
+  // nobody at the sensor yet: stop waiting; a voter part-way through finishes
+  if (fingerprintAwaitingFinger()) {
+    cancelFingerprintFlow();
+    voterStarted = false;
+  }
+}
+
+void enrollSessionPrint() {
+  if (!active) {
+    Serial.println("Enroll session: not running");
+    return;
+  }
+  Serial.printf("Enroll session: %u enrolled, %u failed, %u skipped, %u downloads pending, %.0f voters/h%s\n",
+                (unsigned)enrolled, (unsigned)failed, (unsigned)skipped, (unsigned)deferredCount, votersPerHour(),
+                stopping ? " (stopping)" : "");
+}
@@ -0,0 +1,36 @@
+#ifndef ENROLL_SESSION_H
+#define ENROLL_SESSION_H
+
+#include <Arduino.h>
+
+// Registration-drive mode: enroll voter after voter without a command per
+// voter. Each enrollment ends at storeModel; its template is downloaded,
+// hashed and added to a template-hash batch while the sensor waits for the
+// next voter's first finger, so a voter never waits on the previous transfer.
+// Hashes go out in batches of SESSION_RESULT_BATCH on esp32/fingerprint/templates,
+// and the session ends with a summary (enrolled, failed, skipped, voters/hour).
+#define SESSION_MAX_IDS 256        // user IDs waiting to be handed to the sensor task
+#define SESSION_RESULT_BATCH 8     // publish the hash batch after this many voters
+#define SESSION_DEFERRED 8         // enrolled templates not yet downloaded
+#define SESSION_MAX_ATTEMPTS 2     // per voter, then the voter is skipped
+
+// Network task: queue explicit user IDs for the session started with `tag`.
+// False when the list is full.
+bool enrollSessionQueueId(uint8_t tag, uint16_t id);
+uint8_t enrollSessionNextTag();  // network task: tag for the next list, never 0
+
+// Sensor task. tag != 0: enroll the `count` IDs queued under tag; tag 0:
+// enroll `count` voters into free slots (0 = until stopped).
+bool enrollSessionStart(uint8_t tag, uint16_t count);
+bool enrollSessionActive();
+// Call after fingerprintTick(); starts voters and runs deferred downloads.
+// With yield set (a verify is waiting) no new voter is started and an
+// enrollment still waiting for its first finger is set aside, so the verify
+// gets the sensor; the session carries on with the same ID afterwards.
+void enrollSessionTick(bool yield);
+// No new voters; a voter already at the sensor finishes, then the session
+// drains its downloads and publishes the summary.
+void enrollSessionStop();
+void enrollSessionPrint();
+
+#endif
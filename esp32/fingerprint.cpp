@@ -1,191 +1,366 @@
 #include "fingerprint.h"
 #include "messaging.h"
+#include "fingerprint_index.h"
+#include "hash_index.h"
+#include "latency.h"
+#include "station_store.h"
 #include <Adafruit_Fingerprint.h>
-#include <Preferences.h>
 
 // Use the globally defined mySerial and finger
 extern HardwareSerial mySerial;
 extern Adafruit_Fingerprint finger;
 
-Preferences preferences;
-
 // Global counter of enrolled fingerprints
 uint16_t enrolledCount = 0;
 
-String encodeTemplateHex(const uint8_t* buffer) {
-  String encoded = "";
-  for (int i = 0; i < 512; i++) {
-    if (buffer[i] < 16) encoded += "0";
-    encoded += String(buffer[i], HEX);
+// -----------------------------------------------------------------------------
+// Enrollment / verification state machines
+// Each fingerprintTick() advances the active flow by at most one sensor call, so
+// the sensor task keeps serving the CLI and its command queue while it waits.
+// -----------------------------------------------------------------------------
+
+#define FINGER_WAIT_TIMEOUT_MS 30000UL  // voter walked away
+#define FINGER_REMOVE_TIMEOUT_MS 15000UL
+#define FINGER_REMOVE_DWELL_MS 1000UL   // give the voter time to lift the finger
+#define SEARCH_TIMEOUT_MS 3000           // a full-library search can outlast the 1 s default
+
+enum FlowKind { FLOW_IDLE, FLOW_ENROLL, FLOW_VERIFY };
+
+enum EnrolmentState {
+  STATE_WAIT_FINGER_1,
+  STATE_CAPTURE_1,
+  STATE_REMOVE,
+  STATE_WAIT_FINGER_2,
+  STATE_CAPTURE_2,
+  STATE_CREATE_MODEL,
+  STATE_STORE_MODEL,
+  STATE_DOWNLOAD_TEMPLATE,
+  STATE_DONE,
+  // verification
+  STATE_VERIFY_WAIT_FINGER,
+  STATE_VERIFY_SEARCH
+};
+
+static FlowKind flow = FLOW_IDLE;
+static EnrolmentState state = STATE_WAIT_FINGER_1;
+static uint16_t flowId = 0;
+static uint32_t stateStartMs = 0;
+static bool flowDeferDownload = false;  // session mode: template fetched later
+static uint16_t verifyStart = 0;        // requested search window, verifyCount 0 => none
+static uint16_t verifyCount = 0;
+static FlowOutcome outcome = OUTCOME_FAILED;
+
+static void enterState(EnrolmentState next) {
+  state = next;
+  stateStartMs = millis();
+  switch (next) {
+    case STATE_WAIT_FINGER_1:
+      publishEnrolmentStatus(STATUS_PLACE_FINGER, "Place your finger.");
+      break;
+    case STATE_REMOVE:
+      publishEnrolmentStatus(STATUS_REMOVE_FINGER, "Remove your finger.");
+      break;
+    case STATE_WAIT_FINGER_2:
+      publishEnrolmentStatus(STATUS_PLACE_FINGER_AGAIN, "Place the same finger again.");
+      break;
+    case STATE_DOWNLOAD_TEMPLATE:
+      publishEnrolmentStatus(STATUS_DOWNLOADING_TEMPLATE, "Downloading template...");
+      break;
+    case STATE_VERIFY_WAIT_FINGER:
+      publishEnrolmentStatus(STATUS_PLACE_FINGER, "Place finger for verification...");
+      break;
+    default:
+      break;
   }
-  return encoded;
-}
-
-uint8_t enrollFingerprint(uint16_t id) {
-  enum EnrolmentState {
-    STATE_WAIT_FINGER_1,
-    STATE_CAPTURE_1,
-    STATE_REMOVE,
-    STATE_WAIT_FINGER_2,
-    STATE_CAPTURE_2,
-    STATE_CREATE_MODEL,
-    STATE_STORE_MODEL,
-    STATE_DOWNLOAD_TEMPLATE,
-    STATE_DONE
-  };
-
-  EnrolmentState state = STATE_WAIT_FINGER_1;
-  int p = -1;
-  int retries = 0;
-  const int MAX_RETRIES = 3;
-
-  static uint8_t templatePayload[TEMPLATE_PAYLOAD_SIZE];
-  static uint8_t templateBuffer[TEMPLATE_PAYLOAD_SIZE];
-
-  while (true) {
-    switch (state) {
-      case STATE_WAIT_FINGER_1:
-        publishEnrolmentStatus(STATUS_PLACE_FINGER, "Place your finger.");
-        while ((p = finger.getImage()) != FINGERPRINT_OK) {
-          if (p == FINGERPRINT_NOFINGER) continue;
-        }
-        retries = 0;
-        state = STATE_CAPTURE_1;
-        break;
-
-      case STATE_CAPTURE_1:
-        p = finger.image2Tz(1);
-        if (p == FINGERPRINT_OK) {
-          publishEnrolmentStatus(STATUS_IMAGE_TAKEN, "First image captured.");
-          state = STATE_REMOVE;
-        } else {
-          publishEnrolmentStatus(STATUS_ERROR, "Error processing image.");
-          return p;
-        }
-        break;
-
-      case STATE_REMOVE:
-        publishEnrolmentStatus(STATUS_REMOVE_FINGER, "Remove your finger.");
-        delay(2000);
-        while ((p = finger.getImage()) != FINGERPRINT_NOFINGER) {}
-        state = STATE_WAIT_FINGER_2;
-        break;
-
-      case STATE_WAIT_FINGER_2:
-        publishEnrolmentStatus(STATUS_PLACE_FINGER_AGAIN, "Place the same finger again.");
-        while ((p = finger.getImage()) != FINGERPRINT_OK) {
-          if (p == FINGERPRINT_NOFINGER) continue;
-        }
-        retries = 0;
-        state = STATE_CAPTURE_2;
-        break;
-
-      case STATE_CAPTURE_2:
-        p = finger.image2Tz(2);
-        if (p == FINGERPRINT_OK) {
-          publishEnrolmentStatus(STATUS_IMAGE_TAKEN_AGAIN, "Second image captured.");
-          state = STATE_CREATE_MODEL;
-        } else {
-          publishEnrolmentStatus(STATUS_ERROR, "Error processing second image.");
-          return p;
-        }
-        break;
-
-      case STATE_CREATE_MODEL:
-        p = finger.createModel();
-        if (p == FINGERPRINT_OK) {
-          publishEnrolmentStatus(STATUS_MODEL_CREATED, "Model created.");
-          state = STATE_STORE_MODEL;
-        } else {
-          publishEnrolmentStatus(STATUS_ERROR, "Fingerprints did not match.");
-          return p;
-        }
-        break;
+}
 
-      case STATE_STORE_MODEL:
-        p = finger.storeModel(id);
-        if (p == FINGERPRINT_OK) {
-          publishEnrolmentStatus(STATUS_STORED, "Model stored.");
-          enrolledCount++;
-          preferences.putUInt("enrolledCount", enrolledCount);
-          Serial.print("Enrolled count persisted: ");
-          Serial.println(enrolledCount);
-
-          state = STATE_DOWNLOAD_TEMPLATE;
-        } else {
-          publishEnrolmentStatus(STATUS_ERROR, "Error storing model.");
-          return p;
-        }
-        break;
-
-      case STATE_DOWNLOAD_TEMPLATE:
-        publishEnrolmentStatus(STATUS_DOWNLOADING_TEMPLATE, "Downloading template...");
-        if (downloadTemplateById(id, 3)) {
-          // downloadTemplateById already published the template hash (and validated the payload)
-          state = STATE_DONE;
-        } else {
-          publishEnrolmentStatus(STATUS_ERROR, "Template download failed for ID " + String(id));
-          return FINGERPRINT_PACKETRECIEVEERR;
-        }
-        break;
+// A voter's outcome in an enroll session is one step of the session's request,
+// which ends with the session summary (enroll_session.cpp)
+static void publishOutcome(EnrolmentStatus status, const char* message) {
+  bool step = flow == FLOW_ENROLL && flowDeferDownload && statusIsFinal(status);
+  publishEnrolmentStatus(step ? STATUS_PROGRESS : status, message);
+}
 
+static void finishFlow() {
+  flow = FLOW_IDLE;
+  flowId = 0;
+}
+
+static bool stateTimedOut(uint32_t limitMs) {
+  return millis() - stateStartMs >= limitMs;
+}
+
+static void timeoutFlow() {
+  bool nobodyCame = state == STATE_WAIT_FINGER_1 || state == STATE_VERIFY_WAIT_FINGER;
+  outcome = nobodyCame ? OUTCOME_NO_FINGER : OUTCOME_TIMEOUT;
+  Serial.printf("%s timed out waiting for finger\n", flow == FLOW_ENROLL ? "Enrollment" : "Verification");
+  publishOutcome(STATUS_TIMEOUT, "Timed out waiting for finger.");
+  finishFlow();
+}
+
+bool startEnrollment(uint16_t id, bool deferDownload) {
+  if (flow != FLOW_IDLE || id == 0) return false;
+  flow = FLOW_ENROLL;
+  flowId = id;
+  flowDeferDownload = deferDownload;
+  outcome = OUTCOME_FAILED;
+  enterState(STATE_WAIT_FINGER_1);
+  return true;
+}
+
+bool startVerification(uint16_t start, uint16_t count) {
+  if (flow != FLOW_IDLE) return false;
+  flow = FLOW_VERIFY;
+  flowId = 0;
+  verifyStart = start;
+  verifyCount = count;
+  outcome = OUTCOME_FAILED;
+  enterState(STATE_VERIFY_WAIT_FINGER);
+  return true;
+}
+
+bool fingerprintFlowActive() {
+  return flow != FLOW_IDLE;
+}
+
+bool fingerprintAwaitingFinger() {
+  return flow == FLOW_ENROLL && state == STATE_WAIT_FINGER_1;
+}
+
+FlowOutcome lastFlowOutcome() {
+  return outcome;
+}
 
-      case STATE_DONE:
-        publishEnrolmentStatus(STATUS_SUCCESS, "Enrollment complete.");
-        return FINGERPRINT_OK;
-    }
+bool cancelFingerprintFlow() {
+  if (flow == FLOW_IDLE) return false;
+  Serial.printf("%s cancelled\n", flow == FLOW_ENROLL ? "Enrollment" : "Verification");
+  publishOutcome(STATUS_CANCELLED, flow == FLOW_ENROLL ? "Enrollment cancelled." : "Verification cancelled.");
+  outcome = OUTCOME_CANCELLED;
+  finishFlow();
+  return true;
+}
+
+// HighSpeedSearch (0x1B) of char buffer 1 over pages [start, start + count).
+// Reply: confirmation code, page ID (2 bytes), match score (2 bytes).
+static uint8_t searchRange(uint16_t start, uint16_t count) {
+  uint8_t data[] = { FINGERPRINT_HISPEEDSEARCH, 0x01, (uint8_t)(start >> 8), (uint8_t)(start & 0xFF),
+                     (uint8_t)(count >> 8), (uint8_t)(count & 0xFF) };
+  Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(data), data);
+  finger.writeStructuredPacket(packet);
+  if (finger.getStructuredPacket(&packet, SEARCH_TIMEOUT_MS) != FINGERPRINT_OK) return FINGERPRINT_PACKETRECIEVEERR;
+  if (packet.type != FINGERPRINT_ACKPACKET) return FINGERPRINT_PACKETRECIEVEERR;
+  if (packet.data[0] == FINGERPRINT_OK) {
+    finger.fingerID = ((uint16_t)packet.data[1] << 8) | packet.data[2];
+    finger.confidence = ((uint16_t)packet.data[3] << 8) | packet.data[4];
   }
+  return packet.data[0];
 }
 
-uint8_t verifyFingerprint() {
-  publishEnrolmentStatus(STATUS_PLACE_FINGER, "Place finger for verification...");
-
-  int p = -1;
-  // Wait for finger to be placed
-  while (p != FINGERPRINT_OK) {
-    p = finger.getImage();
-    switch (p) {
-      case FINGERPRINT_OK:
-        Serial.println("Image taken");
-        break;
-      case FINGERPRINT_NOFINGER:
-        delay(50);
-        break;
-      case FINGERPRINT_PACKETRECIEVEERR:
-        Serial.println("Communication error");
-        break;
-      case FINGERPRINT_IMAGEFAIL:
-        Serial.println("Imaging error");
-        break;
-      default:
-        Serial.println("Unknown error");
-        break;
-    }
+// Pages to search: the occupied part of the library, narrowed to the
+// requested window if there is one. False when nothing is left to search.
+static bool searchWindow(uint16_t& start, uint16_t& count) {
+  uint32_t first = 0;
+  uint32_t last = finger.capacity ? finger.capacity - 1 : 0;
+  if (occupancyValid()) {
+    first = occupancyNext(1);
+    last = occupancyLast();
+    if (first == 0) return false;  // library is empty
   }
+  if (verifyCount) {
+    first = max(first, (uint32_t)verifyStart);
+    last = min(last, (uint32_t)verifyStart + verifyCount - 1);
+  }
+  if (last < first) return false;
+  start = first;
+  count = last - first + 1;
+  return true;
+}
+
+// getImage with latency recorded for actual captures only; polls without a
+// finger would otherwise swamp the histogram
+static uint8_t captureImage() {
+  uint32_t startUs = micros();
+  uint8_t p = finger.getImage();
+  if (p == FINGERPRINT_OK) latencyRecord(LAT_GET_IMAGE, micros() - startUs);
+  return p;
+}
+
+static void enrollTick() {
+  uint8_t p;
+  switch (state) {
+    case STATE_WAIT_FINGER_1:
+    case STATE_WAIT_FINGER_2:
+      p = captureImage();
+      if (p == FINGERPRINT_OK) {
+        enterState(state == STATE_WAIT_FINGER_1 ? STATE_CAPTURE_1 : STATE_CAPTURE_2);
+      } else if (stateTimedOut(FINGER_WAIT_TIMEOUT_MS)) {
+        timeoutFlow();
+      }
+      break;
+
+    case STATE_CAPTURE_1:
+      p = latencyTimed(LAT_IMAGE2TZ, [] { return finger.image2Tz(1); });
+      if (p == FINGERPRINT_OK) {
+        publishEnrolmentStatus(STATUS_IMAGE_TAKEN, "First image captured.");
+        enterState(STATE_REMOVE);
+      } else {
+        publishOutcome(STATUS_ERROR, "Error processing image.");
+        finishFlow();
+      }
+      break;
+
+    case STATE_REMOVE:
+      if (!stateTimedOut(FINGER_REMOVE_DWELL_MS)) break;
+      p = finger.getImage();
+      if (p == FINGERPRINT_NOFINGER) {
+        enterState(STATE_WAIT_FINGER_2);
+      } else if (stateTimedOut(FINGER_REMOVE_TIMEOUT_MS)) {
+        timeoutFlow();
+      }
+      break;
+
+    case STATE_CAPTURE_2:
+      p = latencyTimed(LAT_IMAGE2TZ, [] { return finger.image2Tz(2); });
+      if (p == FINGERPRINT_OK) {
+        publishEnrolmentStatus(STATUS_IMAGE_TAKEN_AGAIN, "Second image captured.");
+        enterState(STATE_CREATE_MODEL);
+      } else {
+        publishOutcome(STATUS_ERROR, "Error processing second image.");
+        finishFlow();
+      }
+      break;
+
+    case STATE_CREATE_MODEL:
+      p = latencyTimed(LAT_CREATE_MODEL, [] { return finger.createModel(); });
+      if (p == FINGERPRINT_OK) {
+        publishEnrolmentStatus(STATUS_MODEL_CREATED, "Model created.");
+        enterState(STATE_STORE_MODEL);
+      } else {
+        publishOutcome(STATUS_ERROR, "Fingerprints did not match.");
+        finishFlow();
+      }
+      break;
+
+    case STATE_STORE_MODEL:
+      p = latencyTimed(LAT_STORE_MODEL, [] { return finger.storeModel(flowId); });
+      if (p == FINGERPRINT_OK) {
+        publishEnrolmentStatus(STATUS_STORED, "Model stored.");
+        // re-enrolling an occupied slot overwrites it, the library does not grow
+        if (!occupancyIsSet(flowId)) {
+          occupancyMark(flowId, true);
+          enrolledCount++;
+          storeSetCount(enrolledCount);  // committed with the next store batch
+        }
+        hashIndexForget(flowId);  // filled in by the download that follows
+        Serial.print("Enrolled count: ");
+        Serial.println(enrolledCount);
 
-  // Convert image to template
-  p = finger.image2Tz();
-  if (p != FINGERPRINT_OK) {
-    Serial.println("Image conversion failed");
-    publishEnrolmentStatus(STATUS_ERROR, "Image conversion failed");
-    return p;
+        // in a session the template is fetched while the next voter gets ready
+        enterState(flowDeferDownload ? STATE_DONE : STATE_DOWNLOAD_TEMPLATE);
+      } else {
+        publishOutcome(STATUS_ERROR, "Error storing model.");
+        finishFlow();
+      }
+      break;
+
+    case STATE_DOWNLOAD_TEMPLATE:
+      // the hash and a progress status on success, the enrollment's final error otherwise
+      if (downloadTemplateById(flowId, 3, false)) {
+        enterState(STATE_DONE);
+      } else {
+        finishFlow();
+      }
+      break;
+
+    case STATE_DONE:
+      publishOutcome(STATUS_SUCCESS, "Enrollment complete.");
+      outcome = OUTCOME_OK;
+      finishFlow();
+      break;
+
+    default:
+      finishFlow();
+      break;
   }
+}
 
-  // Search for a match
-  p = finger.fingerSearch();
+// Search the window for the features in char buffer 1 and publish the outcome
+// with the search latency
+static void searchAndReport() {
+  uint16_t start, count;
+  if (!searchWindow(start, count)) {
+    Serial.println("No enrolled templates in the search range");
+    publishEnrolmentStatus(STATUS_ERROR, "No match found (no enrolled templates in range)");
+    return;
+  }
+  uint32_t startUs = micros();
+  uint8_t p = searchRange(start, count);
+  uint32_t searchUs = micros() - startUs;
+  latencyRecord(LAT_SEARCH, searchUs);
+  unsigned long searchMs = (searchUs + 500) / 1000;
+  unsigned last = start + count - 1;
   if (p == FINGERPRINT_OK) {
-    Serial.print("Found a print match! ID: ");
-    Serial.println(finger.fingerID);
-    publishEnrolmentStatus(STATUS_SUCCESS, "Match found with ID: " + String(finger.fingerID));
+    Serial.printf("Found a print match! ID: %u (score %u)\n", (unsigned)finger.fingerID, (unsigned)finger.confidence);
+    publishEnrolmentStatusf(STATUS_SUCCESS, "Match found with ID: %u (score %u, %lu ms over slots %u-%u)",
+                            (unsigned)finger.fingerID, (unsigned)finger.confidence, searchMs, (unsigned)start, last);
+    outcome = OUTCOME_OK;
   } else if (p == FINGERPRINT_NOTFOUND) {
     Serial.println("No match found");
-    publishEnrolmentStatus(STATUS_ERROR, "No match found");
+    publishEnrolmentStatusf(STATUS_ERROR, "No match found (%lu ms over slots %u-%u)", searchMs, (unsigned)start, last);
   } else {
     Serial.println("Search error");
     publishEnrolmentStatus(STATUS_ERROR, "Search error");
   }
+}
 
-  return p;
+static void verifyTick() {
+  uint8_t p;
+  switch (state) {
+    case STATE_VERIFY_WAIT_FINGER:
+      p = captureImage();
+      switch (p) {
+        case FINGERPRINT_OK:
+          Serial.println("Image taken");
+          enterState(STATE_VERIFY_SEARCH);
+          return;
+        case FINGERPRINT_NOFINGER:
+          break;
+        case FINGERPRINT_PACKETRECIEVEERR:
+          Serial.println("Communication error");
+          break;
+        case FINGERPRINT_IMAGEFAIL:
+          Serial.println("Imaging error");
+          break;
+        default:
+          Serial.println("Unknown error");
+          break;
+      }
+      if (stateTimedOut(FINGER_WAIT_TIMEOUT_MS)) timeoutFlow();
+      break;
+
+    case STATE_VERIFY_SEARCH:
+      // Convert image to template
+      p = latencyTimed(LAT_IMAGE2TZ, [] { return finger.image2Tz(); });
+      if (p != FINGERPRINT_OK) {
+        Serial.println("Image conversion failed");
+        publishEnrolmentStatus(STATUS_ERROR, "Image conversion failed");
+        finishFlow();
+        return;
+      }
+
+      searchAndReport();
+      finishFlow();
+      break;
+
+    default:
+      finishFlow();
+      break;
+  }
+}
+
+void fingerprintTick() {
+  if (flow == FLOW_ENROLL) enrollTick();
+  else if (flow == FLOW_VERIFY) verifyTick();
 }
 
 void resetEnrolmentCount() {
@@ -200,9 +375,13 @@ void resetEnrolmentCount() {
     return;
   }
 
-  // Reset counter in Preferences
+  occupancyClearAll();
+  hashIndexClearAll();
+
+  // Reset counter; committed right away, a reset should not be lost
   enrolledCount = 0;
-  preferences.putUInt("enrolledCount", enrolledCount);
+  storeSetCount(enrolledCount);
+  storeCommit();
   Serial.println("Enrollment count reset to 0");
 
   // Publish new state
@@ -2,16 +2,32 @@
 #define FINGERPRINT_H
 
 #include <Arduino.h>
-#include <Preferences.h>
 #include "fingerprint_util.h"
 
 // Declare variables
-extern Preferences preferences;
 extern uint16_t enrolledCount;
 
-// Enroll and verify
-uint8_t enrollFingerprint(uint16_t id);
-uint8_t verifyFingerprint();
+// How the last flow ended; valid once fingerprintFlowActive() turns false.
+enum FlowOutcome : uint8_t {
+  OUTCOME_OK,
+  OUTCOME_FAILED,     // sensor error, images did not match, no match found
+  OUTCOME_NO_FINGER,  // timed out before any finger was placed
+  OUTCOME_TIMEOUT,    // timed out part-way (finger not lifted / not placed again)
+  OUTCOME_CANCELLED
+};
+
+// Enroll and verify: non-blocking flows advanced by fingerprintTick().
+// start* return false if another flow is already running. With deferDownload
+// the enroll flow ends after storeModel and the caller fetches the template.
+// Verification searches the occupied slot range, narrowed to [start, start + count)
+// when count is not 0.
+bool startEnrollment(uint16_t id, bool deferDownload = false);
+bool startVerification(uint16_t start = 0, uint16_t count = 0);
+bool cancelFingerprintFlow();  // false if nothing was running
+bool fingerprintFlowActive();
+bool fingerprintAwaitingFinger();  // enroll flow still waiting for the first placement
+FlowOutcome lastFlowOutcome();
+void fingerprintTick();
 
 void resetEnrolmentCount();
 
@@ -0,0 +1,134 @@
+// fingerprint_index.cpp
+#include <Adafruit_Fingerprint.h>
+#include "fingerprint_index.h"
+
+extern Adafruit_Fingerprint finger;
+
+static uint8_t occupancy[FP_INDEX_MAX_SLOTS / 8];
+static uint16_t occupiedCount = 0;
+static bool indexValid = false;
+
+// Slots the firmware may address: the sensor's library size, capped to the bitmap.
+static uint16_t slotLimit() {
+  return min((uint16_t)finger.capacity, (uint16_t)FP_INDEX_MAX_SLOTS);
+}
+
+static uint16_t countBits() {
+  uint16_t n = 0;
+  for (size_t i = 0; i < sizeof(occupancy); ++i) n += __builtin_popcount(occupancy[i]);
+  return n;
+}
+
+// ReadIndexTable for one page: reply is confirmation code + 32 bitmap bytes,
+// bit (i % 8) of byte (i / 8) set when template i is stored.
+static uint8_t readIndexPage(uint8_t page, uint8_t* out) {
+  uint8_t data[] = { FINGERPRINT_READINDEXTABLE, page };
+  Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(data), data);
+  finger.writeStructuredPacket(packet);
+  if (finger.getStructuredPacket(&packet) != FINGERPRINT_OK) return FINGERPRINT_PACKETRECIEVEERR;
+  if (packet.type != FINGERPRINT_ACKPACKET) return FINGERPRINT_PACKETRECIEVEERR;
+  if (packet.data[0] != FINGERPRINT_OK) return packet.data[0];
+  memcpy(out, packet.data + 1, FP_INDEX_PAGE_BYTES);
+  return FINGERPRINT_OK;
+}
+
+static bool refreshFromIndexTable() {
+  uint16_t limit = slotLimit();
+  uint8_t pages = (limit + FP_INDEX_PAGE_BYTES * 8 - 1) / (FP_INDEX_PAGE_BYTES * 8);
+  for (uint8_t page = 0; page < pages; ++page) {
+    uint8_t r = readIndexPage(page, occupancy + page * FP_INDEX_PAGE_BYTES);
+    if (r != FINGERPRINT_OK) {
+      Serial.printf("ReadIndexTable page %u failed (code %u)\n", (unsigned)page, (unsigned)r);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Slow path for modules without ReadIndexTable: one loadModel per slot.
+static bool refreshByProbe() {
+  uint16_t limit = slotLimit();
+  Serial.printf("Falling back to per-slot probe of %u slots...\n", (unsigned)limit);
+  for (uint16_t id = 1; id < limit; ++id) {
+    if (finger.loadModel(id) == FINGERPRINT_OK) occupancy[id >> 3] |= (1 << (id & 7));
+  }
+  return true;
+}
+
+bool occupancyRefresh() {
+  uint32_t startMs = millis();
+  memset(occupancy, 0, sizeof(occupancy));
+  indexValid = refreshFromIndexTable();
+  if (!indexValid) {
+    memset(occupancy, 0, sizeof(occupancy));
+    indexValid = refreshByProbe();
+  }
+  occupiedCount = countBits();
+  Serial.printf("Occupancy index: %u/%u slots used (read in %lu ms)\n", (unsigned)occupiedCount,
+                (unsigned)slotLimit(), (unsigned long)(millis() - startMs));
+  return indexValid;
+}
+
+bool occupancyValid() {
+  return indexValid;
+}
+
+void occupancyMark(uint16_t id, bool present) {
+  if (id >= FP_INDEX_MAX_SLOTS) return;
+  uint8_t mask = 1 << (id & 7);
+  bool was = occupancy[id >> 3] & mask;
+  if (present && !was) {
+    occupancy[id >> 3] |= mask;
+    occupiedCount++;
+  } else if (!present && was) {
+    occupancy[id >> 3] &= ~mask;
+    occupiedCount--;
+  }
+}
+
+void occupancyClearAll() {
+  memset(occupancy, 0, sizeof(occupancy));
+  occupiedCount = 0;
+}
+
+bool occupancyIsSet(uint16_t id) {
+  if (id >= FP_INDEX_MAX_SLOTS) return false;
+  return occupancy[id >> 3] & (1 << (id & 7));
+}
+
+uint16_t occupancyCount() {
+  return occupiedCount;
+}
+
+uint16_t occupancyNext(uint16_t from) {
+  uint16_t limit = slotLimit();
+  for (uint16_t id = from; id < limit; ++id) {
+    uint8_t byteVal = occupancy[id >> 3];
+    if (byteVal == 0 && (id & 7) == 0) {
+      id += 7;  // skip an empty byte at once
+      continue;
+    }
+    if (byteVal & (1 << (id & 7))) return id;
+  }
+  return 0;
+}
+
+uint16_t occupancyNextFree(uint16_t from) {
+  uint16_t limit = slotLimit();
+  for (uint16_t id = from ? from : 1; id < limit; ++id) {
+    uint8_t byteVal = occupancy[id >> 3];
+    if (byteVal == 0xFF && (id & 7) == 0) {
+      id += 7;  // skip a full byte at once
+      continue;
+    }
+    if (!(byteVal & (1 << (id & 7)))) return id;
+  }
+  return 0;
+}
+
+uint16_t occupancyLast() {
+  for (int id = (int)slotLimit() - 1; id > 0; --id) {
+    if (occupancyIsSet(id)) return id;
+  }
+  return 0;
+}
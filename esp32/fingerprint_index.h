@@ -0,0 +1,28 @@
+#ifndef FINGERPRINT_INDEX_H
+#define FINGERPRINT_INDEX_H
+
+#include <Arduino.h>
+
+// Occupancy bitmap of the sensor's template library, read with the
+// ReadIndexTable (0x1F) command: one 32-byte page covers 256 slots.
+#define FINGERPRINT_READINDEXTABLE 0x1F
+#define FP_INDEX_PAGE_BYTES 32
+#define FP_INDEX_PAGES 4
+#define FP_INDEX_MAX_SLOTS (FP_INDEX_PAGES * FP_INDEX_PAGE_BYTES * 8)  // 1024
+
+// Re-read the bitmap from the sensor. Falls back to per-slot loadModel probing
+// if the module does not implement ReadIndexTable. Returns false if neither worked.
+bool occupancyRefresh();
+bool occupancyValid();
+
+// Incremental updates after the firmware itself changes the library
+void occupancyMark(uint16_t id, bool present);
+void occupancyClearAll();
+
+bool occupancyIsSet(uint16_t id);
+uint16_t occupancyCount();
+uint16_t occupancyNext(uint16_t from);      // first occupied id >= from, 0 if none
+uint16_t occupancyNextFree(uint16_t from);  // first free id >= from (1-based), 0 if full
+uint16_t occupancyLast();                   // highest occupied id, 0 if empty
+
+#endif
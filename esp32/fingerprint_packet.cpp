@@ -0,0 +1,187 @@
+// fingerprint_packet.cpp
+#include "fingerprint_packet.h"
+#include <string.h>
+
+const char* fpParseResultToString(FpParseResult r) {
+  switch (r) {
+    case FP_PARSE_IN_PROGRESS: return "in_progress";
+    case FP_PARSE_DONE: return "done";
+    case FP_PARSE_ERR_CHECKSUM: return "checksum_mismatch";
+    case FP_PARSE_ERR_PACKET_TYPE: return "unexpected_packet_type";
+    case FP_PARSE_ERR_LENGTH: return "bad_packet_length";
+    case FP_PARSE_ERR_OVERFLOW: return "payload_overflow";
+    case FP_PARSE_ERR_SHORT: return "payload_short";
+    case FP_PARSE_ERR_TIMEOUT: return "timeout";
+    default: return "unknown";
+  }
+}
+
+size_t fpBuildPacket(uint8_t* out, uint32_t addr, uint8_t pid, const uint8_t* payload, size_t len) {
+  uint16_t wireLen = (uint16_t)(len + 2);  // length field counts the checksum
+  size_t n = 0;
+  out[n++] = FP_PACKET_START_1;
+  out[n++] = FP_PACKET_START_2;
+  for (int shift = 24; shift >= 0; shift -= 8) out[n++] = (uint8_t)(addr >> shift);
+  out[n++] = pid;
+  out[n++] = wireLen >> 8;
+  out[n++] = wireLen & 0xFF;
+  uint16_t sum = pid + (wireLen >> 8) + (wireLen & 0xFF);
+  for (size_t i = 0; i < len; ++i) {
+    out[n++] = payload[i];
+    sum += payload[i];
+  }
+  out[n++] = sum >> 8;
+  out[n++] = sum & 0xFF;
+  return n;
+}
+
+void FpPacketParser::begin(uint8_t* dest, size_t expected, PayloadSink sink, void* sinkCtx) {
+  dest_ = dest;
+  expected_ = expected;
+  sink_ = sink;
+  sinkCtx_ = sinkCtx;
+  collected_ = 0;
+  state_ = ST_START_1;
+  result_ = FP_PARSE_IN_PROGRESS;
+  addrLeft_ = 0;
+  pid_ = 0;
+  payloadLeft_ = 0;
+  sum_ = 0;
+  rxSum_ = 0;
+  packets_ = 0;
+  skipped_ = 0;
+}
+
+size_t FpPacketParser::wanted() const {
+  if (result_ != FP_PARSE_IN_PROGRESS) return 0;
+  switch (state_) {
+    case ST_START_1: return 2 + 4 + 1 + 2;  // a full header
+    case ST_START_2: return 1 + 4 + 1 + 2;
+    case ST_ADDR: return addrLeft_ + 1 + 2;
+    case ST_PID: return 1 + 2;
+    case ST_LEN_HI: return 2;
+    case ST_LEN_LO: return 1;
+    case ST_PAYLOAD: return payloadLeft_;
+    case ST_SUM_HI: return 2;
+    case ST_SUM_LO: return 1;
+  }
+  return 1;
+}
+
+size_t FpPacketParser::payloadWindow(uint8_t** dst) {
+  if (result_ != FP_PARSE_IN_PROGRESS || state_ != ST_PAYLOAD) return 0;
+  *dst = dest_ + collected_;
+  return payloadLeft_;
+}
+
+FpParseResult FpPacketParser::commitPayload(size_t n) {
+  if (result_ != FP_PARSE_IN_PROGRESS || state_ != ST_PAYLOAD) return result_;
+  if (n > payloadLeft_) n = payloadLeft_;
+  const uint8_t* p = dest_ + collected_;
+  for (size_t i = 0; i < n; ++i) sum_ += p[i];
+  if (sink_ && n) sink_(sinkCtx_, p, n);
+  collected_ += n;
+  payloadLeft_ -= n;
+  if (payloadLeft_ == 0) state_ = ST_SUM_HI;
+  return result_;
+}
+
+FpParseResult FpPacketParser::feed(const uint8_t* data, size_t len, size_t* consumed) {
+  size_t i = 0;
+  while (i < len && result_ == FP_PARSE_IN_PROGRESS) {
+    if (state_ == ST_PAYLOAD) {
+      // bulk copy as much payload as this slice holds
+      size_t n = len - i;
+      if (n > payloadLeft_) n = payloadLeft_;
+      memcpy(dest_ + collected_, data + i, n);
+      commitPayload(n);
+      i += n;
+    } else {
+      step(data[i++]);
+    }
+  }
+  if (consumed) *consumed = i;
+  return result_;
+}
+
+FpParseResult FpPacketParser::step(uint8_t b) {
+  switch (state_) {
+    case ST_START_1:
+      if (b == FP_PACKET_START_1) state_ = ST_START_2;
+      else skipped_++;  // line noise between packets
+      break;
+
+    case ST_START_2:
+      if (b == FP_PACKET_START_2) {
+        state_ = ST_ADDR;
+        addrLeft_ = 4;
+      } else {
+        skipped_++;
+        state_ = (b == FP_PACKET_START_1) ? ST_START_2 : ST_START_1;
+      }
+      break;
+
+    case ST_ADDR:
+      if (--addrLeft_ == 0) state_ = ST_PID;
+      break;
+
+    case ST_PID:
+      if (b != FP_PACKET_PID_DATA && b != FP_PACKET_PID_END) {
+        result_ = FP_PARSE_ERR_PACKET_TYPE;
+        break;
+      }
+      pid_ = b;
+      sum_ = b;
+      state_ = ST_LEN_HI;
+      break;
+
+    case ST_LEN_HI:
+      payloadLeft_ = (uint16_t)b << 8;
+      sum_ += b;
+      state_ = ST_LEN_LO;
+      break;
+
+    case ST_LEN_LO: {
+      uint16_t packetLen = payloadLeft_ | b;
+      sum_ += b;
+      if (packetLen < 2 || packetLen > FP_PACKET_MAX_PAYLOAD + 2) {
+        result_ = FP_PARSE_ERR_LENGTH;
+        break;
+      }
+      payloadLeft_ = packetLen - 2;  // minus checksum bytes
+      if (collected_ + payloadLeft_ > expected_) {
+        result_ = FP_PARSE_ERR_OVERFLOW;
+        break;
+      }
+      state_ = payloadLeft_ ? ST_PAYLOAD : ST_SUM_HI;
+      break;
+    }
+
+    case ST_PAYLOAD:
+      // only reached through feed() bulk path / commitPayload()
+      break;
+
+    case ST_SUM_HI:
+      rxSum_ = (uint16_t)b << 8;
+      state_ = ST_SUM_LO;
+      break;
+
+    case ST_SUM_LO:
+      rxSum_ |= b;
+      return endOfPacket();
+  }
+  return result_;
+}
+
+FpParseResult FpPacketParser::endOfPacket() {
+  if (rxSum_ != sum_) {
+    result_ = FP_PARSE_ERR_CHECKSUM;
+    return result_;
+  }
+  packets_++;
+  state_ = ST_START_1;
+  if (pid_ == FP_PACKET_PID_END) {
+    result_ = (collected_ == expected_) ? FP_PARSE_DONE : FP_PARSE_ERR_SHORT;
+  }
+  return result_;
+}
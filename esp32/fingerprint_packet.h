@@ -0,0 +1,100 @@
+#ifndef FINGERPRINT_PACKET_H
+#define FINGERPRINT_PACKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// R307 / AS608 packet layout:
+//   0xEF 0x01 | addr(4) | pid(1) | len(2, big endian) | payload(len - 2) | checksum(2)
+// checksum = low 16 bits of pid + len bytes + payload bytes
+#define FP_PACKET_START_1 0xEF
+#define FP_PACKET_START_2 0x01
+#define FP_PACKET_PID_DATA 0x02
+#define FP_PACKET_PID_END 0x08
+#define FP_PACKET_MAX_PAYLOAD 256  // largest data packet the sensor can be configured for
+
+enum FpParseResult {
+  FP_PARSE_IN_PROGRESS,      // more bytes needed
+  FP_PARSE_DONE,             // end packet received and destination filled exactly
+  FP_PARSE_ERR_CHECKSUM,     // a packet's checksum did not match its contents
+  FP_PARSE_ERR_PACKET_TYPE,  // pid was neither data (0x02) nor end (0x08)
+  FP_PARSE_ERR_LENGTH,       // length field outside 2..FP_PACKET_MAX_PAYLOAD + 2
+  FP_PARSE_ERR_OVERFLOW,     // sensor sent more payload than the destination holds
+  FP_PARSE_ERR_SHORT,        // end packet arrived before the destination was filled
+  FP_PARSE_ERR_TIMEOUT       // set by the caller when its deadline passes
+};
+
+const char* fpParseResultToString(FpParseResult r);
+
+// Frame payload as one packet for the sensor (e.g. the data/end packets that
+// follow DownChar). out must hold len + FP_PACKET_OVERHEAD bytes; returns the
+// packet length.
+#define FP_PACKET_OVERHEAD (2 + 4 + 1 + 2 + 2)
+size_t fpBuildPacket(uint8_t* out, uint32_t addr, uint8_t pid, const uint8_t* payload, size_t len);
+
+// Resumable parser for the data/end packet stream that follows UpChar (getModel).
+// Bytes can be fed in arbitrary slices; payload is written straight into the
+// destination buffer given to begin(). No Arduino dependencies, so recorded UART
+// captures can be replayed through it off-device.
+class FpPacketParser {
+public:
+  // Sees each span of payload as it is committed, in order, e.g. to hash a
+  // template while it arrives. Spans are passed before their packet's checksum
+  // is checked; anything but FP_PARSE_DONE means the data must be discarded.
+  typedef void (*PayloadSink)(void* ctx, const uint8_t* data, size_t len);
+
+  void begin(uint8_t* dest, size_t expected, PayloadSink sink = nullptr, void* sinkCtx = nullptr);
+
+  // Generic path: consume up to len bytes, returns the current result.
+  FpParseResult feed(const uint8_t* data, size_t len, size_t* consumed = nullptr);
+
+  // Zero-copy path: while inside a packet payload, returns how many payload
+  // bytes are still expected and where they go. The caller reads the UART
+  // straight into *dst and then calls commitPayload() with the count read.
+  size_t payloadWindow(uint8_t** dst);
+  FpParseResult commitPayload(size_t n);
+
+  // Bytes the parser wants before its next state change (header/checksum
+  // remainder, or remaining payload). Useful to size UART reads.
+  size_t wanted() const;
+
+  void fail(FpParseResult r) { result_ = r; }
+
+  FpParseResult result() const { return result_; }
+  size_t collected() const { return collected_; }
+  uint16_t packets() const { return packets_; }
+  uint32_t skippedBytes() const { return skipped_; }
+
+private:
+  enum State {
+    ST_START_1,
+    ST_START_2,
+    ST_ADDR,
+    ST_PID,
+    ST_LEN_HI,
+    ST_LEN_LO,
+    ST_PAYLOAD,
+    ST_SUM_HI,
+    ST_SUM_LO
+  };
+
+  FpParseResult step(uint8_t b);
+  FpParseResult endOfPacket();
+
+  uint8_t* dest_ = nullptr;
+  size_t expected_ = 0;
+  PayloadSink sink_ = nullptr;
+  void* sinkCtx_ = nullptr;
+  size_t collected_ = 0;
+  State state_ = ST_START_1;
+  FpParseResult result_ = FP_PARSE_IN_PROGRESS;
+  uint8_t addrLeft_ = 0;
+  uint8_t pid_ = 0;
+  uint16_t payloadLeft_ = 0;
+  uint16_t sum_ = 0;
+  uint16_t rxSum_ = 0;
+  uint16_t packets_ = 0;
+  uint32_t skipped_ = 0;
+};
+
+#endif
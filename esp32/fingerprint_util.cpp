@@ -1,8 +1,14 @@
 // fingerprint_util.cpp
 #include <Adafruit_Fingerprint.h>
 #include "fingerprint_util.h"
+#include "fingerprint_packet.h"
+#include "fingerprint_index.h"
+#include "hash_index.h"
+#include "sensor_link.h"
+#include "latency.h"
 #include "messaging.h"
 #include "fingerprint.h"  // for enrolledCount (extern)
+#include "buffer_pool.h"
 #include "mbedtls/sha256.h"
 #include <Arduino.h>
 
@@ -12,13 +18,17 @@ extern Adafruit_Fingerprint finger;
 extern uint16_t enrolledCount;  // from fingerprint.cpp
 
 #define TEMPLATE_PAYLOAD_SIZE 512  // the actual template payload size
-#define PACKET_HEADER_PREFIX_1 0xEF
-#define PACKET_HEADER_PREFIX_2 0x01
 #define PACKET_HEADER_SIZE 9     // 0xEF 0x01 + 4-byte addr + packet id + length(2)
 #define READ_TIMEOUT_MS 10000UL  // adjust if needed
+#define FINGERPRINT_DOWNCHAR 0x09  // DownChar: template from the host into a char buffer
 
-// Helper: ask sensor for template count; fall back to enrolledCount or fallbackMax
+static_assert(TEMPLATE_PAYLOAD_SIZE <= POOL_BLOCK_SIZE, "a template must fit one pool block");
+
+// Helper: number of stored templates from the occupancy index; falls back to the
+// sensor's template count, then enrolledCount, then fallbackMax
 uint16_t getStoredTemplateCount(uint16_t fallbackMax) {
+  if (occupancyValid()) return occupancyCount();
+
   uint16_t count = 0;
   uint8_t rc = finger.getTemplateCount();
   if (rc == FINGERPRINT_OK) {
@@ -36,171 +46,373 @@ uint16_t getStoredTemplateCount(uint16_t fallbackMax) {
   return fallbackMax;
 }
 
-// Wait until we see 0xEF 0x01 in sequence or timeout
-static bool waitForPacketHeader(uint32_t deadline) {
-  while (millis() < deadline) {
-    if (mySerial.available() >= 2) {
-      int b1 = mySerial.read();
-      if (b1 == PACKET_HEADER_PREFIX_1) {
-        int b2 = mySerial.peek();
-        if (b2 == PACKET_HEADER_PREFIX_2) {
-          // leave stream positioned at the second header byte for the next readBytes
-          return true;
-        } else {
-          // continue scanning
-          continue;
-        }
+// Pump bytes from the UART RX buffer through the packet parser until the end
+// packet lands, a packet is rejected or the deadline passes. Header and checksum
+// bytes go through a tiny scratch buffer; payload bytes are read straight into
+// the parser's destination.
+static FpParseResult receiveTemplatePayload(FpPacketParser& parser, uint32_t deadline) {
+  uint8_t scratch[PACKET_HEADER_SIZE];
+
+  while (parser.result() == FP_PARSE_IN_PROGRESS) {
+    int avail = mySerial.available();
+    if (avail <= 0) {
+      if ((int32_t)(millis() - deadline) >= 0) {
+        parser.fail(FP_PARSE_ERR_TIMEOUT);
+        break;
       }
+      delay(1);
+      continue;
+    }
+
+    uint8_t* dst = nullptr;
+    size_t window = parser.payloadWindow(&dst);
+    if (window > 0) {
+      size_t n = mySerial.read(dst, min(window, (size_t)avail));
+      parser.commitPayload(n);
+    } else {
+      size_t want = min(parser.wanted(), sizeof(scratch));
+      size_t n = mySerial.read(scratch, min(want, (size_t)avail));
+      parser.feed(scratch, n);
     }
-    delay(1);
   }
-  return false;
+  return parser.result();
 }
 
-// Attempts to download and publish a template for a given ID.
-// Returns true if published successfully, false otherwise.
-bool downloadTemplateById(uint16_t id, uint8_t maxRetries) {
-  if (id == 0) {
-    Serial.println("downloadTemplateById: invalid id 0");
-    publishEnrolmentStatus(STATUS_ERROR, "Invalid template ID requested (0).");
+// Load a slot into the sensor's char buffer and start the UpChar transfer.
+// On success the sensor is streaming data packets into the UART RX buffer.
+static bool requestTemplate(uint16_t id) {
+  // clear any stale bytes
+  while (mySerial.available()) mySerial.read();
+
+  // load model into buffer (sensor internal)
+  uint8_t r = latencyTimed(LAT_LOAD_MODEL, [id] { return finger.loadModel(id); });
+  if (r != FINGERPRINT_OK) {
+    Serial.printf("  loadModel(%u) returned %u\n", (unsigned)id, (unsigned)r);
     return false;
   }
 
-  Serial.printf("Attempting to load template ID %u\n", (unsigned)id);
+  // tell sensor to send model
+  r = latencyTimed(LAT_GET_MODEL, [] { return finger.getModel(); });
+  if (r != FINGERPRINT_OK) {
+    Serial.printf("  getModel(%u) returned %u\n", (unsigned)id, (unsigned)r);
+    return false;
+  }
+  return true;
+}
 
-  static uint8_t templatePayload[TEMPLATE_PAYLOAD_SIZE];
+// Parser sink for a streamed SHA-256: each payload span is hashed as it lands,
+// so the digest is final right after the end packet instead of costing a
+// second pass over the template. mbedTLS runs it on the ESP32's hardware SHA
+// engine (CONFIG_MBEDTLS_HARDWARE_SHA), in software while another context
+// holds the engine.
+static void hashPayload(void* ctx, const uint8_t* data, size_t len) {
+  mbedtls_sha256_update((mbedtls_sha256_context*)ctx, data, len);
+}
 
+// Collect a template whose transfer was started by requestTemplate(). With
+// hash set, the template's SHA-256 is computed on the fly and written there.
+static bool receiveTemplate(uint16_t id, uint8_t* dest, FpPacketParser& parser, uint8_t* hash = nullptr) {
+  uint32_t startMs = millis();
+  uint32_t startUs = micros();
+  mbedtls_sha256_context sha;
+  if (hash) {
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);  // 0 => SHA-256 (not 224)
+    parser.begin(dest, TEMPLATE_PAYLOAD_SIZE, hashPayload, &sha);
+  } else {
+    parser.begin(dest, TEMPLATE_PAYLOAD_SIZE);
+  }
+  FpParseResult res = receiveTemplatePayload(parser, startMs + READ_TIMEOUT_MS);
+  if (res == FP_PARSE_DONE) latencyRecord(LAT_TEMPLATE_RX, micros() - startUs);
+  if (hash) {
+    if (res == FP_PARSE_DONE) {
+      mbedtls_sha256_finish(&sha, hash);
+      latencyRecord(LAT_TEMPLATE_HASHED, micros() - startUs);
+    }
+    mbedtls_sha256_free(&sha);
+  }
+  // Both lines stay under the 64 bytes Print::printf formats on the stack;
+  // anything longer costs a heap allocation per template
+  if (res != FP_PARSE_DONE) {
+    Serial.printf("  ID %u: %s at byte %u, packet %u\n", (unsigned)id, fpParseResultToString(res),
+                  (unsigned)parser.collected(), (unsigned)parser.packets());
+    return false;
+  }
+  Serial.printf("  ID %u: %u packets, %lu ms, %lu noise bytes\n", (unsigned)id, (unsigned)parser.packets(),
+                (unsigned long)(millis() - startMs), (unsigned long)parser.skippedBytes());
+  return true;
+}
+
+// Download one template into dest with retries. Does not publish.
+bool fetchTemplate(uint16_t id, uint8_t* dest, uint8_t maxRetries, uint8_t* hash) {
+  FpPacketParser parser;
   for (uint8_t attempt = 0; attempt < maxRetries; ++attempt) {
     Serial.printf("  attempt %u/%u\n", (unsigned)(attempt + 1), (unsigned)maxRetries);
-
-    // clear any stale bytes
-    while (mySerial.available()) mySerial.read();
-
-    // load model into buffer (sensor internal)
-    uint8_t r = finger.loadModel(id);
-    if (r != FINGERPRINT_OK) {
-      Serial.printf("  loadModel returned %u\n", (unsigned)r);
+    if (!requestTemplate(id)) {
       delay(100);
       continue;  // try next attempt
     }
+    if (receiveTemplate(id, dest, parser, hash)) return true;
+    delay(200);
+  }
+  sensorLinkRecover();  // the sensor may have fallen back to another baud rate
+  return false;
+}
 
-    // tell sensor to send model
-    r = finger.getModel();
-    if (r != FINGERPRINT_OK) {
-      Serial.printf("  getModel returned %u\n", (unsigned)r);
-      delay(50);
-      continue;
+// Receive-then-hash against hashing while receiving, on the same slot. Times
+// run from the first byte read to the digest.
+void templateHashBench(uint16_t id, uint8_t samples) {
+  PoolBuffer block(POOL_BENCH);
+  if (!block) {
+    Serial.println("Hash bench: no buffer free");
+    return;
+  }
+  uint8_t* buf = block.get();
+  if (id == 0) id = occupancyValid() ? occupancyNext(1) : 0;
+  if (id == 0) {
+    Serial.println("Hash bench: no stored template (run probe first)");
+    return;
+  }
+  if (samples == 0) samples = 1;
+
+  FpPacketParser parser;
+  uint32_t sum[2] = { 0, 0 }, peak[2] = { 0, 0 };
+  uint8_t ok[2] = { 0, 0 }, mismatches = 0;
+  uint8_t oneShot[32], streamed[32];
+  for (uint8_t i = 0; i < samples; ++i) {
+    bool got[2] = { false, false };
+    for (uint8_t mode = 0; mode < 2; ++mode) {
+      if (!requestTemplate(id)) continue;
+      uint32_t t0 = micros();
+      got[mode] = mode == 0 ? receiveTemplate(id, buf, parser) : receiveTemplate(id, buf, parser, streamed);
+      if (got[mode] && mode == 0) hashTemplateRaw(buf, TEMPLATE_PAYLOAD_SIZE, oneShot);
+      uint32_t dt = micros() - t0;
+      if (!got[mode]) continue;
+      ok[mode]++;
+      sum[mode] += dt;
+      peak[mode] = max(peak[mode], dt);
     }
+    if (got[0] && got[1] && memcmp(oneShot, streamed, sizeof(oneShot)) != 0) mismatches++;
+  }
 
-    // collect payload bytes from incoming packets until we've got TEMPLATE_PAYLOAD_SIZE
-    size_t collected = 0;
-    uint32_t startMs = millis();
-    uint32_t deadline = startMs + READ_TIMEOUT_MS;
+  Serial.printf("== Hash bench: %u sample(s), template ID %u ==\n", (unsigned)samples, (unsigned)id);
+  Serial.println("  path             avg/max us          ok");
+  static const char* const PATHS[] = { "receive+sha256", "streamed" };
+  for (uint8_t mode = 0; mode < 2; ++mode) {
+    Serial.printf("  %-15s  %7lu / %-7lu    %u/%u\n", PATHS[mode], (unsigned long)(ok[mode] ? sum[mode] / ok[mode] : 0),
+                  (unsigned long)peak[mode], (unsigned)ok[mode], (unsigned)samples);
+  }
+  if (mismatches) Serial.printf("  digests differed in %u sample(s)\n", (unsigned)mismatches);
+}
 
-    while (collected < TEMPLATE_PAYLOAD_SIZE && millis() < deadline) {
-      // find packet header
-      if (!waitForPacketHeader(deadline)) {
-        Serial.println("  header not found within timeout");
-        break;
-      }
+// DownChar into char buffer 1, then the template as data packets of the
+// negotiated length (the last one an end packet), then Store. The sensor only
+// acknowledges the command and the store; the data packets go out back to back.
+bool storeTemplate(uint16_t id, const uint8_t* src) {
+  while (mySerial.available()) mySerial.read();
 
-      // read the rest of the header (we already consumed first byte earlier)
-      // We expect PACKET_HEADER_SIZE bytes total: 0xEF 0x01, addr(4), pid(1), len(2)
-      uint8_t header[PACKET_HEADER_SIZE];
-      header[0] = PACKET_HEADER_PREFIX_1;
-      // read the remaining bytes (PACKET_HEADER_SIZE - 1)
-      size_t got = mySerial.readBytes(header + 1, PACKET_HEADER_SIZE - 1);
-      if (got != PACKET_HEADER_SIZE - 1) {
-        Serial.printf("  header read incomplete: expected %d got %u\n", PACKET_HEADER_SIZE - 1, (unsigned)got);
-        break;  // try next attempt
-      }
+  uint8_t cmd[] = { FINGERPRINT_DOWNCHAR, 0x01 };
+  Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(cmd), cmd);
+  finger.writeStructuredPacket(packet);
+  if (finger.getStructuredPacket(&packet) != FINGERPRINT_OK || packet.type != FINGERPRINT_ACKPACKET ||
+      packet.data[0] != FINGERPRINT_OK) {
+    Serial.printf("  DownChar for ID %u rejected\n", (unsigned)id);
+    return false;
+  }
 
-      // length field is header[7]<<8 | header[8] (big endian)
-      uint16_t packetLen = ((uint16_t)header[7] << 8) | header[8];
-      if (packetLen < 3) {
-        Serial.printf("  invalid packetLen %u\n", (unsigned)packetLen);
-        // consume the rest to keep stream in sync
-        if (mySerial.available()) mySerial.read();
-        continue;
-      }
+  uint8_t frame[SENSOR_LINK_MAX_PACKET + FP_PACKET_OVERHEAD];
+  size_t chunk = min((size_t)sensorLinkPacketLen(), (size_t)SENSOR_LINK_MAX_PACKET);
+  for (size_t off = 0; off < TEMPLATE_PAYLOAD_SIZE; off += chunk) {
+    size_t n = min(chunk, TEMPLATE_PAYLOAD_SIZE - off);
+    uint8_t pid = off + n == TEMPLATE_PAYLOAD_SIZE ? FP_PACKET_PID_END : FP_PACKET_PID_DATA;
+    mySerial.write(frame, fpBuildPacket(frame, finger.device_addr, pid, src + off, n));
+  }
 
-      uint16_t payloadLen = packetLen - 2;  // minus checksum bytes
-      // Sanity bound payloadLen — sensor sends chunks, typically 256 or smaller
-      if (payloadLen > 1024) {
-        Serial.printf("  suspicious payloadLen %u, skipping\n", (unsigned)payloadLen);
-        // consume payload+checksum to resync
-        uint8_t tmp[256];
-        size_t toConsume = (payloadLen + 2 <= sizeof(tmp)) ? payloadLen + 2 : sizeof(tmp);
-        mySerial.readBytes(tmp, toConsume);
-        continue;
-      }
+  uint8_t r = latencyTimed(LAT_STORE_MODEL, [id] { return finger.storeModel(id); });
+  if (r != FINGERPRINT_OK) {
+    Serial.printf("  storeModel(%u) returned %u\n", (unsigned)id, (unsigned)r);
+    return false;
+  }
+  return true;
+}
 
-      // read payloadLen bytes (the actual payload chunk)
-      uint8_t chunkBuf[512];  // chunk won't exceed this
-      size_t readGot = mySerial.readBytes(chunkBuf, payloadLen);
-      if (readGot != payloadLen) {
-        Serial.printf("  payload read short: expected %u got %u\n", (unsigned)payloadLen, (unsigned)readGot);
-        break;  // attempt failed
-      }
+// Attempts to download and publish a template for a given ID.
+// Returns true if published successfully, false otherwise.
+bool downloadTemplateById(uint16_t id, uint8_t maxRetries, bool endsRequest) {
+  if (id == 0) {
+    Serial.println("downloadTemplateById: invalid id 0");
+    publishEnrolmentStatus(STATUS_ERROR, "Invalid template ID requested (0).");
+    return false;
+  }
 
-      // append to templatePayload
-      size_t toCopy = min((size_t)payloadLen, TEMPLATE_PAYLOAD_SIZE - collected);
-      memcpy(templatePayload + collected, chunkBuf, toCopy);
-      collected += toCopy;
+  Serial.printf("Attempting to load template ID %u\n", (unsigned)id);
 
-      // read & discard checksum (2 bytes)
-      uint8_t checksum[2];
-      size_t csGot = mySerial.readBytes(checksum, 2);
-      if (csGot != 2) {
-        Serial.println("  checksum read incomplete");
-        break;
-      }
-    }  // end collect loop
-
-    if (collected == TEMPLATE_PAYLOAD_SIZE) {
-      Serial.println("Template payload collected successfully.");
-      // publish via messaging (base64)
-      publishTemplate(id, templatePayload, TEMPLATE_PAYLOAD_SIZE);
-      publishEnrolmentStatus(STATUS_SUCCESS, "Template downloaded and published for ID " + String(id));
-      return true;
-    } else {
-      Serial.printf("  collected %u/%u bytes (attempt %u failed)\n", (unsigned)collected, (unsigned)TEMPLATE_PAYLOAD_SIZE, (unsigned)(attempt + 1));
-      delay(200);
-      // next attempt
-    }
-  }  // attempts
+  PoolBuffer templatePayload(POOL_DOWNLOAD);
+  if (!templatePayload) {
+    publishEnrolmentStatusf(STATUS_BUSY, "No buffer free to download ID %u, retry later", (unsigned)id);
+    return false;
+  }
+
+  uint8_t hash[32];
+  if (fetchTemplate(id, templatePayload.get(), maxRetries, hash)) {
+    Serial.println("Template payload collected successfully.");
+    hashIndexSet(id, hash);
+    publishTemplateHash(id, hash);
+    publishEnrolmentStatusf(endsRequest ? STATUS_SUCCESS : STATUS_PROGRESS, "Template downloaded and published for ID %u",
+                            (unsigned)id);
+    return true;
+  }
 
-  publishEnrolmentStatus(STATUS_ERROR, "Template download failed for ID " + String(id));
+  publishEnrolmentStatusf(STATUS_ERROR, "Template download failed for ID %u", (unsigned)id);
   return false;
 }
 
-// Bulk download using single-template downloader; uses sensor template count if available
-void downloadAllTemplates(uint16_t maxTemplates, uint8_t maxRetries) {
+// Bulk download over the occupied slots only. Once template k is in, the
+// transfer of the next occupied slot is started, and template k's hash (computed
+// while it arrived) is queued into a batched `templates` message while k+1's
+// packets fill the UART RX buffer. Only the hash of k is still needed by then,
+// so k+1 is received into the same buffer.
+//
+// Runs as a job of one slot per step. A step ends with template k+1 received
+// and nothing in flight on the UART, so between steps the sensor task can run
+// a verify or an enrollment and then carry on where it stopped.
+struct BulkDownload {
+  bool active;
+  uint16_t upper;      // templates to visit
+  uint16_t done;       // visited so far (including the one in the buffer)
+  uint16_t id;         // slot whose hash is in slotHash (if haveCur)
+  bool haveCur;
+  uint8_t maxRetries;
+  uint16_t ok, failed;
+  uint32_t startMs, lastProgressMs;
+  uint32_t pausedMs, pauseStartMs;  // time other work had the sensor
+};
+
+static BulkDownload bulk;
+static uint8_t* slotBuf;  // pool block, held for the whole job
+static uint8_t slotHash[32];
+
+bool bulkDownloadBegin(uint16_t maxTemplates, uint8_t maxRetries) {
   Serial.println("=== STARTING BULK TEMPLATE DOWNLOAD ===");
 
-  // Get available count from sensor (fallback to provided maxTemplates)
+  if (!occupancyValid()) occupancyRefresh();
+
+  // Get available count from the occupancy index (fallback to provided maxTemplates)
   uint16_t sensorCount = getStoredTemplateCount(maxTemplates);
   Serial.printf("Sensor reported %u templates available (using upper bound %u)\n", (unsigned)sensorCount, (unsigned)maxTemplates);
 
   // Cap to maxTemplates param to avoid insane loops
   uint16_t upper = min(sensorCount, maxTemplates);
+  uint16_t id = occupancyNext(1);
 
-  if (upper == 0) {
+  if (upper == 0 || id == 0) {
     Serial.println("No templates reported; nothing to download.");
     publishEnrolmentStatus(STATUS_ERROR, "No templates to download.");
-    return;
+    return false;
   }
 
-  for (uint16_t id = 1; id <= upper; ++id) {
-    Serial.printf("Downloading template for ID %u\n", (unsigned)id);
-    bool ok = downloadTemplateById(id, maxRetries);
-    if (!ok) {
-      Serial.printf("Failed to download ID %u (continuing)\n", (unsigned)id);
-      // continue — we don't abort whole bulk on single fail
-    }
-    delay(100);  // small spacing between downloads
+  slotBuf = poolAcquire(POOL_BULK_DOWNLOAD);
+  if (!slotBuf) {
+    publishEnrolmentStatus(STATUS_BUSY, "No buffers free for the bulk download, retry later");
+    return false;
   }
 
+  bulk = {};
+  bulk.active = true;
+  bulk.upper = upper;
+  bulk.done = 1;
+  bulk.id = id;
+  bulk.maxRetries = maxRetries;
+  bulk.startMs = bulk.lastProgressMs = millis();
+
+  templateBatchBegin();
+
+  // prime the pipeline with the first template
+  bulk.haveCur = fetchTemplate(id, slotBuf, maxRetries, slotHash);
+  if (!bulk.haveCur) bulk.failed++;
+  return true;
+}
+
+static void bulkDownloadFinish(const char* outcome) {
+  templateBatchFlush();
+  bulk.active = false;
+  poolRelease(slotBuf);
+  slotBuf = nullptr;
+
+  uint32_t elapsedMs = millis() - bulk.startMs - bulk.pausedMs;
+  float rate = elapsedMs ? (bulk.ok + bulk.failed) * 1000.0f / (float)elapsedMs : 0.0f;
+  char summary[128];
+  snprintf(summary, sizeof(summary), "Bulk template download %s: %u ok, %u failed in %lu ms (%.1f templates/s)", outcome,
+           (unsigned)bulk.ok, (unsigned)bulk.failed, (unsigned long)elapsedMs, rate);
   Serial.println("=== BULK DOWNLOAD COMPLETE ===");
-  publishEnrolmentStatus(STATUS_SUCCESS, "Bulk template download complete.");
+  Serial.println(summary);
+  if (bulk.pausedMs) Serial.printf("(paused for other requests: %lu ms)\n", (unsigned long)bulk.pausedMs);
+  publishEnrolmentStatus(STATUS_SUCCESS, summary);
+}
+
+bool bulkDownloadStep() {
+  if (!bulk.active) return false;
+  if (bulk.pauseStartMs) {
+    bulk.pausedMs += millis() - bulk.pauseStartMs;
+    bulk.pauseStartMs = 0;
+    Serial.printf("Bulk download resumed at ID %u\n", (unsigned)bulk.id);
+  }
+
+  // start the next transfer before doing any work on the current template
+  uint16_t next = (bulk.done < bulk.upper) ? occupancyNext(bulk.id + 1) : 0;
+  bool nextStarted = next != 0 && requestTemplate(next);
+
+  // the slot may have been deleted or reset while the job was paused
+  if (bulk.haveCur && occupancyIsSet(bulk.id)) {
+    hashIndexSet(bulk.id, slotHash);
+    templateBatchAdd(bulk.id, slotHash);
+    bulk.ok++;
+  }
+
+  if (next == 0) {
+    bulkDownloadFinish("complete");
+    return false;
+  }
+
+  // collect template k+1 (already streaming); retry the slow way if it broke
+  static FpPacketParser parser;
+  bulk.haveCur = nextStarted && receiveTemplate(next, slotBuf, parser, slotHash);
+  if (!bulk.haveCur && bulk.maxRetries > 1) {
+    bulk.haveCur = fetchTemplate(next, slotBuf, bulk.maxRetries - 1, slotHash);
+  }
+  if (!bulk.haveCur) {
+    Serial.printf("Failed to download ID %u (continuing)\n", (unsigned)next);
+    bulk.failed++;
+  }
+  bulk.id = next;
+  bulk.done++;
+
+  uint32_t now = millis();
+  if (now - bulk.lastProgressMs >= 5000) {
+    bulk.lastProgressMs = now;
+    float rate = (bulk.ok + bulk.failed) * 1000.0f / (float)(now - bulk.startMs - bulk.pausedMs);
+    char progress[96];
+    snprintf(progress, sizeof(progress), "Bulk sync %u/%u (%.1f templates/s)", (unsigned)(bulk.ok + bulk.failed),
+             (unsigned)bulk.upper, rate);
+    Serial.println(progress);
+    publishEnrolmentStatus(STATUS_DOWNLOADING_TEMPLATE, progress);
+  }
+  return true;
+}
+
+void bulkDownloadPause() {
+  if (!bulk.active || bulk.pauseStartMs) return;
+  bulk.pauseStartMs = millis();
+  // send what is batched so far; an enroll session opens its own batch
+  templateBatchFlush();
+  Serial.printf("Bulk download paused at ID %u (%u/%u)\n", (unsigned)bulk.id, (unsigned)bulk.done, (unsigned)bulk.upper);
+}
+
+void bulkDownloadAbort() {
+  if (!bulk.active) return;
+  if (bulk.pauseStartMs) {
+    bulk.pausedMs += millis() - bulk.pauseStartMs;
+    bulk.pauseStartMs = 0;
+  }
+  bulkDownloadFinish("cancelled");
 }
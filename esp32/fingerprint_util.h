@@ -8,11 +8,26 @@
 #define PACKET_HEADER_SIZE 9       // bytes before payload length (0xEF 0x01 ... packet header)
 #define READ_TIMEOUT_MS 10000UL    // timeout for reading packets
 
-static uint8_t templateBuffer[TEMPLATE_SIZE];
-
-// Bulk download function
-void downloadAllTemplates(uint16_t maxTemplates = 20, uint8_t maxRetries = 3);
-bool downloadTemplateById(uint16_t id, uint8_t maxRetries = 3);  // publishes on success
+// Bulk download of every occupied slot as a resumable job: begin fetches the
+// first template, each step finishes one slot and leaves nothing in flight on
+// the UART, so other sensor work can run between steps. Begin is false when
+// there is nothing to download; step is false once the summary is published.
+bool bulkDownloadBegin(uint16_t maxTemplates, uint8_t maxRetries);
+bool bulkDownloadStep();
+void bulkDownloadPause();  // flushes the open hash batch before other work takes the sensor
+void bulkDownloadAbort();  // publishes the summary so far
+// Publishes the hash and a success status, or progress when the download is a
+// step of a longer request (endsRequest false, as inside an enrollment)
+bool downloadTemplateById(uint16_t id, uint8_t maxRetries = 3, bool endsRequest = true);
 uint16_t getStoredTemplateCount(uint16_t fallbackMax = 255);
+// Download one template into dest (TEMPLATE_PAYLOAD_SIZE bytes) with retries; no publish.
+// With hash set, its SHA-256 is computed as the packets arrive and written there.
+bool fetchTemplate(uint16_t id, uint8_t* dest, uint8_t maxRetries, uint8_t* hash = nullptr);
+// Upload a raw template (TEMPLATE_PAYLOAD_SIZE bytes) and store it in slot id;
+// the inverse of fetchTemplate. Indexes are left to the caller.
+bool storeTemplate(uint16_t id, const uint8_t* src);
+// Serial CLI: time receive-then-hash against the streamed hash on one slot
+// (0: the first stored one). Blocks the sensor task.
+void templateHashBench(uint16_t id, uint8_t samples);
 
 #endif
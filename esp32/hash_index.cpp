@@ -0,0 +1,132 @@
+// hash_index.cpp
+#include <mbedtls/sha256.h>
+#include "hash_index.h"
+#include "station_store.h"
+#include "messaging.h"
+
+#define HASH_BYTES STORE_SLOT_BYTES
+
+// The leaves live in the station store, which persists them
+static const uint8_t (*const leaves)[HASH_BYTES] = storeState().slots;
+static uint8_t nodes[2 * HASH_INDEX_BUCKETS][HASH_BYTES];  // [0] unused
+static uint64_t staleBuckets = ~0ULL;  // tree nodes above these need rehashing
+
+static const uint8_t EMPTY_LEAF[HASH_BYTES] = { 0 };
+static const uint8_t UNKNOWN_LEAF[HASH_BYTES] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static void setLeaf(uint16_t id, const uint8_t value[HASH_BYTES]) {
+  if (id >= FP_INDEX_MAX_SLOTS || memcmp(leaves[id], value, HASH_BYTES) == 0) return;
+  storeSetSlot(id, value);
+  staleBuckets |= 1ULL << (id / HASH_INDEX_BUCKET_SLOTS);
+}
+
+// Rehash stale buckets and every node above them
+static void updateTree() {
+  if (!staleBuckets) return;
+  for (uint16_t b = 0; b < HASH_INDEX_BUCKETS; ++b) {
+    if (!(staleBuckets & (1ULL << b))) continue;
+    mbedtls_sha256(leaves[b * HASH_INDEX_BUCKET_SLOTS], HASH_INDEX_BUCKET_SLOTS * HASH_BYTES,
+                   nodes[HASH_INDEX_BUCKETS + b], 0);
+  }
+  // one level at a time, only parents of stale nodes
+  uint64_t stale = staleBuckets;
+  for (uint16_t width = HASH_INDEX_BUCKETS / 2; width >= 1; width /= 2) {
+    uint64_t parents = 0;
+    for (uint16_t i = 0; i < width; ++i) {
+      if (!(stale & (3ULL << (2 * i)))) continue;
+      mbedtls_sha256(nodes[2 * (width + i)], 2 * HASH_BYTES, nodes[width + i], 0);
+      parents |= 1ULL << i;
+    }
+    stale = parents;
+  }
+  staleBuckets = 0;
+}
+
+void hashIndexBegin() {
+  // The sensor is the source of truth for which slots are in use
+  uint16_t unknown = 0;
+  if (occupancyValid()) {
+    for (uint16_t id = 0; id < FP_INDEX_MAX_SLOTS; ++id) {
+      bool stored = occupancyIsSet(id);
+      bool empty = memcmp(leaves[id], EMPTY_LEAF, HASH_BYTES) == 0;
+      if (!stored && !empty) setLeaf(id, EMPTY_LEAF);
+      else if (stored && empty) setLeaf(id, UNKNOWN_LEAF);
+      if (stored && memcmp(leaves[id], UNKNOWN_LEAF, HASH_BYTES) == 0) unknown++;
+    }
+  }
+  staleBuckets = ~0ULL;
+  updateTree();
+  Serial.printf("Hash index ready, %u slot(s) without a known hash\n", (unsigned)unknown);
+}
+
+void hashIndexSet(uint16_t id, const uint8_t hash[32]) {
+  // a real template never hashes to a sentinel, but keep the encoding unambiguous
+  if (memcmp(hash, EMPTY_LEAF, HASH_BYTES) == 0 || memcmp(hash, UNKNOWN_LEAF, HASH_BYTES) == 0) return;
+  setLeaf(id, hash);
+}
+
+void hashIndexForget(uint16_t id) {
+  setLeaf(id, UNKNOWN_LEAF);
+}
+
+void hashIndexClear(uint16_t id) {
+  setLeaf(id, EMPTY_LEAF);
+}
+
+void hashIndexClearAll() {
+  for (uint16_t id = 0; id < FP_INDEX_MAX_SLOTS; ++id) setLeaf(id, EMPTY_LEAF);
+}
+
+void hashIndexRoot(uint8_t out[32]) {
+  updateTree();
+  memcpy(out, nodes[1], HASH_BYTES);
+}
+
+uint16_t hashIndexUnknownCount() {
+  uint16_t n = 0;
+  for (uint16_t id = 0; id < FP_INDEX_MAX_SLOTS; ++id) {
+    if (memcmp(leaves[id], UNKNOWN_LEAF, HASH_BYTES) == 0) n++;
+  }
+  return n;
+}
+
+static_assert(HASH_INDEX_BUCKET_SLOTS <= SYNC_REPLY_MAX_ENTRIES && (1 << HASH_INDEX_SYNC_LEVELS) <= SYNC_REPLY_MAX_ENTRIES,
+              "a sync reply lists at most SYNC_REPLY_MAX_ENTRIES entries");
+
+// No room for the whole reply; the backend asks again
+static void syncRefused(uint16_t node) {
+  publishEnrolmentStatusf(STATUS_BUSY, "Sync node %u: event queue full", (unsigned)node);
+}
+
+void hashIndexSync(uint16_t node) {
+  if (node == 0) node = 1;
+  if (node >= 2 * HASH_INDEX_BUCKETS) {
+    publishEnrolmentStatusf(STATUS_ERROR, "Invalid sync node %u", (unsigned)node);
+    return;
+  }
+  updateTree();
+
+  if (node >= HASH_INDEX_BUCKETS) {
+    uint16_t first = (node - HASH_INDEX_BUCKETS) * HASH_INDEX_BUCKET_SLOTS;
+    if (!syncReplyBegin(node, nodes[node], true, hashIndexUnknownCount())) return syncRefused(node);
+    for (uint16_t id = first; id < first + HASH_INDEX_BUCKET_SLOTS; ++id) {
+      if (memcmp(leaves[id], EMPTY_LEAF, HASH_BYTES) != 0) syncReplyAdd(id, leaves[id]);  // empty slots omitted
+    }
+    syncReplyEnd();
+    return;
+  }
+
+  // descend HASH_INDEX_SYNC_LEVELS levels, but never below the buckets
+  uint16_t first = node;
+  uint16_t count = 1;
+  for (uint8_t level = 0; level < HASH_INDEX_SYNC_LEVELS && first < HASH_INDEX_BUCKETS; ++level) {
+    first *= 2;
+    count *= 2;
+  }
+  if (!syncReplyBegin(node, nodes[node], false, hashIndexUnknownCount())) return syncRefused(node);
+  for (uint16_t n = first; n < first + count; ++n) syncReplyAdd(n, nodes[n]);
+  syncReplyEnd();
+}
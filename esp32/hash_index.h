@@ -0,0 +1,40 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <Arduino.h>
+#include "fingerprint_index.h"
+
+// SHA-256 of every stored template, one leaf per sensor slot, with a Merkle
+// tree on top so the backend can compare a whole station in a few messages.
+//
+// Leaves (32 bytes each, slot i = fingerprint ID i, FP_INDEX_MAX_SLOTS of them):
+//   empty slot             -> 32 x 0x00
+//   stored, hash unknown   -> 32 x 0xFF  (download it to fill the leaf in)
+//   stored, hash known     -> SHA-256 of the 512-byte template payload
+// Tree nodes are numbered heap-style: node 1 is the root, node n has children
+// 2n and 2n+1, and nodes HASH_INDEX_BUCKETS..2*HASH_INDEX_BUCKETS-1 are
+// buckets of HASH_INDEX_BUCKET_SLOTS consecutive slots.
+//   bucket   = SHA-256(leaf[first] || ... || leaf[first + 15])
+//   internal = SHA-256(left || right)
+//
+// Sensor task only. The leaves are kept (and persisted) by station_store.
+#define HASH_INDEX_BUCKET_SLOTS 16
+#define HASH_INDEX_BUCKETS (FP_INDEX_MAX_SLOTS / HASH_INDEX_BUCKET_SLOTS)  // 64
+#define HASH_INDEX_SYNC_LEVELS 4  // a sync reply lists up to 16 descendants
+
+// Reconcile the stored leaves with the occupancy bitmap (after storeBegin())
+void hashIndexBegin();
+
+void hashIndexSet(uint16_t id, const uint8_t hash[32]);
+void hashIndexForget(uint16_t id);  // stored, hash unknown
+void hashIndexClear(uint16_t id);   // slot emptied
+void hashIndexClearAll();
+
+void hashIndexRoot(uint8_t out[32]);
+uint16_t hashIndexUnknownCount();
+
+// Publish node's hash plus its descendants HASH_INDEX_SYNC_LEVELS levels down,
+// or, for a bucket, its non-empty slots. Node 0 means the root.
+void hashIndexSync(uint16_t node);
+
+#endif
@@ -0,0 +1,137 @@
+// json_writer.cpp
+#include "json_writer.h"
+#include <string.h>
+#include "text_codec.h"
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+JsonWriter::JsonWriter(char* buf, size_t cap) : buf_(buf), cap_(cap) {
+  if (cap_ == 0) {
+    overflow_ = true;
+    return;
+  }
+  buf_[0] = '\0';
+}
+
+void JsonWriter::raw(const char* s, size_t n) {
+  if (overflow_) return;
+  if (n > remaining()) {
+    overflow_ = true;
+    return;
+  }
+  memcpy(buf_ + len_, s, n);
+  len_ += n;
+  buf_[len_] = '\0';
+}
+
+void JsonWriter::rawChar(char c) {
+  raw(&c, 1);
+}
+
+void JsonWriter::escaped(const char* s) {
+  rawChar('"');
+  if (s) {
+    const char* run = s;  // copy unescaped runs in one go
+    for (; *s; ++s) {
+      unsigned char c = (unsigned char)*s;
+      if (c >= 0x20 && c != '"' && c != '\\') continue;
+      raw(run, s - run);
+      switch (c) {
+        case '"': raw("\\\"", 2); break;
+        case '\\': raw("\\\\", 2); break;
+        case '\n': raw("\\n", 2); break;
+        case '\r': raw("\\r", 2); break;
+        case '\t': raw("\\t", 2); break;
+        default: {
+          char u[6] = { '\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0x0F] };
+          raw(u, sizeof(u));
+          break;
+        }
+      }
+      run = s + 1;
+    }
+    raw(run, s - run);
+  }
+  rawChar('"');
+}
+
+void JsonWriter::prefix(const char* key) {
+  if (needComma_) rawChar(',');
+  if (key) {
+    escaped(key);
+    rawChar(':');
+  }
+  needComma_ = true;
+}
+
+JsonWriter& JsonWriter::beginObject(const char* key) {
+  prefix(key);
+  rawChar('{');
+  needComma_ = false;
+  return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+  rawChar('}');
+  needComma_ = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::beginArray(const char* key) {
+  prefix(key);
+  rawChar('[');
+  needComma_ = false;
+  return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+  rawChar(']');
+  needComma_ = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::str(const char* key, const char* value) {
+  prefix(key);
+  escaped(value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::num(const char* key, uint32_t value) {
+  prefix(key);
+  char digits[10];
+  size_t n = 0;
+  do {
+    digits[n++] = '0' + (value % 10);
+    value /= 10;
+  } while (value);
+  while (n) rawChar(digits[--n]);
+  return *this;
+}
+
+JsonWriter& JsonWriter::boolean(const char* key, bool value) {
+  prefix(key);
+  if (value) raw("true", 4);
+  else raw("false", 5);
+  return *this;
+}
+
+JsonWriter& JsonWriter::hex(const char* key, const uint8_t* data, size_t len) {
+  prefix(key);
+  rawChar('"');
+  if (len * 2 > remaining()) {
+    overflow_ = true;
+    return *this;
+  }
+  len_ += hexEncode(data, len, buf_ + len_);
+  buf_[len_] = '\0';
+  rawChar('"');
+  return *this;
+}
+
+void JsonWriter::rewind(size_t mark, bool needComma) {
+  if (mark > len_) return;
+  len_ = mark;
+  buf_[len_] = '\0';
+  overflow_ = false;
+  needComma_ = needComma;
+}
@@ -0,0 +1,52 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Serializes JSON into a caller-owned, fixed-size buffer. Never allocates.
+// Strings are escaped per RFC 8259. If the buffer runs out the writer stops
+// writing and ok() turns false; the buffer always stays NUL-terminated.
+//
+//   char buf[128];
+//   JsonWriter w(buf, sizeof(buf));
+//   w.beginObject().str("status", "stored").num("id", 7).endObject();
+//   if (w.ok()) client.publish(topic, (const uint8_t*)w.c_str(), w.length());
+class JsonWriter {
+public:
+  JsonWriter(char* buf, size_t cap);
+
+  JsonWriter& beginObject(const char* key = nullptr);
+  JsonWriter& endObject();
+  JsonWriter& beginArray(const char* key = nullptr);
+  JsonWriter& endArray();
+
+  JsonWriter& str(const char* key, const char* value);
+  JsonWriter& num(const char* key, uint32_t value);
+  JsonWriter& boolean(const char* key, bool value);
+  JsonWriter& hex(const char* key, const uint8_t* data, size_t len);  // lowercase hex string
+
+  // Roll back to an earlier length (e.g. an array element that did not fit).
+  size_t mark() const { return len_; }
+  void rewind(size_t mark, bool needComma);
+
+  bool ok() const { return !overflow_; }
+  size_t length() const { return len_; }
+  const char* c_str() const { return buf_; }
+  size_t remaining() const { return cap_ - 1 - len_; }
+  bool needsComma() const { return needComma_; }
+
+private:
+  void raw(const char* s, size_t n);
+  void rawChar(char c);
+  void escaped(const char* s);
+  void prefix(const char* key);
+
+  char* buf_;
+  size_t cap_;
+  size_t len_ = 0;
+  bool overflow_ = false;
+  bool needComma_ = false;
+};
+
+#endif
@@ -0,0 +1,66 @@
+// latency.cpp
+#include "latency.h"
+
+LatencyHistogram latencyHistograms[LAT_METRIC_COUNT];
+
+const char* latencyName(LatencyMetric m) {
+  switch (m) {
+    case LAT_GET_IMAGE: return "getImage";
+    case LAT_IMAGE2TZ: return "image2Tz";
+    case LAT_CREATE_MODEL: return "createModel";
+    case LAT_STORE_MODEL: return "storeModel";
+    case LAT_SEARCH: return "search";
+    case LAT_LOAD_MODEL: return "loadModel";
+    case LAT_GET_MODEL: return "getModel";
+    case LAT_TEMPLATE_RX: return "templateRx";
+    case LAT_SHA256: return "sha256";
+    case LAT_PUBLISH: return "publish";
+    case LAT_COMMAND: return "command";
+    case LAT_TEMPLATE_HASHED: return "templateHashed";
+    default: return "unknown";
+  }
+}
+
+uint32_t latencyPercentile(LatencyMetric m, uint8_t pct) {
+  return latencyPermille(m, pct * 10);
+}
+
+uint32_t latencyPermille(LatencyMetric m, uint16_t permille) {
+  const LatencyHistogram& h = latencyHistograms[m];
+  uint32_t total = h.count;
+  if (total == 0) return 0;
+  uint64_t rank = ((uint64_t)total * permille + 999) / 1000;  // 1-based rank of the sample we want
+  if (rank == 0) rank = 1;
+  uint64_t seen = 0;
+  for (uint8_t b = 0; b < LATENCY_BUCKETS; ++b) {
+    uint32_t n = h.buckets[b];
+    if (seen + n < rank) {
+      seen += n;
+      continue;
+    }
+    if (b == 0) return 0;
+    uint32_t lo = 1UL << (b - 1);
+    uint32_t width = lo;  // [lo, 2*lo)
+    uint32_t est = lo + (uint32_t)((uint64_t)width * (rank - seen) / n);
+    return min(est, h.maxUs);
+  }
+  return h.maxUs;
+}
+
+void latencyReset() {
+  memset(latencyHistograms, 0, sizeof(latencyHistograms));
+}
+
+void latencyPrint() {
+  Serial.println("=== Latency (us) ===");
+  Serial.println("  metric          count       p50       p95       p99       max       avg");
+  for (uint8_t i = 0; i < LAT_METRIC_COUNT; ++i) {
+    LatencyMetric m = (LatencyMetric)i;
+    const LatencyHistogram& h = latencyHistograms[m];
+    if (h.count == 0) continue;
+    Serial.printf("  %-12s %8lu %9lu %9lu %9lu %9lu %9lu\n", latencyName(m), (unsigned long)h.count,
+                  (unsigned long)latencyPercentile(m, 50), (unsigned long)latencyPercentile(m, 95),
+                  (unsigned long)latencyPercentile(m, 99), (unsigned long)h.maxUs,
+                  (unsigned long)(h.sumUs / h.count));
+  }
+}
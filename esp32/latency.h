@@ -0,0 +1,76 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <Arduino.h>
+
+// Fixed-size latency histograms for the hot paths. Buckets are powers of two
+// in microseconds (bucket b holds [2^(b-1), 2^b)), so recording is a clz and
+// three adds and can stay on in production. Each metric has one writer task;
+// readers (stats, heartbeat) only need approximate, not atomic, snapshots.
+enum LatencyMetric : uint8_t {
+  LAT_GET_IMAGE,     // successful captures only; no-finger polls are not counted
+  LAT_IMAGE2TZ,
+  LAT_CREATE_MODEL,
+  LAT_STORE_MODEL,
+  LAT_SEARCH,
+  LAT_LOAD_MODEL,
+  LAT_GET_MODEL,     // UpChar command only
+  LAT_TEMPLATE_RX,   // 512-byte template transfer after UpChar
+  LAT_SHA256,
+  LAT_PUBLISH,       // client.publish
+  LAT_COMMAND,       // MQTT command parse + dispatch (network task)
+  LAT_TEMPLATE_HASHED,  // template transfer with the SHA-256 streamed alongside, to the digest
+  LAT_METRIC_COUNT
+};
+
+#define LATENCY_BUCKETS 32
+
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t sumUs;
+};
+
+inline uint8_t latencyBucket(uint32_t us) {
+  uint8_t b = us ? 32 - __builtin_clz(us) : 0;
+  return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+}
+
+extern LatencyHistogram latencyHistograms[LAT_METRIC_COUNT];
+
+inline void latencyRecord(LatencyMetric m, uint32_t us) {
+  LatencyHistogram& h = latencyHistograms[m];
+  h.buckets[latencyBucket(us)]++;
+  h.count++;
+  h.sumUs += us;
+  if (us > h.maxUs) h.maxUs = us;
+}
+
+// Times the enclosing block
+struct LatencyScope {
+  LatencyMetric metric;
+  uint32_t startUs;
+  explicit LatencyScope(LatencyMetric m) : metric(m), startUs(micros()) {}
+  ~LatencyScope() {
+    latencyRecord(metric, micros() - startUs);
+  }
+};
+
+// r = latencyTimed(LAT_STORE_MODEL, [] { return finger.storeModel(id); });
+template <typename Op>
+inline auto latencyTimed(LatencyMetric m, Op op) -> decltype(op()) {
+  LatencyScope scope(m);
+  return op();
+}
+
+const char* latencyName(LatencyMetric m);
+// Estimated from the buckets (linear within a bucket), capped at the max seen
+uint32_t latencyPercentile(LatencyMetric m, uint8_t pct);
+// Same in tenths of a percent, for the tail: 990 = p99, 999 = p99.9
+uint32_t latencyPermille(LatencyMetric m, uint16_t permille);
+void latencyReset();
+// Serial CLI `stats`
+void latencyPrint();
+
+#endif
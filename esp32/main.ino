@@ -2,20 +2,29 @@
 #define MQTT_MAX_PACKET_SIZE 2048  // or 1500 — big enough for your base64 template + JSON
 #include <PubSubClient.h>
 #include <WiFi.h>
-#include <ArduinoJson.h>
 #include <HardwareSerial.h>
-#include <WiFiClientSecure.h>
 #include <Adafruit_Fingerprint.h>
-#include <Preferences.h>
 
 // Custom Modules
 #include "secrets.h"
 #include "messaging.h"
 #include "fingerprint.h"
 #include "fingerprint_util.h"
+#include "fingerprint_index.h"
+#include "hash_index.h"
+#include "sensor_link.h"
+#include "station_store.h"
+#include "station_tasks.h"
+#include "station_id.h"
+#include "enroll_session.h"
+#include "backup.h"
+#include "command_dispatch.h"
+#include "connection.h"
+#include "tls_client.h"
+#include "boot.h"
 
 // Networking / MQTT
-WiFiClientSecure wifiClient;
+TlsClient wifiClient;  // broker certificate not verified, demo only (tls_client.h)
 PubSubClient client(wifiClient);
 
 // Use HardwareSerial on ESP32
@@ -23,32 +32,46 @@ HardwareSerial mySerial(1);
 Adafruit_Fingerprint finger = Adafruit_Fingerprint(&mySerial);
 
 // externs from other compilation units
-extern Preferences preferences;  // declared/defined in fingerprint.cpp
 extern uint16_t enrolledCount;   // declared/defined in fingerprint.cpp
 
 // Functions in other files (prototypes)
-bool downloadTemplateById(uint16_t id, uint8_t maxRetries);
-void downloadAllTemplates(uint16_t maxTemplates, uint8_t maxRetries);
 void publishEnrolmentCount();
-void publishEnrolmentStatus(EnrolmentStatus status, String message);
+void publishEnrolmentStatus(EnrolmentStatus status, const char* message);
 void resetEnrolmentCount();
-uint8_t enrollFingerprint(uint16_t id);
-uint8_t verifyFingerprint();
 
 // -----------------------------------------------------------------------------
 // Serial admin utilities (probe, delete, CLI)
 // -----------------------------------------------------------------------------
 
-// Non-destructive probe of slots 1..capacity (prints status)
-void probeFingerprintSlots() {
-  Serial.println("== Fingerprint Diagnostic Probe ==");
-  if (finger.getTemplateCount() == FINGERPRINT_OK) {
-    Serial.print("Sensor templateCount: ");
-    Serial.println(finger.templateCount);
-  } else {
-    Serial.println("Unable to read templateCount from sensor.");
+// Non-destructive probe: refresh the occupancy index and list used slots.
+// With deep=true each occupied slot is also loaded to check it is readable;
+// that pass runs as a bulk job, one slot per step.
+static uint16_t probeCursor = 0;
+
+static bool probeDeepStep() {
+  uint16_t id = probeCursor;
+  if (id == 0) {
+    Serial.println("== Probe complete ==");
+    return false;
   }
+  uint8_t r = finger.loadModel(id);
+  if (r == FINGERPRINT_DBRANGEFAIL) {
+    Serial.printf("ID %u: CORRUPT/DBRANGEFAIL (code %u)\n", (unsigned)id, (unsigned)r);
+  } else if (r == FINGERPRINT_PACKETRECIEVEERR) {
+    Serial.printf("ID %u: PACKET RECEIVE ERR (code %u)\n", (unsigned)id, (unsigned)r);
+  } else if (r != FINGERPRINT_OK) {
+    Serial.printf("ID %u: OTHER ERROR code %u\n", (unsigned)id, (unsigned)r);
+  }
+  probeCursor = occupancyNext(id + 1);
+  return true;
+}
+
+static void probeDeepAbort() {
+  Serial.printf("== Probe stopped before ID %u ==\n", (unsigned)probeCursor);
+}
 
+bool probeFingerprintSlots(bool deep) {
+  Serial.println("== Fingerprint Diagnostic Probe ==");
   Serial.print("Capacity: ");
   Serial.println(finger.capacity);
   Serial.print("Packet length: ");
@@ -56,23 +79,36 @@ void probeFingerprintSlots() {
   Serial.print("Baud rate: ");
   Serial.println(finger.baud_rate);
 
-  Serial.println("\nProbing each slot (1..capacity). This may take a while...");
-  for (uint16_t id = 1; id <= finger.capacity; ++id) {
-    uint8_t r = finger.loadModel(id);
-    if (r == FINGERPRINT_OK) {
-      Serial.printf("ID %u: PRESENT (loadModel returned %u)\n", (unsigned)id, (unsigned)r);
-    } else if (r == FINGERPRINT_DBRANGEFAIL) {
-      Serial.printf("ID %u: CORRUPT/DBRANGEFAIL (code %u)\n", (unsigned)id, (unsigned)r);
-    } else if (r == FINGERPRINT_PACKETRECIEVEERR) {
-      Serial.printf("ID %u: PACKET RECEIVE ERR (code %u)\n", (unsigned)id, (unsigned)r);
-    } else if (r == FINGERPRINT_NOTFOUND) {
-      Serial.printf("ID %u: NOT FOUND (code %u)\n", (unsigned)id, (unsigned)r);
-    } else {
-      Serial.printf("ID %u: OTHER ERROR code %u\n", (unsigned)id, (unsigned)r);
-    }
-    delay(30);  // throttle
+  if (!occupancyRefresh()) {
+    Serial.println("Unable to read occupancy index from sensor.");
+    return false;
+  }
+  Serial.printf("Occupied slots: %u, next free ID: %u\n", (unsigned)occupancyCount(), (unsigned)occupancyNextFree(1));
+
+  // print occupied ids as compact ranges, e.g. "1-40 42 57-60"
+  uint16_t id = occupancyNext(0);
+  while (id != 0) {
+    uint16_t end = id;
+    while (occupancyIsSet(end + 1)) end++;
+    if (end == id) Serial.printf("  %u\n", (unsigned)id);
+    else Serial.printf("  %u-%u\n", (unsigned)id, (unsigned)end);
+    id = occupancyNext(end + 1);
   }
-  Serial.println("== Probe complete ==");
+
+  if (!deep) {
+    Serial.println("== Probe complete ==");
+    return false;
+  }
+  Serial.println("Loading each occupied slot...");
+  probeCursor = occupancyNext(0);
+  startBulkJob({ "probe", probeDeepStep, nullptr, probeDeepAbort });
+  return true;
+}
+
+// Lowest free slot from the occupancy index, 0 if the library is full
+uint16_t allocateTemplateId() {
+  if (!occupancyValid()) occupancyRefresh();
+  return occupancyNextFree(1);
 }
 
 // Delete a single template slot, update persisted count and publish
@@ -82,167 +118,116 @@ bool deleteTemplateId(uint16_t id) {
   uint8_t res = finger.deleteModel(id);
   if (res == FINGERPRINT_OK) {
     Serial.printf("deleteModel succeeded for ID %u\n", (unsigned)id);
+    occupancyMark(id, false);
+    hashIndexClear(id);
     if (enrolledCount > 0) {
       enrolledCount--;
-      preferences.putUInt("enrolledCount", enrolledCount);
+      storeSetCount(enrolledCount);
       publishEnrolmentCount();
     }
-    publishEnrolmentStatus(STATUS_SUCCESS, "Deleted template ID " + String(id));
+    publishEnrolmentStatusf(STATUS_SUCCESS, "Deleted template ID %u", (unsigned)id);
     return true;
   } else {
     Serial.printf("deleteModel failed (code %u) for ID %u\n", (unsigned)res, (unsigned)id);
-    publishEnrolmentStatus(STATUS_ERROR, "Failed to delete template ID " + String(id));
+    publishEnrolmentStatusf(STATUS_ERROR, "Failed to delete template ID %u", (unsigned)id);
     return false;
   }
 }
 
-// Serial command handler (type command then Enter)
-void handleSerialCommands() {
-  if (!Serial.available()) return;
-
-  // Read a line (until newline)
-  String line = Serial.readStringUntil('\n');
-  line.trim();
-  if (line.length() == 0) return;
-
-  // Split command and arg
-  String cmd = line;
-  String arg;
-  int sp = line.indexOf(' ');
-  if (sp != -1) {
-    cmd = line.substring(0, sp);
-    arg = line.substring(sp + 1);
-    arg.trim();
-  }
-  cmd.toLowerCase();
-
-  if (cmd == "help") {
-    Serial.println(F("Serial commands:"));
-    Serial.println(F("  help                 - show this"));
-    Serial.println(F("  info                 - sensor info"));
-    Serial.println(F("  count                - getTemplateCount() and persisted count"));
-    Serial.println(F("  probe | p            - probe all slots 1..capacity"));
-    Serial.println(F("  download <id>        - download & publish template for id"));
-    Serial.println(F("  download-all         - bulk download templates"));
-    Serial.println(F("  delete <id>          - delete template id"));
-    Serial.println(F("  delall confirm       - empty DB (dangerous)"));
-    Serial.println(F("  enrolled-count       - prints enrolledCount (persisted)"));
-    Serial.println(F("  enroll <id>          - run enroll flow for id (same as 'e' key)"));
-    Serial.println(F("  verify               - run verify flow (same as 'v' key)"));
-    return;
-  }
-
-  if (cmd == "info") {
-    Serial.println("=== Sensor Info ===");
-    Serial.print("Capacity: ");
-    Serial.println(finger.capacity);
-    Serial.print("TemplateCount(raw): ");
-    if (finger.getTemplateCount() == FINGERPRINT_OK) Serial.println(finger.templateCount);
-    else Serial.println("unknown");
-    Serial.print("Packet length: ");
-    Serial.println(finger.packet_len);
-    Serial.print("Baud rate: ");
-    Serial.println(finger.baud_rate);
-    return;
-  }
+// Serial command handler (type command then Enter). Reads whatever has
+// arrived into a fixed line buffer; a line that stops without a newline is
+// taken as complete after SERIAL_LINE_IDLE_MS, so the single-key shortcuts
+// (e, v, c, t, p) still work from a Serial Monitor that sends no line ending.
+#define SERIAL_LINE_IDLE_MS 1000
 
-  if (cmd == "count") {
-    if (finger.getTemplateCount() == FINGERPRINT_OK) {
-      Serial.print("Sensor reports templateCount = ");
-      Serial.println(finger.templateCount);
-    } else {
-      Serial.println("getTemplateCount() failed");
+void handleSerialCommands() {
+  static char line[COMMAND_LINE_MAX];
+  static size_t len = 0;
+  static uint32_t lastByteMs = 0;
+
+  while (Serial.available()) {
+    char c = Serial.read();
+    lastByteMs = millis();
+    if (c == '\n') {
+      line[len] = '\0';
+      len = 0;
+      dispatchCommandLine(line);
+      continue;
     }
-    Serial.print("Persisted enrolledCount = ");
-    Serial.println(enrolledCount);
-    return;
+    if (len < sizeof(line) - 1) line[len++] = c;  // overlong lines are cut, not overrun
   }
-
-  if (cmd == "probe" || cmd == "p") {
-    probeFingerprintSlots();
-    return;
+  if (len > 0 && millis() - lastByteMs >= SERIAL_LINE_IDLE_MS) {
+    line[len] = '\0';
+    len = 0;
+    dispatchCommandLine(line);
   }
+}
 
-  if (cmd == "download") {
-    if (arg.length() == 0) {
-      Serial.println("Usage: download <id>");
-      return;
-    }
-    uint16_t id = (uint16_t)arg.toInt();
-    if (id == 0) {
-      Serial.println("Invalid id 0. use 1..capacity");
-      return;
+// Runs on the sensor task when a queued request reaches the front and no
+// enroll/verify flow is active. Flows are started here and advanced by ticks;
+// bulk commands start a job that is stepped between other requests; the
+// remaining maintenance commands run to completion.
+void executeSensorCommand(const SensorCommand& cmd) {
+  switch (cmd.type) {
+    case CMD_VERIFY:
+      startVerification(cmd.id, cmd.max);  // max 0 => whole occupied range
+      break;
+
+    case CMD_ENROLL: {
+      uint16_t id = cmd.id ? cmd.id : allocateTemplateId();  // no id given: next free slot
+      if (id == 0) {
+        publishEnrolmentStatus(STATUS_ERROR, "No free template slot for enroll");
+        break;
+      }
+      Serial.printf("Fingerprint: Enroll request for user %u\n", (unsigned)id);
+      startEnrollment(id);
+      break;
     }
-    Serial.printf("Serial command: download %u\n", (unsigned)id);
-    bool ok = downloadTemplateById(id, 3);
-    Serial.printf("downloadTemplateById returned %s\n", ok ? "true" : "false");
-    return;
-  }
 
-  if (cmd == "download-all") {
-    Serial.println("Serial command: bulk download (downloadAllTemplates)");
-    downloadAllTemplates((uint16_t)finger.capacity, 3);
-    return;
-  }
+    case CMD_DOWNLOAD_TEMPLATE:
+      downloadTemplateById(cmd.id, cmd.retries);
+      break;
 
-  if (cmd == "delete") {
-    if (arg.length() == 0) {
-      Serial.println("Usage: delete <id>");
-      return;
-    }
-    uint16_t id = (uint16_t)arg.toInt();
-    if (id == 0) {
-      Serial.println("Invalid id 0. use 1..capacity");
-      return;
-    }
-    deleteTemplateId(id);
-    return;
-  }
+    case CMD_ENROLL_SESSION:
+      Serial.printf("Fingerprint: Enroll session (%u %s)\n", (unsigned)cmd.max, cmd.tag ? "listed IDs" : "voters");
+      enrollSessionStart(cmd.tag, cmd.max);
+      break;
 
-  if (cmd == "delall") {
-    if (arg == "confirm") {
-      Serial.println("Emptying fingerprint database (finger.emptyDatabase()) now.");
-      uint8_t r = finger.emptyDatabase();
-      if (r == FINGERPRINT_OK) {
-        enrolledCount = 0;
-        preferences.putUInt("enrolledCount", enrolledCount);
-        publishEnrolmentCount();
-        publishEnrolmentStatus(STATUS_SUCCESS, "Database emptied (delall confirm)");
-        Serial.println("emptyDatabase: OK. enrolledCount reset to 0.");
-      } else {
-        Serial.printf("emptyDatabase failed with code %u\n", (unsigned)r);
-        publishEnrolmentStatus(STATUS_ERROR, "emptyDatabase failed");
+    case CMD_DOWNLOAD_ALL:
+      if (bulkDownloadBegin(cmd.max, cmd.retries)) {
+        startBulkJob({ "bulk download", bulkDownloadStep, bulkDownloadPause, bulkDownloadAbort });
       }
-    } else {
-      Serial.println("This is dangerous. To proceed type: delall confirm");
-    }
-    return;
-  }
+      break;
 
-  if (cmd == "enrolled-count") {
-    Serial.printf("Persisted enrolledCount = %u\n", (unsigned)enrolledCount);
-    return;
-  }
+    case CMD_PROBE:
+      probeFingerprintSlots(cmd.all);
+      break;
 
-  if (cmd == "enroll") {
-    if (arg.length() == 0) {
-      Serial.println("Usage: enroll <id>");
-      return;
-    }
-    uint16_t id = (uint16_t)arg.toInt();
-    Serial.printf("Serial: enrolling id %u\n", (unsigned)id);
-    enrollFingerprint(id);
-    return;
-  }
+    case CMD_BACKUP:
+      if (backupBegin(cmd.id)) startBulkJob({ "backup", backupStep, nullptr, backupAbort });
+      break;
 
-  if (cmd == "verify") {
-    verifyFingerprint();
-    return;
-  }
+    case CMD_RESTORE:
+      restoreBegin(cmd.tag);
+      startBulkJob({ "restore", restoreStep, nullptr, restoreAbort });
+      break;
+
+    case CMD_RESET_ENROLLMENTS:
+      resetEnrolmentCount();
+      break;
 
-  Serial.print("Unknown command: '");
-  Serial.print(cmd);
-  Serial.println("'. Type 'help' for options.");
+    case CMD_SYNC:
+      hashIndexSync(cmd.id);
+      break;
+
+    case CMD_END_SESSION:
+      enrollSessionStop();
+      break;
+
+    case CMD_CANCEL:
+      cancelSensorWork(cmd.all);
+      break;
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -251,125 +236,52 @@ void handleSerialCommands() {
 
 void setup() {
   Serial.begin(115200);
-  while (!Serial)
-    ;  // For Leonardo/Micro/Zero compatibility (harmless elsewhere)
 
-  // Start serial for sensor
-  mySerial.begin(57600, SERIAL_8N1, 16, 17);
+  // Start serial for sensor (RX buffer sized to hold a whole template transfer)
+  mySerial.setRxBufferSize(1024);
+  mySerial.begin(SENSOR_LINK_DEFAULT_BAUD, SERIAL_8N1, 16, 17);
 
-  // WiFi connect
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
-  Serial.println();
-  Serial.println("WiFi connected.");
+  // Client ID and topics carry the station ID
+  stationIdBegin();
+
+  // WiFi + MQTT come up in the background on the network task
+  connectionBegin();
 
   // MQTT
-  wifiClient.setInsecure();  // demo only
   client.setServer(MQTT_SERVER, MQTT_PORT);
   client.setBufferSize(2048);  // attempt to set runtime buffer as well
   Serial.printf("PubSubClient buffer size: %u\n", client.getBufferSize());
 
   client.setCallback(mqttCallback);
 
-  // Fingerprint persistence
-  preferences.begin("fingerprint", false);
-  enrolledCount = preferences.getUInt("enrolledCount", 0);
-  Serial.print("Loaded enrolledCount: ");
-  Serial.println(enrolledCount);
-
-  // Fingerprint sensor init + initial probe
-  finger.begin(57600);
-  if (finger.verifyPassword()) {
-    Serial.println("Found fingerprint sensor!");
-    // run the probe once on startup so you immediately see slot status
-    probeFingerprintSlots();
-  } else {
-    Serial.println("Fingerprint sensor not found :(");
-    while (1) { delay(1); }  // block if sensor isn't present
-  }
+  // Station state loads on its own task while the sensor task brings up the
+  // sensor and the network task connects (boot.h)
+  bootBegin();
+
+  // Sensor work on one core, MQTT/TLS on the other
+  startStationTasks();
 }
 
 void loop() {
-  // Maintain MQTT connection
-  if (!client.connected()) reconnect();
-  client.loop();
-
-  // Serial admin CLI (line-based). Also allows quick keys below
-  handleSerialCommands();
-
-  // Legacy single character shortcuts (still useful from Serial Monitor without newline)
-  if (Serial.available()) {
-    // peek instead of read to avoid consuming a line in the CLI
-    int c = Serial.peek();
-    if (c != -1 && c != '\n' && c != '\r') {
-      // If user typed a single key and hit enter, the CLI above would have consumed it.
-      // These single-letter shortcuts are kept for quick manual tests:
-      char ch = Serial.read();
-      if (ch == 'e') enrollFingerprint(enrolledCount);
-      else if (ch == 'v') verifyFingerprint();
-      else if (ch == 't') downloadAllTemplates(20, 3);
-      // If it was part of a longer line, handleSerialCommands already processed it.
-    }
-  }
+  // All work happens in the sensor and network tasks started by setup()
+  vTaskDelete(NULL);
 }
 
 // --- MQTT Callback ---
+// payload is PubSubClient's receive buffer; the dispatcher parses it in place,
+// never writes past length and publishes nothing before it is done with it.
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  // ensure safe C-string null termination
-  if (length >= 1) {
-    payload[length] = '\0';
-  } else {
-    payload[length] = '\0';
-  }
-  String msg = String((char*)payload);
-
-  Serial.printf("MQTT Message on [%s]: %s\n", topic, msg.c_str());
-
-  // Handle fingerprint commands
-  if (strcmp(topic, TOPIC_FP_COMMAND) == 0) {
-    DynamicJsonDocument doc(512);
-    DeserializationError err = deserializeJson(doc, msg);
-    if (err) {
-      Serial.println("Failed to parse fingerprint command JSON");
-      return;
-    }
+  // In pieces: Print::printf allocates for anything over 63 characters
+  Serial.print("MQTT Message on [");
+  Serial.print(topic);
+  Serial.print("]: ");
+  Serial.write(payload, length);
+  Serial.println();
 
-    String action = doc["action"] | "";
-    uint16_t userId = doc["userId"] | 0;
-
-    if (action == "verify") {
-      Serial.println("Fingerprint: Verify request");
-      verifyFingerprint();
-    } else if (action == "enroll") {
-      if (userId == 0) {
-        publishEnrolmentStatus(STATUS_ERROR, "Invalid userId for enroll");
-      } else {
-        Serial.printf("Fingerprint: Enroll request for user %d\n", userId);
-        enrollFingerprint(userId);
-      }
-    } else if (action == "download-templates") {
-      uint16_t maxT = doc["max"] | 20;
-      uint8_t retries = doc["retries"] | 3;
-      downloadAllTemplates(maxT, retries);
-    } else if (action == "download-template") {
-      if (userId == 0) {
-        publishEnrolmentStatus(STATUS_ERROR, "Invalid userId for download-template");
-      } else {
-        Serial.printf("Fingerprint: Download template request for ID %d\n", userId);
-        downloadTemplateById(userId, 3);
-      }
-    } else if (action == "enrolled-count") {
-      Serial.println("Fingerprint: Get Enrollment Count");
-      publishEnrolmentCount();
-    } else if (action == "reset-enrollments") {
-      Serial.println("Resetting all enrollments...");
-      resetEnrolmentCount();
-      publishEnrolmentCount();
-    } else {
-      Serial.printf("Unknown fingerprint action: %s\n", action.c_str());
-    }
+  // Own command topic, fleet broadcast, or one message from the shared work queue
+  if (strcmp(topic, stationTopic(TOPIC_FP_COMMAND)) == 0 || strcmp(topic, STATION_BROADCAST_TOPIC) == 0) {
+    dispatchJsonCommand((char*)payload, length);
+  } else if (strcmp(topic, STATION_WORK_TOPIC) == 0) {
+    dispatchJsonCommand((char*)payload, length, true);
   }
 }
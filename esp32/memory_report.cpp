@@ -0,0 +1,45 @@
+// memory_report.cpp
+#include <PubSubClient.h>
+#include "memory_report.h"
+#include "messaging.h"
+#include "station_tasks.h"
+#include "soak.h"
+
+extern PubSubClient client;
+
+MemorySnapshot memorySnapshot() {
+  MemorySnapshot m = {};
+  m.pool = poolStats();
+  for (uint8_t i = 0; i < POOL_BLOCKS; ++i) m.poolByOwner[poolOwner(i)]++;
+  m.heapSize = ESP.getHeapSize();
+  m.heapFree = ESP.getFreeHeap();
+  m.heapMinFree = ESP.getMinFreeHeap();
+  m.heapLargest = ESP.getMaxAllocHeap();
+  m.sensorStackFree = sensorTaskStackFree();
+  m.networkStackFree = networkTaskStackFree();
+  m.messagingBuffers = messagingBufferBytes();
+  m.mqttBuffer = client.getBufferSize();
+  return m;
+}
+
+void memoryPrint() {
+  MemorySnapshot m = memorySnapshot();
+  Serial.printf("Pool: %u/%u blocks of %u bytes in use, peak %u, %lu acquired, %lu failed\n", (unsigned)m.pool.inUse,
+                (unsigned)POOL_BLOCKS, (unsigned)POOL_BLOCK_SIZE, (unsigned)m.pool.peak, (unsigned long)m.pool.acquired,
+                (unsigned long)m.pool.failures);
+  for (uint8_t o = POOL_FREE + 1; o < POOL_OWNER_COUNT; ++o) {
+    if (m.poolByOwner[o]) Serial.printf("  %-9s %u\n", poolOwnerName((PoolOwner)o), (unsigned)m.poolByOwner[o]);
+  }
+  Serial.printf("Heap: %lu free of %lu, lowest %lu (peak use %lu), largest block %lu\n", (unsigned long)m.heapFree,
+                (unsigned long)m.heapSize, (unsigned long)m.heapMinFree, (unsigned long)(m.heapSize - m.heapMinFree),
+                (unsigned long)m.heapLargest);
+  HeapTrend t = heapTrend();
+  if (t.samples >= HEAP_DRIFT_MIN_SAMPLES) {
+    Serial.printf("Heap trend: %ld bytes/h over %u min, %u%% fragmented%s\n", (long)t.slopePerHour,
+                  (unsigned)t.samples, (unsigned)t.fragmentedPct, t.drifting ? " (DRIFTING)" : "");
+  }
+  Serial.printf("Stack headroom: sensor %lu bytes, network %lu bytes\n", (unsigned long)m.sensorStackFree,
+                (unsigned long)m.networkStackFree);
+  Serial.printf("Static: pool %u bytes, messaging buffers %lu bytes; MQTT buffer %u bytes (heap)\n",
+                (unsigned)(POOL_BLOCKS * POOL_BLOCK_SIZE), (unsigned long)m.messagingBuffers, (unsigned)m.mqttBuffer);
+}
@@ -0,0 +1,27 @@
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#include <Arduino.h>
+#include "buffer_pool.h"
+
+// The RAM budget at a glance: buffer pool use, heap (with its trend, soak.h)
+// and task stack headroom.
+// `mem` on the serial CLI prints it; {"action":"mem"} publishes it on the
+// health topic as {"status":"mem",...}.
+struct MemorySnapshot {
+  PoolStats pool;
+  uint8_t poolByOwner[POOL_OWNER_COUNT];  // blocks out per owner
+  uint32_t heapSize;
+  uint32_t heapFree;
+  uint32_t heapMinFree;                   // low-water mark since boot: heapSize - heapMinFree is the peak use
+  uint32_t heapLargest;                   // largest block malloc can hand out now
+  uint32_t sensorStackFree;               // high-water marks, bytes
+  uint32_t networkStackFree;
+  uint32_t messagingBuffers;              // network-task serialization buffers (static)
+  uint16_t mqttBuffer;                    // PubSubClient packet buffer (heap)
+};
+
+MemorySnapshot memorySnapshot();  // any task; counters are approximate
+void memoryPrint();
+
+#endif
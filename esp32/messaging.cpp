@@ -1,14 +1,138 @@
 #define MQTT_MAX_PACKET_SIZE 2048  // or 1500 — big enough for your base64 template + JSON
 #include <PubSubClient.h>
-#include "secrets.h"
 #include "messaging.h"
 #include <mbedtls/sha256.h>  // Arduino HexHash helper
-#include <ArduinoJson.h>
+#include <stdarg.h>
+#include "spsc_queue.h"
+#include "station_tasks.h"
+#include "json_writer.h"
+#include "alloc_counter.h"
+#include "latency.h"
+#include "backup.h"
+#include "text_codec.h"
+#include "boot.h"
+#include "memory_report.h"
+#include "soak.h"
+#include "request_tag.h"
 
 // Reference MQTT client defined in .ino
 extern PubSubClient client;
 
-String statusToString(EnrolmentStatus status) {
+// Publishes requested from the sensor task are queued as events and sent by the
+// network task in messagingDrainEvents(); only the network task touches `client`.
+// Both paths end in the outbound queue further down.
+enum NetEventType : uint8_t {
+  EVT_STATUS,
+  EVT_RESULT,
+  EVT_COUNT,
+  EVT_TEMPLATE_HASH,
+  EVT_BATCH_BEGIN,
+  EVT_BATCH_ADD,
+  EVT_BATCH_FLUSH,
+  EVT_SYNC_BEGIN,
+  EVT_SYNC_ADD,
+  EVT_SYNC_END,
+  EVT_BACKUP_CHUNK,  // id = chunk buffer (see backup.h)
+  EVT_RESTORE_ACK,
+  EVT_MEMORY_REPORT
+};
+
+struct NetEvent {
+  NetEventType type;
+  uint8_t status;  // EnrolmentStatus
+  bool success;    // EVT_SYNC_BEGIN: slot listing
+  bool truncated;  // EVT_BATCH_FLUSH, EVT_SYNC_END: entries were lost, send the marker instead
+  uint16_t id;
+  uint16_t count;
+  uint16_t aux;    // EVT_RESTORE_ACK: failed templates
+  uint8_t hash[32];
+  char message[128];
+  RequestTag request;  // the calling task's current request when posted
+  uint32_t postedMs;
+};
+
+// Template batches and sync replies are framed: entries between a begin and
+// the flush or end that closes the message
+enum FrameKind : uint8_t { FRAME_NONE, FRAME_BATCH, FRAME_SYNC, FRAME_KINDS };
+
+static FrameKind frameOf(NetEventType type) {
+  switch (type) {
+    case EVT_BATCH_BEGIN:
+    case EVT_BATCH_ADD:
+    case EVT_BATCH_FLUSH: return FRAME_BATCH;
+    case EVT_SYNC_BEGIN:
+    case EVT_SYNC_ADD:
+    case EVT_SYNC_END: return FRAME_SYNC;
+    default: return FRAME_NONE;
+  }
+}
+
+static bool eventIsEntry(NetEventType type) {
+  return type == EVT_BATCH_ADD || type == EVT_SYNC_ADD;
+}
+
+static bool eventClosesFrame(NetEventType type) {
+  return type == EVT_BATCH_FLUSH || type == EVT_SYNC_END;
+}
+
+static SpscQueue<NetEvent, 32> eventQueue;
+static uint32_t eventDrops = 0;  // written by the sensor task only
+
+// Sensor task only, per FrameKind: the message being posted lost an event on
+// the way to eventQueue. After a lost entry the rest are dropped and the close
+// asks for the marker; after a lost begin nothing of the message is posted.
+enum FramePost : uint8_t { POST_OK, POST_TRUNCATED, POST_LOST };
+static FramePost framePost[FRAME_KINDS];
+
+#define SYNC_REPLY_EVENTS (SYNC_REPLY_MAX_ENTRIES + 2)
+static_assert(SYNC_REPLY_EVENTS <= decltype(eventQueue)::capacity(), "a sync reply fits eventQueue");
+
+// False if ev is not posted because its message is already broken
+static bool framePostAdmit(NetEvent& ev, FrameKind kind) {
+  if (eventIsEntry(ev.type)) return framePost[kind] == POST_OK;
+  if (eventClosesFrame(ev.type)) {
+    FramePost state = framePost[kind];
+    framePost[kind] = POST_OK;
+    ev.truncated = state == POST_TRUNCATED;
+    return state != POST_LOST;
+  }
+  framePost[kind] = POST_OK;
+  return true;
+}
+
+static void outboxPush(const NetEvent& ev);
+static void outboxFlush();
+static uint8_t outboxHolds = 0;  // OutboxHold nesting, network task only
+
+// On the network task the event goes straight into the outbox and out, unless
+// an OutboxHold keeps it there; anywhere else it is handed over through eventQueue.
+static void postEvent(NetEvent& ev, NetEventType type, const char* message = nullptr) {
+  ev.type = type;
+  ev.request = currentRequest();
+  ev.postedMs = millis();
+  ev.message[0] = '\0';
+  if (message) strlcpy(ev.message, message, sizeof(ev.message));
+  if (onNetworkTask()) {
+    outboxPush(ev);
+    if (!outboxHolds) outboxFlush();
+    return;
+  }
+  FrameKind kind = frameOf(type);
+  if (kind != FRAME_NONE && !framePostAdmit(ev, kind)) {
+    eventDrops++;
+    return;
+  }
+  if (!eventQueue.push(ev)) {
+    eventDrops++;  // never block the sensor; the network side reports drops
+    if (type == EVT_BACKUP_CHUNK) backupChunkReleased(ev.id);
+    if (eventIsEntry(type)) framePost[kind] = POST_TRUNCATED;
+    else if (!eventClosesFrame(type) && kind != FRAME_NONE) framePost[kind] = POST_LOST;
+    return;
+  }
+  notifyNetworkTask();
+}
+
+const char* statusToString(EnrolmentStatus status) {
   switch (status) {
     case STATUS_PLACE_FINGER: return "place_finger";
     case STATUS_IMAGE_TAKEN: return "image_taken";
@@ -20,86 +144,1051 @@ String statusToString(EnrolmentStatus status) {
     case STATUS_DOWNLOADING_TEMPLATE: return "downloading_template";
     case STATUS_SUCCESS: return "success";
     case STATUS_ERROR: return "error";
+    case STATUS_WAITING_FOR_FINGER: return "waiting_for_finger";
+    case STATUS_CANCELLED: return "cancelled";
+    case STATUS_TIMEOUT: return "timeout";
+    case STATUS_BUSY: return "busy";
+    case STATUS_STARTED: return "started";
+    case STATUS_PROGRESS: return "progress";
     default: return "unknown";
   }
 }
 
-void publishEnrolmentStatus(EnrolmentStatus status, String message) {
-  String payload = "{\"status\":\"" + statusToString(status) + "\",\"message\":\"" + message + "\"}";
-  client.publish(TOPIC_FP_STATUS, payload.c_str());
-  Serial.println("MQTT Published (status): " + payload);
+// --- Network-task senders ---
+// Every message is serialized into txBuf (network task only), as JSON with
+// JsonWriter or in the compact binary layout, and logged with print/write, so
+// the publish path makes no heap allocations.
+
+static char txBuf[1024];  // heartbeat with every latency metric is the largest
+static uint32_t publishCount = 0;
+static uint32_t publishAllocations = 0;
+static WireFormat wireFormat = WIRE_JSON;
+static WireStats wireStats[2];
+
+// Counts allocations made by this layer while building and logging a message.
+// The socket write itself is excluded: lwIP/TLS buffers are the stack's business.
+struct PublishAllocScope {
+  uint32_t start = allocCount();
+  ~PublishAllocScope() {
+    publishAllocations += allocCount() - start;
+  }
+};
+
+// Allocations plus time spent encoding, charged to the active wire format
+struct EncodeScope : PublishAllocScope {
+  uint32_t startUs = micros();
+  ~EncodeScope() {
+    wireStats[wireFormat].encodeMicros += micros() - startUs;
+  }
+};
+
+static bool publishPayload(const char* topic, const uint8_t* payload, size_t len) {
+  publishCount++;
+  wireStats[wireFormat].messages++;
+  wireStats[wireFormat].bytes += len;
+  LatencyScope scope(LAT_PUBLISH);
+  return client.publish(topic, payload, len);
+}
+
+static void logPublished(const char* label, const JsonWriter& w) {
+  Serial.print("MQTT Published (");
+  Serial.print(label);
+  Serial.print("): ");
+  Serial.write((const uint8_t*)w.c_str(), w.length());
+  Serial.println();
 }
 
-void publishResult(uint16_t id, bool success, const String& message) {
-  String payload = "{\"id\":" + String(id) + ",\"success\":" + String(success ? "true" : "false") + ",\"message\":\"" + message + "\"}";
-  client.publish(TOPIC_FP_RESULT, payload.c_str());
-  Serial.println("MQTT Published (result): " + payload);
+static bool publishWriter(const char* topic, const char* label, const JsonWriter& w) {
+  if (!w.ok()) {
+    Serial.printf("MQTT message for %s truncated, not sent\n", topic);
+    return false;
+  }
+  {
+    PublishAllocScope scope;
+    logPublished(label, w);
+  }
+  return publishPayload(topic, (const uint8_t*)w.c_str(), w.length());
 }
 
+// --- Compact binary layout (see WireMessageType in messaging.h) ---
+struct BinWriter {
+  uint8_t* buf;
+  size_t cap;
+  size_t len;
+  bool ok;
 
-void publishTemplate(uint16_t id, const uint8_t* buffer, size_t length) {
-  // Hash the raw template bytes (no encode->decode nonsense)
-  String hash = hashTemplate(buffer, length);
+  BinWriter(void* b, size_t c) : buf((uint8_t*)b), cap(c), len(0), ok(true) {}
+  void u8(uint8_t v) {
+    if (len < cap) buf[len++] = v;
+    else ok = false;
+  }
+  void u16(uint16_t v) {
+    u8(v >> 8);
+    u8(v & 0xFF);
+  }
+  void u32(uint32_t v) {
+    u16(v >> 16);
+    u16(v & 0xFFFF);
+  }
+  void bytes(const uint8_t* p, size_t n) {
+    if (n > cap - len) {
+      ok = false;
+      return;
+    }
+    memcpy(buf + len, p, n);
+    len += n;
+  }
+  void text(const char* s) {  // u8 length + bytes, no terminator
+    size_t n = s ? strnlen(s, 255) : 0;
+    u8((uint8_t)n);
+    bytes((const uint8_t*)s, n);
+  }
+  void header(WireMessageType type) {
+    u8(WIRE_BINARY_MAGIC);
+    u8(type);
+  }
+};
 
-  // Build JSON: { "id": <id>, "template": "<hex-hash>" }
-  StaticJsonDocument<256> doc;
-  doc["id"] = id;
-  doc["template"] = hash;
+static bool publishBinary(const char* topic, const char* label, const BinWriter& b) {
+  if (!b.ok) {
+    Serial.printf("MQTT message for %s truncated, not sent\n", topic);
+    return false;
+  }
+  {
+    PublishAllocScope scope;
+    Serial.print("MQTT Published (");
+    Serial.print(label);
+    Serial.print(", binary): ");
+    Serial.print((unsigned)b.len);
+    Serial.println(" bytes");
+  }
+  return publishPayload(topic, b.buf, b.len);
+}
 
-  char out[512];
-  size_t outLen = serializeJson(doc, out, sizeof(out));
+// rid, waitMs and execMs of the request an event answers (request_tag.h);
+// nothing for an event that answers none
+static const NetEvent NO_REQUEST = {};
 
-  bool ok = client.publish(TOPIC_FP_TEMPLATES, out, outLen);
-  Serial.printf("publish template (hash only) id=%u len=%u -> ok=%d client_state=%d\n",
-                id, (unsigned)outLen, ok, client.state());
+static void writeRequest(JsonWriter& w, const NetEvent& ev) {
+  const RequestTag& r = ev.request;
+  if (!r.receivedMs) return;
+  if (r.rid) w.num("rid", r.rid);
+  w.num("waitMs", r.startedMs - r.receivedMs).num("execMs", ev.postedMs - r.startedMs);
+}
 
-  if (!ok) {
-    publishEnrolmentStatus(STATUS_ERROR, "Template-hash publish failed");
+static void writeRequest(BinWriter& b, const NetEvent& ev) {
+  const RequestTag& r = ev.request;
+  if (!r.receivedMs) return;
+  b.u32(r.rid);
+  b.u32(r.startedMs - r.receivedMs);
+  b.u32(ev.postedMs - r.startedMs);
+}
+
+static bool sendStatus(EnrolmentStatus status, const char* message, const NetEvent& origin = NO_REQUEST) {
+  if (wireFormat == WIRE_BINARY) {
+    BinWriter b(txBuf, sizeof(txBuf));
+    {
+      EncodeScope scope;
+      b.header(WIRE_MSG_STATUS);
+      b.u8(status);
+      b.text(message);
+      writeRequest(b, origin);
+    }
+    return publishBinary(stationTopic(TOPIC_FP_STATUS), "status", b);
+  }
+  JsonWriter w(txBuf, sizeof(txBuf));
+  {
+    EncodeScope scope;
+    w.beginObject().str("status", statusToString(status)).str("message", message);
+    writeRequest(w, origin);
+    w.endObject();
+  }
+  return publishWriter(stationTopic(TOPIC_FP_STATUS), "status", w);
+}
+
+static bool sendResult(const NetEvent& ev) {
+  if (wireFormat == WIRE_BINARY) {
+    BinWriter b(txBuf, sizeof(txBuf));
+    {
+      EncodeScope scope;
+      b.header(WIRE_MSG_RESULT);
+      b.u16(ev.id);
+      b.u8(ev.success);
+      b.text(ev.message);
+      writeRequest(b, ev);
+    }
+    return publishBinary(stationTopic(TOPIC_FP_RESULT), "result", b);
+  }
+  JsonWriter w(txBuf, sizeof(txBuf));
+  {
+    EncodeScope scope;
+    w.beginObject().num("id", ev.id).boolean("success", ev.success).str("message", ev.message);
+    writeRequest(w, ev);
+    w.endObject();
+  }
+  return publishWriter(stationTopic(TOPIC_FP_RESULT), "result", w);
+}
+
+static bool sendCount(uint16_t count) {
+  if (wireFormat == WIRE_BINARY) {
+    BinWriter b(txBuf, sizeof(txBuf));
+    {
+      EncodeScope scope;
+      b.header(WIRE_MSG_COUNT);
+      b.u16(count);
+    }
+    return publishBinary(stationTopic(TOPIC_FP_COUNT), "enrolledCount", b);
+  }
+  JsonWriter w(txBuf, sizeof(txBuf));
+  {
+    EncodeScope scope;
+    w.beginObject().num("enrolledCount", count).endObject();
+  }
+  return publishWriter(stationTopic(TOPIC_FP_COUNT), "enrolledCount", w);
+}
+
+static bool sendTemplateHash(const NetEvent& ev) {
+  bool ok;
+  if (wireFormat == WIRE_BINARY) {
+    BinWriter b(txBuf, sizeof(txBuf));
+    {
+      EncodeScope scope;
+      b.header(WIRE_MSG_TEMPLATE);
+      b.u16(ev.id);
+      b.bytes(ev.hash, 32);
+      writeRequest(b, ev);
+    }
+    ok = publishBinary(stationTopic(TOPIC_FP_TEMPLATES), "template hash", b);
   } else {
-    Serial.printf("MQTT Published (template hash): %s\n", out);
+    // Build JSON: { "id": <id>, "template": "<hex-hash>" }
+    JsonWriter w(txBuf, sizeof(txBuf));
+    {
+      EncodeScope scope;
+      w.beginObject().num("id", ev.id).hex("template", ev.hash, 32);
+      writeRequest(w, ev);
+      w.endObject();
+    }
+    ok = publishWriter(stationTopic(TOPIC_FP_TEMPLATES), "template hash", w);
+  }
+  if (!ok && client.connected()) {
+    Serial.printf("publish template (hash only) id=%u failed, client_state=%d\n", (unsigned)ev.id, client.state());
+    sendStatus(STATUS_ERROR, "Template-hash publish failed", ev);
+  }
+  return ok;
+}
+
+// --- Batched template hashes ---
+// JSON: {"rid":..,"templates":[{"id":..,"template":"<hex>"},..]}
+// binary: header, u16 entry count, then per entry u16 id + 32 hash bytes, then
+// u32 rid if the job was started with one
+static char batchBuf[MQTT_MAX_PACKET_SIZE];
+static JsonWriter batch(batchBuf, sizeof(batchBuf));
+static BinWriter batchBin(batchBuf, sizeof(batchBuf));
+static WireFormat batchFormat = WIRE_JSON;  // fixed for the lifetime of one message
+static uint16_t batchEntries = 0;
+static uint32_t batchMessages = 0;
+static bool batchSealed = false;  // closed, waiting for the broker to come back
+static uint32_t batchRid = 0;     // of the bulk job or session, for every message of the batch
+
+// Largest payload PubSubClient can send on a topic: buffer minus fixed header
+// (up to 5 bytes), topic length prefix and the topic itself.
+static size_t maxPayloadFor(const char* topic) {
+  size_t limit = client.getBufferSize();
+  if (limit > sizeof(batchBuf)) limit = sizeof(batchBuf);
+  size_t overhead = 5 + 2 + strlen(topic);
+  return limit > overhead ? limit - overhead : 0;
+}
+
+static bool batchFlush();
+
+static bool batchBegin(uint32_t rid) {
+  if (batchSealed && !batchFlush()) return false;
+  batchEntries = 0;
+  batchMessages = 0;
+  batchRid = rid;
+  return true;
+}
+
+static void batchOpen() {
+  size_t limit = maxPayloadFor(stationTopic(TOPIC_FP_TEMPLATES));
+  batchFormat = wireFormat;
+  if (batchFormat == WIRE_BINARY) {
+    batchBin = BinWriter(batchBuf, limit);
+    batchBin.header(WIRE_MSG_TEMPLATE_BATCH);
+    batchBin.u16(0);  // entry count, patched in batchFlush()
+    return;
+  }
+  batch = JsonWriter(batchBuf, min(sizeof(batchBuf), limit + 1));
+  batch.beginObject();
+  if (batchRid) batch.num("rid", batchRid);
+  batch.beginArray("templates");
+}
+
+// False only when the message could not go out because the link is down; it
+// stays sealed in batchBuf and the next call publishes it unchanged.
+static bool batchFlush() {
+  if (batchEntries == 0) return true;
+  if (!batchSealed) {
+    if (batchFormat == WIRE_BINARY) {
+      batchBin.buf[2] = batchEntries >> 8;
+      batchBin.buf[3] = batchEntries & 0xFF;
+      if (batchRid) batchBin.u32(batchRid);
+    } else {
+      batch.endArray().endObject();
+    }
+    batchSealed = true;
+  }
+  bool ok;
+  size_t len;
+  if (batchFormat == WIRE_BINARY) {
+    len = batchBin.len;
+    ok = batchBin.ok && publishPayload(stationTopic(TOPIC_FP_TEMPLATES), batchBin.buf, len);
+  } else {
+    len = batch.length();
+    ok = batch.ok() && publishPayload(stationTopic(TOPIC_FP_TEMPLATES), (const uint8_t*)batch.c_str(), len);
+  }
+  if (!ok && !client.connected()) return false;
+  Serial.printf("publish template batch #%lu: %u entries, %u bytes -> ok=%d\n", (unsigned long)batchMessages + 1,
+                (unsigned)batchEntries, (unsigned)len, ok);
+  if (!ok) sendStatus(STATUS_ERROR, "Template-hash batch publish failed");
+  batchMessages++;
+  batchEntries = 0;
+  batchSealed = false;
+  return true;
+}
+
+// The outbox lost entries of the open message (see outboxPush()): a sealed
+// message was complete and still goes out, the open entries are dropped and a
+// marker tells the backend this job's listing is short. False while the link
+// is down, as batchFlush().
+static bool batchTruncated() {
+  if (batchSealed && !batchFlush()) return false;
+  batchEntries = 0;
+  if (wireFormat == WIRE_BINARY) {
+    BinWriter b(txBuf, sizeof(txBuf));
+    {
+      EncodeScope scope;
+      b.header(WIRE_MSG_TEMPLATE_BATCH);
+      b.u16(WIRE_BATCH_TRUNCATED);
+      if (batchRid) b.u32(batchRid);
+    }
+    return publishBinary(stationTopic(TOPIC_FP_TEMPLATES), "template batch truncated", b) || client.connected();
+  }
+  JsonWriter w(txBuf, sizeof(txBuf));
+  {
+    EncodeScope scope;
+    w.beginObject();
+    if (batchRid) w.num("rid", batchRid);
+    w.boolean("truncated", true).beginArray("templates").endArray().endObject();
+  }
+  return publishWriter(stationTopic(TOPIC_FP_TEMPLATES), "template batch truncated", w) || client.connected();
+}
+
+// Append one entry to the open message; false if it did not fit.
+static bool batchAppend(uint16_t id, const uint8_t hash[32]) {
+  EncodeScope scope;
+  if (batchFormat == WIRE_BINARY) {
+    if (batchBin.cap - batchBin.len < 2 + 32 + (batchRid ? 4 : 0)) return false;  // keep room for the rid
+    batchBin.u16(id);
+    batchBin.bytes(hash, 32);
+    return true;
+  }
+  // keep room for the closing "]}"
+  size_t mark = batch.mark();
+  bool comma = batch.needsComma();
+  batch.beginObject().num("id", id).hex("template", hash, 32).endObject();
+  if (batch.ok() && batch.remaining() >= 2) return true;
+  batch.rewind(mark, comma);
+  return false;
+}
+
+// False when the entry has to wait for the link (see batchFlush()).
+static bool batchAdd(uint16_t id, const uint8_t hash[32]) {
+  if (batchSealed && !batchFlush()) return false;
+  // never mix encodings inside one batch message
+  if (batchEntries > 0 && batchFormat != wireFormat && !batchFlush()) return false;
+  if (batchEntries == 0) batchOpen();
+  if (!batchAppend(id, hash)) {
+    // send what we have and start a new message with this entry
+    if (batchEntries == 0) {
+      Serial.printf("template batch: entry for ID %u does not fit the MQTT buffer\n", (unsigned)id);
+      return true;
+    }
+    if (!batchFlush()) return false;
+    batchOpen();
+    if (!batchAppend(id, hash)) return true;
+  }
+  batchEntries++;
+  return true;
+}
+
+// --- Hash-index sync replies ---
+// Built entry by entry like a batch; at most 16 entries, always one message.
+static char syncBuf[1600];
+static JsonWriter syncJson(syncBuf, sizeof(syncBuf));
+static BinWriter syncBin(syncBuf, sizeof(syncBuf));
+static WireFormat syncFormat = WIRE_JSON;
+static uint16_t syncNode = 0;
+static bool syncSlots = false;
+static uint8_t syncEntries = 0;
+static bool syncOpen = false;  // between a begin and the end that publishes it
+static bool syncSealed = false;
+
+static bool syncBegin(uint16_t node, const uint8_t hash[32], bool slots, uint16_t unknown) {
+  EncodeScope scope;
+  syncFormat = wireFormat;
+  syncNode = node;
+  syncSlots = slots;
+  syncEntries = 0;
+  syncOpen = true;
+  syncSealed = false;
+  if (syncFormat == WIRE_BINARY) {
+    syncBin = BinWriter(syncBuf, sizeof(syncBuf));
+    syncBin.header(WIRE_MSG_SYNC);
+    syncBin.u16(node);
+    syncBin.bytes(hash, 32);
+    syncBin.u8(slots);
+    syncBin.u16(unknown);
+    syncBin.u8(0);  // entry count, patched in syncEnd()
+    return true;
+  }
+  syncJson = JsonWriter(syncBuf, sizeof(syncBuf));
+  syncJson.beginObject().num("node", node).hex("hash", hash, 32).num("unknown", unknown);
+  syncJson.beginArray(slots ? "slots" : "nodes");
+  return true;
+}
+
+// An entry with no open reply (its begin was lost) is ignored
+static bool syncAdd(uint16_t id, const uint8_t hash[32]) {
+  if (!syncOpen || syncSealed) return true;
+  EncodeScope scope;
+  if (syncFormat == WIRE_BINARY) {
+    syncBin.u16(id);
+    syncBin.bytes(hash, 32);
+  } else {
+    syncJson.beginObject().num("id", id).hex("hash", hash, 32).endObject();
+  }
+  syncEntries++;
+  return true;
+}
+
+// False while the link is down; the sealed reply is resent unchanged. A
+// truncated reply (entries lost in the outbox) is replaced by the marker. An
+// end with no open reply is ignored.
+static bool syncEnd(bool truncated) {
+  if (!syncOpen) return true;
+  if (!syncSealed) {
+    EncodeScope scope;
+    if (truncated && syncFormat == WIRE_BINARY) {
+      static const uint8_t NO_HASH[32] = { 0 };
+      syncBin = BinWriter(syncBuf, sizeof(syncBuf));
+      syncBin.header(WIRE_MSG_SYNC);
+      syncBin.u16(syncNode);
+      syncBin.bytes(NO_HASH, sizeof(NO_HASH));
+      syncBin.u8(syncSlots);
+      syncBin.u16(0);
+      syncBin.u8(WIRE_SYNC_TRUNCATED);
+    } else if (truncated) {
+      syncJson = JsonWriter(syncBuf, sizeof(syncBuf));
+      syncJson.beginObject().num("node", syncNode).boolean("truncated", true).endObject();
+    } else if (syncFormat == WIRE_BINARY) {
+      syncBin.buf[2 + 2 + 32 + 1 + 2] = syncEntries;
+    } else {
+      syncJson.endArray().endObject();
+    }
+    syncSealed = true;
+  }
+  bool ok = syncFormat == WIRE_BINARY ? publishBinary(stationTopic(TOPIC_FP_SYNC), "sync", syncBin)
+                                      : publishWriter(stationTopic(TOPIC_FP_SYNC), "sync", syncJson);
+  if (!ok && !client.connected()) return false;
+  syncOpen = false;
+  syncSealed = false;
+  syncEntries = 0;
+  return true;
+}
+
+// --- Template backup ---
+// A chunk of raw templates is larger than the PubSubClient buffer, so it is
+// streamed with beginPublish/write/endPublish: the binary layout straight from
+// the chunk's blocks, JSON with the templates base64-encoded one at a time into
+// txBuf, which is free again once the message head is on the wire.
+#define BASE64_TEMPLATE_LEN BASE64_ENCODED_LEN(TEMPLATE_PAYLOAD_SIZE)
+static_assert(sizeof(txBuf) >= BASE64_TEMPLATE_LEN, "txBuf holds one base64 template");
+
+static bool streamWrite(const void* data, size_t len) {
+  return client.write((const uint8_t*)data, len) == len;
+}
+
+static bool streamBackupBinary(const BackupChunk& c) {
+  uint8_t head[8];
+  BinWriter b(head, sizeof(head));
+  b.header(WIRE_MSG_BACKUP);
+  b.u16(c.seq);
+  b.u16(c.next);
+  b.u8(c.done);
+  b.u8(c.count);
+  size_t len = b.len + c.count * (2 + TEMPLATE_PAYLOAD_SIZE);
+  wireStats[WIRE_BINARY].bytes += len;
+  if (!client.beginPublish(stationTopic(TOPIC_FP_BACKUP), len, false)) return false;
+  bool ok = streamWrite(head, b.len);
+  for (uint8_t i = 0; ok && i < c.count; ++i) {
+    uint8_t id[2] = { (uint8_t)(c.ids[i] >> 8), (uint8_t)(c.ids[i] & 0xFF) };
+    ok = streamWrite(id, sizeof(id)) && streamWrite(c.data[i], TEMPLATE_PAYLOAD_SIZE);
+  }
+  return client.endPublish() && ok;
+}
+
+static bool streamBackupJson(const BackupChunk& c) {
+  JsonWriter head(txBuf, sizeof(txBuf));
+  head.beginObject().num("seq", c.seq).num("next", c.next).boolean("done", c.done).beginArray("templates");
+  // per template: {"id":..,"data":"<base64>"}, comma-separated
+  char prefix[BACKUP_PER_CHUNK][24];
+  size_t prefixLen[BACKUP_PER_CHUNK];
+  size_t len = head.length() + 2;  // closing "]}"
+  for (uint8_t i = 0; i < c.count; ++i) {
+    prefixLen[i] = snprintf(prefix[i], sizeof(prefix[i]), "%s{\"id\":%u,\"data\":\"", i ? "," : "", (unsigned)c.ids[i]);
+    len += prefixLen[i] + BASE64_TEMPLATE_LEN + 2;
+  }
+  wireStats[WIRE_JSON].bytes += len;
+  if (!client.beginPublish(stationTopic(TOPIC_FP_BACKUP), len, false)) return false;
+  bool ok = streamWrite(head.c_str(), head.length());
+  for (uint8_t i = 0; ok && i < c.count; ++i) {
+    {
+      EncodeScope scope;
+      base64Encode(c.data[i], TEMPLATE_PAYLOAD_SIZE, txBuf);
+    }
+    ok = streamWrite(prefix[i], prefixLen[i]) && streamWrite(txBuf, BASE64_TEMPLATE_LEN) && streamWrite("\"}", 2);
   }
+  ok = ok && streamWrite("]}", 2);
+  return client.endPublish() && ok;
+}
+
+// Streamed publish of chunk buffer `index`, which is released unless the link
+// is down (then the outbox retries it after the reconnect).
+static bool sendBackupChunk(uint8_t index) {
+  const BackupChunk& c = backupChunk(index);
+  publishCount++;
+  wireStats[wireFormat].messages++;
+  bool ok;
+  {
+    LatencyScope scope(LAT_PUBLISH);
+    ok = wireFormat == WIRE_BINARY ? streamBackupBinary(c) : streamBackupJson(c);
+  }
+  if (!ok && !client.connected()) return false;
+  Serial.printf("MQTT Published (backup chunk %u%s): %u templates -> ok=%d\n", (unsigned)c.seq,
+                wireFormat == WIRE_BINARY ? ", binary" : "", (unsigned)c.count, ok);
+  if (!ok) sendStatus(STATUS_ERROR, "Backup chunk publish failed");
+  backupChunkReleased(index);
+  return true;
+}
+
+static bool sendRestoreAck(uint16_t seq, uint16_t stored, uint16_t failed, bool done) {
+  if (wireFormat == WIRE_BINARY) {
+    BinWriter b(txBuf, sizeof(txBuf));
+    {
+      EncodeScope scope;
+      b.header(WIRE_MSG_RESTORE_ACK);
+      b.u16(seq);
+      b.u16(stored);
+      b.u16(failed);
+      b.u8(done);
+    }
+    return publishBinary(stationTopic(TOPIC_FP_BACKUP), "restore ack", b);
+  }
+  JsonWriter w(txBuf, sizeof(txBuf));
+  {
+    EncodeScope scope;
+    w.beginObject().num("restoreAck", seq).num("stored", stored).num("failed", failed).boolean("done", done).endObject();
+  }
+  return publishWriter(stationTopic(TOPIC_FP_BACKUP), "restore ack", w);
+}
+
+// --- Outbound queue ---
+// Every publish goes through this ring (network task only) before it reaches
+// PubSubClient. While the broker is unreachable results and template hashes
+// wait here and go out in order after the reconnect; a prompt that repeats the
+// one queued just before it for the same request only updates that entry's
+// message (a final status never does). When the ring is full the oldest progress prompt is evicted first
+// (a pipelining backend needs the final status of each request more), then the
+// oldest status, then the oldest data entry outside a batch or sync message.
+// Entries of those messages are never evicted one by one: a sync reply that
+// leaves out empty slots would read one evicted entry as an empty slot. When
+// nothing else is left, the oldest such message loses all its entries and its
+// flush or end goes out as a "truncated" marker (batchTruncated(), syncEnd());
+// entries still to come for it are discarded until then.
+#define OUTBOX_CAPACITY 64
+
+static NetEvent outbox[OUTBOX_CAPACITY];
+static size_t outboxHead = 0;
+static size_t outboxCount = 0;
+static OutboxStats outboxStats;
+
+// Per FrameKind, for a message that lost entries before its close was queued
+enum FrameDiscard : uint8_t {
+  DISCARD_NONE,
+  DISCARD_TO_MARKER,  // drop its entries, its close becomes the marker
+  DISCARD_ALL         // its begin was refused: drop everything up to and including the close
+};
+static FrameDiscard frameDiscard[FRAME_KINDS];
+
+bool statusIsFinal(EnrolmentStatus status) {
+  switch (status) {
+    case STATUS_SUCCESS:
+    case STATUS_ERROR:
+    case STATUS_CANCELLED:
+    case STATUS_TIMEOUT:
+    case STATUS_BUSY: return true;
+    default: return false;
+  }
+}
+
+static NetEvent& outboxAt(size_t i) {
+  return outbox[(outboxHead + i) % OUTBOX_CAPACITY];
+}
+
+static void outboxRemove(size_t i) {
+  if (outboxAt(i).type == EVT_BACKUP_CHUNK) backupChunkReleased(outboxAt(i).id);  // the receiver sees the gap
+  for (; i + 1 < outboxCount; ++i) outboxAt(i) = outboxAt(i + 1);
+  outboxCount--;
+}
+
+// Drops every queued entry of the message whose entry is at `first` and turns
+// its close into the marker, or, if the close is not queued yet, discards the
+// rest of the message as it comes.
+static void outboxTruncate(size_t first) {
+  FrameKind kind = frameOf(outboxAt(first).type);
+  for (size_t i = first; i < outboxCount;) {
+    NetEvent& queued = outboxAt(i);
+    if (frameOf(queued.type) != kind) {
+      ++i;
+    } else if (eventIsEntry(queued.type)) {
+      outboxRemove(i);
+      outboxStats.dropped++;
+    } else if (eventClosesFrame(queued.type)) {
+      queued.truncated = true;
+      return;
+    } else {
+      return;  // the next message begins: this one's close was lost too, nothing of it goes out
+    }
+  }
+  frameDiscard[kind] = DISCARD_TO_MARKER;
+}
+
+// Makes room for one event; false if everything queued has to stay
+static bool outboxEvict() {
+  size_t victim = outboxCount;
+  size_t firstStatus = outboxCount;
+  size_t firstData = outboxCount;
+  size_t firstEntry = outboxCount;
+  for (size_t i = 0; i < outboxCount && victim == outboxCount; ++i) {
+    const NetEvent& queued = outboxAt(i);
+    if (queued.type != EVT_STATUS) {
+      if (frameOf(queued.type) == FRAME_NONE) {
+        if (firstData == outboxCount) firstData = i;
+      } else if (eventIsEntry(queued.type) && firstEntry == outboxCount) {
+        firstEntry = i;
+      }
+      continue;
+    }
+    if (firstStatus == outboxCount) firstStatus = i;
+    if (!statusIsFinal((EnrolmentStatus)queued.status)) victim = i;
+  }
+  if (victim == outboxCount) victim = firstStatus < outboxCount ? firstStatus : firstData;
+  if (victim < outboxCount) {
+    outboxRemove(victim);
+    outboxStats.dropped++;
+    return true;
+  }
+  if (firstEntry == outboxCount) return false;
+  outboxTruncate(firstEntry);
+  return true;
+}
+
+static void outboxPush(const NetEvent& ev);
+
+// Applies frameDiscard to an incoming event; false if it is dropped
+static bool outboxAdmitFramed(NetEvent& ev) {
+  FrameKind kind = frameOf(ev.type);
+  if (kind == FRAME_NONE || frameDiscard[kind] == DISCARD_NONE) return true;
+  FrameDiscard discard = frameDiscard[kind];
+  if (eventIsEntry(ev.type)) {
+    outboxStats.dropped++;
+    return false;
+  }
+  frameDiscard[kind] = DISCARD_NONE;
+  if (eventClosesFrame(ev.type)) {
+    ev.truncated = true;
+    return discard == DISCARD_TO_MARKER;
+  }
+  // a new message begins before the damaged one was closed: close it first
+  if (discard == DISCARD_TO_MARKER) {
+    NetEvent close = {};
+    close.type = kind == FRAME_BATCH ? EVT_BATCH_FLUSH : EVT_SYNC_END;
+    close.truncated = true;
+    close.postedMs = ev.postedMs;
+    outboxPush(close);
+  }
+  return true;
+}
+
+static void outboxPush(const NetEvent& posted) {
+  NetEvent ev = posted;
+  if (ev.type == EVT_STATUS && outboxCount > 0) {
+    NetEvent& last = outboxAt(outboxCount - 1);
+    if (last.type == EVT_STATUS && last.status == ev.status && !statusIsFinal((EnrolmentStatus)ev.status) &&
+        last.request.rid == ev.request.rid && last.request.receivedMs == ev.request.receivedMs) {
+      strlcpy(last.message, ev.message, sizeof(last.message));
+      last.postedMs = ev.postedMs;
+      outboxStats.coalesced++;
+      return;
+    }
+  }
+  if (!outboxAdmitFramed(ev)) return;
+  while (outboxCount == OUTBOX_CAPACITY) {
+    if (outboxEvict()) {
+      if (!outboxAdmitFramed(ev)) return;  // its own message was the one truncated
+      continue;
+    }
+    // only begins, closes and markers left: refuse the new event
+    outboxStats.dropped++;
+    FrameKind kind = frameOf(ev.type);
+    if (ev.type == EVT_BACKUP_CHUNK) {
+      backupChunkReleased(ev.id);
+    } else if (kind != FRAME_NONE) {
+      bool begins = !eventIsEntry(ev.type) && !eventClosesFrame(ev.type);
+      frameDiscard[kind] = begins ? DISCARD_ALL : DISCARD_TO_MARKER;
+    }
+    return;
+  }
+  outboxAt(outboxCount++) = ev;
+  outboxStats.queued++;
+  if (outboxCount > outboxStats.highWater) outboxStats.highWater = outboxCount;
+}
+
+static bool sendMemoryReport();
+
+// Hand one event to PubSubClient. False if it was not delivered.
+static bool sendEvent(const NetEvent& ev) {
+  switch (ev.type) {
+    case EVT_STATUS: return sendStatus((EnrolmentStatus)ev.status, ev.message, ev);
+    case EVT_RESULT: return sendResult(ev);
+    case EVT_COUNT: return sendCount(ev.count);
+    case EVT_TEMPLATE_HASH: return sendTemplateHash(ev);
+    case EVT_BATCH_BEGIN: return batchBegin(ev.request.rid);
+    case EVT_BATCH_ADD: return batchAdd(ev.id, ev.hash);
+    case EVT_BATCH_FLUSH: return ev.truncated ? batchTruncated() : batchFlush();
+    case EVT_SYNC_BEGIN: return syncBegin(ev.id, ev.hash, ev.success, ev.count);
+    case EVT_SYNC_ADD: return syncAdd(ev.id, ev.hash);
+    case EVT_SYNC_END: return syncEnd(ev.truncated);
+    case EVT_BACKUP_CHUNK: return sendBackupChunk(ev.id);
+    case EVT_RESTORE_ACK: return sendRestoreAck(ev.id, ev.count, ev.aux, ev.success);
+    case EVT_MEMORY_REPORT: return sendMemoryReport();
+  }
+  return true;
+}
+
+static void outboxFlush() {
+  size_t sent = 0;
+  while (outboxCount > 0 && client.connected()) {
+    if (!sendEvent(outboxAt(0)) && !client.connected()) {
+      outboxStats.deferred++;  // link dropped mid-flush; retried after reconnect
+      break;
+    }
+    outboxHead = (outboxHead + 1) % OUTBOX_CAPACITY;
+    outboxCount--;
+    sent++;
+  }
+  outboxStats.flushed += sent;
+  if (outboxStats.depth > 0 && sent > 0 && outboxCount == 0) {
+    Serial.printf("Outbox: %u buffered message(s) sent after reconnect\n", (unsigned)outboxStats.depth);
+  }
+  outboxStats.depth = outboxCount;
+}
+
+// Move everything the sensor task posted into the outbox (no network I/O)
+static void absorbEvents() {
+  NetEvent ev;
+  while (eventQueue.pop(ev)) outboxPush(ev);
+}
+
+void messagingDrainEvents() {
+  static uint32_t reportedDrops = 0;
+  absorbEvents();
+  outboxFlush();
+  uint32_t drops = eventDrops;
+  if (drops != reportedDrops) {
+    Serial.printf("Event queue full: %lu publish(es) dropped so far\n", (unsigned long)drops);
+    reportedDrops = drops;
+  }
+}
+
+uint32_t messagingEventDrops() {
+  return eventDrops;
+}
+
+uint32_t messagingPublishCount() {
+  return publishCount;
+}
+
+uint32_t messagingBufferBytes() {
+  return sizeof(txBuf) + sizeof(batchBuf) + sizeof(syncBuf);
+}
+
+uint32_t messagingPublishAllocations() {
+  return publishAllocations;
+}
+
+OutboxHold::OutboxHold() {
+  outboxHolds++;
+}
+
+OutboxHold::~OutboxHold() {
+  if (--outboxHolds == 0) outboxFlush();
+}
+
+// Publishes nothing itself: an open template batch is sent in its own format
+// by the next batchAdd() or flush.
+void messagingSetWireFormat(WireFormat format) {
+  if (format == wireFormat) return;
+  wireFormat = format;
+  Serial.printf("Wire format switched to %s\n", format == WIRE_BINARY ? "binary" : "json");
+}
+
+WireFormat messagingWireFormat() {
+  return wireFormat;
+}
+
+const WireStats& messagingWireStats(WireFormat format) {
+  return wireStats[format];
+}
+
+const OutboxStats& messagingOutboxStats() {
+  return outboxStats;
+}
+
+// --- Public API: safe on either task, never blocks on the network ---
+
+void publishEnrolmentStatus(EnrolmentStatus status, const char* message) {
+  NetEvent ev = {};
+  ev.status = status;
+  postEvent(ev, EVT_STATUS, message);
+}
+
+void publishEnrolmentStatusf(EnrolmentStatus status, const char* fmt, ...) {
+  char message[sizeof(((NetEvent*)nullptr)->message)];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(message, sizeof(message), fmt, args);
+  va_end(args);
+  publishEnrolmentStatus(status, message);
+}
+
+void publishResult(uint16_t id, bool success, const char* message) {
+  NetEvent ev = {};
+  ev.id = id;
+  ev.success = success;
+  postEvent(ev, EVT_RESULT, message);
+}
+
+void publishTemplateHash(uint16_t id, const uint8_t hash[32]) {
+  NetEvent ev = {};
+  ev.id = id;
+  memcpy(ev.hash, hash, sizeof(ev.hash));
+  postEvent(ev, EVT_TEMPLATE_HASH);
+}
+
+void templateBatchBegin() {
+  NetEvent ev = {};
+  postEvent(ev, EVT_BATCH_BEGIN);
+}
+
+void templateBatchAdd(uint16_t id, const uint8_t hash[32]) {
+  NetEvent ev = {};
+  ev.id = id;
+  memcpy(ev.hash, hash, sizeof(ev.hash));
+  postEvent(ev, EVT_BATCH_ADD);
+}
+
+void templateBatchFlush() {
+  NetEvent ev = {};
+  postEvent(ev, EVT_BATCH_FLUSH);
 }
 
 void publishEnrolmentCount() {
-  String payload = "{\"enrolledCount\":" + String(enrolledCount) + "}";
-  client.publish(TOPIC_FP_COUNT, payload.c_str());
-  Serial.println("MQTT Published (enrolledCount): " + payload);
+  NetEvent ev = {};
+  ev.count = enrolledCount;  // snapshot taken on the calling task
+  postEvent(ev, EVT_COUNT);
+}
+
+bool syncReplyBegin(uint16_t node, const uint8_t hash[32], bool slots, uint16_t unknown) {
+  // all of the reply or none of it: the sensor task is the only producer, so
+  // the room there now is still there for the entries and the end
+  if (!onNetworkTask() && eventQueue.capacity() - eventQueue.size() < SYNC_REPLY_EVENTS) {
+    eventDrops++;
+    framePost[FRAME_SYNC] = POST_LOST;
+    return false;
+  }
+  NetEvent ev = {};
+  ev.id = node;
+  memcpy(ev.hash, hash, sizeof(ev.hash));
+  ev.success = slots;
+  ev.count = unknown;
+  postEvent(ev, EVT_SYNC_BEGIN);
+  return onNetworkTask() || framePost[FRAME_SYNC] != POST_LOST;
+}
+
+void syncReplyAdd(uint16_t id, const uint8_t hash[32]) {
+  NetEvent ev = {};
+  ev.id = id;
+  memcpy(ev.hash, hash, sizeof(ev.hash));
+  postEvent(ev, EVT_SYNC_ADD);
+}
+
+void syncReplyEnd() {
+  NetEvent ev = {};
+  postEvent(ev, EVT_SYNC_END);
+}
+
+void publishBackupChunk(uint8_t index) {
+  NetEvent ev = {};
+  ev.id = index;
+  postEvent(ev, EVT_BACKUP_CHUNK);
+}
+
+void publishMemoryReport() {
+  NetEvent ev = {};
+  postEvent(ev, EVT_MEMORY_REPORT);
+}
+
+void publishRestoreAck(uint16_t seq, uint16_t stored, uint16_t failed, bool done) {
+  NetEvent ev = {};
+  ev.id = seq;
+  ev.count = stored;
+  ev.aux = failed;
+  ev.success = done;
+  postEvent(ev, EVT_RESTORE_ACK);
 }
 
+// Heartbeat with uptime and, for every metric that has samples,
+// [count, p50, p95, p99, max] in microseconds. Status is "alive" once the
+// station is ready, else its mode; binary carries the mode in a trailing byte.
 void sendHeartbeat() {
-  String statusPayload = "{\"status\":\"alive\"}";
-  client.publish(TOPIC_HEALTH, statusPayload.c_str());
-  Serial.println("MQTT Data Published (heartbeat): " + statusPayload);
-}
-
-// --- Reconnect logic ---
-void reconnect() {
-  while (!client.connected()) {
-    Serial.print("Attempting MQTT connection...");
-    if (client.connect("fingerprintClient", MQTT_USERNAME, MQTT_PASSWORD)) {
-      Serial.println("connected");
-      // Subscribe to all topics we care about
-      client.subscribe(TOPIC_FP_COMMAND);
-    } else {
-      Serial.print("failed, rc=");
-      Serial.print(client.state());
-      Serial.println(" retrying...");
-      delay(5000);
+  uint32_t uptime = millis() / 1000;
+  StationMode mode = stationMode();
+  if (wireFormat == WIRE_BINARY) {
+    BinWriter b(txBuf, sizeof(txBuf));
+    {
+      EncodeScope scope;
+      b.header(WIRE_MSG_HEARTBEAT);
+      b.u32(uptime);
+      size_t countAt = b.len;
+      uint8_t n = 0;
+      b.u8(0);  // metric count, patched below
+      for (uint8_t i = 0; i < LAT_METRIC_COUNT; ++i) {
+        LatencyMetric m = (LatencyMetric)i;
+        if (latencyHistograms[m].count == 0) continue;
+        b.u8(m);
+        b.u32(latencyHistograms[m].count);
+        b.u32(latencyPercentile(m, 50));
+        b.u32(latencyPercentile(m, 95));
+        b.u32(latencyPercentile(m, 99));
+        b.u32(latencyHistograms[m].maxUs);
+        n++;
+      }
+      if (countAt < b.cap) b.buf[countAt] = n;
+      b.u8(mode);
+    }
+    publishBinary(stationTopic(TOPIC_HEALTH), "heartbeat", b);
+    return;
+  }
+  JsonWriter w(txBuf, sizeof(txBuf));
+  {
+    EncodeScope scope;
+    w.beginObject()
+      .str("status", mode == MODE_READY ? "alive" : stationModeToString(mode))
+      .num("uptime", uptime)
+      .beginObject("latency");
+    for (uint8_t i = 0; i < LAT_METRIC_COUNT; ++i) {
+      LatencyMetric m = (LatencyMetric)i;
+      if (latencyHistograms[m].count == 0) continue;
+      w.beginArray(latencyName(m))
+        .num(nullptr, latencyHistograms[m].count)
+        .num(nullptr, latencyPercentile(m, 50))
+        .num(nullptr, latencyPercentile(m, 95))
+        .num(nullptr, latencyPercentile(m, 99))
+        .num(nullptr, latencyHistograms[m].maxUs)
+        .endArray();
+    }
+    w.endObject().endObject();
+  }
+  publishWriter(stationTopic(TOPIC_HEALTH), "heartbeat", w);
+}
+
+// {"status":"boot","mode":..,"reset":..,"phases":{"store":[start,end],..}} in
+// ms since reset; phases still running are left out. JSON in both wire formats.
+bool sendBootReport() {
+  JsonWriter w(txBuf, sizeof(txBuf));
+  {
+    EncodeScope scope;
+    w.beginObject()
+      .str("status", "boot")
+      .str("mode", stationModeToString(stationMode()))
+      .str("reset", bootResetReason())
+      .beginObject("phases");
+    for (uint8_t i = 0; i < BOOT_PHASE_COUNT; ++i) {
+      const BootPhaseTiming& p = bootPhase((BootPhase)i);
+      if (p.endMs == 0) continue;
+      w.beginArray(bootPhaseName((BootPhase)i)).num(nullptr, p.startMs).num(nullptr, p.endMs).endArray();
+    }
+    w.endObject().endObject();
+  }
+  return publishWriter(stationTopic(TOPIC_HEALTH), "boot report", w);
+}
+
+// {"status":"mem","pool":{..,"owners":{..}},"heap":{..},"stack":{..},"static":{..}}
+static bool sendMemoryReport() {
+  MemorySnapshot m = memorySnapshot();
+  JsonWriter w(txBuf, sizeof(txBuf));
+  {
+    EncodeScope scope;
+    w.beginObject().str("status", "mem");
+    w.beginObject("pool")
+      .num("blocks", POOL_BLOCKS)
+      .num("blockSize", POOL_BLOCK_SIZE)
+      .num("inUse", m.pool.inUse)
+      .num("peak", m.pool.peak)
+      .num("failures", m.pool.failures)
+      .beginObject("owners");
+    for (uint8_t o = POOL_FREE + 1; o < POOL_OWNER_COUNT; ++o) {
+      if (m.poolByOwner[o]) w.num(poolOwnerName((PoolOwner)o), m.poolByOwner[o]);
     }
+    w.endObject().endObject();
+    w.beginObject("heap")
+      .num("size", m.heapSize)
+      .num("free", m.heapFree)
+      .num("minFree", m.heapMinFree)
+      .num("largest", m.heapLargest)
+      .endObject();
+    HeapTrend t = heapTrend();
+    w.beginObject("trend")
+      .num("minutes", t.samples)
+      .num("lossPerHour", t.slopePerHour < 0 ? -t.slopePerHour : 0)
+      .num("fragmentedPct", t.fragmentedPct)
+      .boolean("drifting", t.drifting)
+      .endObject();
+    w.beginObject("stack").num("sensor", m.sensorStackFree).num("network", m.networkStackFree).endObject();
+    w.beginObject("static")
+      .num("pool", POOL_BLOCKS * POOL_BLOCK_SIZE)
+      .num("messaging", m.messagingBuffers)
+      .num("mqtt", m.mqttBuffer)
+      .endObject();
+    w.endObject();
   }
+  return publishWriter(stationTopic(TOPIC_HEALTH), "memory report", w);
 }
 
 // --- Hashing Function ---
-String hashTemplate(const uint8_t* data, size_t len) {
-  // Compute SHA-256 of raw bytes
-  unsigned char hash[32];
-  mbedtls_sha256((const unsigned char*)data, len, hash, 0);  // 0 => SHA-256 (not 224)
-
-  // Convert to hex string
-  char hexBuf[65];
-  for (int i = 0; i < 32; ++i) {
-    sprintf(hexBuf + (i * 2), "%02x", hash[i]);
-  }
-  hexBuf[64] = '\0';
-  return String(hexBuf);
+void hashTemplateRaw(const uint8_t* data, size_t len, uint8_t out[32]) {
+  LatencyScope scope(LAT_SHA256);
+  mbedtls_sha256((const unsigned char*)data, len, out, 0);  // 0 => SHA-256 (not 224)
 }
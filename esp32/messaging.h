@@ -2,11 +2,17 @@
 #define MESSAGING_H
 
 #include <Arduino.h>
+#include "station_id.h"
 
 // Access global enrollment count
 extern uint16_t enrolledCount;
 
-// Enrolment statuses
+// Enrolment statuses. Every request ends with exactly one final status
+// (statusIsFinal()); everything before it is a prompt or a step on the way.
+// STARTED acknowledges a job or session that answers with its final status
+// when it ends; PROGRESS reports a step of it, such as one voter of an
+// enroll session or the template download inside an enrollment. Append only:
+// the binary STATUS layout carries the index.
 enum EnrolmentStatus {
   STATUS_PLACE_FINGER,
   STATUS_IMAGE_TAKEN,
@@ -18,32 +24,146 @@ enum EnrolmentStatus {
   STATUS_DOWNLOADING_TEMPLATE,
   STATUS_SUCCESS,
   STATUS_ERROR,
-  STATUS_WAITING_FOR_FINGER
+  STATUS_WAITING_FOR_FINGER,
+  STATUS_CANCELLED,
+  STATUS_TIMEOUT,
+  STATUS_BUSY,  // request not admitted, retry later
+  STATUS_STARTED,
+  STATUS_PROGRESS
 };
 
-// Topics
-// --- MQTT topics (mirror server) ---
-#define TOPIC_FP_COMMAND "esp32/fingerprint/command"
-#define TOPIC_FP_STATUS "esp32/fingerprint/status"
-#define TOPIC_FP_COUNT "esp32/fingerprint/count"
-#define TOPIC_FP_RESULT "esp32/fingerprint/result"
-#define TOPIC_FP_TEMPLATES "esp32/fingerprint/templates"
-#define TOPIC_HEALTH "esp32/health"
+// SUCCESS, ERROR, CANCELLED, TIMEOUT and BUSY: the request is over
+bool statusIsFinal(EnrolmentStatus status);
+
+// Topics are per station (esp32/<station>/fingerprint/status, ...), see station_id.h
+
+// Wire format, negotiated with a "format" field ("json" | "binary") on
+// the command topics. Binary messages start with WIRE_BINARY_MAGIC (never a valid
+// first JSON byte) and a WireMessageType; integers are big endian. [req] is
+// u32 rid, u32 waitMs, u32 execMs, present when the message answers a command
+// (request_tag.h).
+//   STATUS          u8 status (EnrolmentStatus), u8 len, message bytes, [req]
+//   RESULT          u16 id, u8 success, u8 len, message bytes, [req]
+//   COUNT           u16 enrolledCount
+//   TEMPLATE        u16 id, 32-byte SHA-256, [req]
+//   TEMPLATE_BATCH  u16 n, n x (u16 id, 32-byte SHA-256), [u32 rid]; n =
+//                   WIRE_BATCH_TRUNCATED: entries of this job were lost, no entries
+//   HEARTBEAT       u32 uptime s, u8 n, n x (u8 LatencyMetric, u32 count,
+//                   u32 p50, u32 p95, u32 p99, u32 max), times in us
+//   SYNC            u16 node, 32-byte node hash, u8 kind (0 nodes, 1 slots),
+//                   u16 unknown, u8 n, n x (u16 node or slot id, 32-byte hash); n =
+//                   WIRE_SYNC_TRUNCATED: the reply lost entries, ask again (hash zero)
+//   BACKUP          u16 seq, u16 next, u8 done, u8 n, n x (u16 id, 512-byte template)
+//   RESTORE_ACK     u16 seq, u16 stored, u16 failed, u8 done
+enum WireFormat : uint8_t { WIRE_JSON, WIRE_BINARY };
+
+#define WIRE_BINARY_MAGIC 0xB1
+// Entry counts of the truncated markers; JSON has "truncated":true instead
+#define WIRE_BATCH_TRUNCATED 0xFFFF
+#define WIRE_SYNC_TRUNCATED 0xFF
+
+enum WireMessageType : uint8_t {
+  WIRE_MSG_STATUS = 1,
+  WIRE_MSG_RESULT = 2,
+  WIRE_MSG_COUNT = 3,
+  WIRE_MSG_TEMPLATE = 4,
+  WIRE_MSG_TEMPLATE_BATCH = 5,
+  WIRE_MSG_HEARTBEAT = 6,
+  WIRE_MSG_SYNC = 7,
+  WIRE_MSG_BACKUP = 8,
+  WIRE_MSG_RESTORE_ACK = 9
+};
+
+struct WireStats {
+  uint32_t messages;
+  uint32_t bytes;         // payload bytes handed to PubSubClient
+  uint32_t encodeMicros;  // time spent serializing
+};
+
+struct OutboxStats {
+  uint32_t queued;     // events accepted into the outbound queue
+  uint32_t coalesced;  // repeated statuses folded into the queued one
+  uint32_t dropped;    // evicted, or refused, because the queue was full
+  uint32_t flushed;    // handed to PubSubClient
+  uint32_t deferred;   // flushes stopped by a lost connection
+  uint16_t depth;      // waiting right now
+  uint16_t highWater;
+};
 
 // Function declarations
-String statusToString(EnrolmentStatus status);
+// The publish functions below are safe on either task and return at once. Messages
+// go through an outbound queue that holds them while the broker is unreachable.
+const char* statusToString(EnrolmentStatus status);
 
-void publishEnrolmentStatus(EnrolmentStatus status, String message);
+void publishEnrolmentStatus(EnrolmentStatus status, const char* message);
+void publishEnrolmentStatusf(EnrolmentStatus status, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
 void publishEnrolmentCount();
 void resetEnrolmentCount();
-void publishResult(uint16_t id, bool success, const String& message);
+void publishResult(uint16_t id, bool success, const char* message);
+
+void publishTemplateHash(uint16_t id, const uint8_t hash[32]);
+// SHA-256 of bytes already in RAM. Downloads hash as the packets arrive
+// instead (fetchTemplate with a hash out).
+void hashTemplateRaw(const uint8_t* data, size_t len, uint8_t out[32]);
+
+// Batched template hashes: {"templates":[{"id":..,"template":".."},..]}
+// Each message is filled up to what fits in the PubSubClient buffer. If the
+// outbound queue had to drop entries, {"rid":..,"truncated":true,"templates":[]}
+// goes out in place of the message that lost them.
+void templateBatchBegin();
+void templateBatchAdd(uint16_t id, const uint8_t hash[32]);
+void templateBatchFlush();
+
+// Hash-index sync reply (see hash_index.h):
+// {"node":n,"hash":"..","unknown":u,"nodes"|"slots":[{"id":..,"hash":".."},..]},
+// or {"node":n,"truncated":true} if the outbound queue had to drop entries.
+// At most SYNC_REPLY_MAX_ENTRIES entries. syncReplyBegin() returns false, and
+// nothing of the reply goes out, if the event queue has no room for all of it.
+#define SYNC_REPLY_MAX_ENTRIES 16
+bool syncReplyBegin(uint16_t node, const uint8_t hash[32], bool slots, uint16_t unknown);
+void syncReplyAdd(uint16_t id, const uint8_t hash[32]);
+void syncReplyEnd();
 
-// New: publish raw template buffer (will Base64 encode internally)
-void publishTemplate(uint16_t id, const uint8_t* buffer, size_t length);
-// New: hash raw bytes directly
-String hashTemplate(const uint8_t* data, size_t len);
+// Template backup/restore (see backup.h), on TOPIC_FP_BACKUP:
+// {"seq":n,"next":id,"done":b,"templates":[{"id":..,"data":"<base64>"},..]}
+// {"restoreAck":seq,"stored":n,"failed":m,"done":b}
+// A chunk is streamed to the socket rather than built in one buffer.
+void publishBackupChunk(uint8_t index);
+void publishRestoreAck(uint16_t seq, uint16_t stored, uint16_t failed, bool done);
 
+// Network task: uptime + latency summary on TOPIC_HEALTH (not queued while offline)
 void sendHeartbeat();
-void reconnect();
+// Network task: mode, reset reason and boot phase timings on TOPIC_HEALTH (boot.h)
+bool sendBootReport();
+// memorySnapshot() on TOPIC_HEALTH (memory_report.h), taken when it is sent
+void publishMemoryReport();
+
+// Network task: send everything the sensor task queued
+void messagingDrainEvents();
+
+// Network task: while one exists, events posted on the network task wait in the
+// outbound queue instead of going out on the spot; the last one to go flushes.
+// The MQTT dispatcher holds one, since the command it parsed points into
+// PubSubClient's buffer and every publish overwrites that buffer.
+class OutboxHold {
+public:
+  OutboxHold();
+  ~OutboxHold();
+  OutboxHold(const OutboxHold&) = delete;
+  OutboxHold& operator=(const OutboxHold&) = delete;
+};
+uint32_t messagingEventDrops();
+const OutboxStats& messagingOutboxStats();
+// Messages built and heap allocations made while building them; the latter
+// only counts when alloc_counter.h is enabled and should stay at 0.
+uint32_t messagingPublishCount();
+uint32_t messagingPublishAllocations();
+// Bytes of the static serialization buffers (tx, template batch, sync)
+uint32_t messagingBufferBytes();
+
+// Set from the network task (MQTT command); the getters are just statistics.
+void messagingSetWireFormat(WireFormat format);
+WireFormat messagingWireFormat();
+const WireStats& messagingWireStats(WireFormat format);
 
 #endif
@@ -0,0 +1,27 @@
+// request_tag.cpp
+#include "request_tag.h"
+#include "station_tasks.h"
+
+static RequestTag current[2];  // sensor task, network task
+
+static RequestTag& slot() {
+  return current[onNetworkTask() ? 1 : 0];
+}
+
+RequestTag requestTagNew(uint32_t rid) {
+  uint32_t now = millis();
+  if (now == 0) now = 1;  // 0 means no request
+  return { rid, now, now };
+}
+
+const RequestTag& currentRequest() {
+  return slot();
+}
+
+RequestScope::RequestScope(const RequestTag& tag) : saved_(slot()) {
+  slot() = tag;
+}
+
+RequestScope::~RequestScope() {
+  slot() = saved_;
+}
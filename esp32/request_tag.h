@@ -0,0 +1,41 @@
+#ifndef REQUEST_TAG_H
+#define REQUEST_TAG_H
+
+#include <Arduino.h>
+
+// Ties replies to the command that caused them, so the backend can keep
+// several commands in flight per station. A command may carry "rid" (any
+// nonzero 32-bit number); every status, result and template message it leads
+// to echoes it, together with the time it waited for the sensor and the time
+// it has been running when the message was posted:
+//   {"status":"success","message":"..","rid":17,"waitMs":120,"execMs":2310}
+// Binary messages append rid, waitMs and execMs (u32 each) to their usual
+// layout; messages that answer no command stay as they were.
+//
+// Each task has a current tag. Dispatch sets it while a command's handler
+// runs; the sensor task sets it around every piece of work it does for a
+// request (accepting it, running it, each step of the flow, enroll session or
+// bulk job it started), and messaging stamps whatever is posted meanwhile.
+struct RequestTag {
+  uint32_t rid;         // from the command, 0 if it had none
+  uint32_t receivedMs;  // command dispatched; 0: no request (unsolicited message)
+  uint32_t startedMs;   // the sensor began on it; receivedMs until then
+};
+
+RequestTag requestTagNew(uint32_t rid);  // received and started now
+// The tag of whatever the calling task is working on ({} if nothing)
+const RequestTag& currentRequest();
+
+// Makes tag the calling task's current tag for the enclosing block
+class RequestScope {
+public:
+  explicit RequestScope(const RequestTag& tag);
+  ~RequestScope();
+  RequestScope(const RequestScope&) = delete;
+  RequestScope& operator=(const RequestScope&) = delete;
+
+private:
+  RequestTag saved_;
+};
+
+#endif
@@ -0,0 +1,171 @@
+// sensor_link.cpp
+#include <Adafruit_Fingerprint.h>
+#include "sensor_link.h"
+#include "station_store.h"
+#include "fingerprint_util.h"
+#include "fingerprint_index.h"
+#include "buffer_pool.h"
+
+extern HardwareSerial mySerial;
+extern Adafruit_Fingerprint finger;
+
+#define LINK_SETTLE_MS 20  // let the UART and the sensor settle after a switch
+
+// Rates tried when the stored one does not answer, most likely first
+static const uint32_t PROBE_BAUDS[] = { SENSOR_LINK_DEFAULT_BAUD, SENSOR_LINK_MAX_BAUD, 9600, 19200, 38400, 76800, 96000 };
+static const uint16_t PACKET_SIZES[] = { 32, 64, 128, 256 };  // index = FINGERPRINT_PACKETSIZE_*
+
+static uint32_t linkBaud = SENSOR_LINK_DEFAULT_BAUD;
+static uint16_t linkPacketLen = 128;
+
+static bool answersAt(uint32_t baud) {
+  mySerial.updateBaudRate(baud);
+  delay(LINK_SETTLE_MS);
+  while (mySerial.available()) mySerial.read();
+  return finger.verifyPassword();
+}
+
+static bool findSensor(uint32_t preferred) {
+  if (answersAt(preferred)) {
+    linkBaud = preferred;
+    return true;
+  }
+  for (uint32_t baud : PROBE_BAUDS) {
+    if (baud != preferred && answersAt(baud)) {
+      Serial.printf("Sensor link: found sensor at %lu baud\n", (unsigned long)baud);
+      linkBaud = baud;
+      return true;
+    }
+  }
+  mySerial.updateBaudRate(linkBaud);
+  return false;
+}
+
+// FINGERPRINT_BAUDRATE_* is N for N x 9600. The sensor acknowledges at the old
+// rate and then switches; some clones only switch after a power cycle, so the
+// old rate is checked before rescanning.
+static bool switchBaud(uint32_t baud) {
+  if (baud == linkBaud) return true;
+  uint8_t r = finger.setBaudRate(baud / 9600);
+  if (r != FINGERPRINT_OK) {
+    Serial.printf("Sensor link: setBaudRate(%lu) refused (code %u)\n", (unsigned long)baud, (unsigned)r);
+    return false;
+  }
+  if (answersAt(baud)) {
+    linkBaud = baud;
+    return true;
+  }
+  if (answersAt(linkBaud)) {
+    Serial.printf("Sensor link: sensor stayed at %lu baud\n", (unsigned long)linkBaud);
+    return false;
+  }
+  Serial.println("Sensor link: lost the sensor after a baud change, rescanning");
+  findSensor(baud);
+  return false;
+}
+
+static bool switchPacketLen(uint16_t len) {
+  if (len == linkPacketLen) return true;
+  uint8_t code = 0;
+  while (code < 3 && PACKET_SIZES[code] != len) code++;
+  uint8_t r = finger.setPacketSize(code);
+  if (r != FINGERPRINT_OK || finger.getParameters() != FINGERPRINT_OK) {
+    Serial.printf("Sensor link: setPacketSize(%u) failed (code %u)\n", (unsigned)len, (unsigned)r);
+    return false;
+  }
+  linkPacketLen = finger.packet_len;
+  return linkPacketLen == len;
+}
+
+void sensorLinkSave() {
+  storeSetLink(linkBaud, linkPacketLen);
+}
+
+bool sensorLinkBegin(uint32_t preferredBaud) {
+  uint32_t startMs = millis();
+  linkBaud = SENSOR_LINK_DEFAULT_BAUD;  // what mySerial was opened with
+  if (!findSensor(preferredBaud ? preferredBaud : SENSOR_LINK_DEFAULT_BAUD)) {
+    Serial.println("Sensor link: no answer at any baud rate");
+    return false;
+  }
+
+  switchBaud(SENSOR_LINK_MAX_BAUD);  // stays on the working rate if refused
+  if (finger.getParameters() == FINGERPRINT_OK) linkPacketLen = finger.packet_len;
+  switchPacketLen(SENSOR_LINK_MAX_PACKET);
+
+  // never leave boot with a link that does not answer
+  if (!finger.verifyPassword() && !findSensor(SENSOR_LINK_DEFAULT_BAUD)) return false;
+  Serial.printf("Sensor link: %lu baud, %u-byte packets (negotiated in %lu ms)\n", (unsigned long)linkBaud,
+                (unsigned)linkPacketLen, (unsigned long)(millis() - startMs));
+  return true;
+}
+
+bool sensorLinkRecover() {
+  if (finger.verifyPassword()) return true;
+  uint32_t before = linkBaud;
+  if (!findSensor(linkBaud)) {
+    Serial.println("Sensor link: sensor not answering");
+    return false;
+  }
+  if (linkBaud != before) sensorLinkSave();
+  return true;
+}
+
+uint32_t sensorLinkBaud() {
+  return linkBaud;
+}
+
+uint16_t sensorLinkPacketLen() {
+  return linkPacketLen;
+}
+
+void sensorLinkBench(uint8_t samples) {
+  static const uint32_t BENCH_BAUDS[] = { SENSOR_LINK_DEFAULT_BAUD, SENSOR_LINK_MAX_BAUD };
+  PoolBuffer buf(POOL_BENCH);
+  if (!buf) {
+    Serial.println("Link bench: no buffer free");
+    return;
+  }
+  uint32_t homeBaud = linkBaud;
+  uint16_t homePacket = linkPacketLen;
+  uint16_t id = occupancyValid() ? occupancyNext(1) : 0;
+  if (samples == 0) samples = 1;
+
+  Serial.printf("== Link bench: %u sample(s), template ID %u ==\n", (unsigned)samples, (unsigned)id);
+  Serial.println("  baud    pkt  getImage avg/max us  template avg/max ms  ok");
+  for (uint32_t baud : BENCH_BAUDS) {
+    for (uint16_t pkt : PACKET_SIZES) {
+      if (!switchBaud(baud) || !switchPacketLen(pkt)) {
+        Serial.printf("  %6lu  %3u  (not accepted)\n", (unsigned long)baud, (unsigned)pkt);
+        continue;
+      }
+      uint32_t imgSum = 0, imgMax = 0, tplSum = 0, tplMax = 0;
+      uint8_t tplOk = 0;
+      for (uint8_t i = 0; i < samples; ++i) {
+        uint32_t t0 = micros();
+        finger.getImage();  // no finger: the command round trip plus one scan
+        uint32_t dt = micros() - t0;
+        imgSum += dt;
+        imgMax = max(imgMax, dt);
+        if (id == 0) continue;
+        t0 = millis();
+        bool ok = fetchTemplate(id, buf.get(), 1);
+        dt = millis() - t0;
+        if (!ok) continue;
+        tplOk++;
+        tplSum += dt;
+        tplMax = max(tplMax, dt);
+      }
+      Serial.printf("  %6lu  %3u  %8lu / %-8lu    %6lu / %-6lu      %u/%u\n", (unsigned long)baud, (unsigned)pkt,
+                    (unsigned long)(imgSum / samples), (unsigned long)imgMax,
+                    (unsigned long)(tplOk ? tplSum / tplOk : 0), (unsigned long)tplMax, (unsigned)tplOk,
+                    (unsigned)(id ? samples : 0));
+    }
+  }
+
+  // back to the negotiated setting
+  switchPacketLen(homePacket);
+  switchBaud(homeBaud);
+  if (!sensorLinkRecover()) return;
+  Serial.printf("Link restored to %lu baud, %u-byte packets\n", (unsigned long)linkBaud, (unsigned)linkPacketLen);
+}
@@ -0,0 +1,31 @@
+#ifndef SENSOR_LINK_H
+#define SENSOR_LINK_H
+
+#include <Arduino.h>
+
+// UART speed and data packet size of the sensor link. The R30x keeps both in
+// its system parameters (baud = N x 9600, N = 1..12; packet = 32..256 bytes);
+// the negotiated pair is also kept in the station store so the next boot finds
+// the sensor on the first try.
+#define SENSOR_LINK_DEFAULT_BAUD 57600  // factory setting
+#define SENSOR_LINK_MAX_BAUD 115200
+#define SENSOR_LINK_MAX_PACKET 256
+
+// Find the sensor, trying preferredBaud (the stored rate, 0 if not known yet)
+// first, then raise baud rate and packet size as far as it accepts. False if
+// the sensor did not answer at any rate. Leaves the store alone, so it can run
+// while the store is still loading; sensorLinkSave() records the result.
+bool sensorLinkBegin(uint32_t preferredBaud);
+void sensorLinkSave();
+
+// Call when the sensor stops answering: rescan the baud rates and follow it.
+bool sensorLinkRecover();
+
+uint32_t sensorLinkBaud();
+uint16_t sensorLinkPacketLen();
+
+// Serial CLI: time getImage and a template download at every baud/packet
+// combination, then restore the negotiated setting. Blocks the sensor task.
+void sensorLinkBench(uint8_t samples);
+
+#endif
@@ -0,0 +1,236 @@
+// adafruit_fingerprint.cpp
+// The Adafruit Fingerprint Sensor Library's packet handling, reproduced for
+// the calls the firmware makes so that the host sees the same behaviour:
+// byte-by-byte reads with a 1 ms poll, no checksum check on replies and
+// BADPACKET for anything longer than the 64-byte packet buffer.
+#include <Adafruit_Fingerprint.h>
+
+Adafruit_Fingerprint_Packet::Adafruit_Fingerprint_Packet(uint8_t type, uint16_t length, uint8_t* data) {
+  this->start_code = FINGERPRINT_STARTCODE;
+  this->type = type;
+  this->length = length;
+  address[0] = address[1] = address[2] = address[3] = 0xFF;
+  if (length == 0) return;
+  if (length < 64) memcpy(this->data, data, length);
+  else memcpy(this->data, data, 64);
+}
+
+Adafruit_Fingerprint::Adafruit_Fingerprint(HardwareSerial* serial, uint32_t password)
+    : fingerID(0), confidence(0), templateCount(0), password_(password), serial_(serial) {}
+
+void Adafruit_Fingerprint::begin(uint32_t baud) {
+  delay(1000);  // one second delay to let the sensor 'boot up'
+  serial_->begin(baud);
+}
+
+void Adafruit_Fingerprint::writeStructuredPacket(const Adafruit_Fingerprint_Packet& packet) {
+  uint8_t frame[11 + 64];
+  size_t n = 0;
+  frame[n++] = (uint8_t)(packet.start_code >> 8);
+  frame[n++] = (uint8_t)(packet.start_code & 0xFF);
+  for (int i = 0; i < 4; ++i) frame[n++] = packet.address[i];
+  frame[n++] = packet.type;
+  uint16_t wire_length = packet.length + 2;
+  frame[n++] = (uint8_t)(wire_length >> 8);
+  frame[n++] = (uint8_t)(wire_length & 0xFF);
+  uint16_t sum = ((wire_length) >> 8) + ((wire_length)&0xFF) + packet.type;
+  for (uint8_t i = 0; i < packet.length; i++) {
+    frame[n++] = packet.data[i];
+    sum += packet.data[i];
+  }
+  frame[n++] = (uint8_t)(sum >> 8);
+  frame[n++] = (uint8_t)(sum & 0xFF);
+  serial_->write(frame, n);
+}
+
+uint8_t Adafruit_Fingerprint::getStructuredPacket(Adafruit_Fingerprint_Packet* packet, uint16_t timeout) {
+  uint8_t byte;
+  uint16_t idx = 0, timer = 0;
+
+  while (true) {
+    while (!serial_->available()) {
+      delay(1);
+      timer++;
+      if (timer >= timeout) return FINGERPRINT_TIMEOUT;
+    }
+    byte = serial_->read();
+    switch (idx) {
+      case 0:
+        if (byte != (FINGERPRINT_STARTCODE >> 8)) continue;
+        packet->start_code = (uint16_t)byte << 8;
+        break;
+      case 1:
+        packet->start_code |= byte;
+        if (packet->start_code != FINGERPRINT_STARTCODE) return FINGERPRINT_BADPACKET;
+        break;
+      case 2:
+      case 3:
+      case 4:
+      case 5:
+        packet->address[idx - 2] = byte;
+        break;
+      case 6:
+        packet->type = byte;
+        break;
+      case 7:
+        packet->length = (uint16_t)byte << 8;
+        break;
+      case 8:
+        packet->length |= byte;
+        break;
+      default:
+        packet->data[idx - 9] = byte;
+        if ((idx - 8) == packet->length) return FINGERPRINT_OK;
+        break;
+    }
+    idx++;
+    if ((size_t)(idx + 9) >= sizeof(packet->data)) return FINGERPRINT_BADPACKET;
+  }
+}
+
+// Command out, acknowledgement into packet (SEND_CMD_PACKET/GET_CMD_PACKET)
+bool Adafruit_Fingerprint::exchange(const uint8_t* data, uint16_t len, Adafruit_Fingerprint_Packet& packet) {
+  packet = Adafruit_Fingerprint_Packet(FINGERPRINT_COMMANDPACKET, len, (uint8_t*)data);
+  writeStructuredPacket(packet);
+  if (getStructuredPacket(&packet) != FINGERPRINT_OK) return false;
+  return packet.type == FINGERPRINT_ACKPACKET;
+}
+
+// The confirmation code, the reply's first data byte
+uint8_t Adafruit_Fingerprint::sendCommand(const uint8_t* data, uint16_t len) {
+  Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, 0, nullptr);
+  if (!exchange(data, len, packet)) return FINGERPRINT_PACKETRECIEVEERR;
+  return packet.data[0];
+}
+
+uint8_t Adafruit_Fingerprint::checkPassword() {
+  uint8_t cmd[] = { FINGERPRINT_VERIFYPASSWORD, (uint8_t)(password_ >> 24), (uint8_t)(password_ >> 16),
+                    (uint8_t)(password_ >> 8), (uint8_t)(password_ & 0xFF) };
+  if (sendCommand(cmd, sizeof(cmd)) == FINGERPRINT_OK) return FINGERPRINT_OK;
+  return FINGERPRINT_PACKETRECIEVEERR;
+}
+
+bool Adafruit_Fingerprint::verifyPassword() {
+  return checkPassword() == FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::getParameters() {
+  uint8_t cmd[] = { FINGERPRINT_READSYSPARAM };
+  Adafruit_Fingerprint_Packet reply(FINGERPRINT_COMMANDPACKET, sizeof(cmd), cmd);
+  bool ok = exchange(cmd, sizeof(cmd), reply);
+  if (!ok) return FINGERPRINT_PACKETRECIEVEERR;
+  const uint8_t* d = reply.data;
+  status_reg = ((uint16_t)d[1] << 8) | d[2];
+  system_id = ((uint16_t)d[3] << 8) | d[4];
+  capacity = ((uint16_t)d[5] << 8) | d[6];
+  security_level = ((uint16_t)d[7] << 8) | d[8];
+  device_addr = ((uint32_t)d[9] << 24) | ((uint32_t)d[10] << 16) | ((uint32_t)d[11] << 8) | (uint32_t)d[12];
+  packet_len = ((uint16_t)d[13] << 8) | d[14];
+  if (packet_len == 0) packet_len = 32;
+  else if (packet_len == 1) packet_len = 64;
+  else if (packet_len == 2) packet_len = 128;
+  else if (packet_len == 3) packet_len = 256;
+  baud_rate = (((uint16_t)d[15] << 8) | d[16]) * 9600;  // 16 bits, as in the library: 115200 does not fit
+  return d[0];
+}
+
+uint8_t Adafruit_Fingerprint::getImage() {
+  uint8_t cmd[] = { FINGERPRINT_GETIMAGE };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::image2Tz(uint8_t slot) {
+  uint8_t cmd[] = { FINGERPRINT_IMAGE2TZ, slot };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::createModel() {
+  uint8_t cmd[] = { FINGERPRINT_REGMODEL };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::storeModel(uint16_t location) {
+  uint8_t cmd[] = { FINGERPRINT_STORE, 0x01, (uint8_t)(location >> 8), (uint8_t)(location & 0xFF) };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::loadModel(uint16_t location) {
+  uint8_t cmd[] = { FINGERPRINT_LOAD, 0x01, (uint8_t)(location >> 8), (uint8_t)(location & 0xFF) };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::getModel() {
+  uint8_t cmd[] = { FINGERPRINT_UPLOAD, 0x01 };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::deleteModel(uint16_t location) {
+  uint8_t cmd[] = { FINGERPRINT_DELETE, (uint8_t)(location >> 8), (uint8_t)(location & 0xFF), 0x00, 0x01 };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::emptyDatabase() {
+  uint8_t cmd[] = { FINGERPRINT_EMPTY };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::fingerFastSearch() {
+  uint8_t cmd[] = { FINGERPRINT_HISPEEDSEARCH, 0x01, 0x00, 0x00, 0x00, 0xA3 };
+  Adafruit_Fingerprint_Packet reply(FINGERPRINT_COMMANDPACKET, sizeof(cmd), cmd);
+  bool ok = exchange(cmd, sizeof(cmd), reply);
+  fingerID = 0xFFFF;
+  confidence = 0xFFFF;
+  if (!ok) return FINGERPRINT_PACKETRECIEVEERR;
+  fingerID = ((uint16_t)reply.data[1] << 8) | reply.data[2];
+  confidence = ((uint16_t)reply.data[3] << 8) | reply.data[4];
+  return reply.data[0];
+}
+
+uint8_t Adafruit_Fingerprint::fingerSearch(uint8_t slot) {
+  uint8_t cmd[] = { FINGERPRINT_SEARCH, slot, 0x00, 0x00, (uint8_t)(capacity >> 8), (uint8_t)(capacity & 0xFF) };
+  Adafruit_Fingerprint_Packet reply(FINGERPRINT_COMMANDPACKET, sizeof(cmd), cmd);
+  bool ok = exchange(cmd, sizeof(cmd), reply);
+  fingerID = 0xFFFF;
+  confidence = 0xFFFF;
+  if (!ok) return FINGERPRINT_PACKETRECIEVEERR;
+  fingerID = ((uint16_t)reply.data[1] << 8) | reply.data[2];
+  confidence = ((uint16_t)reply.data[3] << 8) | reply.data[4];
+  return reply.data[0];
+}
+
+uint8_t Adafruit_Fingerprint::getTemplateCount() {
+  uint8_t cmd[] = { FINGERPRINT_TEMPLATECOUNT };
+  Adafruit_Fingerprint_Packet reply(FINGERPRINT_COMMANDPACKET, sizeof(cmd), cmd);
+  bool ok = exchange(cmd, sizeof(cmd), reply);
+  if (!ok) return FINGERPRINT_PACKETRECIEVEERR;
+  templateCount = ((uint16_t)reply.data[1] << 8) | reply.data[2];
+  return reply.data[0];
+}
+
+uint8_t Adafruit_Fingerprint::setPassword(uint32_t password) {
+  uint8_t cmd[] = { FINGERPRINT_SETPASSWORD, (uint8_t)(password >> 24), (uint8_t)(password >> 16),
+                    (uint8_t)(password >> 8), (uint8_t)(password & 0xFF) };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::LEDcontrol(bool on) {
+  uint8_t cmd[] = { (uint8_t)(on ? FINGERPRINT_LEDON : FINGERPRINT_LEDOFF) };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::writeRegister(uint8_t reg, uint8_t value) {
+  uint8_t cmd[] = { FINGERPRINT_WRITE_REG, reg, value };
+  return sendCommand(cmd, sizeof(cmd));
+}
+
+uint8_t Adafruit_Fingerprint::setBaudRate(uint8_t baudrate) {
+  return writeRegister(FINGERPRINT_BAUD_REG_ADDR, baudrate);
+}
+
+uint8_t Adafruit_Fingerprint::setSecurityLevel(uint8_t level) {
+  return writeRegister(FINGERPRINT_SECURITY_REG_ADDR, level);
+}
+
+uint8_t Adafruit_Fingerprint::setPacketSize(uint8_t size) {
+  return writeRegister(FINGERPRINT_PACKET_REG_ADDR, size);
+}
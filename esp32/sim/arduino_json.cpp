@@ -0,0 +1,374 @@
+// arduino_json.cpp
+// deserializeJson() for ArduinoJson.h: a recursive-descent parser that fills
+// the document's slots and, like the library with a char* input, unescapes
+// strings in place and leaves the values pointing into the input.
+#include <ArduinoJson.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ArduinoJsonSim;
+
+ArduinoJsonSim::Slot* JsonDocument::allocSlot() {
+  if (used_ >= capacity_) {
+    overflowed_ = true;
+    return nullptr;
+  }
+  Slot* slot = &pool_[used_++];
+  *slot = Slot();
+  slot->key = nullptr;
+  slot->next = nullptr;
+  return slot;
+}
+
+const char* DeserializationError::c_str() const {
+  switch (code_) {
+    case Ok: return "Ok";
+    case EmptyInput: return "EmptyInput";
+    case IncompleteInput: return "IncompleteInput";
+    case InvalidInput: return "InvalidInput";
+    case NoMemory: return "NoMemory";
+    case TooDeep: return "TooDeep";
+  }
+  return "???";
+}
+
+namespace ArduinoJsonSim {
+
+const Value* memberOf(const Value* obj, const char* key) {
+  if (!obj || obj->type != VALUE_OBJECT || !key) return nullptr;
+  for (const Slot* s = obj->coll.head; s; s = s->next) {
+    if (strcmp(s->key, key) == 0) return &s->value;
+  }
+  return nullptr;
+}
+
+const Value* elementOf(const Value* arr, size_t index) {
+  if (!arr || arr->type != VALUE_ARRAY) return nullptr;
+  const Slot* s = arr->coll.head;
+  while (s && index--) s = s->next;
+  return s ? &s->value : nullptr;
+}
+
+int64_t toSigned(const Value* v) {
+  if (!v) return 0;
+  switch (v->type) {
+    case VALUE_SIGNED: return v->i;
+    case VALUE_UNSIGNED: return (int64_t)v->u;
+    case VALUE_FLOAT: return (int64_t)v->f;
+    case VALUE_BOOL: return v->b ? 1 : 0;
+    case VALUE_STRING: return strtoll(v->str, nullptr, 10);
+    default: return 0;
+  }
+}
+
+uint64_t toUnsigned(const Value* v) {
+  if (!v) return 0;
+  switch (v->type) {
+    case VALUE_SIGNED: return (uint64_t)v->i;
+    case VALUE_UNSIGNED: return v->u;
+    case VALUE_FLOAT: return v->f < 0 ? 0 : (uint64_t)v->f;
+    case VALUE_BOOL: return v->b ? 1 : 0;
+    case VALUE_STRING: return *v->str == '-' ? 0 : strtoull(v->str, nullptr, 10);
+    default: return 0;
+  }
+}
+
+double toFloat(const Value* v) {
+  if (!v) return 0;
+  switch (v->type) {
+    case VALUE_SIGNED: return (double)v->i;
+    case VALUE_UNSIGNED: return (double)v->u;
+    case VALUE_FLOAT: return v->f;
+    case VALUE_BOOL: return v->b ? 1 : 0;
+    case VALUE_STRING: return strtod(v->str, nullptr);
+    default: return 0;
+  }
+}
+
+}  // namespace ArduinoJsonSim
+
+namespace {
+
+class Parser {
+public:
+  Parser(JsonDocument& doc, char* input, size_t length, uint8_t nesting)
+      : doc_(doc), p_(input), end_(input + length), nesting_(nesting) {}
+
+  DeserializationError run() {
+    skipSpace();
+    if (atEnd()) return DeserializationError::EmptyInput;
+    return parseValue(doc_.root(), nesting_);
+  }
+
+private:
+  bool atEnd() const { return p_ >= end_ || *p_ == '\0'; }
+
+  void skipSpace() {
+    while (!atEnd() && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n')) ++p_;
+  }
+
+  DeserializationError parseValue(Value& out, uint8_t nesting) {
+    skipSpace();
+    if (atEnd()) return DeserializationError::IncompleteInput;
+    switch (*p_) {
+      case '{':
+        if (nesting == 0) return DeserializationError::TooDeep;
+        return parseObject(out, nesting - 1);
+      case '[':
+        if (nesting == 0) return DeserializationError::TooDeep;
+        return parseArray(out, nesting - 1);
+      case '"':
+      case '\'': {
+        const char* s;
+        DeserializationError err = parseString(s);
+        if (err) return err;
+        out.type = VALUE_STRING;
+        out.str = s;
+        return DeserializationError::Ok;
+      }
+      case 't': return parseLiteral("true", out, VALUE_BOOL, true);
+      case 'f': return parseLiteral("false", out, VALUE_BOOL, false);
+      case 'n': return parseLiteral("null", out, VALUE_NULL, false);
+      default: return parseNumber(out);
+    }
+  }
+
+  DeserializationError parseObject(Value& out, uint8_t nesting) {
+    ++p_;  // '{'
+    out.type = VALUE_OBJECT;
+    out.coll.head = out.coll.tail = nullptr;
+    out.coll.size = 0;
+    skipSpace();
+    if (atEnd()) return DeserializationError::IncompleteInput;
+    if (*p_ == '}') {
+      ++p_;
+      return DeserializationError::Ok;
+    }
+    for (;;) {
+      skipSpace();
+      if (atEnd()) return DeserializationError::IncompleteInput;
+      if (*p_ != '"' && *p_ != '\'') return DeserializationError::InvalidInput;
+      const char* key;
+      DeserializationError err = parseString(key);
+      if (err) return err;
+      skipSpace();
+      if (atEnd()) return DeserializationError::IncompleteInput;
+      if (*p_ != ':') return DeserializationError::InvalidInput;
+      ++p_;
+
+      // A repeated key replaces the earlier value, as in the library
+      Slot* slot = nullptr;
+      for (Slot* s = out.coll.head; s; s = s->next) {
+        if (strcmp(s->key, key) == 0) slot = s;
+      }
+      if (slot) {
+        slot->value = Value();
+      } else {
+        slot = doc_.allocSlot();
+        if (!slot) return DeserializationError::NoMemory;
+        slot->key = key;
+        append(out, slot);
+      }
+      err = parseValue(slot->value, nesting);
+      if (err) return err;
+
+      skipSpace();
+      if (atEnd()) return DeserializationError::IncompleteInput;
+      if (*p_ == '}') {
+        ++p_;
+        return DeserializationError::Ok;
+      }
+      if (*p_ != ',') return DeserializationError::InvalidInput;
+      ++p_;
+    }
+  }
+
+  DeserializationError parseArray(Value& out, uint8_t nesting) {
+    ++p_;  // '['
+    out.type = VALUE_ARRAY;
+    out.coll.head = out.coll.tail = nullptr;
+    out.coll.size = 0;
+    skipSpace();
+    if (atEnd()) return DeserializationError::IncompleteInput;
+    if (*p_ == ']') {
+      ++p_;
+      return DeserializationError::Ok;
+    }
+    for (;;) {
+      Slot* slot = doc_.allocSlot();
+      if (!slot) return DeserializationError::NoMemory;
+      append(out, slot);
+      DeserializationError err = parseValue(slot->value, nesting);
+      if (err) return err;
+
+      skipSpace();
+      if (atEnd()) return DeserializationError::IncompleteInput;
+      if (*p_ == ']') {
+        ++p_;
+        return DeserializationError::Ok;
+      }
+      if (*p_ != ',') return DeserializationError::InvalidInput;
+      ++p_;
+    }
+  }
+
+  static void append(Value& coll, Slot* slot) {
+    if (coll.coll.tail) coll.coll.tail->next = slot;
+    else coll.coll.head = slot;
+    coll.coll.tail = slot;
+    coll.coll.size++;
+  }
+
+  static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  bool readHex4(uint16_t& out) {
+    out = 0;
+    for (int i = 0; i < 4; ++i) {
+      if (atEnd()) return false;
+      int d = hexDigit(*p_++);
+      if (d < 0) return false;
+      out = (uint16_t)((out << 4) | d);
+    }
+    return true;
+  }
+
+  static char* putUtf8(char* w, uint32_t cp) {
+    if (cp < 0x80) {
+      *w++ = (char)cp;
+    } else if (cp < 0x800) {
+      *w++ = (char)(0xC0 | (cp >> 6));
+      *w++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      *w++ = (char)(0xE0 | (cp >> 12));
+      *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+      *w++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+      *w++ = (char)(0xF0 | (cp >> 18));
+      *w++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+      *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+      *w++ = (char)(0x80 | (cp & 0x3F));
+    }
+    return w;
+  }
+
+  // Unescapes in place: the decoded text is never longer than the source, so
+  // the writer trails the reader and the closing quote becomes the terminator
+  DeserializationError parseString(const char*& out) {
+    char quote = *p_++;
+    char* start = p_;
+    char* w = p_;
+    for (;;) {
+      if (atEnd()) return DeserializationError::IncompleteInput;
+      char c = *p_++;
+      if (c == quote) break;
+      if (c != '\\') {
+        *w++ = c;
+        continue;
+      }
+      if (atEnd()) return DeserializationError::IncompleteInput;
+      char e = *p_++;
+      switch (e) {
+        case '"':
+        case '\'':
+        case '\\':
+        case '/': *w++ = e; break;
+        case 'b': *w++ = '\b'; break;
+        case 'f': *w++ = '\f'; break;
+        case 'n': *w++ = '\n'; break;
+        case 'r': *w++ = '\r'; break;
+        case 't': *w++ = '\t'; break;
+        case 'u': {
+          uint16_t unit;
+          if (!readHex4(unit)) return atEnd() ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput;
+          uint32_t cp = unit;
+          if (unit >= 0xD800 && unit < 0xDC00 && end_ - p_ >= 6 && p_[0] == '\\' && p_[1] == 'u') {
+            p_ += 2;
+            uint16_t low;
+            if (!readHex4(low)) return DeserializationError::InvalidInput;
+            cp = 0x10000 + (((uint32_t)unit - 0xD800) << 10) + (low - 0xDC00);
+          }
+          w = putUtf8(w, cp);
+          break;
+        }
+        default: return DeserializationError::InvalidInput;
+      }
+    }
+    *w = '\0';
+    out = start;
+    return DeserializationError::Ok;
+  }
+
+  DeserializationError parseLiteral(const char* word, Value& out, ValueType type, bool b) {
+    for (const char* q = word; *q; ++q, ++p_) {
+      if (atEnd()) return DeserializationError::IncompleteInput;
+      if (*p_ != *q) return DeserializationError::InvalidInput;
+    }
+    out.type = type;
+    out.b = b;
+    return DeserializationError::Ok;
+  }
+
+  DeserializationError parseNumber(Value& out) {
+    char buf[64];
+    size_t n = 0;
+    while (!atEnd() && n < sizeof(buf) - 1 && strchr("+-0123456789.eE", *p_)) buf[n++] = *p_++;
+    buf[n] = '\0';
+    if (n == 0) return DeserializationError::InvalidInput;
+
+    bool negative = buf[0] == '-';
+    const char* digits = buf + (negative || buf[0] == '+');
+    bool integral = *digits && strspn(digits, "0123456789") == strlen(digits);
+    if (integral) {
+      errno = 0;
+      if (negative) {
+        long long v = strtoll(buf, nullptr, 10);
+        if (errno == 0) {
+          out.type = VALUE_SIGNED;
+          out.i = v;
+          return DeserializationError::Ok;
+        }
+      } else {
+        unsigned long long v = strtoull(digits, nullptr, 10);
+        if (errno == 0) {
+          out.type = VALUE_UNSIGNED;
+          out.u = v;
+          return DeserializationError::Ok;
+        }
+      }
+      // out of 64-bit range: stored as a float, as the library does
+    }
+    char* endp;
+    double f = strtod(buf, &endp);
+    if (*endp != '\0') return DeserializationError::InvalidInput;
+    out.type = VALUE_FLOAT;
+    out.f = f;
+    return DeserializationError::Ok;
+  }
+
+  JsonDocument& doc_;
+  char* p_;
+  char* end_;
+  uint8_t nesting_;
+};
+
+}  // namespace
+
+DeserializationError deserializeJson(JsonDocument& doc, char* input, size_t length,
+                                     DeserializationOption::NestingLimit limit) {
+  doc.clear();
+  if (!input) return DeserializationError::EmptyInput;
+  Parser parser(doc, input, length, limit.value);
+  DeserializationError err = parser.run();
+  if (err) doc.clear();
+  return err;
+}
+
+DeserializationError deserializeJson(JsonDocument& doc, char* input, DeserializationOption::NestingLimit limit) {
+  return deserializeJson(doc, input, input ? strlen(input) : 0, limit);
+}
@@ -0,0 +1,261 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// Shared by the benches: a booted station, the backend side of its topics,
+// a scripted voter at the sensor and the statistics the benches report.
+// Everything is timed on the simulator's clock unless it says wall clock.
+#include "sim.h"
+#include "../../messaging.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+inline bool hasFlag(int argc, char** argv, const char* flag) {
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], flag) == 0) return true;
+  }
+  return false;
+}
+
+// "esp32/fp-a1b2c3/<suffix>" for the default SimConfig MAC
+inline std::string stationTopic(const char* suffix) {
+  char mac[8];
+  const uint8_t* m = simConfig().mac;
+  snprintf(mac, sizeof(mac), "%02x%02x%02x", m[3], m[4], m[5]);
+  return std::string("esp32/fp-") + mac + "/" + suffix;
+}
+
+// The value of "key" in a flat JSON message: the string without quotes, or
+// the number/literal as written; "" when absent. Good enough for what the
+// station publishes, which never nests a key inside a string.
+inline std::string jsonField(const std::string& json, const char* key) {
+  std::string needle = std::string("\"") + key + "\":";
+  size_t at = json.find(needle);
+  if (at == std::string::npos) return "";
+  at += needle.size();
+  if (at < json.size() && json[at] == '"') {
+    size_t end = json.find('"', at + 1);
+    return end == std::string::npos ? "" : json.substr(at + 1, end - at - 1);
+  }
+  size_t end = json.find_first_of(",}]", at);
+  return json.substr(at, end == std::string::npos ? std::string::npos : end - at);
+}
+
+inline uint32_t jsonUint(const std::string& json, const char* key) {
+  return (uint32_t)strtoul(jsonField(json, key).c_str(), nullptr, 10);
+}
+
+// A status message in either wire format (messaging.h)
+struct StatusView {
+  bool valid = false;
+  std::string status;  // statusToString() name
+  std::string message;
+  uint32_t rid = 0;
+};
+
+inline StatusView decodeStatus(const std::string& payload) {
+  StatusView v;
+  const uint8_t* b = (const uint8_t*)payload.data();
+  size_t n = payload.size();
+  if (n >= 4 && b[0] == WIRE_BINARY_MAGIC) {
+    if (b[1] != WIRE_MSG_STATUS || n < 4u + b[3]) return v;
+    v.valid = true;
+    v.status = statusToString((EnrolmentStatus)b[2]);
+    v.message.assign((const char*)b + 4, b[3]);
+    size_t at = 4 + b[3];
+    if (n >= at + 12) {
+      v.rid = ((uint32_t)b[at] << 24) | ((uint32_t)b[at + 1] << 16) | ((uint32_t)b[at + 2] << 8) | b[at + 3];
+    }
+    return v;
+  }
+  v.status = jsonField(payload, "status");
+  v.valid = !v.status.empty();
+  v.message = jsonField(payload, "message");
+  v.rid = jsonUint(payload, "rid");
+  return v;
+}
+
+inline bool isFinalStatus(const std::string& status) {
+  return status == "success" || status == "error" || status == "timeout" || status == "cancelled" ||
+         status == "busy";
+}
+
+// Lower-case hex, as the station writes hashes
+inline std::string hex(const uint8_t* data, size_t len) {
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+  for (size_t i = 0; i < len; ++i) {
+    s += digits[data[i] >> 4];
+    s += digits[data[i] & 0x0F];
+  }
+  return s;
+}
+
+// Boots a fresh station and waits for its MQTT session; exits on failure.
+// beforeBoot sets up what the station should find at power-on (templates
+// already on the sensor, flash contents).
+inline void bootStation(const SimConfig& config, const std::function<void()>& beforeBoot = nullptr) {
+  simInit(config);
+  if (beforeBoot) beforeBoot();
+  simBoot();
+  if (!simRunUntil([] { return simStationConnected(); }, 60000)) {
+    fprintf(stderr, "station did not connect\n%s", simSerialTake().c_str());
+    exit(2);
+  }
+  simRunFor(500);  // boot report and retained state out of the way
+}
+
+// Runs trial in a child process, for a fresh set of firmware globals (a
+// process hosts one station). True if trial returned true.
+inline bool isolated(const std::function<bool()>& trial) {
+  int pid = simFork();
+  if (pid == 0) {
+    bool ok = trial();
+    fflush(stdout);
+    fflush(stderr);
+    _exit(ok ? 0 : 1);
+  }
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid) return false;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The backend: sends commands with a rid and waits for the status that ends them
+class Backend {
+public:
+  Backend() : peer_("backend") {
+    peer_.subscribe(stationTopic("#").c_str());
+    peer_.onMessage = [this](const SimMessage& m) { onMessage(m); };
+  }
+
+  // Publishes {"action":..,"rid":n<,extra>}; returns the rid
+  uint32_t send(const char* action, const std::string& extra = "") {
+    uint32_t rid = ++nextRid_;
+    std::string json = std::string("{\"action\":\"") + action + "\",\"rid\":" + std::to_string(rid);
+    if (!extra.empty()) json += "," + extra;
+    json += "}";
+    peer_.publish(stationTopic("fingerprint/command"), json);
+    sentUs_ = simMicros();
+    return rid;
+  }
+
+  // Waits for a final status (success, error, timeout, cancelled, busy) with rid
+  bool waitFinal(uint32_t rid, uint32_t timeoutMs, std::string* status = nullptr) {
+    finalStatus_.clear();
+    waitRid_ = rid;
+    bool ok = simRunUntil([this] { return !finalStatus_.empty(); }, timeoutMs);
+    waitRid_ = 0;
+    if (status) *status = finalStatus_;
+    return ok;
+  }
+
+  // Final statuses with rid among messages(); a request gets exactly one
+  uint32_t finals(uint32_t rid) const {
+    uint32_t n = 0;
+    for (const SimMessage& m : messages_) {
+      if (m.topic != stationTopic("fingerprint/status")) continue;
+      StatusView v = decodeStatus(m.payload);
+      n += v.rid == rid && isFinalStatus(v.status);
+    }
+    return n;
+  }
+
+  uint64_t sentUs() const { return sentUs_; }
+  uint64_t finalUs() const { return finalUs_; }
+  const std::string& finalMessage() const { return finalMessage_; }
+  std::vector<SimMessage>& messages() { return messages_; }
+
+private:
+  void onMessage(const SimMessage& m) {
+    messages_.push_back(m);
+    if (!waitRid_ || m.topic != stationTopic("fingerprint/status")) return;
+    StatusView v = decodeStatus(m.payload);
+    if (v.rid != waitRid_ || !isFinalStatus(v.status)) return;
+    finalStatus_ = v.status;
+    finalMessage_ = v.message;
+    finalUs_ = m.atUs;
+  }
+
+  SimPeer peer_;
+  std::vector<SimMessage> messages_;
+  uint32_t nextRid_ = 0;
+  uint32_t waitRid_ = 0;
+  uint64_t sentUs_ = 0;
+  uint64_t finalUs_ = 0;
+  std::string finalStatus_;
+  std::string finalMessage_;
+};
+
+// A voter at the sensor who follows the prompts on the status topic: puts the
+// finger on placeMs after being asked, takes it off liftMs after being asked
+// and once the flow has ended
+class Voter {
+public:
+  uint32_t placeMs = 400;
+  uint32_t liftMs = 250;
+
+  Voter() : peer_("voter") {
+    peer_.subscribe(stationTopic("fingerprint/status").c_str());
+    peer_.onMessage = [this](const SimMessage& m) { onStatus(m); };
+  }
+
+  void expect(uint32_t person) { person_ = person; }
+  void leave() { person_ = 0; }
+
+private:
+  void onStatus(const SimMessage& m) {
+    std::string status = decodeStatus(m.payload).status;
+    uint32_t person = person_;
+    if (!person) return;
+    if (status == "place_finger" || status == "place_finger_again") {
+      simAfter(placeMs, [person] { simSensor().place(person); });
+    } else if (status == "remove_finger" || (isFinalStatus(status) && status != "busy")) {
+      simAfter(liftMs, [] { simSensor().lift(); });
+    }
+  }
+
+  SimPeer peer_;
+  uint32_t person_ = 0;
+};
+
+struct Samples {
+  std::vector<double> v;
+
+  void add(double x) { v.push_back(x); }
+  size_t size() const { return v.size(); }
+  double mean() const {
+    double s = 0;
+    for (double x : v) s += x;
+    return v.empty() ? 0 : s / v.size();
+  }
+  // Nearest-rank percentile, p in [0, 100]
+  double pct(double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t)(p / 100.0 * v.size() + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > v.size()) rank = v.size();
+    return v[rank - 1];
+  }
+  double max() {
+    return pct(100);
+  }
+};
+
+inline double wallSeconds() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace bench
+
+#endif
@@ -0,0 +1,149 @@
+// dispatch_bench.cpp
+// The command dispatcher (command_dispatch.h) on both transports. For each
+// kind of command a burst arrives at once, on the command topic or typed on
+// the serial console, and the station works through it. Reports per kind:
+//  - msgs/s: how fast the station drains the burst, simulated time (the
+//    network task takes one MQTT message per loop, the console is 115200 baud)
+//  - dispatch: the firmware's own LAT_COMMAND mean per MQTT command (parse and
+//    handler): host CPU with SimConfig::measureCpu, plus the simulated time
+//    the handler waits for the 115200 baud console to take its log lines
+//  - task: host CPU the receiving task spent per command, replies included
+//  - allocs: heap allocations per command, anywhere on the station
+// Fails if a command allocates or a message is lost, or if a cancel sent
+// behind a burst of verify commands is answered busy.
+//
+//   dispatch_bench [--quick]
+#include "bench_util.h"
+#include "../../command_dispatch.h"
+#include "../../latency.h"
+
+using namespace bench;
+
+static int failures = 0;
+
+static uint64_t taskCpuUs(const char* name) {
+  for (const SimTaskInfo& t : simTasks()) {
+    if (t.name == name) return t.cpuUs;
+  }
+  return 0;
+}
+
+static uint32_t handled(bool mqtt) {
+  return mqtt ? commandStats().mqtt : commandStats().serial;
+}
+
+// Sends n commands at once on one transport and reports one row
+static void burst(Backend& backend, bool mqtt, const char* name, uint32_t n,
+                  const std::function<std::string(uint32_t i)>& make) {
+  const char* task = mqtt ? "network" : "sensor";
+  uint32_t before = handled(mqtt);
+  uint32_t heapBefore = simHeapStats().allocations;
+  uint32_t dispatchAllocs = commandStats().allocations;
+  LatencyHistogram lat = latencyHistograms[LAT_COMMAND];
+  uint64_t cpuBefore = taskCpuUs(task);
+  uint32_t lostBefore = simBrokerStats().lostToStation;
+  uint64_t startUs = simMicros();
+
+  if (mqtt) {
+    SimPeer sender("sender");
+    for (uint32_t i = 0; i < n; ++i) sender.publish(stationTopic("fingerprint/command"), make(i));
+  } else {
+    std::string lines;
+    for (uint32_t i = 0; i < n; ++i) lines += make(i) + "\n";
+    simSerialInput(lines.c_str());
+  }
+  bool done = simRunUntil([&] { return handled(mqtt) - before >= n; }, 600000);
+  double seconds = (simMicros() - startUs) / 1e6;
+  uint32_t count = handled(mqtt) - before;
+  uint32_t allocations = simHeapStats().allocations - heapBefore;
+  uint32_t lost = simBrokerStats().lostToStation - lostBefore;
+  const LatencyHistogram& now = latencyHistograms[LAT_COMMAND];
+  uint32_t timed = now.count - lat.count;
+
+  char dispatch[16] = "-";
+  if (mqtt && timed) snprintf(dispatch, sizeof(dispatch), "%.2f", (double)(now.sumUs - lat.sumUs) / timed);
+  printf("  %-6s %-24s %6u %10.0f %10s %10.2f %8.2f %6u\n", mqtt ? "mqtt" : "serial", name, count,
+         seconds > 0 ? count / seconds : 0, dispatch, count ? (double)(taskCpuUs(task) - cpuBefore) / count : 0,
+         count ? (double)allocations / count : 0, lost);
+  if (!done || lost) {
+    fprintf(stderr, "%s: %u of %u handled, %u lost\n", name, count, n, lost);
+    failures++;
+  }
+  if (allocations || commandStats().allocations != dispatchAllocs) {
+    fprintf(stderr, "%s: %u heap allocation(s)\n", name, allocations);
+    failures++;
+  }
+
+  // whatever the burst queued or started goes away before the next kind
+  backend.send("cancel", "\"all\":true");
+  backend.send("end-session");
+  simRunFor(3000);
+  simSerialTake();
+}
+
+static std::string command(const char* action, uint32_t rid, const std::string& extra = "") {
+  std::string json = std::string("{\"action\":\"") + action + "\",\"rid\":" + std::to_string(rid);
+  if (!extra.empty()) json += "," + extra;
+  return json + "}";
+}
+
+// A cancel behind a burst that fills the command queue is still taken: the
+// sensor task is held up by console commands while the burst arrives
+static void cancelBehindBurst(Backend& backend, uint32_t n) {
+  std::string lines;
+  for (uint32_t i = 0; i < 4 * n; ++i) lines += "count\n";
+  simSerialInput(lines.c_str());
+  simRunFor(10);
+  SimPeer sender("sender");
+  for (uint32_t i = 0; i < n; ++i) {
+    sender.publish(stationTopic("fingerprint/command"), command("verify", 1000 + i, "\"start\":1,\"count\":100"));
+  }
+  uint32_t rid = backend.send("cancel", "\"all\":true");
+  std::string status;
+  bool answered = backend.waitFinal(rid, 60000, &status);
+  printf("  cancel behind %u verify: %s\n", n, answered ? status.c_str() : "no answer");
+  if (!answered || status == "busy") {
+    fprintf(stderr, "cancel behind a burst: %s %s\n", answered ? status.c_str() : "no answer",
+            backend.finalMessage().c_str());
+    failures++;
+  }
+  simRunFor(3000);
+  simSerialTake();
+}
+
+int main(int argc, char** argv) {
+  bool quick = hasFlag(argc, argv, "--quick");
+  const uint32_t n = quick ? 50 : 1000;
+
+  SimConfig config;
+  config.measureCpu = true;
+  bootStation(config, [] {
+    for (uint16_t id = 1; id <= 100; ++id) simSensor().enrollDirect(id, 1000 + id);
+  });
+  Backend backend;
+  simSerialTake();
+
+  std::string ids;
+  for (uint16_t id = 300; id < 500; ++id) ids += (ids.empty() ? "" : ",") + std::to_string(id);
+
+  printf("dispatch_bench: bursts of %u commands; msgs/s simulated, dispatch and task in us\n", n);
+  printf("  %-6s %-24s %6s %10s %10s %10s %8s %6s\n", "via", "command", "n", "msgs/s", "dispatch", "task",
+         "allocs", "lost");
+  burst(backend, true, "enrolled-count", n, [](uint32_t i) { return command("enrolled-count", 1000 + i); });
+  burst(backend, true, "set-format", n,
+        [](uint32_t i) { return command("set-format", 1000 + i, "\"format\":\"json\""); });
+  burst(backend, true, "verify (queue, busy)", n,
+        [](uint32_t i) { return command("verify", 1000 + i, "\"start\":1,\"count\":100"); });
+  burst(backend, true, "enroll-session, 200 ids", n,
+        [&ids](uint32_t i) { return command("enroll-session", 1000 + i, "\"userIds\":[" + ids + "]"); });
+  burst(backend, true, "unknown action", n, [](uint32_t i) { return command("no-such-action", 1000 + i); });
+  burst(backend, true, "malformed JSON", n,
+        [](uint32_t i) { return "{\"action\":\"verify\",\"rid\":" + std::to_string(1000 + i) + ","; });
+  burst(backend, false, "enrolled-count", n, [](uint32_t) { return std::string("enrolled-count"); });
+  burst(backend, false, "verify 1 100", n, [](uint32_t) { return std::string("verify 1 100"); });
+  burst(backend, false, "unknown command", n, [](uint32_t) { return std::string("no-such-command"); });
+  cancelBehindBurst(backend, n);
+
+  if (failures) printf("FAILED: %d check(s)\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+// parser_bench.cpp
+// FpPacketParser (fingerprint_packet.h) on UpChar byte streams, in two parts:
+//
+//  1. Replay, host CPU time: synthetic template transfers at every packet
+//     size, with stray bytes between packets and single bit flips, fed the
+//     way the firmware reads the UART (byte at a time, in read()-sized
+//     slices, and zero-copy through payloadWindow()). Reports templates/s
+//     and checks that no corrupted template is ever reported as done.
+//     --capture <file> replays a recorded stream instead (raw bytes after
+//     the UpChar acknowledgement, any number of 512-byte templates).
+//  2. On the station, simulated time: bulk downloads from a sensor that adds
+//     noise and flips bits, reporting templates/s, retries and failures, and
+//     checking every published hash against the sensor's template.
+//
+//   parser_bench [--quick] [--capture <file>]
+#include "bench_util.h"
+#include "../../fingerprint_packet.h"
+#include <mbedtls/sha256.h>
+
+using namespace bench;
+
+#define TEMPLATE_BYTES 512
+
+static int failures = 0;
+
+// --- Replay ---
+
+struct ByteStream {
+  std::vector<uint8_t> bytes;
+  std::vector<std::vector<uint8_t>> templates;  // what each transfer carries
+  std::vector<bool> flipped;                    // a bit of that transfer was flipped
+};
+
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t next32() {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return (uint32_t)rng;
+}
+
+static ByteStream synthesize(size_t count, size_t packetLen, double noise, double flip) {
+  ByteStream s;
+  uint8_t packet[FP_PACKET_MAX_PAYLOAD + FP_PACKET_OVERHEAD];
+  for (size_t t = 0; t < count; ++t) {
+    std::vector<uint8_t> tpl(TEMPLATE_BYTES);
+    SimSensor::makeTemplate(tpl.data(), 1000 + (uint32_t)t, 0);
+    bool flipped = false;
+    for (size_t off = 0; off < TEMPLATE_BYTES; off += packetLen) {
+      if (next32() % 1000000 < noise * 1000000) {
+        size_t stray = 1 + next32() % 8;
+        for (size_t i = 0; i < stray; ++i) s.bytes.push_back((uint8_t)next32());
+      }
+      uint8_t pid = off + packetLen >= TEMPLATE_BYTES ? FP_PACKET_PID_END : FP_PACKET_PID_DATA;
+      size_t n = fpBuildPacket(packet, 0xFFFFFFFF, pid, tpl.data() + off, packetLen);
+      if (next32() % 1000000 < flip * 1000000) {
+        packet[next32() % n] ^= (uint8_t)(1u << (next32() % 8));
+        flipped = true;
+      }
+      s.bytes.insert(s.bytes.end(), packet, packet + n);
+    }
+    s.templates.push_back(tpl);
+    s.flipped.push_back(flipped);
+  }
+  return s;
+}
+
+enum ReadMode { READ_BYTES, READ_SLICES, READ_ZERO_COPY };
+static const char* const READ_MODES[] = { "byte at a time", "read() slices", "zero-copy" };
+
+struct ReplayResult {
+  size_t done = 0;
+  size_t detected = 0;    // transfer reported as failed
+  size_t undetected = 0;  // reported done with wrong contents
+  size_t resyncBytes = 0;
+  double seconds = 0;
+};
+
+// Parses transfer after transfer the way receiveTemplatePayload() does; a
+// failed transfer resynchronizes on the next one, as a retry would
+static ReplayResult replay(const ByteStream& s, ReadMode mode) {
+  ReplayResult r;
+  uint8_t dest[TEMPLATE_BYTES];
+  FpPacketParser parser;
+  const uint8_t* p = s.bytes.data();
+  const uint8_t* end = p + s.bytes.size();
+  size_t index = 0;
+  double start = wallSeconds();
+  while (p < end) {
+    parser.begin(dest, TEMPLATE_BYTES);
+    while (parser.result() == FP_PARSE_IN_PROGRESS && p < end) {
+      // bytes "in the RX buffer": what arrives between two polls
+      size_t avail = mode == READ_BYTES ? 1 : 1 + next32() % 64;
+      if (avail > (size_t)(end - p)) avail = end - p;
+      uint8_t* dst = nullptr;
+      size_t window = mode == READ_ZERO_COPY ? parser.payloadWindow(&dst) : 0;
+      if (window > 0) {
+        size_t n = window < avail ? window : avail;
+        memcpy(dst, p, n);
+        p += n;
+        parser.commitPayload(n);
+      } else {
+        size_t consumed = 0;
+        size_t want = mode == READ_BYTES ? 1 : parser.wanted();
+        parser.feed(p, want < avail ? want : avail, &consumed);
+        p += consumed;
+      }
+    }
+    r.resyncBytes += parser.skippedBytes();
+    if (parser.result() == FP_PARSE_IN_PROGRESS) break;  // stream ended inside a transfer
+    if (parser.result() == FP_PARSE_DONE) {
+      r.done++;
+      // the transfer this one ended in; a resync may have skipped earlier ones
+      bool match = false;
+      for (size_t i = index; i < s.templates.size() && !match; ++i) {
+        if (memcmp(dest, s.templates[i].data(), TEMPLATE_BYTES) == 0) {
+          match = true;
+          index = i + 1;
+        }
+      }
+      if (!match && !s.templates.empty()) r.undetected++;
+    } else {
+      r.detected++;
+    }
+  }
+  r.seconds = wallSeconds() - start;
+  return r;
+}
+
+static void replaySuite(bool quick) {
+  const size_t count = quick ? 500 : 20000;
+  static const size_t PACKET_LENS[] = { 32, 64, 128, 256 };
+  printf("replay: %zu templates per stream, host CPU time\n", count);
+  printf("  %-5s %-6s %-6s %-16s %12s %8s %9s %10s\n", "pkt", "noise", "flip", "reader", "templates/s", "done",
+         "detected", "undetected");
+  for (size_t packetLen : PACKET_LENS) {
+    struct Mix {
+      double noise, flip;
+    };
+    static const Mix MIXES[] = { { 0, 0 }, { 0.2, 0 }, { 0.05, 0.02 } };
+    for (const Mix& mix : MIXES) {
+      ByteStream s = synthesize(count, packetLen, mix.noise, mix.flip);
+      size_t flippedTransfers = 0;
+      for (bool f : s.flipped) flippedTransfers += f;
+      for (int mode = READ_BYTES; mode <= READ_ZERO_COPY; ++mode) {
+        ReplayResult r = replay(s, (ReadMode)mode);
+        printf("  %-5zu %-6.2f %-6.2f %-16s %12.0f %8zu %9zu %10zu\n", packetLen, mix.noise, mix.flip,
+               READ_MODES[mode], r.seconds > 0 ? r.done / r.seconds : 0, r.done, r.detected, r.undetected);
+        if (r.undetected) {
+          fprintf(stderr, "replay: %zu corrupted template(s) reported done\n", r.undetected);
+          failures++;
+        }
+        // every clean transfer comes through; a flipped one may cost its
+        // neighbour too while the parser resynchronizes
+        if (r.done + 2 * flippedTransfers < count) {
+          fprintf(stderr, "replay: only %zu of %zu templates (%zu flipped)\n", r.done, count, flippedTransfers);
+          failures++;
+        }
+      }
+    }
+  }
+}
+
+static void replayCapture(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "cannot open %s\n", path);
+    failures++;
+    return;
+  }
+  ByteStream s;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.bytes.insert(s.bytes.end(), buf, buf + n);
+  fclose(f);
+  printf("capture %s: %zu bytes\n", path, s.bytes.size());
+  for (int mode = READ_BYTES; mode <= READ_ZERO_COPY; ++mode) {
+    ReplayResult r = replay(s, (ReadMode)mode);
+    printf("  %-16s %12.0f templates/s  %zu done, %zu failed, %zu bytes skipped\n", READ_MODES[mode],
+           r.seconds > 0 ? r.done / r.seconds : 0, r.done, r.detected, r.resyncBytes);
+  }
+}
+
+// --- On the station ---
+
+// One station: bulk download from a sensor with these faults. Every published
+// hash must be the sensor's template's; a clean link must lose nothing.
+static bool faultRun(uint16_t library, double noise, double bitFlip, bool clean) {
+  SimConfig config;
+  config.sensor.noise = noise;
+  config.sensor.bitFlip = bitFlip;
+  bootStation(config, [&] {
+    for (uint16_t id = 1; id <= library; ++id) simSensor().enrollDirect(id, 1000 + id);
+  });
+  Backend backend;
+  uint32_t upBefore = simSensor().stats().templatesUp;
+  uint32_t allocBefore = simHeapStats().allocations;
+  uint32_t rid = backend.send("download-all", "\"max\":" + std::to_string(library));
+  std::string status;
+  bool done = backend.waitFinal(rid, library * 2000, &status);
+  simRunFor(500);
+  unsigned ok = 0, failed = 0;
+  const std::string& summary = backend.finalMessage();
+  size_t colon = summary.find(": ");
+  if (colon != std::string::npos) sscanf(summary.c_str() + colon + 2, "%u ok, %u failed", &ok, &failed);
+  double seconds = (backend.finalUs() - backend.sentUs()) / 1e6;
+
+  unsigned wrong = 0;
+  for (const SimMessage& m : backend.messages()) {
+    if (m.topic != stationTopic("fingerprint/templates")) continue;
+    for (size_t at = m.payload.find("\"id\":"); at != std::string::npos; at = m.payload.find("\"id\":", at + 1)) {
+      uint16_t id = (uint16_t)atoi(m.payload.c_str() + at + 5);
+      uint8_t digest[32];
+      const uint8_t* tpl = simSensor().templateAt(id);
+      if (!tpl) {
+        wrong++;
+        continue;
+      }
+      mbedtls_sha256(tpl, TEMPLATE_BYTES, digest, 0);
+      if (m.payload.compare(m.payload.find("\"template\":\"", at) + 12, 64, hex(digest, 32)) != 0) wrong++;
+    }
+  }
+  uint32_t allocations = simHeapStats().allocations - allocBefore;
+  printf("  %-6.2f %-6.2f %12.1f %8u %8u %8u %8u %8u\n", noise, bitFlip, done ? (ok + failed) / seconds : 0, ok,
+         failed, simSensor().stats().templatesUp - upBefore, wrong, allocations);
+  // the receive path allocates nothing per template
+  if (allocations >= library) fprintf(stderr, "station: %u heap allocations\n", allocations);
+  if (!done || status != "success" || wrong || ok + failed != library || (clean && failed) || allocations >= library) {
+    fprintf(stderr, "station: %s %s\n", done ? status.c_str() : "no final status", summary.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void stationSuite(bool quick) {
+  const uint16_t library = quick ? 30 : 200;
+  struct Fault {
+    double noise, bitFlip;
+  };
+  static const Fault FAULTS[] = { { 0, 0 }, { 0.1, 0 }, { 0, 0.01 }, { 0.1, 0.05 } };
+  printf("station: bulk download of %u templates, simulated time\n", (unsigned)library);
+  printf("  %-6s %-6s %12s %8s %8s %8s %8s %8s\n", "noise", "flip", "templates/s", "ok", "failed", "uploads", "wrong",
+         "allocs");
+  for (const Fault& fault : FAULTS) {
+    bool clean = fault.noise == 0 && fault.bitFlip == 0;
+    if (!isolated([&] { return faultRun(library, fault.noise, fault.bitFlip, clean); })) failures++;
+  }
+}
+
+int main(int argc, char** argv) {
+  bool quick = hasFlag(argc, argv, "--quick");
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (strcmp(argv[i], "--capture") == 0) {
+      replayCapture(argv[i + 1]);
+      return failures ? 1 : 0;
+    }
+  }
+  replaySuite(quick);
+  stationSuite(quick);
+  if (failures) printf("FAILED: %d check(s)\n", failures);
+  return failures ? 1 : 0;
+}
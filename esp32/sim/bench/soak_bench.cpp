@@ -0,0 +1,264 @@
+// soak_bench.cpp
+// Hours of simulated station time under a polling-day load, driven from the
+// backend's side: verify (known voters and the odd stranger), enrolled-count,
+// download-template (random slots, some empty) and enroll, one command at a
+// time at random intervals. The broker goes away every ten minutes and Wi-Fi
+// once an hour, and the sensor fails captures, flips bits, adds noise and
+// drops replies now and then.
+//
+// Reports per command: p50/p99/p99.9/max latency from command to reply and
+// the outcomes; messages lost (commands never answered, broker deliveries the
+// station missed, outbox evictions and dropped events); the heap each minute
+// as free bytes, largest block and fragmentation, with a least-squares trend
+// of the heap in use after a warm-up. Fails when that trend keeps rising past
+// HEAP_DRIFT_LIMIT_PER_HOUR (the limit the firmware's own trend uses, soak.h),
+// when the firmware flags drift, or when a command goes unanswered on a link
+// that stayed up.
+//
+//   soak_bench [--quick] [--hours h] [--rate commands-per-minute]
+#include "bench_util.h"
+#include "../../soak.h"
+#include <cmath>
+
+using namespace bench;
+
+#define WARMUP_MINUTES 10
+#define BROKER_OUTAGE_EVERY_MS 600000
+#define WIFI_OUTAGE_EVERY_MS 3600000
+#define WIFI_OUTAGE_FIRST_MS 1500000
+#define REPLY_TIMEOUT_MS 90000
+
+enum Kind { K_VERIFY, K_COUNT, K_DOWNLOAD, K_ENROLL, KIND_COUNT };
+
+struct Mix {
+  const char* action;
+  uint8_t weight;  // percent
+};
+
+// As the firmware's soak mode, without the cancels (soak.cpp)
+static const Mix MIX[KIND_COUNT] = {
+  { "verify", 57 },
+  { "enrolled-count", 20 },
+  { "download-template", 20 },
+  { "enroll", 3 },
+};
+
+struct KindStats {
+  Samples latencyMs;
+  uint32_t success = 0;
+  uint32_t error = 0;      // error, timeout or cancelled status
+  uint32_t busy = 0;
+  uint32_t unanswered = 0;
+};
+
+struct HeapSample {
+  double minutes;
+  uint32_t free;
+  uint32_t largest;
+  uint32_t blocks;
+};
+
+static Kind pickKind() {
+  uint32_t r = simRandom() % 100;
+  for (int k = 0; k < KIND_COUNT; ++k) {
+    if (r < MIX[k].weight) return (Kind)k;
+    r -= MIX[k].weight;
+  }
+  return K_VERIFY;
+}
+
+// Least squares, bytes of heap in use per hour
+static double usedSlopePerHour(const std::vector<HeapSample>& samples, uint32_t heapSize) {
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (const HeapSample& s : samples) {
+    if (s.minutes < WARMUP_MINUTES) continue;
+    double x = s.minutes / 60, y = (double)(heapSize - s.free);
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double d = n * sxx - sx * sx;
+  return n < HEAP_DRIFT_MIN_SAMPLES || d == 0 ? 0 : (n * sxy - sx * sy) / d;
+}
+
+static uint8_t fragmentedPct(const HeapSample& s) {
+  return s.free ? (uint8_t)(100 - (uint64_t)s.largest * 100 / s.free) : 0;
+}
+
+int main(int argc, char** argv) {
+  bool quick = hasFlag(argc, argv, "--quick");
+  double hours = quick ? 40.0 / 60 : 4;
+  uint32_t perMinute = SOAK_RATE_DEFAULT;
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (strcmp(argv[i], "--hours") == 0) hours = atof(argv[i + 1]);
+    if (strcmp(argv[i], "--rate") == 0) perMinute = (uint32_t)atoi(argv[i + 1]);
+  }
+  if (hours <= 0 || perMinute == 0) {
+    fprintf(stderr, "usage: soak_bench [--quick] [--hours h] [--rate commands-per-minute]\n");
+    return 2;
+  }
+  const uint16_t library = 200;
+  const uint16_t capacity = SimSensorConfig().capacity;
+
+  SimConfig config;
+  config.sensor.imageFail = 0.02;
+  config.sensor.bitFlip = 0.001;
+  config.sensor.noise = 0.005;
+  config.sensor.dropReply = 0.001;
+  std::vector<uint32_t> voters;  // people with a template on the sensor
+  bootStation(config, [&] {
+    for (uint16_t id = 1; id <= library; ++id) {
+      simSensor().enrollDirect(id, 1000 + id);
+      voters.push_back(1000 + id);
+    }
+  });
+  Backend backend;
+  Voter voter;
+  double wallStart = wallSeconds();
+  uint64_t startUs = simMicros();
+  uint64_t endUs = startUs + (uint64_t)(hours * 3600e6);
+  auto minutesIn = [startUs] { return (simMicros() - startUs) / 60e6; };
+
+  // Outages on their own clock, whatever the backend is doing
+  uint32_t brokerOutages = 0, wifiOutages = 0;
+  for (uint64_t at = startUs + BROKER_OUTAGE_EVERY_MS * 1000ull; at < endUs; at += BROKER_OUTAGE_EVERY_MS * 1000ull) {
+    uint32_t downMs = 5000 + simRandom() % 25000;
+    simAt(at, [&brokerOutages] {
+      simBrokerUp(false);
+      brokerOutages++;
+    });
+    simAt(at + downMs * 1000ull, [] { simBrokerUp(true); });
+  }
+  for (uint64_t at = startUs + WIFI_OUTAGE_FIRST_MS * 1000ull; at < endUs; at += WIFI_OUTAGE_EVERY_MS * 1000ull) {
+    simAt(at, [&wifiOutages] {
+      simWifiUp(false);
+      wifiOutages++;
+    });
+    simAt(at + 20000000ull, [] { simWifiUp(true); });
+  }
+
+  std::vector<HeapSample> heap;
+  std::function<void()> sampleHeap = [&] {
+    SimHeapStats h = simHeapStats();
+    heap.push_back({ minutesIn(), h.free, h.largest, h.blocks });
+    if (simMicros() + 60000000ull <= endUs) simAfter(60000, sampleHeap);
+  };
+  sampleHeap();
+
+  KindStats stats[KIND_COUNT];
+  uint32_t skippedOffline = 0, steadyUnanswered = 0;
+  uint32_t person = 100000;
+  uint32_t lostToStationBefore = simBrokerStats().lostToStation;
+  uint32_t outboxDropsBefore = messagingOutboxStats().dropped;
+  uint32_t eventDropsBefore = messagingEventDrops();
+  const double meanGapMs = 60000.0 / perMinute;
+
+  while (simMicros() < endUs) {
+    simRunFor((uint32_t)(-meanGapMs * std::log(1 - simRandomUnit() * 0.999)));
+    if (!simStationConnected()) {
+      // the backend holds its commands until the station is back
+      skippedOffline++;
+      simRunUntil([] { return simStationConnected(); }, 300000);
+      continue;
+    }
+    Kind kind = pickKind();
+    std::string extra;
+    if (kind == K_VERIFY) {
+      voter.expect(simRandom() % 20 ? voters[simRandom() % voters.size()] : ++person);  // 1 in 20 not enrolled
+    } else if (kind == K_ENROLL) {
+      if (voters.size() + 1 >= capacity) kind = K_COUNT;
+      else voter.expect(++person);
+    } else if (kind == K_DOWNLOAD) {
+      extra = "\"userId\":" + std::to_string(1 + simRandom() % (voters.size() + 50));
+    }
+
+    uint32_t connects = simBrokerStats().connects;
+    backend.messages().clear();
+    uint32_t rid = backend.send(MIX[kind].action, extra);
+    std::string status;
+    bool answered;
+    uint64_t replyUs = 0;
+    if (kind == K_COUNT) {
+      // the count carries no rid; the first one published after the command
+      std::string topic = stationTopic("fingerprint/count");
+      auto countSeen = [&] {
+        for (const SimMessage& m : backend.messages()) {
+          if (m.topic == topic) return true;
+        }
+        return false;
+      };
+      answered = simRunUntil(countSeen, REPLY_TIMEOUT_MS);
+      for (const SimMessage& m : backend.messages()) {
+        if (m.topic == topic) {
+          replyUs = m.atUs;
+          break;
+        }
+      }
+      status = "success";
+    } else {
+      answered = backend.waitFinal(rid, REPLY_TIMEOUT_MS, &status);
+      replyUs = backend.finalUs();
+    }
+    simRunFor(1000);  // the voter lifts and steps away
+    voter.leave();
+
+    KindStats& ks = stats[kind];
+    if (!answered) {
+      ks.unanswered++;
+      bool steady = simBrokerStats().connects == connects && simStationConnected();
+      if (steady) {
+        fprintf(stderr, "%.1f min: %s rid %u unanswered on a steady link\n", minutesIn(), MIX[kind].action, rid);
+        steadyUnanswered++;
+      }
+      continue;
+    }
+    ks.latencyMs.add((replyUs - backend.sentUs()) / 1000.0);
+    if (status == "success") ks.success++;
+    else if (status == "busy") ks.busy++;
+    else ks.error++;
+    if (kind == K_ENROLL && status == "success") voters.push_back(person);
+  }
+
+  SimHeapStats end = simHeapStats();
+  HeapTrend trend = heapTrend();
+  double slope = usedSlopePerHour(heap, end.size);
+  uint8_t worstFrag = 0;
+  for (const HeapSample& s : heap) worstFrag = std::max(worstFrag, fragmentedPct(s));
+  uint32_t unanswered = 0;
+  for (const KindStats& ks : stats) unanswered += ks.unanswered;
+
+  printf("soak_bench: %.1f h simulated (%.1f s wall), %u commands/min, %u broker and %u Wi-Fi outages, %u reconnects\n",
+         hours, wallSeconds() - wallStart, perMinute, brokerOutages, wifiOutages, simBrokerStats().connects - 1);
+  printf("  %-18s %6s %9s %9s %9s %9s %7s %6s %5s %5s\n", "command", "n", "p50 ms", "p99 ms", "p99.9 ms", "max ms",
+         "success", "error", "busy", "lost");
+  for (int k = 0; k < KIND_COUNT; ++k) {
+    KindStats& ks = stats[k];
+    printf("  %-18s %6zu %9.0f %9.0f %9.0f %9.0f %7u %6u %5u %5u\n", MIX[k].action, ks.latencyMs.size(),
+           ks.latencyMs.pct(50), ks.latencyMs.pct(99), ks.latencyMs.pct(99.9), ks.latencyMs.max(), ks.success,
+           ks.error, ks.busy, ks.unanswered);
+  }
+  printf("  messages lost: %u commands unanswered (%u on a steady link), %u held back while offline, "
+         "%u deliveries missed by the station, %u outbox evictions, %u dropped events\n",
+         unanswered, steadyUnanswered, skippedOffline, simBrokerStats().lostToStation - lostToStationBefore,
+         messagingOutboxStats().dropped - outboxDropsBefore, messagingEventDrops() - eventDropsBefore);
+  printf("  heap: free %u -> %u of %u, lowest %u, largest block %u, %u blocks; fragmentation %u%% now, %u%% worst\n",
+         heap.front().free, end.free, end.size, end.minFree, end.largest, end.blocks,
+         fragmentedPct({ 0, end.free, end.largest, 0 }), worstFrag);
+  printf("  heap in use after %u min: %+.0f bytes/h (limit %d); firmware trend %ld bytes/h%s\n", WARMUP_MINUTES,
+         slope, HEAP_DRIFT_LIMIT_PER_HOUR, (long)trend.slopePerHour, trend.drifting ? ", DRIFTING" : "");
+
+  int failures = 0;
+  if (slope > HEAP_DRIFT_LIMIT_PER_HOUR || trend.drifting) {
+    fprintf(stderr, "heap use keeps rising\n");
+    failures++;
+  }
+  if (steadyUnanswered) failures++;
+  if (!simStationConnected() && !simRunUntil([] { return simStationConnected(); }, 300000)) {
+    fprintf(stderr, "station did not reconnect\n");
+    failures++;
+  }
+  if (failures) printf("FAILED\n");
+  return failures ? 1 : 0;
+}
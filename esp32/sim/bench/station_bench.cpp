@@ -0,0 +1,164 @@
+// station_bench.cpp
+// End-to-end operations against a simulated station: template download
+// (single and bulk), enrollment and verification, each started with an MQTT
+// command and timed on the simulator's clock up to the status that ends it,
+// which must be the only final status the request gets.
+// Reports latency, bytes and messages the station published, and heap
+// allocations per operation. Exits non-zero if an operation fails or a
+// downloaded template's hash does not match the sensor's template.
+//
+//   station_bench [--quick]
+#include "bench_util.h"
+#include <mbedtls/sha256.h>
+
+using namespace bench;
+
+static int failures = 0;
+
+struct OpStats {
+  const char* name;
+  Samples ms;
+  uint64_t bytes = 0;
+  uint32_t messages = 0;
+  uint32_t allocations = 0;
+};
+
+struct Counters {
+  uint64_t bytes;
+  uint32_t messages;
+  uint32_t allocations;
+
+  static Counters now() {
+    const SimBrokerStats& b = simBrokerStats();
+    return { b.fromStationBytes, b.fromStation, simHeapStats().allocations };
+  }
+};
+
+static void account(OpStats& op, const Counters& before) {
+  Counters after = Counters::now();
+  op.bytes += after.bytes - before.bytes;
+  op.messages += after.messages - before.messages;
+  op.allocations += after.allocations - before.allocations;
+}
+
+static void report(OpStats& op) {
+  size_t n = op.ms.size();
+  if (!n) return;
+  printf("%-16s %5zu  p50 %8.1f  p95 %8.1f  max %8.1f ms  %7.0f B/op  %5.1f msg/op  %5.2f alloc/op\n", op.name, n,
+         op.ms.pct(50), op.ms.pct(95), op.ms.max(), (double)op.bytes / n, (double)op.messages / n,
+         (double)op.allocations / n);
+}
+
+static bool runOp(Backend& backend, OpStats& op, const char* action, const std::string& extra, uint32_t timeoutMs) {
+  Counters before = Counters::now();
+  uint32_t rid = backend.send(action, extra);
+  std::string status;
+  bool done = backend.waitFinal(rid, timeoutMs, &status);
+  // let trailing messages (hash batches, counts) reach the broker
+  simRunFor(200);
+  account(op, before);
+  if (done && backend.finals(rid) != 1) {
+    fprintf(stderr, "%s %s: %u final statuses for one request\n", action, extra.c_str(), backend.finals(rid));
+    failures++;
+    return false;
+  }
+  if (!done || status != "success") {
+    fprintf(stderr, "%s %s: %s %s\n", action, extra.c_str(), done ? status.c_str() : "no final status",
+            backend.finalMessage().c_str());
+    failures++;
+    return false;
+  }
+  op.ms.add((backend.finalUs() - backend.sentUs()) / 1000.0);
+  return true;
+}
+
+// The hash the station published for id must be the SHA-256 of the sensor's template
+static void checkHashes(Backend& backend, uint16_t firstId, uint16_t n) {
+  std::string all;
+  for (const SimMessage& m : backend.messages()) {
+    if (m.topic == stationTopic("fingerprint/templates")) all += m.payload;
+  }
+  for (uint16_t id = firstId; id < firstId + n; ++id) {
+    uint8_t digest[32];
+    mbedtls_sha256(simSensor().templateAt(id), 512, digest, 0);
+    std::string entry = "\"id\":" + std::to_string(id) + ",\"template\":\"" + hex(digest, 32) + "\"";
+    if (all.find(entry) == std::string::npos) {
+      fprintf(stderr, "no matching hash published for template %u\n", (unsigned)id);
+      failures++;
+    }
+  }
+  backend.messages().clear();
+}
+
+int main(int argc, char** argv) {
+  bool quick = hasFlag(argc, argv, "--quick");
+  const uint16_t library = quick ? 40 : 400;
+  const uint16_t singles = quick ? 10 : 100;
+  const uint16_t enrolls = quick ? 5 : 40;
+  const uint16_t verifies = quick ? 10 : 100;
+  double wallStart = wallSeconds();
+
+  SimConfig config;
+  bootStation(config, [&] {
+    for (uint16_t id = 1; id <= library; ++id) simSensor().enrollDirect(id, 1000 + id);
+  });
+  Backend backend;
+  Voter voter;
+
+  OpStats single{ "download" }, bulk{ "download-all" }, enroll{ "enroll" }, verify{ "verify" };
+
+  for (uint16_t id = 1; id <= singles; ++id) {
+    runOp(backend, single, "download", "\"userId\":" + std::to_string(id), 10000);
+  }
+  checkHashes(backend, 1, singles);
+
+  uint32_t upBefore = simSensor().stats().templatesUp;
+  runOp(backend, bulk, "download-all", "\"max\":" + std::to_string(library), library * 1000);
+  checkHashes(backend, 1, library);
+  double bulkSeconds = bulk.ms.size() ? bulk.ms.v[0] / 1000.0 : 0;
+  uint32_t transferred = simSensor().stats().templatesUp - upBefore;
+
+  for (uint16_t i = 0; i < enrolls; ++i) {
+    uint32_t person = 5000 + i;
+    voter.expect(person);
+    if (runOp(backend, enroll, "enroll", "", 30000)) {
+      uint16_t id = library + 1 + i;
+      if (simSensor().personAt(id) != person) {
+        fprintf(stderr, "enroll %u: slot %u holds person %u\n", (unsigned)person, (unsigned)id,
+                (unsigned)simSensor().personAt(id));
+        failures++;
+      }
+    }
+    simRunFor(1000);
+  }
+
+  for (uint16_t i = 0; i < verifies; ++i) {
+    uint16_t id = 1 + (uint16_t)(simRandom() % library);
+    voter.expect(1000 + id);
+    if (runOp(backend, verify, "verify", "", 30000) &&
+        backend.finalMessage().find("ID: " + std::to_string(id) + " ") == std::string::npos) {
+      fprintf(stderr, "verify person %u: %s\n", (unsigned)(1000 + id), backend.finalMessage().c_str());
+      failures++;
+    }
+    simRunFor(1000);
+  }
+  voter.leave();
+
+  printf("station_bench: library %u templates, sensor link %u baud, %u-byte packets\n", (unsigned)library,
+         (unsigned)simSensor().baud(), (unsigned)simSensor().packetLen());
+  printf("%-16s %5s  (command published to final status; voter takes %u ms to place, %u ms to lift)\n", "operation",
+         "n", voter.placeMs, voter.liftMs);
+  report(single);
+  report(bulk);
+  report(enroll);
+  report(verify);
+  if (bulkSeconds > 0) {
+    printf("bulk download: %u templates in %.2f s, %.1f templates/s\n", (unsigned)transferred, bulkSeconds,
+           transferred / bulkSeconds);
+  }
+  SimHeapStats heap = simHeapStats();
+  printf("heap: %u of %u free, min %u, largest block %u; %u simulated s in %.2f wall s\n", heap.free, heap.size,
+         heap.minFree, heap.largest, simMillis() / 1000, wallSeconds() - wallStart);
+  if (failures) printf("FAILED: %d operation(s)\n", failures);
+  return failures ? 1 : 0;
+}
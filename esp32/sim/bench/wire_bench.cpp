@@ -0,0 +1,235 @@
+// wire_bench.cpp
+// The JSON and compact binary wire formats (messaging.h) on the same
+// workload: enrollments, verifications, single and bulk template downloads
+// and count requests. Each format runs on its own simulated station; the
+// binary one is switched on with "format":"binary" on a command first.
+//
+// Reports, per topic the station publishes on, messages and bytes: MQTT
+// payload, the PUBLISH packet (fixed header, topic, payload) and the TLS
+// record carrying it (AES-GCM, 29 bytes of header, nonce and tag). Encode cost is the firmware's own
+// WireStats::encodeMicros, measured in host CPU time (SimConfig::measureCpu).
+// Fails if an operation fails, a published hash is not the sensor
+// template's, or the binary format is not smaller.
+//
+//   wire_bench [--quick]
+#include "bench_util.h"
+#include <map>
+#include <mbedtls/sha256.h>
+#include <sys/mman.h>
+
+using namespace bench;
+
+#define TLS_RECORD_OVERHEAD 29
+#define TOPIC_SLOTS 8
+
+struct TopicTotals {
+  char name[24];
+  uint32_t messages;
+  uint64_t payload;
+  uint64_t mqtt;
+  uint64_t tls;
+};
+
+struct FormatResult {
+  bool ok;
+  uint32_t encoded;      // WireStats::messages
+  uint64_t encodeUs;     // WireStats::encodeMicros
+  uint32_t allocations;  // heap allocations while building messages
+  TopicTotals topics[TOPIC_SLOTS];
+  TopicTotals total;
+};
+
+static uint32_t mqttPublishBytes(size_t topicLen, size_t payloadLen) {
+  size_t remaining = 2 + topicLen + payloadLen;
+  size_t lenBytes = remaining < 128 ? 1 : remaining < 16384 ? 2 : 3;
+  return (uint32_t)(1 + lenBytes + remaining);
+}
+
+static uint16_t be16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Checks one hash against the sensor's template; false if it differs
+static bool hashMatches(uint16_t id, const uint8_t* hash) {
+  const uint8_t* tpl = simSensor().templateAt(id);
+  if (!tpl) return false;
+  uint8_t digest[32];
+  mbedtls_sha256(tpl, 512, digest, 0);
+  return memcmp(digest, hash, 32) == 0;
+}
+
+// Hashes on the templates topic, either format: (id, matches) pairs
+static void checkTemplates(const std::string& payload, uint32_t& checked, uint32_t& wrong) {
+  const uint8_t* b = (const uint8_t*)payload.data();
+  size_t n = payload.size();
+  if (n >= 2 && b[0] == WIRE_BINARY_MAGIC) {
+    if (b[1] == WIRE_MSG_TEMPLATE && n >= 36) {
+      checked++;
+      wrong += !hashMatches(be16(b + 2), b + 4);
+    } else if (b[1] == WIRE_MSG_TEMPLATE_BATCH && n >= 4) {
+      uint16_t count = be16(b + 2);
+      for (uint16_t i = 0; i < count && 4 + (i + 1) * 34u <= n; ++i) {
+        checked++;
+        wrong += !hashMatches(be16(b + 4 + i * 34), b + 6 + i * 34);
+      }
+    }
+    return;
+  }
+  for (size_t at = payload.find("\"id\":"); at != std::string::npos; at = payload.find("\"id\":", at + 1)) {
+    uint16_t id = (uint16_t)atoi(payload.c_str() + at + 5);
+    size_t h = payload.find("\"template\":\"", at);
+    if (h == std::string::npos || h + 12 + 64 > payload.size()) break;
+    uint8_t hash[32];
+    for (int i = 0; i < 32; ++i) hash[i] = (uint8_t)strtoul(payload.substr(h + 12 + i * 2, 2).c_str(), nullptr, 16);
+    checked++;
+    wrong += !hashMatches(id, hash);
+  }
+}
+
+static bool runOp(Backend& backend, const char* action, const std::string& extra, uint32_t timeoutMs) {
+  uint32_t rid = backend.send(action, extra);
+  std::string status;
+  bool done = backend.waitFinal(rid, timeoutMs, &status);
+  simRunFor(200);
+  if (done && status == "success") return true;
+  fprintf(stderr, "%s %s: %s %s\n", action, extra.c_str(), done ? status.c_str() : "no final status",
+          backend.finalMessage().c_str());
+  return false;
+}
+
+static void formatRun(WireFormat format, bool quick, FormatResult& out) {
+  const uint16_t library = quick ? 20 : 200;
+  const uint16_t enrolls = quick ? 3 : 20;
+  const uint16_t verifies = quick ? 5 : 50;
+  const uint16_t downloads = quick ? 5 : 50;
+  const uint16_t counts = quick ? 5 : 50;
+
+  SimConfig config;
+  config.measureCpu = true;
+  bootStation(config, [&] {
+    for (uint16_t id = 1; id <= library; ++id) simSensor().enrollDirect(id, 1000 + id);
+  });
+  Backend backend;
+  Voter voter;
+  bool ok = runOp(backend, "set-format", format == WIRE_BINARY ? "\"format\":\"binary\"" : "\"format\":\"json\"", 5000);
+  backend.messages().clear();
+  WireStats before = messagingWireStats(format);
+  uint32_t allocBefore = messagingPublishAllocations();
+
+  for (uint16_t i = 0; i < enrolls; ++i) {
+    voter.expect(5000 + i);
+    ok &= runOp(backend, "enroll", "", 30000);
+    simRunFor(1000);
+  }
+  for (uint16_t i = 0; i < verifies; ++i) {
+    uint16_t id = 1 + i % library;
+    voter.expect(1000 + id);
+    ok &= runOp(backend, "verify", "", 30000);
+    simRunFor(1000);
+  }
+  voter.leave();
+  for (uint16_t i = 0; i < downloads; ++i) {
+    ok &= runOp(backend, "download", "\"userId\":" + std::to_string(1 + i % library), 10000);
+  }
+  ok &= runOp(backend, "download-all", "\"max\":" + std::to_string(library), library * 1000);
+  for (uint16_t i = 0; i < counts; ++i) {
+    backend.send("enrolled-count");
+    simRunFor(300);
+  }
+
+  const WireStats& after = messagingWireStats(format);
+  out.encoded = after.messages - before.messages;
+  out.encodeUs = after.encodeMicros - before.encodeMicros;
+  out.allocations = messagingPublishAllocations() - allocBefore;
+
+  std::string prefix = stationTopic("");
+  std::map<std::string, TopicTotals> byTopic;
+  uint32_t checked = 0, wrong = 0;
+  for (const SimMessage& m : backend.messages()) {
+    std::string name = m.topic.compare(0, prefix.size(), prefix) == 0 ? m.topic.substr(prefix.size()) : m.topic;
+    if (name == "fingerprint/command") continue;  // the backend's, the same in both runs
+    TopicTotals& t = byTopic[name];
+    uint32_t mqtt = mqttPublishBytes(m.topic.size(), m.payload.size());
+    t.messages++;
+    t.payload += m.payload.size();
+    t.mqtt += mqtt;
+    t.tls += mqtt + TLS_RECORD_OVERHEAD;
+    if (name == "fingerprint/templates") checkTemplates(m.payload, checked, wrong);
+  }
+  size_t slot = 0;
+  out.total = {};
+  snprintf(out.total.name, sizeof(out.total.name), "total");
+  for (auto& entry : byTopic) {
+    TopicTotals t = entry.second;
+    snprintf(t.name, sizeof(t.name), "%s", entry.first.c_str());
+    if (slot < TOPIC_SLOTS) out.topics[slot++] = t;
+    out.total.messages += t.messages;
+    out.total.payload += t.payload;
+    out.total.mqtt += t.mqtt;
+    out.total.tls += t.tls;
+  }
+  if (wrong || checked < (uint32_t)downloads + library) {
+    fprintf(stderr, "%s: %u of %u template hashes wrong, %u expected\n", format == WIRE_BINARY ? "binary" : "json",
+            wrong, checked, (unsigned)(downloads + library));
+    ok = false;
+  }
+  out.ok = ok;
+}
+
+static const TopicTotals* find(const FormatResult& r, const char* name) {
+  for (const TopicTotals& t : r.topics) {
+    if (strcmp(t.name, name) == 0) return &t;
+  }
+  return nullptr;
+}
+
+int main(int argc, char** argv) {
+  bool quick = hasFlag(argc, argv, "--quick");
+  // children write their results here
+  FormatResult* results = (FormatResult*)mmap(nullptr, 2 * sizeof(FormatResult), PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results == MAP_FAILED) return 2;
+  memset(results, 0, 2 * sizeof(FormatResult));
+  for (int f = WIRE_JSON; f <= WIRE_BINARY; ++f) {
+    isolated([&] {
+      formatRun((WireFormat)f, quick, results[f]);
+      return results[f].ok;
+    });
+  }
+  const FormatResult& json = results[WIRE_JSON];
+  const FormatResult& bin = results[WIRE_BINARY];
+
+  printf("wire_bench: same workload in both formats; bytes per topic (payload / MQTT PUBLISH / TLS record)\n");
+  printf("  %-22s %6s %22s %22s %7s\n", "topic", "msgs", "json", "binary", "binary");
+  auto row = [](const char* name, const TopicTotals* j, const TopicTotals* b) {
+    TopicTotals none = {};
+    if (!j) j = &none;
+    if (!b) b = &none;
+    char js[32], bs[32];
+    snprintf(js, sizeof(js), "%llu/%llu/%llu", (unsigned long long)j->payload, (unsigned long long)j->mqtt,
+             (unsigned long long)j->tls);
+    snprintf(bs, sizeof(bs), "%llu/%llu/%llu", (unsigned long long)b->payload, (unsigned long long)b->mqtt,
+             (unsigned long long)b->tls);
+    printf("  %-22s %6u %22s %22s %6.0f%%\n", name, j->messages, js, bs, j->tls ? 100.0 * b->tls / j->tls : 0);
+  };
+  for (const TopicTotals& t : json.topics) {
+    if (t.name[0]) row(t.name, &t, find(bin, t.name));
+  }
+  row("total", &json.total, &bin.total);
+  printf("encode (host CPU): json %.2f us/msg over %u, binary %.2f us/msg over %u; allocations %u / %u\n",
+         json.encoded ? (double)json.encodeUs / json.encoded : 0, json.encoded,
+         bin.encoded ? (double)bin.encodeUs / bin.encoded : 0, bin.encoded, json.allocations, bin.allocations);
+
+  int failures = 0;
+  if (!json.ok || !bin.ok) failures++;
+  if (bin.total.tls >= json.total.tls) {
+    fprintf(stderr, "binary format is not smaller on the wire\n");
+    failures++;
+  }
+  if (json.allocations || bin.allocations) {
+    fprintf(stderr, "building messages allocated\n");
+    failures++;
+  }
+  if (failures) printf("FAILED\n");
+  return failures ? 1 : 0;
+}
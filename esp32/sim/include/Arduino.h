@@ -0,0 +1,151 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Host stand-in for the ESP32 Arduino core: the subset the firmware uses,
+// with time on the simulator's virtual clock (sim_sched.cpp) and the heap
+// counted in the simulated arena (sim_heap.cpp).
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+#define F(s) (s)
+#define SERIAL_8N1 0x800001c
+
+using std::max;
+using std::min;
+
+uint32_t millis();  // 32 bits as on the ESP32
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+long random(long max);
+long random(long min, long max);
+
+size_t strlcpy(char* dst, const char* src, size_t size);
+size_t strlcat(char* dst, const char* src, size_t size);
+
+// Arduino String on the heap, as on the device (every copy allocates)
+class String {
+public:
+  String(const char* s = "");
+  String(const String& other);
+  String(String&& other) noexcept;
+  explicit String(char c);
+  explicit String(int value, unsigned char base = DEC);
+  explicit String(unsigned value, unsigned char base = DEC);
+  explicit String(long value, unsigned char base = DEC);
+  explicit String(unsigned long value, unsigned char base = DEC);
+  ~String();
+  String& operator=(const String& other);
+  String& operator=(String&& other) noexcept;
+  String& operator=(const char* s);
+
+  const char* c_str() const { return buf_ ? buf_ : ""; }
+  unsigned length() const { return len_; }
+  bool reserve(unsigned size);
+  bool concat(const char* s, unsigned n);
+  String& operator+=(const String& s) { concat(s.c_str(), s.length()); return *this; }
+  String& operator+=(const char* s) { concat(s, strlen(s)); return *this; }
+  String& operator+=(char c) { concat(&c, 1); return *this; }
+  bool operator==(const String& s) const { return len_ == s.len_ && strcmp(c_str(), s.c_str()) == 0; }
+  bool operator==(const char* s) const { return strcmp(c_str(), s ? s : "") == 0; }
+  bool operator!=(const String& s) const { return !(*this == s); }
+  bool operator!=(const char* s) const { return !(*this == s); }
+  char operator[](unsigned i) const { return i < len_ ? buf_[i] : '\0'; }
+  int indexOf(char c, unsigned from = 0) const;
+  String substring(unsigned from, unsigned to = (unsigned)-1) const;
+  long toInt() const { return buf_ ? atol(buf_) : 0; }
+  void trim();
+  void toLowerCase();
+
+  friend String operator+(const String& a, const String& b);
+  friend String operator+(const String& a, const char* b);
+  friend String operator+(const char* a, const String& b);
+
+private:
+  char* buf_ = nullptr;
+  unsigned len_ = 0;
+  unsigned cap_ = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size);
+  size_t write(const char* s) { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+  size_t write(const char* buf, size_t size) { return write((const uint8_t*)buf, size); }
+  virtual void flush() {}
+
+  // Formats into a 64-byte stack buffer and mallocs when the output is
+  // longer, like the core's Print::printf
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  size_t print(const String& s) { return write(s.c_str(), s.length()); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return printNumber(v, base); }
+  size_t print(int v, int base = DEC) { return printSigned(v, base); }
+  size_t print(unsigned v, int base = DEC) { return printNumber(v, base); }
+  size_t print(long v, int base = DEC) { return printSigned(v, base); }
+  size_t print(unsigned long v, int base = DEC) { return printNumber(v, base); }
+  size_t print(long long v, int base = DEC) { return printSigned(v, base); }
+  size_t print(unsigned long long v, int base = DEC) { return printNumber(v, base); }
+  size_t print(double v, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(T v) { size_t n = print(v); return n + println(); }
+  template <typename T>
+  size_t println(T v, int format) { size_t n = print(v, format); return n + println(); }
+
+private:
+  size_t printNumber(unsigned long long v, int base);
+  size_t printSigned(long long v, int base);
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long ms) { timeoutMs_ = ms; }
+  size_t readBytes(uint8_t* buf, size_t len);
+  size_t readBytes(char* buf, size_t len) { return readBytes((uint8_t*)buf, len); }
+
+protected:
+  unsigned long timeoutMs_ = 1000;
+};
+
+// ESP.* heap getters, backed by the simulated heap
+class EspClass {
+public:
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint64_t getEfuseMac();
+  void restart();
+};
+extern EspClass ESP;
+
+#include "HardwareSerial.h"
+
+#endif
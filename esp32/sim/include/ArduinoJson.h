@@ -0,0 +1,317 @@
+#ifndef SIM_ARDUINOJSON_H
+#define SIM_ARDUINOJSON_H
+
+#include "Arduino.h"
+#include <limits>
+#include <type_traits>
+
+// The read side of ArduinoJson 6 that the firmware uses: deserializeJson()
+// into a fixed-capacity document and const access to the result. Budgets match
+// the library on the ESP32: every object member and array element takes one
+// 16-byte slot out of the document, and a char* input is parsed in place
+// (zero-copy), so strings cost no slots. Conversions follow 6.x: is<T>()
+// checks the stored type, as<T>() converts (strings parse as numbers), and
+// `v | def` is the value when is<T>() holds, def otherwise.
+#define ARDUINOJSON_SLOT_SIZE 16
+#define JSON_OBJECT_SIZE(n) ((n) * ARDUINOJSON_SLOT_SIZE)
+#define JSON_ARRAY_SIZE(n) ((n) * ARDUINOJSON_SLOT_SIZE)
+#define ARDUINOJSON_DEFAULT_NESTING_LIMIT 10
+
+namespace ArduinoJsonSim {
+
+enum ValueType : uint8_t { VALUE_NULL, VALUE_OBJECT, VALUE_ARRAY, VALUE_STRING, VALUE_SIGNED, VALUE_UNSIGNED,
+                           VALUE_FLOAT, VALUE_BOOL };
+
+struct Slot;
+
+struct Value {
+  ValueType type = VALUE_NULL;
+  union {
+    const char* str;
+    int64_t i;
+    uint64_t u;
+    double f;
+    bool b;
+    struct {
+      Slot* head;
+      Slot* tail;
+      uint16_t size;
+    } coll;
+  };
+  Value() : u(0) {}
+};
+
+struct Slot {
+  Value value;
+  const char* key;  // object members only
+  Slot* next;
+};
+
+const Value* memberOf(const Value* obj, const char* key);
+const Value* elementOf(const Value* arr, size_t index);
+int64_t toSigned(const Value* v);
+uint64_t toUnsigned(const Value* v);
+double toFloat(const Value* v);
+
+}  // namespace ArduinoJsonSim
+
+class JsonArrayConst;
+class JsonObjectConst;
+
+class JsonVariantConst {
+public:
+  JsonVariantConst() : data_(nullptr) {}
+  explicit JsonVariantConst(const ArduinoJsonSim::Value* data) : data_(data) {}
+
+  bool isNull() const { return !data_ || data_->type == ArduinoJsonSim::VALUE_NULL; }
+  size_t size() const;
+  JsonVariantConst operator[](const char* key) const {
+    return JsonVariantConst(ArduinoJsonSim::memberOf(data_, key));
+  }
+  JsonVariantConst operator[](size_t index) const {
+    return JsonVariantConst(ArduinoJsonSim::elementOf(data_, index));
+  }
+  JsonVariantConst operator[](int index) const { return (*this)[(size_t)index]; }
+
+  template <typename T>
+  bool is() const;
+  template <typename T>
+  T as() const;
+  template <typename T>
+  operator T() const { return as<T>(); }
+
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  T operator|(T def) const { return is<T>() ? as<T>() : def; }
+  const char* operator|(const char* def) const { return is<const char*>() ? as<const char*>() : def; }
+
+  const ArduinoJsonSim::Value* data() const { return data_; }
+
+private:
+  const ArduinoJsonSim::Value* data_;
+};
+
+class JsonArrayConst {
+public:
+  class iterator {
+  public:
+    explicit iterator(const ArduinoJsonSim::Slot* slot) : slot_(slot) {}
+    JsonVariantConst operator*() const { return JsonVariantConst(&slot_->value); }
+    iterator& operator++() { slot_ = slot_->next; return *this; }
+    bool operator!=(const iterator& other) const { return slot_ != other.slot_; }
+    bool operator==(const iterator& other) const { return slot_ == other.slot_; }
+
+  private:
+    const ArduinoJsonSim::Slot* slot_;
+  };
+
+  JsonArrayConst() : data_(nullptr) {}
+  explicit JsonArrayConst(const ArduinoJsonSim::Value* data)
+      : data_(data && data->type == ArduinoJsonSim::VALUE_ARRAY ? data : nullptr) {}
+
+  bool isNull() const { return !data_; }
+  size_t size() const { return data_ ? data_->coll.size : 0; }
+  iterator begin() const { return iterator(data_ ? data_->coll.head : nullptr); }
+  iterator end() const { return iterator(nullptr); }
+  JsonVariantConst operator[](size_t index) const {
+    return JsonVariantConst(ArduinoJsonSim::elementOf(data_, index));
+  }
+
+private:
+  const ArduinoJsonSim::Value* data_;
+};
+
+class JsonObjectConst {
+public:
+  JsonObjectConst() : data_(nullptr) {}
+  explicit JsonObjectConst(const ArduinoJsonSim::Value* data)
+      : data_(data && data->type == ArduinoJsonSim::VALUE_OBJECT ? data : nullptr) {}
+
+  bool isNull() const { return !data_; }
+  size_t size() const { return data_ ? data_->coll.size : 0; }
+  bool containsKey(const char* key) const { return ArduinoJsonSim::memberOf(data_, key) != nullptr; }
+  JsonVariantConst operator[](const char* key) const {
+    return JsonVariantConst(ArduinoJsonSim::memberOf(data_, key));
+  }
+
+private:
+  const ArduinoJsonSim::Value* data_;
+};
+
+inline size_t JsonVariantConst::size() const {
+  if (!data_) return 0;
+  bool coll = data_->type == ArduinoJsonSim::VALUE_ARRAY || data_->type == ArduinoJsonSim::VALUE_OBJECT;
+  return coll ? data_->coll.size : 0;
+}
+
+namespace ArduinoJsonSim {
+
+template <typename T, typename Enable = void>
+struct Converter;
+
+template <typename T>
+struct Converter<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+  static bool is(const Value* v) {
+    if (!v) return false;
+    if (v->type == VALUE_SIGNED) {
+      return v->i >= (int64_t)std::numeric_limits<T>::min() &&
+             (v->i < 0 || (uint64_t)v->i <= (uint64_t)std::numeric_limits<T>::max());
+    }
+    if (v->type == VALUE_UNSIGNED) return v->u <= (uint64_t)std::numeric_limits<T>::max();
+    return false;
+  }
+  static T as(const Value* v) {
+    if (!v) return 0;
+    if (v->type == VALUE_FLOAT) {
+      double f = v->f;
+      if (f < (double)std::numeric_limits<T>::min() || f > (double)std::numeric_limits<T>::max()) return 0;
+      return (T)f;
+    }
+    if (std::is_signed<T>::value) {
+      int64_t x = toSigned(v);
+      if (x < (int64_t)std::numeric_limits<T>::min() ||
+          (x > 0 && (uint64_t)x > (uint64_t)std::numeric_limits<T>::max())) {
+        return 0;
+      }
+      return (T)x;
+    }
+    if (v->type == VALUE_SIGNED && v->i < 0) return 0;
+    uint64_t x = toUnsigned(v);
+    return x <= (uint64_t)std::numeric_limits<T>::max() ? (T)x : 0;
+  }
+};
+
+template <typename T>
+struct Converter<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static bool is(const Value* v) {
+    return v && (v->type == VALUE_FLOAT || v->type == VALUE_SIGNED || v->type == VALUE_UNSIGNED);
+  }
+  static T as(const Value* v) { return (T)toFloat(v); }
+};
+
+template <>
+struct Converter<bool> {
+  static bool is(const Value* v) { return v && v->type == VALUE_BOOL; }
+  static bool as(const Value* v) {
+    if (!v) return false;
+    switch (v->type) {
+      case VALUE_BOOL: return v->b;
+      case VALUE_SIGNED:
+      case VALUE_UNSIGNED: return v->u != 0;
+      case VALUE_FLOAT: return v->f != 0;
+      default: return false;
+    }
+  }
+};
+
+template <>
+struct Converter<const char*> {
+  static bool is(const Value* v) { return v && v->type == VALUE_STRING; }
+  static const char* as(const Value* v) { return is(v) ? v->str : nullptr; }
+};
+
+template <>
+struct Converter<JsonArrayConst> {
+  static bool is(const Value* v) { return v && v->type == VALUE_ARRAY; }
+  static JsonArrayConst as(const Value* v) { return JsonArrayConst(v); }
+};
+
+template <>
+struct Converter<JsonObjectConst> {
+  static bool is(const Value* v) { return v && v->type == VALUE_OBJECT; }
+  static JsonObjectConst as(const Value* v) { return JsonObjectConst(v); }
+};
+
+template <>
+struct Converter<JsonVariantConst> {
+  static bool is(const Value* v) { return v != nullptr; }
+  static JsonVariantConst as(const Value* v) { return JsonVariantConst(v); }
+};
+
+}  // namespace ArduinoJsonSim
+
+template <typename T>
+bool JsonVariantConst::is() const {
+  return ArduinoJsonSim::Converter<T>::is(data_);
+}
+
+template <typename T>
+T JsonVariantConst::as() const {
+  return ArduinoJsonSim::Converter<T>::as(data_);
+}
+
+class DeserializationError {
+public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+  DeserializationError(Code code = Ok) : code_(code) {}
+  explicit operator bool() const { return code_ != Ok; }
+  Code code() const { return code_; }
+  const char* c_str() const;
+  bool operator==(Code code) const { return code_ == code; }
+  bool operator!=(Code code) const { return code_ != code; }
+
+private:
+  Code code_;
+};
+
+class JsonDocument {
+public:
+  JsonDocument(const JsonDocument&) = delete;
+  JsonDocument& operator=(const JsonDocument&) = delete;
+
+  void clear() {
+    used_ = 0;
+    overflowed_ = false;
+    root_ = ArduinoJsonSim::Value();
+  }
+  size_t capacity() const { return capacity_ * ARDUINOJSON_SLOT_SIZE; }
+  size_t memoryUsage() const { return used_ * ARDUINOJSON_SLOT_SIZE; }
+  bool overflowed() const { return overflowed_; }
+  bool isNull() const { return root_.type == ArduinoJsonSim::VALUE_NULL; }
+  size_t size() const { return JsonVariantConst(&root_).size(); }
+
+  template <typename T>
+  T as() const { return JsonVariantConst(&root_).as<T>(); }
+  template <typename T>
+  bool is() const { return JsonVariantConst(&root_).is<T>(); }
+  JsonVariantConst operator[](const char* key) const { return JsonVariantConst(&root_)[key]; }
+  JsonVariantConst operator[](size_t index) const { return JsonVariantConst(&root_)[index]; }
+
+  // Parser side (sim/arduino_json.cpp)
+  ArduinoJsonSim::Slot* allocSlot();
+  ArduinoJsonSim::Value& root() { return root_; }
+
+protected:
+  JsonDocument(ArduinoJsonSim::Slot* pool, size_t capacity) : pool_(pool), capacity_(capacity) {}
+
+private:
+  ArduinoJsonSim::Slot* pool_;
+  size_t capacity_;  // slots
+  size_t used_ = 0;
+  bool overflowed_ = false;
+  ArduinoJsonSim::Value root_;
+};
+
+template <size_t N>
+class StaticJsonDocument : public JsonDocument {
+public:
+  StaticJsonDocument() : JsonDocument(slots_, N / ARDUINOJSON_SLOT_SIZE) {}
+
+private:
+  ArduinoJsonSim::Slot slots_[N / ARDUINOJSON_SLOT_SIZE ? N / ARDUINOJSON_SLOT_SIZE : 1];
+};
+
+namespace DeserializationOption {
+struct NestingLimit {
+  explicit NestingLimit(uint8_t n = ARDUINOJSON_DEFAULT_NESTING_LIMIT) : value(n) {}
+  uint8_t value;
+};
+}  // namespace DeserializationOption
+
+// Zero-copy: strings are unescaped in place and keep pointing into input
+DeserializationError deserializeJson(JsonDocument& doc, char* input, size_t length,
+                                     DeserializationOption::NestingLimit limit = DeserializationOption::NestingLimit());
+DeserializationError deserializeJson(JsonDocument& doc, char* input,
+                                     DeserializationOption::NestingLimit limit = DeserializationOption::NestingLimit());
+
+#endif
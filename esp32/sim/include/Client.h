@@ -0,0 +1,35 @@
+#ifndef SIM_CLIENT_H
+#define SIM_CLIENT_H
+
+#include "Arduino.h"
+
+class IPAddress {
+public:
+  IPAddress(uint32_t addr = 0) : addr_(addr) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr_(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+  operator uint32_t() const { return addr_; }
+  String toString() const;
+
+private:
+  uint32_t addr_;
+};
+
+class Client : public Stream {
+public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual int connect(IPAddress ip, uint16_t port, int32_t timeoutMs) = 0;
+  virtual int connect(const char* host, uint16_t port, int32_t timeoutMs) = 0;
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t* buf, size_t size) = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SIM_HARDWARE_SERIAL_H
+#define SIM_HARDWARE_SERIAL_H
+
+#include "Arduino.h"
+
+// UART0 (Serial) is the console: output goes to the harness, input is what
+// the harness typed (simSerialInput). Any other port is the sensor link: bytes
+// take 10 bit times each way at the configured rate, the receive buffer has
+// the size set with setRxBufferSize() and drops what does not fit, and the
+// simulated sensor only understands the host at its own rate (sim_uart.cpp).
+class HardwareSerial : public Stream {
+public:
+  explicit HardwareSerial(int uart) : uart_(uart) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1,
+             bool invert = false, unsigned long timeoutMs = 20000UL);
+  void end();
+  void updateBaudRate(unsigned long baud);
+  uint32_t baudRate();
+  size_t setRxBufferSize(size_t size);
+
+  int available() override;
+  int peek() override;
+  int read() override;
+  size_t read(uint8_t* buf, size_t size);
+  size_t read(char* buf, size_t size) { return read((uint8_t*)buf, size); }
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+  void flush() override;
+  operator bool() const { return true; }
+
+private:
+  int uart_;
+};
+
+extern HardwareSerial Serial;
+
+#endif
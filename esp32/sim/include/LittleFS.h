@@ -0,0 +1,62 @@
+#ifndef SIM_LITTLEFS_H
+#define SIM_LITTLEFS_H
+
+#include "Arduino.h"
+
+// LittleFS on simulated flash (sim_storage.cpp). Files live in the flash
+// image, which survives a simulated reboot; rename and remove are atomic.
+// Writes cost flash time on the calling task. A power cut (simFlashCutAt)
+// lands in the middle of a write and keeps only a random prefix of it, which
+// is harsher than LittleFS, where unsynced data of an open file is lost.
+namespace fs {
+
+class File : public Stream {
+public:
+  File() : handle_(-1) {}
+  explicit File(int handle) : handle_(handle) {}
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buf, size_t size);
+  bool seek(uint32_t pos);
+  size_t position() const;
+  size_t size() const;
+  void flush() override {}
+  void close();
+  operator bool() const { return handle_ >= 0; }
+  const char* name() const;
+
+private:
+  int handle_;
+};
+
+class FS {
+public:
+  File open(const char* path, const char* mode = "r", bool create = false);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+  bool mkdir(const char* path) { return true; }
+};
+
+}  // namespace fs
+
+using fs::File;
+
+class LittleFSFS : public fs::FS {
+public:
+  bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+             const char* partitionLabel = "spiffs");
+  bool format();
+  void end();
+  size_t totalBytes();
+  size_t usedBytes();
+};
+
+extern LittleFSFS LittleFS;
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SIM_PREFERENCES_H
+#define SIM_PREFERENCES_H
+
+#include "Arduino.h"
+
+// NVS key/value store in the simulated flash image (sim_storage.cpp). As on
+// the device, a read-only begin() of a namespace that was never written fails.
+class Preferences {
+public:
+  ~Preferences() { end(); }
+
+  bool begin(const char* name, bool readOnly = false, const char* partitionLabel = nullptr);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putUChar(const char* key, uint8_t value);
+  size_t putUShort(const char* key, uint16_t value);
+  size_t putUInt(const char* key, uint32_t value);
+  size_t putULong(const char* key, uint32_t value) { return putUInt(key, value); }
+  size_t putBool(const char* key, bool value) { return putUChar(key, value); }
+  size_t putString(const char* key, const char* value);
+  size_t putBytes(const char* key, const void* value, size_t len);
+
+  uint8_t getUChar(const char* key, uint8_t def = 0);
+  uint16_t getUShort(const char* key, uint16_t def = 0);
+  uint32_t getUInt(const char* key, uint32_t def = 0);
+  uint32_t getULong(const char* key, uint32_t def = 0) { return getUInt(key, def); }
+  bool getBool(const char* key, bool def = false) { return getUChar(key, def) != 0; }
+  size_t getString(const char* key, char* value, size_t maxLen);
+  String getString(const char* key, String def = String());
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+private:
+  bool started_ = false;
+  bool readOnly_ = false;
+  char name_[16] = {};
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SIM_PUBSUBCLIENT_H
+#define SIM_PUBSUBCLIENT_H
+
+#include "Arduino.h"
+#include "Client.h"
+#include <functional>
+#include <string>
+
+// PubSubClient 2.8 on the simulator's in-memory broker (sim_net.cpp). The
+// MQTT packets are not encoded, but everything the firmware can observe is
+// kept: one heap buffer of getBufferSize() bytes holds the packet being
+// received (the callback's topic and payload point into it) and is overwritten
+// by every publish and subscribe; a publish that does not fit the buffer
+// fails; loop() hands over at most one message; the connection lives and dies
+// with the Client underneath.
+#define MQTT_MAX_PACKET_SIZE_DEFAULT 256
+#define MQTT_MAX_HEADER_SIZE 5
+#define MQTT_KEEPALIVE 15
+#define MQTT_SOCKET_TIMEOUT 15
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+#define MQTT_CONNECT_BAD_PROTOCOL 1
+#define MQTT_CONNECT_BAD_CLIENT_ID 2
+#define MQTT_CONNECT_UNAVAILABLE 3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED 5
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient : public Print {
+public:
+  PubSubClient();
+  explicit PubSubClient(Client& client);
+  ~PubSubClient();
+
+  PubSubClient& setServer(const char* domain, uint16_t port);
+  PubSubClient& setServer(IPAddress ip, uint16_t port);
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient& setClient(Client& client);
+  PubSubClient& setKeepAlive(uint16_t seconds);
+  PubSubClient& setSocketTimeout(uint16_t seconds);
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize();
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* user, const char* pass);
+  bool connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+               bool willRetain, const char* willMessage, bool cleanSession = true);
+  void disconnect();
+
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+  // Streamed publish: header now, payload through write(), sent on endPublish()
+  bool beginPublish(const char* topic, unsigned int length, bool retained);
+  int endPublish();
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+
+  bool subscribe(const char* topic);
+  bool subscribe(const char* topic, uint8_t qos);
+  bool unsubscribe(const char* topic);
+  bool loop();
+  bool connected();
+  int state();
+
+private:
+  bool fits(const char* topic, size_t extra);
+  void putTopic(const char* topic, uint16_t pos);
+
+  Client* client_ = nullptr;
+  uint8_t* buffer_ = nullptr;
+  uint16_t bufferSize_ = 0;
+  uint16_t keepAliveS_ = MQTT_KEEPALIVE;
+  uint16_t socketTimeoutS_ = MQTT_SOCKET_TIMEOUT;
+  int state_ = MQTT_DISCONNECTED;
+  uint32_t session_ = 0;  // broker session, 0 when not connected
+  std::function<void(char*, uint8_t*, unsigned int)> callback_;
+  // streamed publish in progress
+  bool streaming_ = false;
+  uint32_t streamLength_ = 0;
+  std::string streamTopic_;    // simulator memory, not the station's heap
+  std::string streamPayload_;
+};
+
+#endif
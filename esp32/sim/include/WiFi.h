@@ -0,0 +1,38 @@
+#ifndef SIM_WIFI_H
+#define SIM_WIFI_H
+
+#include "Arduino.h"
+#include "Client.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+// Station mode only. Association takes SimNetConfig::wifiAssociateMs while the
+// access point is up (simWifiUp); with auto-reconnect the driver associates
+// again on its own once the access point is back (sim_net.cpp).
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t mode);
+  bool setAutoReconnect(bool autoReconnect);
+  wl_status_t begin(const char* ssid, const char* passphrase = nullptr);
+  bool disconnect(bool wifiOff = false);
+  bool reconnect();
+  wl_status_t status();
+  int hostByName(const char* host, IPAddress& ip);
+  void macAddress(uint8_t* mac);
+  int8_t RSSI();
+  void setSleep(bool enable) {}
+};
+
+extern WiFiClass WiFi;
+
+#endif
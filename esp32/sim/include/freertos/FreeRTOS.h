@@ -0,0 +1,24 @@
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+#include <stdint.h>
+
+// The part of FreeRTOS the firmware uses, on the simulator's cooperative
+// scheduler (sim_sched.cpp). One tick is one millisecond, as on the ESP32
+// Arduino core.
+typedef void* TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY 0xffffffffUL
+#define tskNO_AFFINITY 0x7fffffff
+
+#endif
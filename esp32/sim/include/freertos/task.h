@@ -0,0 +1,22 @@
+#ifndef SIM_FREERTOS_TASK_H
+#define SIM_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+
+// Tasks run one at a time on virtual time; every call that blocks on the
+// device (delay, notify wait) is where the next task gets its turn. The core
+// argument is recorded and otherwise ignored.
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackBytes, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+// Bytes of the task's stack budget never touched, from a painted stack
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+BaseType_t xPortGetCoreID();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SIM_MBEDTLS_SHA256_H
+#define SIM_MBEDTLS_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Software SHA-256 behind the mbedTLS 2.x/3.x calls the firmware makes
+typedef struct {
+  uint32_t state[8];
+  uint64_t total;
+  unsigned char buffer[64];
+  int is224;
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t len);
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char* output);
+int mbedtls_sha256(const unsigned char* input, size_t len, unsigned char* output, int is224);
+
+#define mbedtls_sha256_starts_ret mbedtls_sha256_starts
+#define mbedtls_sha256_update_ret mbedtls_sha256_update
+#define mbedtls_sha256_finish_ret mbedtls_sha256_finish
+#define mbedtls_sha256_ret mbedtls_sha256
+
+#endif
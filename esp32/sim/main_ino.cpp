@@ -0,0 +1,9 @@
+// main_ino.cpp
+// main.ino as the Arduino build compiles it: the IDE adds prototypes for the
+// sketch's functions ahead of the sketch, and only mqttCallback is used before
+// its definition.
+#include <Arduino.h>
+
+void mqttCallback(char* topic, byte* payload, unsigned int length);
+
+#include "../main.ino"
@@ -0,0 +1,215 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Host simulator for the station firmware. The firmware sources build
+// unchanged against the platform stand-ins in sim/include and run on:
+//  - a virtual clock and a cooperative scheduler for the FreeRTOS tasks: a
+//    task runs until it blocks (delay, notify wait), so a run is
+//    deterministic for a given seed and hours of station time take seconds
+//  - SimSensor, an R307 that speaks the packet protocol byte by byte behind
+//    the UART at the configured baud rate, with a finger the harness places
+//    and lifts, and injectable faults
+//  - an in-memory MQTT broker; harness peers (SimPeer) stand in for the
+//    backend, Wi-Fi and the broker can be taken down
+//  - simulated flash (LittleFS, NVS) that survives a simulated reboot and can
+//    lose power in the middle of a write
+//  - a simulated heap: what the firmware allocates comes out of an arena of
+//    SimConfig::heapBytes, which backs ESP.getFreeHeap() and friends and the
+//    allocation counter
+// The firmware's globals exist once per process, so a harness simulates one
+// station per process (fork for more, see simFork()).
+
+struct SimSensorConfig {
+  uint16_t capacity = 1000;
+  uint32_t baud = 57600;       // rate after power-up
+  uint16_t packetLen = 128;    // data packet payload after power-up
+  uint32_t maxBaud = 115200;   // highest rate it takes
+  bool baudAfterPowerCycle = false;  // clone that accepts a new rate but keeps the old one until reset
+  bool indexTable = true;      // answers ReadIndexTable (0x1F)
+  // Processing time per command, microseconds
+  uint32_t getImageUs = 350000;  // finger on the glass
+  uint32_t noFingerUs = 60000;
+  uint32_t image2TzUs = 250000;
+  uint32_t createModelUs = 80000;
+  uint32_t storeUs = 40000;
+  uint32_t loadUs = 12000;
+  uint32_t uploadUs = 4000;    // UpChar, before the first data packet
+  uint32_t deleteUs = 30000;
+  uint32_t emptyUs = 200000;
+  uint32_t searchBaseUs = 15000;
+  uint32_t searchPerTemplateUs = 80;
+  uint32_t commandUs = 3000;   // everything else
+  // Faults
+  double imageFail = 0;  // getImage with a finger on fails
+  double bitFlip = 0;    // per packet to the host: one bit flipped
+  double noise = 0;      // per packet to the host: 1-8 stray bytes in front of it
+  double dropReply = 0;  // per command: no reply at all
+};
+
+struct SimNetConfig {
+  uint32_t wifiAssociateMs = 1500;
+  uint32_t tcpConnectMs = 60;
+  uint32_t tlsFullMs = 900;     // key exchange and certificate
+  uint32_t tlsResumedMs = 180;  // session resumed
+  uint32_t brokerRttMs = 40;    // CONNECT/CONNACK
+  uint32_t uplinkMs = 20;       // station -> broker
+  uint32_t downlinkMs = 20;     // broker -> subscriber
+  bool brokerKeepsSessions = true;  // TLS sessions survive a broker outage
+};
+
+struct SimConfig {
+  uint64_t seed = 1;
+  uint8_t mac[6] = { 0x24, 0x6f, 0x28, 0xa1, 0xb2, 0xc3 };  // station ID fp-a1b2c3
+  uint32_t heapBytes = 160 * 1024;  // what Wi-Fi, lwIP and mbedTLS leave to the firmware
+  bool echoSerial = false;          // copy the firmware console to stdout (also SIM_ECHO=1)
+  // Account the host CPU time each task uses (SimTaskInfo::cpuUs) and add a
+  // task's own to what micros() returns on it, so that the firmware's
+  // micros() stopwatches measure code cost on the host. Scheduling and
+  // millis() stay on the virtual clock.
+  bool measureCpu = false;
+  SimSensorConfig sensor;
+  SimNetConfig net;
+};
+
+// --- Clock and scheduler ---
+// Fresh station: empty flash, network up, sensor powered with an empty library
+void simInit(const SimConfig& config = SimConfig());
+// Power on: a loop task runs setup() and loop() as on the device
+void simBoot();
+const SimConfig& simConfig();
+uint64_t simMicros();
+uint32_t simMillis();
+void simRunFor(uint32_t ms);
+// Runs until done() holds (checked after every task switch and event) or
+// timeoutMs passes; false on timeout
+bool simRunUntil(const std::function<bool()>& done, uint32_t timeoutMs);
+// Harness callbacks on the virtual clock, run between task switches
+void simAt(uint64_t atUs, std::function<void()> fn);
+void simAfter(uint32_t ms, std::function<void()> fn);
+// Deterministic random numbers for harnesses, from SimConfig::seed
+uint32_t simRandom();
+double simRandomUnit();
+// fork() the whole station; the child gets a copy of every task and the
+// flash. Returns as fork() does.
+int simFork();
+
+// --- Console ---
+void simSerialInput(const char* text);  // typed on the serial monitor
+std::string simSerialTake();            // console output since the last call
+
+// --- Sensor ---
+struct SimSensorStats {
+  uint32_t commands;
+  uint32_t badPackets;   // failed checksum or framing, from the host
+  uint32_t repliesDropped;
+  uint32_t bitFlips;
+  uint32_t noiseBursts;
+  uint32_t templatesUp;    // UpChar transfers
+  uint32_t templatesDown;  // DownChar transfers
+  uint64_t bytesToHost;
+  uint64_t bytesFromHost;
+  uint32_t rxOverflowBytes;  // dropped by the host's full receive buffer
+};
+
+class SimSensor {
+public:
+  // Finger on the glass: person identifies the finger (nonzero)
+  void place(uint32_t person);
+  void lift();
+  uint32_t finger() const;
+  void setOnline(bool online);  // offline: no reply to anything
+  // A slot as if it had been enrolled before boot
+  bool enrollDirect(uint16_t id, uint32_t person);
+  bool occupied(uint16_t id) const;
+  uint32_t personAt(uint16_t id) const;  // 0: empty or not a template this sensor made
+  const uint8_t* templateAt(uint16_t id) const;  // 512 bytes, nullptr if empty
+  uint16_t templateCount() const;
+  uint32_t baud() const;
+  uint16_t packetLen() const;
+  SimSensorConfig& config();
+  const SimSensorStats& stats() const;
+  // The 512-byte template the sensor builds for person (variant: which enrollment)
+  static void makeTemplate(uint8_t* out, uint32_t person, uint32_t variant);
+  static uint32_t templatePerson(const uint8_t* tpl);
+};
+SimSensor& simSensor();
+
+// --- Network ---
+void simWifiUp(bool up);
+void simBrokerUp(bool up);
+bool simStationConnected();  // MQTT session of the station is up
+
+struct SimMessage {
+  std::string topic;
+  std::string payload;
+  uint64_t atUs;  // delivered
+};
+
+// A backend client on the broker side: always connected while the broker is up
+class SimPeer {
+public:
+  explicit SimPeer(const char* name);
+  ~SimPeer();
+  SimPeer(const SimPeer&) = delete;
+  SimPeer& operator=(const SimPeer&) = delete;
+
+  void subscribe(const char* filter);  // MQTT wildcards and $share/<group>/ allowed
+  bool publish(const std::string& topic, const std::string& payload);  // false while the broker is down
+
+  std::vector<SimMessage> inbox;  // kept unless onMessage is set
+  std::function<void(const SimMessage&)> onMessage;
+
+private:
+  int id_;
+};
+
+struct SimBrokerStats {
+  uint32_t fromStation;     // messages the station published
+  uint64_t fromStationBytes;
+  uint32_t toStation;       // messages handed to the station's callback
+  uint32_t lostToStation;   // published to the station while it was offline or too big for its buffer
+  uint32_t lostFromPeers;   // peer publishes while the broker was down
+  uint32_t connects;
+  uint32_t tlsResumed;
+};
+const SimBrokerStats& simBrokerStats();
+
+// --- Flash ---
+std::string simFlashImage();                  // LittleFS and NVS contents
+void simFlashLoad(const std::string& image);  // before simBoot()
+uint32_t simFlashOps();                       // mutating flash operations so far
+// Cut the power at the op-th mutating operation from now (1 = the next one):
+// a write keeps a random prefix, then onCut runs on the task that wrote and
+// must not return (e.g. save simFlashImage() and _exit())
+void simFlashCutAt(uint32_t op, std::function<void()> onCut);
+// Runs on the task that writes, before each mutating operation (simFlashOps()
+// already counts it); for tracing what the firmware holds at every write
+void simFlashOnOp(std::function<void()> fn);
+
+// --- Heap ---
+struct SimHeapStats {
+  uint32_t size;
+  uint32_t free;
+  uint32_t minFree;
+  uint32_t largest;
+  uint32_t allocations;  // malloc/calloc/realloc calls by the firmware
+  uint32_t frees;
+  uint32_t blocks;       // live allocations
+};
+SimHeapStats simHeapStats();
+
+// --- Tasks ---
+struct SimTaskInfo {
+  std::string name;
+  uint32_t stackBytes;  // as requested
+  uint32_t stackUsed;   // deepest use seen, host stack
+  uint64_t cpuUs;       // host CPU time used, with SimConfig::measureCpu
+};
+std::vector<SimTaskInfo> simTasks();
+
+#endif
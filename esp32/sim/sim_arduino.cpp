@@ -0,0 +1,290 @@
+// sim_arduino.cpp
+// The rest of the Arduino core: String, Print, Stream, ESP and esp_* calls.
+// Time lives in sim_sched.cpp, the serial ports in sim_uart.cpp.
+#include <ctype.h>
+#include <unistd.h>
+#include "sim_internal.h"
+#include <Arduino.h>
+#include <Client.h>
+
+EspClass ESP;
+
+// --- String ---
+
+String::String(const char* s) {
+  if (s && *s) concat(s, strlen(s));
+}
+
+String::String(const String& other) {
+  concat(other.c_str(), other.len_);
+}
+
+String::String(String&& other) noexcept : buf_(other.buf_), len_(other.len_), cap_(other.cap_) {
+  other.buf_ = nullptr;
+  other.len_ = other.cap_ = 0;
+}
+
+String::String(char c) {
+  concat(&c, 1);
+}
+
+#define NUMBER_CHARS 67  // 64 binary digits, sign, terminator
+
+// Digits of v into buf (NUMBER_CHARS), right-aligned; returns the first one
+static const char* formatNumber(char* buf, unsigned long long v, bool negative, unsigned char base) {
+  char* p = buf + NUMBER_CHARS - 1;
+  *p = '\0';
+  if (base < 2 || base > 36) base = 10;
+  do {
+    unsigned d = v % base;
+    *--p = (char)(d < 10 ? '0' + d : 'a' + d - 10);
+    v /= base;
+  } while (v);
+  if (negative) *--p = '-';
+  return p;
+}
+
+static const char* formatSigned(char* buf, long long v, unsigned char base) {
+  if (base != DEC) return formatNumber(buf, (unsigned long long)v, false, base);
+  return formatNumber(buf, v < 0 ? -(unsigned long long)v : (unsigned long long)v, v < 0, base);
+}
+
+String::String(int value, unsigned char base) {
+  char buf[NUMBER_CHARS];
+  *this = formatSigned(buf, base == DEC ? (long long)value : (long long)(unsigned)value, base);
+}
+
+String::String(unsigned value, unsigned char base) {
+  char buf[NUMBER_CHARS];
+  *this = formatNumber(buf, value, false, base);
+}
+
+String::String(long value, unsigned char base) {
+  char buf[NUMBER_CHARS];
+  *this = formatSigned(buf, base == DEC ? (long long)value : (long long)(unsigned long)value, base);
+}
+
+String::String(unsigned long value, unsigned char base) {
+  char buf[NUMBER_CHARS];
+  *this = formatNumber(buf, value, false, base);
+}
+
+String::~String() {
+  free(buf_);
+}
+
+String& String::operator=(const String& other) {
+  if (this == &other) return *this;
+  len_ = 0;
+  if (buf_) buf_[0] = '\0';
+  concat(other.c_str(), other.len_);
+  return *this;
+}
+
+String& String::operator=(String&& other) noexcept {
+  if (this == &other) return *this;
+  free(buf_);
+  buf_ = other.buf_;
+  len_ = other.len_;
+  cap_ = other.cap_;
+  other.buf_ = nullptr;
+  other.len_ = other.cap_ = 0;
+  return *this;
+}
+
+String& String::operator=(const char* s) {
+  len_ = 0;
+  if (buf_) buf_[0] = '\0';
+  if (s) concat(s, strlen(s));
+  return *this;
+}
+
+bool String::reserve(unsigned size) {
+  if (buf_ && cap_ >= size) return true;
+  char* p = (char*)realloc(buf_, size + 1);
+  if (!p) return false;
+  if (!buf_) p[0] = '\0';
+  buf_ = p;
+  cap_ = size;
+  return true;
+}
+
+bool String::concat(const char* s, unsigned n) {
+  if (!reserve(len_ + n)) return false;
+  memmove(buf_ + len_, s, n);
+  len_ += n;
+  buf_[len_] = '\0';
+  return true;
+}
+
+int String::indexOf(char c, unsigned from) const {
+  for (unsigned i = from; i < len_; ++i) {
+    if (buf_[i] == c) return (int)i;
+  }
+  return -1;
+}
+
+String String::substring(unsigned from, unsigned to) const {
+  if (to > len_) to = len_;
+  String out;
+  if (from < to) out.concat(buf_ + from, to - from);
+  return out;
+}
+
+void String::trim() {
+  if (!buf_) return;
+  unsigned start = 0;
+  while (start < len_ && isspace((unsigned char)buf_[start])) start++;
+  unsigned end = len_;
+  while (end > start && isspace((unsigned char)buf_[end - 1])) end--;
+  len_ = end - start;
+  memmove(buf_, buf_ + start, len_);
+  buf_[len_] = '\0';
+}
+
+void String::toLowerCase() {
+  for (unsigned i = 0; i < len_; ++i) buf_[i] = (char)tolower((unsigned char)buf_[i]);
+}
+
+String operator+(const String& a, const String& b) {
+  String out(a);
+  out += b;
+  return out;
+}
+
+String operator+(const String& a, const char* b) {
+  String out(a);
+  out += b;
+  return out;
+}
+
+String operator+(const char* a, const String& b) {
+  String out(a);
+  out += b;
+  return out;
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (unsigned)(addr_ & 0xFF), (unsigned)(addr_ >> 8 & 0xFF),
+           (unsigned)(addr_ >> 16 & 0xFF), (unsigned)(addr_ >> 24));
+  return String(buf);
+}
+
+// --- Print, Stream ---
+
+size_t Print::write(const uint8_t* buf, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buf++);
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char loc[64];
+  char* out = loc;
+  va_list args;
+  va_start(args, format);
+  va_list copy;
+  va_copy(copy, args);
+  int len = vsnprintf(loc, sizeof(loc), format, copy);
+  va_end(copy);
+  if (len < 0) {
+    va_end(args);
+    return 0;
+  }
+  if ((size_t)len >= sizeof(loc)) {
+    out = (char*)malloc(len + 1);
+    if (!out) {
+      va_end(args);
+      return 0;
+    }
+    vsnprintf(out, len + 1, format, args);
+  }
+  va_end(args);
+  size_t n = write((const uint8_t*)out, len);
+  if (out != loc) free(out);
+  return n;
+}
+
+size_t Print::printNumber(unsigned long long v, int base) {
+  char buf[NUMBER_CHARS];
+  return write(formatNumber(buf, v, false, (unsigned char)base));
+}
+
+size_t Print::printSigned(long long v, int base) {
+  char buf[NUMBER_CHARS];
+  return write(formatSigned(buf, v, (unsigned char)base));
+}
+
+size_t Print::print(double v, int digits) {
+  char buf[40];
+  int n = snprintf(buf, sizeof(buf), "%.*f", digits, v);
+  return write(buf, n > 0 ? (size_t)n : 0);
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t len) {
+  size_t n = 0;
+  uint32_t start = millis();
+  while (n < len) {
+    int c = read();
+    if (c < 0) {
+      if (millis() - start >= timeoutMs_) break;
+      delay(1);
+      continue;
+    }
+    buf[n++] = (uint8_t)c;
+  }
+  return n;
+}
+
+// --- ESP ---
+
+uint64_t EspClass::getEfuseMac() {
+  uint64_t mac = 0;
+  for (int i = 5; i >= 0; --i) mac = mac << 8 | simConfig().mac[i];
+  return mac;
+}
+
+void EspClass::restart() {
+  fprintf(stderr, "sim: ESP.restart() at %llu ms\n", (unsigned long long)simMillis());
+  fflush(stdout);
+  _exit(3);
+}
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type) {
+  memcpy(mac, simConfig().mac, 6);
+  mac[5] += (uint8_t)type;  // the other interfaces count up from the station MAC
+  return ESP_OK;
+}
+
+uint32_t esp_random() {
+  return (uint32_t)simRandom64(SIM_RNG_ESP);
+}
+
+esp_reset_reason_t esp_reset_reason() {
+  return ESP_RST_POWERON;
+}
+
+long random(long max) {
+  return max > 0 ? (long)(esp_random() % (uint32_t)max) : 0;
+}
+
+long random(long min, long max) {
+  return min < max ? min + random(max - min) : min;
+}
+
+size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+
+size_t strlcat(char* dst, const char* src, size_t size) {
+  size_t used = strnlen(dst, size);
+  if (used == size) return size + strlen(src);
+  return used + strlcpy(dst + used, src, size - used);
+}
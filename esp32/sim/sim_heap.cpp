@@ -0,0 +1,194 @@
+// sim_heap.cpp
+// The simulated heap. malloc and friends are replaced for the whole process;
+// a call made by firmware code on a firmware task is served from an arena of
+// SimConfig::heapBytes (first fit, blocks coalesce when freed, 16-byte
+// aligned like the ESP32's), anything else (the harness, the simulator's own
+// bookkeeping inside a SimPlatformScope) goes to glibc. free() tells the two
+// apart by address, so a block may be freed from either side.
+#include <malloc.h>
+#include "sim_internal.h"
+#include <Arduino.h>
+#include "../alloc_counter.h"
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+}
+
+#define HEAP_ALIGN 16
+
+struct BlockHeader {
+  uint32_t size;      // whole block, header included
+  uint32_t prevSize;  // of the block before, 0 for the first
+  uint32_t used;
+  uint32_t pad;
+};
+
+static uint8_t* arena = nullptr;
+static uint32_t arenaSize = 0;
+static uint32_t freeBytes = 0;
+static uint32_t minFreeBytes = 0;
+static uint32_t allocations = 0;
+static uint32_t frees = 0;
+static uint32_t liveBlocks = 0;
+
+static bool inArena(const void* p) {
+  return arena && (const uint8_t*)p >= arena && (const uint8_t*)p < arena + arenaSize;
+}
+
+static BlockHeader* headerOf(void* p) {
+  return (BlockHeader*)((uint8_t*)p - sizeof(BlockHeader));
+}
+
+static BlockHeader* nextOf(BlockHeader* b) {
+  uint8_t* n = (uint8_t*)b + b->size;
+  return n < arena + arenaSize ? (BlockHeader*)n : nullptr;
+}
+
+void simHeapReset(uint32_t bytes) {
+  if (arena) __libc_free(arena);
+  arenaSize = bytes & ~(HEAP_ALIGN - 1);
+  arena = (uint8_t*)__libc_malloc(arenaSize);
+  BlockHeader* b = (BlockHeader*)arena;
+  b->size = arenaSize;
+  b->prevSize = 0;
+  b->used = 0;
+  freeBytes = minFreeBytes = arenaSize - sizeof(BlockHeader);
+  allocations = frees = liveBlocks = 0;
+}
+
+static void* arenaAlloc(size_t size) {
+  allocations++;
+  if (size == 0) size = 1;
+  if (size > arenaSize) return nullptr;
+  uint32_t need = (uint32_t)((size + sizeof(BlockHeader) + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1));
+  for (BlockHeader* b = (BlockHeader*)arena; b; b = nextOf(b)) {
+    if (b->used || b->size < need) continue;
+    if (b->size - need >= sizeof(BlockHeader) + HEAP_ALIGN) {
+      BlockHeader* rest = (BlockHeader*)((uint8_t*)b + need);
+      rest->size = b->size - need;
+      rest->prevSize = need;
+      rest->used = 0;
+      BlockHeader* after = nextOf(rest);
+      if (after) after->prevSize = rest->size;
+      b->size = need;
+      freeBytes -= need;
+    } else {
+      freeBytes -= b->size - sizeof(BlockHeader);
+    }
+    b->used = 1;
+    liveBlocks++;
+    if (freeBytes < minFreeBytes) minFreeBytes = freeBytes;
+    return b + 1;
+  }
+  return nullptr;
+}
+
+static void arenaFree(void* p) {
+  BlockHeader* b = headerOf(p);
+  if (!b->used) abort();  // double free
+  frees++;
+  liveBlocks--;
+  b->used = 0;
+  freeBytes += b->size - sizeof(BlockHeader);
+  BlockHeader* next = nextOf(b);
+  if (next && !next->used) {
+    b->size += next->size;
+    freeBytes += sizeof(BlockHeader);
+  }
+  if (b->prevSize) {
+    BlockHeader* prev = (BlockHeader*)((uint8_t*)b - b->prevSize);
+    if (!prev->used) {
+      prev->size += b->size;
+      freeBytes += sizeof(BlockHeader);
+      b = prev;
+    }
+  }
+  next = nextOf(b);
+  if (next) next->prevSize = b->size;
+}
+
+static size_t usableSize(void* p) {
+  if (inArena(p)) return headerOf(p)->size - sizeof(BlockHeader);
+  return malloc_usable_size(p);
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+  if (simFirmwareHeap() && arena) return arenaAlloc(size);
+  return __libc_malloc(size);
+}
+
+void free(void* p) {
+  if (!p) return;
+  if (inArena(p)) arenaFree(p);
+  else __libc_free(p);
+}
+
+void* calloc(size_t n, size_t size) {
+  if (!(simFirmwareHeap() && arena)) return __libc_calloc(n, size);
+  if (size && n > SIZE_MAX / size) return nullptr;
+  void* p = arenaAlloc(n * size);
+  if (p) memset(p, 0, n * size);
+  return p;
+}
+
+void* realloc(void* p, size_t size) {
+  if (!p) return malloc(size);
+  if (!inArena(p) && !simFirmwareHeap()) return __libc_realloc(p, size);
+  if (inArena(p) && size <= usableSize(p)) {
+    allocations++;
+    return p;
+  }
+  void* q = inArena(p) || simFirmwareHeap() ? arenaAlloc(size) : __libc_malloc(size);
+  if (!q) return nullptr;
+  size_t keep = usableSize(p);
+  memcpy(q, p, keep < size ? keep : size);
+  free(p);
+  return q;
+}
+
+}  // extern "C"
+
+SimHeapStats simHeapStats() {
+  SimHeapStats s = {};
+  s.size = arenaSize;
+  s.free = freeBytes;
+  s.minFree = minFreeBytes;
+  for (BlockHeader* b = (BlockHeader*)arena; b; b = nextOf(b)) {
+    if (!b->used && b->size - sizeof(BlockHeader) > s.largest) s.largest = b->size - sizeof(BlockHeader);
+  }
+  s.allocations = allocations;
+  s.frees = frees;
+  s.blocks = liveBlocks;
+  return s;
+}
+
+// --- Firmware view ---
+
+bool allocCounterEnabled() {
+  return true;
+}
+
+uint32_t allocCount() {
+  return allocations;
+}
+
+uint32_t EspClass::getHeapSize() {
+  return arenaSize;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return freeBytes;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  return minFreeBytes;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  return simHeapStats().largest;
+}
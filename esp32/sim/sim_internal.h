@@ -0,0 +1,69 @@
+#ifndef SIM_INTERNAL_H
+#define SIM_INTERNAL_H
+
+#include "sim.h"
+
+// Shared between the simulator's own sources; harnesses use sim.h.
+
+// --- Scheduler (sim_sched.cpp) ---
+bool simInTask();  // running on a firmware task rather than the harness
+// Block the calling task for us of virtual time (flash writes, link setup);
+// from the harness, run the other tasks meanwhile
+void simSpend(uint64_t us);
+// Reset the scheduler and the clock (simInit)
+void simSchedReset();
+
+// Allocations made inside a platform scope are the simulator's (broker
+// queues, file contents, console capture) and stay out of the simulated heap
+bool simFirmwareHeap();
+struct SimPlatformScope {
+  SimPlatformScope();
+  ~SimPlatformScope();
+  SimPlatformScope(const SimPlatformScope&) = delete;
+  SimPlatformScope& operator=(const SimPlatformScope&) = delete;
+};
+
+// --- Random streams (sim_sched.cpp), one per component so that a fault
+// setting in one does not shift the numbers another one sees ---
+enum SimRandomStream { SIM_RNG_HARNESS, SIM_RNG_ESP, SIM_RNG_SENSOR, SIM_RNG_FLASH, SIM_RNG_COUNT };
+uint64_t simRandom64(SimRandomStream stream);
+double simRandomUnit(SimRandomStream stream);
+
+// --- Heap (sim_heap.cpp) ---
+void simHeapReset(uint32_t bytes);
+
+// --- Console (sim_arduino.cpp) ---
+void simConsoleReset();
+
+// --- Sensor link (sim_uart.cpp, sim_sensor.cpp) ---
+void simUartReset();
+uint32_t simUartHostBaud();
+// Sensor to host: bytes go out back to back at baud from startUs on; at a
+// rate the host is not set to they arrive as garbage
+void simUartToHost(const uint8_t* data, size_t len, uint64_t startUs, uint32_t baud);
+void simSensorReset();
+// Host to sensor: the last byte is on the wire at doneUs
+void simSensorReceive(const uint8_t* data, size_t len, uint64_t doneUs, uint32_t baud);
+// Bytes the host's full receive buffer dropped (SimSensorStats::rxOverflowBytes)
+void simSensorCountOverflow(uint32_t bytes);
+// The sensor's own flash (library, baud rate, packet length) in the flash image
+void simSensorSave(std::string& out);
+bool simSensorLoad(const uint8_t*& p, const uint8_t* end);
+
+// --- Network (sim_net.cpp) ---
+void simNetReset();
+bool simWifiAssociated();
+// A TLS link to the broker; its generation changes whenever Wi-Fi or the
+// broker goes away, which kills the link
+uint32_t simNetGeneration();
+bool simBrokerIsUp();
+bool simBrokerHasSession();       // the broker still knows the station's TLS session
+void simBrokerSessionSaved(bool resumed);
+// The TLS link the station has up (sim_tls_client.cpp), 0 for none; an MQTT
+// session lives on the link it was opened on
+uint32_t simTlsLink();
+
+// --- Flash (sim_storage.cpp) ---
+void simFlashReset();
+
+#endif
@@ -0,0 +1,612 @@
+// sim_net.cpp
+// Wi-Fi, the broker and PubSubClient. The broker routes by topic filter
+// (+, # and $share/<group>/ with round-robin delivery), the station's session
+// is clean: what is published to it while it is offline is lost, and its
+// subscriptions go with the connection. Peers are the harness's backend.
+#include <deque>
+#include <map>
+#include "sim_internal.h"
+#include <WiFi.h>
+#include <PubSubClient.h>
+
+#define STATION_CLIENT 0  // client IDs: the station, then the peers
+
+WiFiClass WiFi;
+
+struct BrokerSub {
+  int client;
+  std::string filter;  // without the $share prefix
+  std::string group;   // empty unless shared
+  uint8_t qos;
+};
+
+struct QueuedMessage {
+  std::string topic;
+  std::string payload;
+  uint8_t qos;
+  uint64_t dueUs;
+};
+
+struct Net {
+  // Wi-Fi
+  bool apUp;
+  bool associated;
+  bool begun;
+  bool autoReconnect;
+  uint32_t associateToken;  // a pending association, superseded by a newer one
+  uint32_t generation;
+  // broker
+  bool brokerUp;
+  bool tlsSessionKnown;
+  bool stationOnline;
+  uint32_t stationLink;
+  std::deque<QueuedMessage> stationQueue;
+  std::vector<BrokerSub> subs;
+  std::map<std::string, uint32_t> shareTurn;
+  std::vector<SimPeer*> peers;  // index = client ID - 1
+  SimBrokerStats stats;
+};
+
+static Net net;
+
+// --- Wi-Fi ---
+
+static void dropLinks() {
+  net.generation++;
+  net.stationOnline = false;
+}
+
+static void associateLater() {
+  if (!net.begun || !net.apUp) return;
+  uint32_t token = ++net.associateToken;
+  simAfter(simConfig().net.wifiAssociateMs, [token] {
+    if (token != net.associateToken || !net.apUp) return;
+    net.associated = true;
+  });
+}
+
+// Peers outlive a reset with their subscriptions; their inboxes are emptied
+void simNetReset() {
+  SimPlatformScope scope;
+  std::vector<SimPeer*> peers;
+  std::vector<BrokerSub> peerSubs;
+  peers.swap(net.peers);
+  for (const BrokerSub& sub : net.subs) {
+    if (sub.client != STATION_CLIENT) peerSubs.push_back(sub);
+  }
+  net = Net();
+  net.peers.swap(peers);
+  net.subs.swap(peerSubs);
+  for (SimPeer* p : net.peers) {
+    if (p) p->inbox.clear();
+  }
+  net.apUp = true;
+  net.brokerUp = true;
+}
+
+bool simWifiAssociated() {
+  return net.associated;
+}
+
+uint32_t simNetGeneration() {
+  return net.generation;
+}
+
+void simWifiUp(bool up) {
+  if (up == net.apUp) return;
+  net.apUp = up;
+  if (!up) {
+    net.associateToken++;
+    if (net.associated) {
+      net.associated = false;
+      dropLinks();
+    }
+  } else if (net.autoReconnect) {
+    associateLater();
+  }
+}
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+  return true;
+}
+
+bool WiFiClass::setAutoReconnect(bool autoReconnect) {
+  net.autoReconnect = autoReconnect;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase) {
+  if (net.associated) {
+    net.associated = false;
+    dropLinks();
+  }
+  net.begun = true;
+  associateLater();
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  net.associateToken++;
+  if (net.associated) {
+    net.associated = false;
+    dropLinks();
+  }
+  return true;
+}
+
+bool WiFiClass::reconnect() {
+  return begin(nullptr) == WL_CONNECTED;
+}
+
+wl_status_t WiFiClass::status() {
+  return net.associated ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& ip) {
+  if (!net.associated) return 0;
+  ip = IPAddress(10, 0, 0, 2);
+  return 1;
+}
+
+void WiFiClass::macAddress(uint8_t* mac) {
+  esp_read_mac(mac, ESP_MAC_WIFI_STA);
+}
+
+int8_t WiFiClass::RSSI() {
+  return net.associated ? -58 : 0;
+}
+
+// --- Broker ---
+
+bool simBrokerIsUp() {
+  return net.brokerUp;
+}
+
+bool simBrokerHasSession() {
+  return net.tlsSessionKnown;
+}
+
+void simBrokerSessionSaved(bool resumed) {
+  net.tlsSessionKnown = true;
+  if (resumed) net.stats.tlsResumed++;
+}
+
+void simBrokerUp(bool up) {
+  if (up == net.brokerUp) return;
+  net.brokerUp = up;
+  if (up) return;
+  dropLinks();
+  net.stats.lostToStation += (uint32_t)net.stationQueue.size();
+  net.stationQueue.clear();
+  if (!simConfig().net.brokerKeepsSessions) net.tlsSessionKnown = false;
+}
+
+bool simStationConnected() {
+  return net.stationOnline && net.stationLink == simTlsLink() && simTlsLink() != 0;
+}
+
+const SimBrokerStats& simBrokerStats() {
+  return net.stats;
+}
+
+static bool topicMatches(const std::string& filter, const std::string& topic) {
+  size_t f = 0, t = 0;
+  while (f < filter.size()) {
+    if (filter[f] == '#') return true;
+    if (filter[f] == '+') {
+      while (t < topic.size() && topic[t] != '/') t++;
+      f++;
+    } else {
+      if (t >= topic.size() || filter[f] != topic[t]) return false;
+      f++;
+      t++;
+    }
+  }
+  return t == topic.size();
+}
+
+static void deliver(int client, const std::string& topic, const std::string& payload, uint8_t qos, uint64_t atUs) {
+  uint64_t due = atUs + (uint64_t)simConfig().net.downlinkMs * 1000;
+  if (client == STATION_CLIENT) {
+    if (!simStationConnected()) {
+      net.stats.lostToStation++;
+      return;
+    }
+    net.stationQueue.push_back({ topic, payload, qos, due });
+    return;
+  }
+  simAt(due, [client, topic, payload, due] {
+    SimPeer* peer = (size_t)client <= net.peers.size() ? net.peers[client - 1] : nullptr;
+    if (!peer) return;
+    SimMessage m = { topic, payload, due };
+    if (peer->onMessage) peer->onMessage(m);
+    else peer->inbox.push_back(m);
+  });
+}
+
+// Each matching client gets one copy; a share group gets one copy for the
+// group, handed to its members in turn
+static void route(const std::string& topic, const std::string& payload, uint64_t atUs) {
+  SimPlatformScope scope;
+  std::vector<int> direct;
+  std::map<std::string, std::vector<const BrokerSub*>> groups;
+  for (const BrokerSub& sub : net.subs) {
+    if (!topicMatches(sub.filter, topic)) continue;
+    if (sub.group.empty()) {
+      if (std::find(direct.begin(), direct.end(), sub.client) == direct.end()) {
+        direct.push_back(sub.client);
+        deliver(sub.client, topic, payload, sub.qos, atUs);
+      }
+    } else {
+      groups[sub.group + "/" + sub.filter].push_back(&sub);
+    }
+  }
+  for (auto& g : groups) {
+    uint32_t turn = net.shareTurn[g.first]++;
+    const BrokerSub* sub = g.second[turn % g.second.size()];
+    deliver(sub->client, topic, payload, sub->qos, atUs);
+  }
+}
+
+static void publishFrom(const std::string& topic, const std::string& payload) {
+  simAt(simMicros() + (uint64_t)simConfig().net.uplinkMs * 1000, [topic, payload] {
+    if (net.brokerUp) route(topic, payload, simMicros());
+  });
+}
+
+static void addSub(int client, const char* filter, uint8_t qos) {
+  SimPlatformScope scope;
+  BrokerSub sub = { client, filter, "", qos };
+  if (sub.filter.compare(0, 7, "$share/") == 0) {
+    size_t slash = sub.filter.find('/', 7);
+    if (slash == std::string::npos) return;
+    sub.group = sub.filter.substr(7, slash - 7);
+    sub.filter = sub.filter.substr(slash + 1);
+  }
+  for (BrokerSub& s : net.subs) {
+    if (s.client == client && s.filter == sub.filter && s.group == sub.group) {
+      s.qos = qos;
+      return;
+    }
+  }
+  net.subs.push_back(sub);
+}
+
+static void removeSub(int client, const char* filter) {
+  SimPlatformScope scope;
+  std::string f = filter, group;
+  if (f.compare(0, 7, "$share/") == 0) {
+    size_t slash = f.find('/', 7);
+    if (slash == std::string::npos) return;
+    group = f.substr(7, slash - 7);
+    f = f.substr(slash + 1);
+  }
+  net.subs.erase(std::remove_if(net.subs.begin(), net.subs.end(),
+                                [&](const BrokerSub& s) { return s.client == client && s.filter == f && s.group == group; }),
+                 net.subs.end());
+}
+
+static void stationSessionEnd() {
+  SimPlatformScope scope;
+  net.stationOnline = false;
+  net.stats.lostToStation += (uint32_t)net.stationQueue.size();
+  net.stationQueue.clear();
+  net.subs.erase(std::remove_if(net.subs.begin(), net.subs.end(),
+                                [](const BrokerSub& s) { return s.client == STATION_CLIENT; }),
+                 net.subs.end());
+}
+
+// --- Peers ---
+
+SimPeer::SimPeer(const char* name) {
+  SimPlatformScope scope;
+  net.peers.push_back(this);
+  id_ = (int)net.peers.size();
+}
+
+SimPeer::~SimPeer() {
+  SimPlatformScope scope;
+  net.peers[id_ - 1] = nullptr;
+  net.subs.erase(std::remove_if(net.subs.begin(), net.subs.end(), [this](const BrokerSub& s) { return s.client == id_; }),
+                 net.subs.end());
+}
+
+void SimPeer::subscribe(const char* filter) {
+  addSub(id_, filter, 1);
+}
+
+bool SimPeer::publish(const std::string& topic, const std::string& payload) {
+  if (!net.brokerUp) {
+    net.stats.lostFromPeers++;
+    return false;
+  }
+  publishFrom(topic, payload);
+  return true;
+}
+
+// --- PubSubClient ---
+
+PubSubClient::PubSubClient() {
+  setBufferSize(MQTT_MAX_PACKET_SIZE_DEFAULT);
+}
+
+PubSubClient::PubSubClient(Client& client) : client_(&client) {
+  setBufferSize(MQTT_MAX_PACKET_SIZE_DEFAULT);
+}
+
+PubSubClient::~PubSubClient() {
+  free(buffer_);
+}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+  return *this;
+}
+
+PubSubClient& PubSubClient::setServer(IPAddress ip, uint16_t port) {
+  return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  callback_ = callback;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setClient(Client& client) {
+  client_ = &client;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAlive(uint16_t seconds) {
+  keepAliveS_ = seconds;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t seconds) {
+  socketTimeoutS_ = seconds;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) return false;
+  uint8_t* grown = (uint8_t*)realloc(buffer_, size);
+  if (!grown) return false;
+  buffer_ = grown;
+  bufferSize_ = size;
+  return true;
+}
+
+uint16_t PubSubClient::getBufferSize() {
+  return bufferSize_;
+}
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass) {
+  return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+}
+
+// CONNECT goes out, CONNACK comes back one broker round trip later
+bool PubSubClient::connect(const char* id, const char* user, const char* pass, const char* willTopic,
+                           uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession) {
+  if (connected()) return false;
+  int result = client_->connected() ? 1 : client_->connect("broker", 8883);
+  if (result != 1) {
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  putTopic(id, MQTT_MAX_HEADER_SIZE);  // the CONNECT packet is built in the buffer
+  uint32_t link = simTlsLink();
+  delay(std::min(simConfig().net.brokerRttMs, socketTimeoutS_ * 1000u));
+  if (simConfig().net.brokerRttMs >= socketTimeoutS_ * 1000u || !client_->connected() || simTlsLink() != link ||
+      !net.brokerUp) {
+    state_ = MQTT_CONNECTION_TIMEOUT;
+    client_->stop();
+    return false;
+  }
+  stationSessionEnd();  // clean session
+  net.stationOnline = true;
+  net.stationLink = link;
+  net.stats.connects++;
+  session_ = link;
+  state_ = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  if (buffer_ && bufferSize_ >= 2) {
+    buffer_[0] = 0xE0;  // DISCONNECT
+    buffer_[1] = 0;
+  }
+  if (session_ && net.stationLink == session_) stationSessionEnd();
+  session_ = 0;
+  state_ = MQTT_DISCONNECTED;
+  client_->flush();
+  client_->stop();
+}
+
+bool PubSubClient::connected() {
+  if (!client_) return false;
+  bool up = client_->connected() && session_ && net.stationOnline && net.stationLink == session_;
+  if (!up) {
+    if (state_ == MQTT_CONNECTED) {
+      state_ = MQTT_CONNECTION_LOST;
+      session_ = 0;
+      client_->flush();
+      client_->stop();
+    }
+    return false;
+  }
+  return state_ == MQTT_CONNECTED;
+}
+
+int PubSubClient::state() {
+  return state_;
+}
+
+// writeString(): two length bytes and the string, into the buffer at pos
+void PubSubClient::putTopic(const char* topic, uint16_t pos) {
+  size_t len = strnlen(topic, bufferSize_);
+  if (pos + 2 + len > bufferSize_) return;
+  buffer_[pos] = (uint8_t)(len >> 8);
+  buffer_[pos + 1] = (uint8_t)len;
+  memcpy(buffer_ + pos + 2, topic, len);
+}
+
+bool PubSubClient::fits(const char* topic, size_t extra) {
+  return bufferSize_ >= MQTT_MAX_HEADER_SIZE + 2 + strnlen(topic, bufferSize_) + extra;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, (const uint8_t*)payload, payload ? strnlen(payload, bufferSize_) : 0, false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  return publish(topic, (const uint8_t*)payload, payload ? strnlen(payload, bufferSize_) : 0, retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  return publish(topic, payload, length, false);
+}
+
+// The packet is assembled in the shared buffer, payload copied byte by byte
+// after the topic, as the library does: a payload that points into the
+// buffer (a received message) is overwritten while it is copied
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  if (!connected()) return false;
+  if (!fits(topic, length)) return false;
+  size_t topicLen = strnlen(topic, bufferSize_);
+  putTopic(topic, MQTT_MAX_HEADER_SIZE);
+  size_t pos = MQTT_MAX_HEADER_SIZE + 2 + topicLen;
+  for (unsigned int i = 0; i < length; ++i) buffer_[pos++] = payload[i];
+  std::string t, p;
+  {
+    SimPlatformScope scope;
+    t.assign((const char*)buffer_ + MQTT_MAX_HEADER_SIZE + 2, topicLen);
+    p.assign((const char*)buffer_ + MQTT_MAX_HEADER_SIZE + 2 + topicLen, length);
+    net.stats.fromStation++;
+    net.stats.fromStationBytes += length;
+    publishFrom(t, p);
+  }
+  return true;
+}
+
+bool PubSubClient::beginPublish(const char* topic, unsigned int length, bool retained) {
+  if (!connected()) return false;
+  putTopic(topic, MQTT_MAX_HEADER_SIZE);
+  SimPlatformScope scope;
+  streaming_ = true;
+  streamTopic_.assign(topic);
+  streamPayload_.clear();
+  streamLength_ = length;
+  return true;
+}
+
+size_t PubSubClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t PubSubClient::write(const uint8_t* buf, size_t size) {
+  if (!streaming_ || !client_->connected()) return 0;
+  SimPlatformScope scope;
+  streamPayload_.append((const char*)buf, size);
+  return size;
+}
+
+int PubSubClient::endPublish() {
+  if (!streaming_) return 0;
+  streaming_ = false;
+  SimPlatformScope scope;
+  std::string topic, payload;
+  topic.swap(streamTopic_);
+  payload.swap(streamPayload_);
+  if (!connected() || payload.size() != streamLength_) return 0;  // the broker drops a short packet
+  net.stats.fromStation++;
+  net.stats.fromStationBytes += payload.size();
+  publishFrom(topic, payload);
+  return 1;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+  return subscribe(topic, 0);
+}
+
+bool PubSubClient::subscribe(const char* topic, uint8_t qos) {
+  if (qos > 1) return false;
+  if (bufferSize_ < 9 + strnlen(topic, bufferSize_)) return false;
+  if (!connected()) return false;
+  putTopic(topic, MQTT_MAX_HEADER_SIZE + 2);  // after the packet ID
+  addSub(STATION_CLIENT, topic, qos);
+  return true;
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+  if (bufferSize_ < 9 + strnlen(topic, bufferSize_)) return false;
+  if (!connected()) return false;
+  putTopic(topic, MQTT_MAX_HEADER_SIZE + 2);
+  removeSub(STATION_CLIENT, topic);
+  return true;
+}
+
+static size_t lengthBytes(size_t remaining) {
+  return remaining < 128 ? 1 : remaining < 16384 ? 2 : remaining < 2097152 ? 3 : 4;
+}
+
+// One PUBLISH per call, read into the buffer: the callback's topic is
+// null-terminated in place and the payload follows it. A packet longer than
+// the buffer is skipped. QoS 1 deliveries are acknowledged from the buffer
+// after the callback returns.
+bool PubSubClient::loop() {
+  if (!connected()) return false;
+  if (net.stationQueue.empty() || net.stationQueue.front().dueUs > simMicros()) return true;
+  QueuedMessage m;
+  {
+    SimPlatformScope scope;
+    m = std::move(net.stationQueue.front());
+    net.stationQueue.pop_front();
+  }
+  size_t tl = m.topic.size();
+  size_t remaining = 2 + tl + (m.qos ? 2 : 0) + m.payload.size();
+  size_t llen = lengthBytes(remaining);
+  size_t total = 1 + llen + remaining;
+  if (total > bufferSize_) {
+    SimPlatformScope scope;
+    net.stats.lostToStation++;
+    m = QueuedMessage();
+    return true;
+  }
+  buffer_[0] = (uint8_t)(0x30 | m.qos << 1);
+  size_t rl = remaining;
+  for (size_t i = 0; i < llen; ++i) {
+    buffer_[1 + i] = (uint8_t)((rl & 0x7F) | (i + 1 < llen ? 0x80 : 0));
+    rl >>= 7;
+  }
+  // after the library's memmove: topic at llen + 2, terminated, payload after
+  uint8_t* topic = buffer_ + llen + 2;
+  memcpy(topic, m.topic.data(), tl);
+  topic[tl] = 0;
+  uint16_t msgId = 0;
+  uint8_t* payload = buffer_ + llen + 3 + tl;
+  if (m.qos) {
+    msgId = (uint16_t)(net.stats.toStation + 1);
+    payload[0] = (uint8_t)(msgId >> 8);
+    payload[1] = (uint8_t)msgId;
+    payload += 2;
+  }
+  memcpy(payload, m.payload.data(), m.payload.size());
+  unsigned int len = (unsigned int)m.payload.size();
+  {
+    SimPlatformScope scope;
+    m = QueuedMessage();
+  }
+  net.stats.toStation++;
+  if (callback_) callback_((char*)topic, payload, len);
+  if (msgId) {
+    buffer_[0] = 0x40;  // PUBACK
+    buffer_[1] = 2;
+    buffer_[2] = (uint8_t)(msgId >> 8);
+    buffer_[3] = (uint8_t)msgId;
+  }
+  return true;
+}
@@ -0,0 +1,381 @@
+// sim_sched.cpp
+// Virtual clock and cooperative scheduler. Every firmware task gets its own
+// ucontext and runs until it blocks; the harness (the process's main context)
+// then picks whatever is due next, a task or a callback, and moves the clock
+// to it. Nothing runs in parallel, so a run is a function of the seed.
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <map>
+#include "sim_internal.h"
+#include <Arduino.h>
+
+#define SIM_HOST_STACK (256 * 1024)  // host frames are larger than Xtensa ones
+#define SIM_STACK_PAINT 0xA5
+#define SIM_SPIN_LIMIT 100000        // clock reads without blocking before a task is made to wait 1 ms
+#define LOOP_TASK_STACK 8192         // loopTask on the ESP32 Arduino core
+
+void setup();  // main.ino
+void loop();
+
+struct SimTask {
+  ucontext_t ctx;
+  uint8_t* stack;
+  uint32_t stackBytes;  // budget asked for
+  TaskFunction_t fn;
+  void* arg;
+  std::string name;
+  uint64_t wakeUs;
+  uint64_t order;       // FIFO among tasks due at the same time
+  bool waitingNotify;
+  uint32_t notified;
+  bool deleted;
+  int platformDepth;
+  uint32_t clockReads;
+  uint32_t stackUsed;
+  uint64_t cpuNs;         // host CPU time of finished slices (measureCpu)
+  uint64_t sliceStartNs;  // host CPU clock when the current slice began
+};
+
+struct SimEvent {
+  std::function<void()> fn;
+};
+
+static std::vector<SimTask*> tasks;
+static SimTask* current = nullptr;
+static ucontext_t harnessCtx;
+static uint64_t nowUs = 0;
+static uint64_t order = 0;
+static std::map<std::pair<uint64_t, uint64_t>, SimEvent> events;
+static SimConfig config;
+static uint64_t rng[SIM_RNG_COUNT];
+
+// --- Random streams ---
+
+static uint64_t splitmix(uint64_t& s) {
+  uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+uint64_t simRandom64(SimRandomStream stream) {
+  return splitmix(rng[stream]);
+}
+
+double simRandomUnit(SimRandomStream stream) {
+  return (simRandom64(stream) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint32_t simRandom() {
+  return (uint32_t)simRandom64(SIM_RNG_HARNESS);
+}
+
+double simRandomUnit() {
+  return simRandomUnit(SIM_RNG_HARNESS);
+}
+
+// --- Platform scope ---
+
+bool simInTask() {
+  return current != nullptr;
+}
+
+bool simFirmwareHeap() {
+  return current && current->platformDepth == 0;
+}
+
+SimPlatformScope::SimPlatformScope() {
+  if (current) current->platformDepth++;
+}
+
+SimPlatformScope::~SimPlatformScope() {
+  if (current) current->platformDepth--;
+}
+
+// --- Scheduling ---
+
+static uint64_t threadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Touched bytes never get their paint back, so the deepest use so far can be
+// read off whenever it is asked for
+static void measureStack(SimTask* t) {
+  size_t untouched = 0;
+  while (untouched < SIM_HOST_STACK && t->stack[untouched] == SIM_STACK_PAINT) untouched++;
+  uint32_t used = SIM_HOST_STACK - untouched;
+  if (used > t->stackUsed) t->stackUsed = used;
+}
+
+// Hand the CPU back to the harness until wakeUs
+static void block(uint64_t wakeUs) {
+  SimTask* t = current;
+  t->wakeUs = wakeUs;
+  t->order = ++order;
+  t->clockReads = 0;
+  swapcontext(&t->ctx, &harnessCtx);
+}
+
+static void taskEntry() {
+  SimTask* t = current;
+  t->fn(t->arg);
+  vTaskDelete(nullptr);  // a FreeRTOS task must not return
+}
+
+static void reap(SimTask* t) {
+  SimPlatformScope scope;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    if (tasks[i] == t) {
+      tasks.erase(tasks.begin() + i);
+      break;
+    }
+  }
+  free(t->stack);
+  delete t;
+}
+
+// One step: the earliest due task or event, if due by limitUs
+static bool step(uint64_t limitUs) {
+  SimTask* next = nullptr;
+  for (SimTask* t : tasks) {
+    if (t->deleted) continue;
+    if (!next || t->wakeUs < next->wakeUs || (t->wakeUs == next->wakeUs && t->order < next->order)) next = t;
+  }
+  auto ev = events.begin();
+  bool eventFirst = ev != events.end() &&
+                    (!next || ev->first.first < next->wakeUs ||
+                     (ev->first.first == next->wakeUs && ev->first.second < next->order));
+  uint64_t at = eventFirst ? ev->first.first : next ? next->wakeUs : UINT64_MAX;
+  if (at > limitUs) return false;
+  if (at > nowUs) nowUs = at;
+
+  if (eventFirst) {
+    std::function<void()> fn = std::move(ev->second.fn);
+    events.erase(ev);
+    fn();
+    return true;
+  }
+  current = next;
+  if (config.measureCpu) next->sliceStartNs = threadCpuNs();
+  swapcontext(&harnessCtx, &next->ctx);
+  if (config.measureCpu) next->cpuNs += threadCpuNs() - next->sliceStartNs;
+  current = nullptr;
+  if (next->deleted) reap(next);
+  return true;
+}
+
+static void runUntilUs(uint64_t targetUs) {
+  while (step(targetUs)) {
+  }
+  if (targetUs > nowUs) nowUs = targetUs;
+}
+
+void simSpend(uint64_t us) {
+  if (current) block(nowUs + us);
+  else runUntilUs(nowUs + us);
+}
+
+void simRunFor(uint32_t ms) {
+  runUntilUs(nowUs + (uint64_t)ms * 1000);
+}
+
+bool simRunUntil(const std::function<bool()>& done, uint32_t timeoutMs) {
+  uint64_t deadline = nowUs + (uint64_t)timeoutMs * 1000;
+  if (done()) return true;
+  while (step(deadline)) {
+    if (done()) return true;
+  }
+  nowUs = deadline;
+  return done();
+}
+
+void simAt(uint64_t atUs, std::function<void()> fn) {
+  SimPlatformScope scope;
+  if (atUs < nowUs) atUs = nowUs;
+  events.emplace(std::make_pair(atUs, ++order), SimEvent{ std::move(fn) });
+}
+
+void simAfter(uint32_t ms, std::function<void()> fn) {
+  simAt(nowUs + (uint64_t)ms * 1000, std::move(fn));
+}
+
+uint64_t simMicros() {
+  return nowUs;
+}
+
+uint32_t simMillis() {
+  return (uint32_t)(nowUs / 1000);
+}
+
+void simSchedReset() {
+  for (SimTask* t : tasks) {
+    free(t->stack);
+    delete t;
+  }
+  tasks.clear();
+  events.clear();
+  current = nullptr;
+  nowUs = 0;
+  order = 0;
+}
+
+static void loopTask(void*) {
+  setup();
+  for (;;) loop();
+}
+
+void simInit(const SimConfig& cfg) {
+  config = cfg;
+  if (getenv("SIM_ECHO")) config.echoSerial = true;
+  uint64_t seed = cfg.seed;
+  for (uint64_t& s : rng) s = splitmix(seed);
+  simSchedReset();
+  simHeapReset(cfg.heapBytes);
+  simConsoleReset();
+  simUartReset();
+  simSensorReset();
+  simNetReset();
+  simFlashReset();
+}
+
+void simBoot() {
+  xTaskCreatePinnedToCore(loopTask, "loopTask", LOOP_TASK_STACK, nullptr, 1, nullptr, 1);
+}
+
+const SimConfig& simConfig() {
+  return config;
+}
+
+int simFork() {
+  fflush(stdout);
+  fflush(stderr);
+  return fork();
+}
+
+std::vector<SimTaskInfo> simTasks() {
+  std::vector<SimTaskInfo> out;
+  for (SimTask* t : tasks) {
+    measureStack(t);
+    out.push_back({ t->name, t->stackBytes, t->stackUsed, t->cpuNs / 1000 });
+  }
+  return out;
+}
+
+// --- FreeRTOS ---
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackBytes, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  SimPlatformScope scope;
+  SimTask* t = new SimTask();
+  t->stack = (uint8_t*)malloc(SIM_HOST_STACK);
+  memset(t->stack, SIM_STACK_PAINT, SIM_HOST_STACK);
+  t->stackBytes = stackBytes;
+  t->fn = fn;
+  t->arg = arg;
+  t->name = name;
+  t->wakeUs = nowUs;
+  t->order = ++order;
+  getcontext(&t->ctx);
+  t->ctx.uc_stack.ss_sp = t->stack;
+  t->ctx.uc_stack.ss_size = SIM_HOST_STACK;
+  t->ctx.uc_link = nullptr;
+  makecontext(&t->ctx, taskEntry, 0);
+  tasks.push_back(t);
+  if (handle) *handle = t;
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return current;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  simSpend((uint64_t)ticks * 1000);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  SimTask* t = task ? (SimTask*)task : current;
+  if (!t) return;
+  t->deleted = true;
+  if (t == current) {
+    swapcontext(&t->ctx, &harnessCtx);  // reaped by the harness, never resumed
+    abort();
+  }
+  reap(t);
+}
+
+// Bytes of the budget left, judged by the deepest host stack use seen. Host
+// frames differ from Xtensa ones, so this is a trend, not the device figure.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  SimTask* t = task ? (SimTask*)task : current;
+  if (!t) return 0;
+  measureStack(t);
+  return t->stackUsed < t->stackBytes ? t->stackBytes - t->stackUsed : 0;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+  SimTask* t = (SimTask*)task;
+  if (!t || t->deleted) return;
+  t->notified++;
+  if (t->waitingNotify) {
+    t->waitingNotify = false;
+    t->wakeUs = nowUs;
+    t->order = ++order;
+  }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  SimTask* t = current;
+  if (!t) return 0;
+  if (t->notified == 0) {
+    t->waitingNotify = true;
+    block(ticks == portMAX_DELAY ? UINT64_MAX : nowUs + (uint64_t)ticks * 1000);
+    t->waitingNotify = false;
+  } else {
+    block(nowUs);  // still lets the other tasks due now run first
+  }
+  uint32_t value = t->notified;
+  if (value) t->notified = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xPortGetCoreID() {
+  return 1;
+}
+
+// --- Arduino time ---
+
+// A task polling the clock without ever blocking would stop virtual time;
+// after SIM_SPIN_LIMIT reads it is made to wait a millisecond
+static void clockRead() {
+  if (current && ++current->clockReads > SIM_SPIN_LIMIT) block(nowUs + 1000);
+}
+
+// 32 bits as on the ESP32: micros() wraps after 71 minutes
+uint32_t millis() {
+  clockRead();
+  return (uint32_t)(nowUs / 1000);
+}
+
+uint32_t micros() {
+  clockRead();
+  if (config.measureCpu && current) {
+    return (uint32_t)(nowUs + (current->cpuNs + threadCpuNs() - current->sliceStartNs) / 1000);
+  }
+  return (uint32_t)nowUs;
+}
+
+void delay(uint32_t ms) {
+  simSpend((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  simSpend(us);
+}
+
+void yield() {
+  if (current) block(nowUs);
+}
@@ -0,0 +1,592 @@
+// sim_sensor.cpp
+// SimSensor: an R307 as seen from the UART. Packets from the host are
+// framed and checked byte by byte; a command is worked on for the time
+// SimSensorConfig gives it, one at a time, and the reply goes out at the
+// sensor's baud rate. Templates are 512 bytes; the ones the sensor makes
+// carry the person they came from, which is what search matches on.
+#include <array>
+#include "sim_internal.h"
+#include <Arduino.h>
+
+#define TEMPLATE_BYTES 512
+#define PACKET_MAX_PAYLOAD 256
+#define PID_COMMAND 0x01
+#define PID_DATA 0x02
+#define PID_ACK 0x07
+#define PID_END 0x08
+#define SENSOR_ADDR 0xFFFFFFFFu
+#define SENSOR_PASSWORD 0u
+#define SYSTEM_ID 0x0009
+#define DEFAULT_SECURITY 3
+
+// Confirmation codes
+#define ACK_OK 0x00
+#define ACK_PACKET_ERR 0x01
+#define ACK_NO_FINGER 0x02
+#define ACK_IMAGE_FAIL 0x03
+#define ACK_NOT_FOUND 0x09
+#define ACK_ENROLL_MISMATCH 0x0A
+#define ACK_BAD_LOCATION 0x0B
+#define ACK_DB_READ_FAIL 0x0C
+#define ACK_UPLOAD_FEATURE_FAIL 0x0D
+#define ACK_DELETE_FAIL 0x10
+#define ACK_PASS_FAIL 0x13
+#define ACK_INVALID_IMAGE 0x15
+#define ACK_INVALID_REG 0x1A
+
+enum RxState { RX_START_1, RX_START_2, RX_ADDR, RX_PID, RX_LEN_HI, RX_LEN_LO, RX_BODY };
+
+struct CharBuffer {
+  bool valid;
+  uint8_t tpl[TEMPLATE_BYTES];
+};
+
+struct SensorState {
+  SimSensorConfig cfg;
+  SimSensorStats stats;
+  bool online;
+  uint32_t baud;
+  uint32_t pendingBaud;  // baudAfterPowerCycle: takes effect on the next reset
+  uint16_t packetLen;
+  uint8_t security;
+  uint32_t finger;
+  uint32_t image;        // person in the image buffer, 0 for none
+  CharBuffer charBuf[2];
+  std::vector<std::array<uint8_t, TEMPLATE_BYTES>> library;
+  std::vector<bool> occupied;
+  uint64_t busyUntil;
+  // receive framing
+  RxState rx;
+  uint8_t rxAddrLeft;
+  uint32_t rxAddr;
+  uint8_t rxPid;
+  uint16_t rxLen;
+  std::vector<uint8_t> rxBody;  // payload and checksum
+  // DownChar in progress
+  bool downloading;
+  uint8_t downBuf;
+  std::vector<uint8_t> down;
+};
+
+static SensorState s;
+static SimSensor sensor;
+
+SimSensor& simSensor() {
+  return sensor;
+}
+
+static uint16_t be16(const uint8_t* p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// --- Templates ---
+
+void SimSensor::makeTemplate(uint8_t* out, uint32_t person, uint32_t variant) {
+  uint64_t x = (uint64_t)person << 32 | variant;
+  for (int i = 0; i < TEMPLATE_BYTES; i += 8) {
+    x += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = x;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    memcpy(out + i, &z, 8);
+  }
+  out[0] = 0x03;
+  out[1] = 0x01;
+  for (int i = 0; i < 4; ++i) {
+    out[2 + i] = (uint8_t)(person >> (24 - 8 * i));
+    out[6 + i] = (uint8_t)(~person >> (24 - 8 * i));
+  }
+}
+
+uint32_t SimSensor::templatePerson(const uint8_t* tpl) {
+  uint32_t person = 0, check = 0;
+  for (int i = 0; i < 4; ++i) {
+    person = person << 8 | tpl[2 + i];
+    check = check << 8 | tpl[6 + i];
+  }
+  return check == ~person ? person : 0;
+}
+
+// --- Replies ---
+
+static uint32_t byteUs() {
+  return 10000000u / s.baud;
+}
+
+// One packet to the host, with the configured line faults
+static void sendPacket(uint8_t pid, const uint8_t* payload, size_t len, uint64_t atUs) {
+  std::vector<uint8_t> frame;
+  if (s.cfg.noise > 0 && simRandomUnit(SIM_RNG_SENSOR) < s.cfg.noise) {
+    int stray = 1 + (int)(simRandom64(SIM_RNG_SENSOR) % 8);
+    for (int i = 0; i < stray; ++i) frame.push_back((uint8_t)simRandom64(SIM_RNG_SENSOR));
+    s.stats.noiseBursts++;
+  }
+  size_t start = frame.size();
+  uint16_t length = (uint16_t)(len + 2);
+  uint8_t header[] = { 0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, pid, (uint8_t)(length >> 8), (uint8_t)length };
+  frame.insert(frame.end(), header, header + sizeof(header));
+  frame.insert(frame.end(), payload, payload + len);
+  uint16_t sum = pid + (length >> 8) + (length & 0xFF);
+  for (size_t i = 0; i < len; ++i) sum += payload[i];
+  frame.push_back((uint8_t)(sum >> 8));
+  frame.push_back((uint8_t)sum);
+  if (s.cfg.bitFlip > 0 && simRandomUnit(SIM_RNG_SENSOR) < s.cfg.bitFlip) {
+    size_t bit = simRandom64(SIM_RNG_SENSOR) % ((frame.size() - start) * 8);
+    frame[start + bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    s.stats.bitFlips++;
+  }
+  s.stats.bytesToHost += frame.size();
+  simUartToHost(frame.data(), frame.size(), atUs, s.baud);
+  s.busyUntil = std::max(s.busyUntil, atUs + frame.size() * byteUs());
+}
+
+static void ack(uint8_t code, uint64_t atUs, const uint8_t* extra = nullptr, size_t extraLen = 0) {
+  uint8_t payload[1 + 64];
+  payload[0] = code;
+  if (extraLen) memcpy(payload + 1, extra, extraLen);
+  sendPacket(PID_ACK, payload, 1 + extraLen, atUs);
+}
+
+// --- Commands ---
+
+static uint32_t commandUs(const uint8_t* cmd, size_t len) {
+  switch (cmd[0]) {
+    case 0x01: return s.finger ? s.cfg.getImageUs : s.cfg.noFingerUs;
+    case 0x02: return s.cfg.image2TzUs;
+    case 0x05: return s.cfg.createModelUs;
+    case 0x06: return s.cfg.storeUs;
+    case 0x07: return s.cfg.loadUs;
+    case 0x08: return s.cfg.uploadUs;
+    case 0x0C: return s.cfg.deleteUs;
+    case 0x0D: return s.cfg.emptyUs;
+    case 0x04:
+    case 0x1B: {
+      if (len < 6) return s.cfg.commandUs;
+      uint32_t start = be16(cmd + 2), count = be16(cmd + 4), stored = 0;
+      for (uint32_t id = start; id < start + count && id < s.occupied.size(); ++id) stored += s.occupied[id];
+      return s.cfg.searchBaseUs + stored * s.cfg.searchPerTemplateUs;
+    }
+    default: return s.cfg.commandUs;
+  }
+}
+
+static CharBuffer* charBuffer(uint8_t id) {
+  return id == 2 ? &s.charBuf[1] : &s.charBuf[0];
+}
+
+static void search(const uint8_t* cmd, size_t len, uint64_t at) {
+  CharBuffer* buf = charBuffer(len > 1 ? cmd[1] : 1);
+  uint32_t person = buf->valid ? SimSensor::templatePerson(buf->tpl) : 0;
+  uint32_t start = len >= 6 ? be16(cmd + 2) : 0, count = len >= 6 ? be16(cmd + 4) : 0;
+  for (uint32_t id = start; person && id < start + count && id < s.occupied.size(); ++id) {
+    if (!s.occupied[id] || SimSensor::templatePerson(s.library[id].data()) != person) continue;
+    uint16_t score = (uint16_t)(60 + person * 37 % 140);
+    uint8_t reply[] = { (uint8_t)(id >> 8), (uint8_t)id, (uint8_t)(score >> 8), (uint8_t)score };
+    ack(ACK_OK, at, reply, sizeof(reply));
+    return;
+  }
+  ack(ACK_NOT_FOUND, at, (const uint8_t*)"\0\0\0\0", 4);
+}
+
+static void writeRegister(uint8_t reg, uint8_t value, uint64_t at) {
+  if (reg == 4) {
+    uint32_t baud = value * 9600u;
+    if (value < 1 || value > 12 || baud > s.cfg.maxBaud) {
+      ack(ACK_INVALID_REG, at);
+      return;
+    }
+    ack(ACK_OK, at);  // at the old rate, then it switches
+    if (s.cfg.baudAfterPowerCycle) s.pendingBaud = baud;
+    else s.baud = baud;
+  } else if (reg == 5 && value >= 1 && value <= 5) {
+    s.security = value;
+    ack(ACK_OK, at);
+  } else if (reg == 6 && value <= 3) {
+    s.packetLen = (uint16_t)(32 << value);
+    ack(ACK_OK, at);
+  } else {
+    ack(ACK_INVALID_REG, at);
+  }
+}
+
+static void execute(const std::vector<uint8_t>& cmd, uint64_t at) {
+  size_t len = cmd.size();
+  uint16_t id = len >= 4 ? be16(&cmd[2]) : 0;
+  switch (cmd[0]) {
+    case 0x01:  // GenImg
+      if (!s.finger) {
+        s.image = 0;
+        ack(ACK_NO_FINGER, at);
+      } else if (s.cfg.imageFail > 0 && simRandomUnit(SIM_RNG_SENSOR) < s.cfg.imageFail) {
+        s.image = 0;
+        ack(ACK_IMAGE_FAIL, at);
+      } else {
+        s.image = s.finger;
+        ack(ACK_OK, at);
+      }
+      break;
+    case 0x02: {  // Img2Tz
+      if (!s.image) {
+        ack(ACK_INVALID_IMAGE, at);
+        break;
+      }
+      CharBuffer* buf = charBuffer(len > 1 ? cmd[1] : 1);
+      SimSensor::makeTemplate(buf->tpl, s.image, (uint32_t)simRandom64(SIM_RNG_SENSOR));
+      buf->valid = true;
+      ack(ACK_OK, at);
+      break;
+    }
+    case 0x05: {  // RegModel
+      uint32_t a = s.charBuf[0].valid ? SimSensor::templatePerson(s.charBuf[0].tpl) : 0;
+      uint32_t b = s.charBuf[1].valid ? SimSensor::templatePerson(s.charBuf[1].tpl) : 0;
+      if (!a || a != b) {
+        ack(ACK_ENROLL_MISMATCH, at);
+        break;
+      }
+      SimSensor::makeTemplate(s.charBuf[0].tpl, a, (uint32_t)simRandom64(SIM_RNG_SENSOR));
+      s.charBuf[1] = s.charBuf[0];
+      ack(ACK_OK, at);
+      break;
+    }
+    case 0x06: {  // Store
+      CharBuffer* buf = charBuffer(len > 1 ? cmd[1] : 1);
+      if (len < 4 || id >= s.library.size()) ack(ACK_BAD_LOCATION, at);
+      else if (!buf->valid) ack(ACK_PACKET_ERR, at);
+      else {
+        memcpy(s.library[id].data(), buf->tpl, TEMPLATE_BYTES);
+        s.occupied[id] = true;
+        ack(ACK_OK, at);
+      }
+      break;
+    }
+    case 0x07: {  // LoadChar
+      CharBuffer* buf = charBuffer(len > 1 ? cmd[1] : 1);
+      if (len < 4 || id >= s.library.size()) ack(ACK_BAD_LOCATION, at);
+      else if (!s.occupied[id]) ack(ACK_DB_READ_FAIL, at);
+      else {
+        memcpy(buf->tpl, s.library[id].data(), TEMPLATE_BYTES);
+        buf->valid = true;
+        ack(ACK_OK, at);
+      }
+      break;
+    }
+    case 0x08: {  // UpChar
+      CharBuffer* buf = charBuffer(len > 1 ? cmd[1] : 1);
+      if (!buf->valid) {
+        ack(ACK_UPLOAD_FEATURE_FAIL, at);
+        break;
+      }
+      ack(ACK_OK, at);
+      for (size_t off = 0; off < TEMPLATE_BYTES; off += s.packetLen) {
+        size_t n = std::min((size_t)s.packetLen, (size_t)TEMPLATE_BYTES - off);
+        sendPacket(off + n == TEMPLATE_BYTES ? PID_END : PID_DATA, buf->tpl + off, n, at);
+      }
+      s.stats.templatesUp++;
+      break;
+    }
+    case 0x09:  // DownChar
+      s.downloading = true;
+      s.downBuf = len > 1 ? cmd[1] : 1;
+      s.down.clear();
+      ack(ACK_OK, at);
+      break;
+    case 0x0C: {  // DeletChar
+      uint16_t count = len >= 6 ? be16(&cmd[4]) : 1;
+      if (len < 4 || (uint32_t)id + count > s.library.size()) {
+        ack(ACK_DELETE_FAIL, at);
+        break;
+      }
+      for (uint16_t i = 0; i < count; ++i) s.occupied[id + i] = false;
+      ack(ACK_OK, at);
+      break;
+    }
+    case 0x0D:  // Empty
+      std::fill(s.occupied.begin(), s.occupied.end(), false);
+      ack(ACK_OK, at);
+      break;
+    case 0x0E:  // WriteReg
+      if (len < 3) ack(ACK_PACKET_ERR, at);
+      else writeRegister(cmd[1], cmd[2], at);
+      break;
+    case 0x0F: {  // ReadSysPara
+      uint16_t capacity = (uint16_t)s.library.size();
+      uint8_t code = s.packetLen == 32 ? 0 : s.packetLen == 64 ? 1 : s.packetLen == 128 ? 2 : 3;
+      uint16_t baudN = (uint16_t)(s.baud / 9600);
+      uint8_t p[16] = { 0, 0, SYSTEM_ID >> 8, SYSTEM_ID & 0xFF, (uint8_t)(capacity >> 8), (uint8_t)capacity,
+                        0, s.security, 0xFF, 0xFF, 0xFF, 0xFF, 0, code, (uint8_t)(baudN >> 8), (uint8_t)baudN };
+      ack(ACK_OK, at, p, sizeof(p));
+      break;
+    }
+    case 0x12:  // SetPwd
+      ack(ACK_OK, at);
+      break;
+    case 0x13: {  // VfyPwd
+      uint32_t pwd = len >= 5 ? (uint32_t)cmd[1] << 24 | cmd[2] << 16 | cmd[3] << 8 | cmd[4] : 1;
+      ack(pwd == SENSOR_PASSWORD ? ACK_OK : ACK_PASS_FAIL, at);
+      break;
+    }
+    case 0x04:  // Search
+    case 0x1B:  // HighSpeedSearch
+      search(cmd.data(), len, at);
+      break;
+    case 0x1D: {  // TempleteNum
+      uint16_t n = (uint16_t)std::count(s.occupied.begin(), s.occupied.end(), true);
+      uint8_t p[] = { (uint8_t)(n >> 8), (uint8_t)n };
+      ack(ACK_OK, at, p, sizeof(p));
+      break;
+    }
+    case 0x1F: {  // ReadIndexTable
+      if (!s.cfg.indexTable || len < 2) {
+        ack(ACK_PACKET_ERR, at);
+        break;
+      }
+      uint8_t bitmap[32] = {};
+      for (int i = 0; i < 256; ++i) {
+        size_t slot = (size_t)cmd[1] * 256 + i;
+        if (slot < s.occupied.size() && s.occupied[slot]) bitmap[i / 8] |= (uint8_t)(1 << (i % 8));
+      }
+      ack(ACK_OK, at, bitmap, sizeof(bitmap));
+      break;
+    }
+    case 0x35:  // AuraLedConfig
+    case 0x50:  // OpenLED
+    case 0x51:  // CloseLED
+      ack(ACK_OK, at);
+      break;
+    default:
+      ack(ACK_PACKET_ERR, at);
+      break;
+  }
+}
+
+// A whole packet is in: commands are queued behind whatever the sensor is
+// doing, data packets belong to a DownChar
+static void packetIn(uint8_t pid, const std::vector<uint8_t>& payload, bool sumOk, uint64_t atUs) {
+  if (!sumOk) {
+    s.stats.badPackets++;
+    if (pid == PID_COMMAND) {
+      uint64_t at = std::max(atUs, s.busyUntil) + s.cfg.commandUs;
+      s.busyUntil = at;
+      simAt(at, [at] { ack(ACK_PACKET_ERR, at); });
+    } else {
+      s.downloading = false;
+    }
+    return;
+  }
+  if (pid == PID_DATA || pid == PID_END) {
+    if (!s.downloading) return;
+    s.down.insert(s.down.end(), payload.begin(), payload.end());
+    if (pid == PID_END) {
+      s.downloading = false;
+      if (s.down.size() == TEMPLATE_BYTES) {
+        CharBuffer* buf = charBuffer(s.downBuf);
+        memcpy(buf->tpl, s.down.data(), TEMPLATE_BYTES);
+        buf->valid = true;
+        s.stats.templatesDown++;
+      }
+    }
+    return;
+  }
+  if (pid != PID_COMMAND || payload.empty()) return;
+  s.stats.commands++;
+  s.downloading = false;
+  uint64_t at = std::max(atUs, s.busyUntil) + commandUs(payload.data(), payload.size());
+  s.busyUntil = at;
+  if (s.cfg.dropReply > 0 && simRandomUnit(SIM_RNG_SENSOR) < s.cfg.dropReply) {
+    s.stats.repliesDropped++;
+    return;
+  }
+  simAt(at, [payload, at] {
+    if (s.online) execute(payload, at);
+  });
+}
+
+void simSensorReceive(const uint8_t* data, size_t len, uint64_t doneUs, uint32_t baud) {
+  SimPlatformScope scope;
+  if (!s.online) return;
+  s.stats.bytesFromHost += len;
+  if (baud != s.baud) {  // framing errors: nothing it can use
+    s.rx = RX_START_1;
+    return;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    uint8_t b = data[i];
+    switch (s.rx) {
+      case RX_START_1:
+        if (b == 0xEF) s.rx = RX_START_2;
+        break;
+      case RX_START_2:
+        s.rx = b == 0x01 ? RX_ADDR : b == 0xEF ? RX_START_2 : RX_START_1;
+        s.rxAddrLeft = 4;
+        s.rxAddr = 0;
+        break;
+      case RX_ADDR:
+        s.rxAddr = s.rxAddr << 8 | b;
+        if (--s.rxAddrLeft == 0) s.rx = RX_PID;
+        break;
+      case RX_PID:
+        s.rxPid = b;
+        s.rx = RX_LEN_HI;
+        break;
+      case RX_LEN_HI:
+        s.rxLen = (uint16_t)(b << 8);
+        s.rx = RX_LEN_LO;
+        break;
+      case RX_LEN_LO:
+        s.rxLen |= b;
+        s.rxBody.clear();
+        if (s.rxLen < 2 || s.rxLen > PACKET_MAX_PAYLOAD + 2) {
+          s.stats.badPackets++;
+          s.rx = RX_START_1;
+        } else {
+          s.rx = RX_BODY;
+        }
+        break;
+      case RX_BODY:
+        s.rxBody.push_back(b);
+        if (s.rxBody.size() == s.rxLen) {
+          s.rx = RX_START_1;
+          if (s.rxAddr != SENSOR_ADDR) break;  // another module's packet
+          uint16_t sum = s.rxPid + (s.rxLen >> 8) + (s.rxLen & 0xFF);
+          for (size_t k = 0; k + 2 < s.rxBody.size(); ++k) sum += s.rxBody[k];
+          bool sumOk = be16(&s.rxBody[s.rxLen - 2]) == sum;
+          std::vector<uint8_t> payload(s.rxBody.begin(), s.rxBody.end() - 2);
+          packetIn(s.rxPid, payload, sumOk, doneUs - (len - 1 - i) * byteUs());
+        }
+        break;
+    }
+  }
+}
+
+void simSensorCountOverflow(uint32_t bytes) {
+  s.stats.rxOverflowBytes += bytes;
+}
+
+void simSensorReset() {
+  SimPlatformScope scope;
+  s.cfg = simConfig().sensor;
+  s.stats = SimSensorStats();
+  s.online = true;
+  s.baud = s.cfg.baud;
+  s.pendingBaud = 0;
+  s.packetLen = s.cfg.packetLen;
+  s.security = DEFAULT_SECURITY;
+  s.finger = 0;
+  s.image = 0;
+  s.charBuf[0].valid = s.charBuf[1].valid = false;
+  s.library.assign(s.cfg.capacity, {});
+  s.occupied.assign(s.cfg.capacity, false);
+  s.busyUntil = 0;
+  s.rx = RX_START_1;
+  s.downloading = false;
+  s.down.clear();
+}
+
+// --- Sensor flash in the image: "SENS", baud, packet length, then the
+// occupied slots as id + template ---
+
+static void put32(std::string& out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back((char)(v >> (8 * i)));
+}
+
+static bool get32(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+  if (end - p < 4) return false;
+  v = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+  p += 4;
+  return true;
+}
+
+void simSensorSave(std::string& out) {
+  SimPlatformScope scope;
+  out += "SENS";
+  put32(out, s.pendingBaud ? s.pendingBaud : s.baud);
+  put32(out, s.packetLen);
+  put32(out, (uint32_t)std::count(s.occupied.begin(), s.occupied.end(), true));
+  for (size_t id = 0; id < s.occupied.size(); ++id) {
+    if (!s.occupied[id]) continue;
+    put32(out, (uint32_t)id);
+    out.append((const char*)s.library[id].data(), TEMPLATE_BYTES);
+  }
+}
+
+bool simSensorLoad(const uint8_t*& p, const uint8_t* end) {
+  SimPlatformScope scope;
+  uint32_t baud, packetLen, count;
+  if (end - p < 4 || memcmp(p, "SENS", 4) != 0) return false;
+  p += 4;
+  if (!get32(p, end, baud) || !get32(p, end, packetLen) || !get32(p, end, count)) return false;
+  s.baud = baud;
+  s.pendingBaud = 0;
+  s.packetLen = (uint16_t)packetLen;
+  std::fill(s.occupied.begin(), s.occupied.end(), false);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t id;
+    if (!get32(p, end, id) || end - p < TEMPLATE_BYTES || id >= s.library.size()) return false;
+    memcpy(s.library[id].data(), p, TEMPLATE_BYTES);
+    s.occupied[id] = true;
+    p += TEMPLATE_BYTES;
+  }
+  return true;
+}
+
+// --- Harness API ---
+
+void SimSensor::place(uint32_t person) {
+  s.finger = person;
+}
+
+void SimSensor::lift() {
+  s.finger = 0;
+}
+
+uint32_t SimSensor::finger() const {
+  return s.finger;
+}
+
+void SimSensor::setOnline(bool online) {
+  s.online = online;
+  if (!online) {
+    s.rx = RX_START_1;
+    s.downloading = false;
+  }
+}
+
+bool SimSensor::enrollDirect(uint16_t id, uint32_t person) {
+  if (id >= s.library.size()) return false;
+  makeTemplate(s.library[id].data(), person, (uint32_t)simRandom64(SIM_RNG_SENSOR));
+  s.occupied[id] = true;
+  return true;
+}
+
+bool SimSensor::occupied(uint16_t id) const {
+  return id < s.occupied.size() && s.occupied[id];
+}
+
+uint32_t SimSensor::personAt(uint16_t id) const {
+  return occupied(id) ? templatePerson(s.library[id].data()) : 0;
+}
+
+const uint8_t* SimSensor::templateAt(uint16_t id) const {
+  return occupied(id) ? s.library[id].data() : nullptr;
+}
+
+uint16_t SimSensor::templateCount() const {
+  return (uint16_t)std::count(s.occupied.begin(), s.occupied.end(), true);
+}
+
+uint32_t SimSensor::baud() const {
+  return s.baud;
+}
+
+uint16_t SimSensor::packetLen() const {
+  return s.packetLen;
+}
+
+SimSensorConfig& SimSensor::config() {
+  return s.cfg;
+}
+
+const SimSensorStats& SimSensor::stats() const {
+  return s.stats;
+}
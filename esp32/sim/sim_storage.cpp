@@ -0,0 +1,492 @@
+// sim_storage.cpp
+// Simulated flash: LittleFS files and NVS namespaces, both in memory and
+// both part of the flash image a harness saves and boots from. Every
+// mutating operation is counted so that a harness can cut the power at any
+// one of them (simFlashCutAt).
+#include <map>
+#include "sim_internal.h"
+#include <LittleFS.h>
+#include <Preferences.h>
+
+#define FLASH_WRITE_BASE_US 50
+#define FLASH_WRITE_PER_BYTE_US 2
+#define FLASH_OPEN_US 300
+#define FLASH_RENAME_US 2000
+#define FLASH_REMOVE_US 2000
+#define NVS_WRITE_US 1500
+#define FS_BLOCK 4096
+#define FS_TOTAL_BYTES (1472 * 1024)  // default partition table, spiffs partition
+#define IMAGE_MAGIC "SIMFLASH1"
+
+LittleFSFS LittleFS;
+
+struct OpenFile {
+  std::string path;
+  size_t pos;
+  bool append;
+  bool writable;
+  bool open;
+};
+
+// NVS entries keep their type, as nvs_get_* refuses a key of another type
+enum NvsType : uint8_t { NVS_U8 = 1, NVS_U16, NVS_U32, NVS_STR, NVS_BLOB };
+
+struct Flash {
+  std::map<std::string, std::vector<uint8_t>> files;
+  std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nvs;  // type byte, then the value
+  std::vector<OpenFile> handles;
+  bool mounted;
+  uint32_t ops;
+  uint32_t cutAt;  // 0: no cut armed
+  std::function<void()> onCut;
+  std::function<void()> onOp;
+};
+
+static Flash flash;
+
+void simFlashReset() {
+  SimPlatformScope scope;
+  flash = Flash();
+}
+
+uint32_t simFlashOps() {
+  return flash.ops;
+}
+
+void simFlashCutAt(uint32_t op, std::function<void()> onCut) {
+  SimPlatformScope scope;
+  flash.cutAt = flash.ops + op;
+  flash.onCut = std::move(onCut);
+}
+
+void simFlashOnOp(std::function<void()> fn) {
+  SimPlatformScope scope;
+  flash.onOp = std::move(fn);
+}
+
+// Counts one mutating operation; true when the power goes at this one
+static bool mutation() {
+  flash.ops++;
+  if (flash.onOp) flash.onOp();
+  return flash.cutAt && flash.ops == flash.cutAt;
+}
+
+static void powerCut() {
+  flash.cutAt = 0;
+  std::function<void()> fn;
+  {
+    SimPlatformScope scope;
+    fn.swap(flash.onCut);
+  }
+  if (fn) fn();
+}
+
+// --- Image ---
+
+static void put32(std::string& out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back((char)(v >> (8 * i)));
+}
+
+static void putBytes(std::string& out, const void* data, size_t len) {
+  put32(out, (uint32_t)len);
+  out.append((const char*)data, len);
+}
+
+static bool get32(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+  if (end - p < 4) return false;
+  v = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+  p += 4;
+  return true;
+}
+
+static bool getBytes(const uint8_t*& p, const uint8_t* end, std::string& out) {
+  uint32_t len;
+  if (!get32(p, end, len) || (uint32_t)(end - p) < len) return false;
+  out.assign((const char*)p, len);
+  p += len;
+  return true;
+}
+
+std::string simFlashImage() {
+  SimPlatformScope scope;
+  std::string out = IMAGE_MAGIC;
+  put32(out, (uint32_t)flash.files.size());
+  for (const auto& f : flash.files) {
+    putBytes(out, f.first.data(), f.first.size());
+    putBytes(out, f.second.data(), f.second.size());
+  }
+  put32(out, (uint32_t)flash.nvs.size());
+  for (const auto& ns : flash.nvs) {
+    putBytes(out, ns.first.data(), ns.first.size());
+    put32(out, (uint32_t)ns.second.size());
+    for (const auto& kv : ns.second) {
+      putBytes(out, kv.first.data(), kv.first.size());
+      putBytes(out, kv.second.data(), kv.second.size());
+    }
+  }
+  simSensorSave(out);
+  return out;
+}
+
+void simFlashLoad(const std::string& image) {
+  SimPlatformScope scope;
+  const uint8_t* p = (const uint8_t*)image.data();
+  const uint8_t* end = p + image.size();
+  size_t magic = strlen(IMAGE_MAGIC);
+  bool ok = image.compare(0, magic, IMAGE_MAGIC) == 0;
+  p += magic;
+  simFlashReset();
+  uint32_t count = 0;
+  ok = ok && get32(p, end, count);
+  for (uint32_t i = 0; ok && i < count; ++i) {
+    std::string path, data;
+    ok = getBytes(p, end, path) && getBytes(p, end, data);
+    if (ok) flash.files[path].assign(data.begin(), data.end());
+  }
+  ok = ok && get32(p, end, count);
+  for (uint32_t i = 0; ok && i < count; ++i) {
+    std::string name;
+    uint32_t keys = 0;
+    ok = getBytes(p, end, name) && get32(p, end, keys);
+    auto& ns = flash.nvs[name];
+    for (uint32_t k = 0; ok && k < keys; ++k) {
+      std::string key, value;
+      ok = getBytes(p, end, key) && getBytes(p, end, value);
+      if (ok) ns[key].assign(value.begin(), value.end());
+    }
+  }
+  ok = ok && simSensorLoad(p, end);
+  if (!ok) {
+    fprintf(stderr, "sim: flash image is damaged\n");
+    abort();
+  }
+}
+
+// --- LittleFS ---
+
+bool LittleFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+  flash.mounted = true;
+  return true;
+}
+
+bool LittleFSFS::format() {
+  SimPlatformScope scope;
+  if (mutation()) powerCut();
+  flash.files.clear();
+  return true;
+}
+
+void LittleFSFS::end() {
+  flash.mounted = false;
+}
+
+size_t LittleFSFS::totalBytes() {
+  return FS_TOTAL_BYTES;
+}
+
+size_t LittleFSFS::usedBytes() {
+  size_t used = 2 * FS_BLOCK;  // superblocks
+  for (const auto& f : flash.files) used += (f.second.size() + FS_BLOCK - 1) / FS_BLOCK * FS_BLOCK + FS_BLOCK;
+  return used;
+}
+
+namespace fs {
+
+File FS::open(const char* path, const char* mode, bool create) {
+  SimPlatformScope scope;
+  if (!flash.mounted || !path || !mode) return File();
+  bool exists = flash.files.count(path) != 0;
+  bool write = mode[0] == 'w' || mode[0] == 'a' || strchr(mode, '+');
+  if (!exists && !write) return File();
+  simSpend(FLASH_OPEN_US);
+  if (mode[0] == 'w' || (mode[0] == 'a' && !exists)) {
+    if (mutation()) powerCut();
+    flash.files[path].clear();
+  }
+  OpenFile h = { path, 0, mode[0] == 'a', write, true };
+  for (size_t i = 0; i < flash.handles.size(); ++i) {
+    if (!flash.handles[i].open) {
+      flash.handles[i] = h;
+      return File((int)i);
+    }
+  }
+  flash.handles.push_back(h);
+  return File((int)flash.handles.size() - 1);
+}
+
+bool FS::exists(const char* path) {
+  SimPlatformScope scope;
+  return flash.mounted && flash.files.count(path) != 0;
+}
+
+bool FS::remove(const char* path) {
+  SimPlatformScope scope;
+  if (!flash.mounted || !flash.files.count(path)) return false;
+  simSpend(FLASH_REMOVE_US);
+  if (mutation()) powerCut();
+  flash.files.erase(path);
+  return true;
+}
+
+// Atomic: a cut leaves either the old or the new name
+bool FS::rename(const char* from, const char* to) {
+  SimPlatformScope scope;
+  if (!flash.mounted || !flash.files.count(from)) return false;
+  simSpend(FLASH_RENAME_US);
+  if (mutation()) powerCut();
+  std::vector<uint8_t> data;
+  data.swap(flash.files[from]);
+  flash.files.erase(from);
+  flash.files[to].swap(data);
+  return true;
+}
+
+static OpenFile* handleOf(int handle) {
+  if (handle < 0 || (size_t)handle >= flash.handles.size() || !flash.handles[handle].open) return nullptr;
+  return &flash.handles[handle];
+}
+
+static std::vector<uint8_t>* dataOf(OpenFile* h) {
+  auto it = h ? flash.files.find(h->path) : flash.files.end();
+  return it == flash.files.end() ? nullptr : &it->second;
+}
+
+// A cut keeps a random prefix of the write, then the power is gone
+size_t File::write(const uint8_t* buf, size_t size) {
+  SimPlatformScope scope;
+  OpenFile* h = handleOf(handle_);
+  if (!h || !h->writable || size == 0) return 0;
+  simSpend(FLASH_WRITE_BASE_US + FLASH_WRITE_PER_BYTE_US * size);
+  h = handleOf(handle_);
+  std::vector<uint8_t>* data = dataOf(h);
+  if (!data) return 0;
+  size_t keep = size;
+  bool cut = mutation();
+  if (cut) keep = simRandom64(SIM_RNG_FLASH) % size;
+  if (h->append) h->pos = data->size();
+  if (data->size() < h->pos + keep) data->resize(h->pos + keep);
+  memcpy(data->data() + h->pos, buf, keep);
+  h->pos += keep;
+  if (cut) powerCut();
+  return size;
+}
+
+int File::available() {
+  SimPlatformScope scope;
+  OpenFile* h = handleOf(handle_);
+  std::vector<uint8_t>* data = dataOf(h);
+  return data && data->size() > h->pos ? (int)(data->size() - h->pos) : 0;
+}
+
+int File::read() {
+  SimPlatformScope scope;
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int File::peek() {
+  SimPlatformScope scope;
+  OpenFile* h = handleOf(handle_);
+  std::vector<uint8_t>* data = dataOf(h);
+  return data && data->size() > h->pos ? (*data)[h->pos] : -1;
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+  SimPlatformScope scope;
+  OpenFile* h = handleOf(handle_);
+  std::vector<uint8_t>* data = dataOf(h);
+  if (!data || data->size() <= h->pos) return 0;
+  size_t n = std::min(size, data->size() - h->pos);
+  memcpy(buf, data->data() + h->pos, n);
+  h->pos += n;
+  return n;
+}
+
+bool File::seek(uint32_t pos) {
+  SimPlatformScope scope;
+  OpenFile* h = handleOf(handle_);
+  std::vector<uint8_t>* data = dataOf(h);
+  if (!data || pos > data->size()) return false;
+  h->pos = pos;
+  return true;
+}
+
+size_t File::position() const {
+  SimPlatformScope scope;
+  OpenFile* h = handleOf(handle_);
+  return h ? h->pos : 0;
+}
+
+size_t File::size() const {
+  SimPlatformScope scope;
+  std::vector<uint8_t>* data = dataOf(handleOf(handle_));
+  return data ? data->size() : 0;
+}
+
+void File::close() {
+  SimPlatformScope scope;
+  OpenFile* h = handleOf(handle_);
+  if (h) h->open = false;
+  handle_ = -1;
+}
+
+const char* File::name() const {
+  SimPlatformScope scope;
+  OpenFile* h = handleOf(handle_);
+  return h ? h->path.c_str() : "";
+}
+
+}  // namespace fs
+
+// --- NVS ---
+
+static std::map<std::string, std::vector<uint8_t>>* nvsNamespace(const char* name) {
+  SimPlatformScope scope;
+  auto it = flash.nvs.find(name);
+  return it == flash.nvs.end() ? nullptr : &it->second;
+}
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partitionLabel) {
+  SimPlatformScope scope;
+  if (started_) return false;
+  if (!name || strlen(name) >= sizeof(name_)) return false;
+  if (!nvsNamespace(name)) {
+    if (readOnly) return false;
+    SimPlatformScope scope;
+    flash.nvs[name];
+  }
+  strlcpy(name_, name, sizeof(name_));
+  readOnly_ = readOnly;
+  started_ = true;
+  return true;
+}
+
+void Preferences::end() {
+  started_ = false;
+}
+
+static size_t nvsPut(bool started, bool readOnly, const char* ns, const char* key, NvsType type, const void* value,
+                     size_t len) {
+  if (!started || readOnly || !key) return 0;
+  simSpend(NVS_WRITE_US);
+  SimPlatformScope scope;
+  if (mutation()) powerCut();  // NVS commits an entry whole or not at all
+  std::vector<uint8_t>& entry = flash.nvs[ns][key];
+  entry.assign(1, (uint8_t)type);
+  entry.insert(entry.end(), (const uint8_t*)value, (const uint8_t*)value + len);
+  return len;
+}
+
+static const std::vector<uint8_t>* nvsGet(bool started, const char* ns, const char* key, NvsType type) {
+  SimPlatformScope scope;
+  if (!started || !key) return nullptr;
+  auto* n = nvsNamespace(ns);
+  if (!n) return nullptr;
+  auto it = n->find(key);
+  if (it == n->end() || it->second.empty() || it->second[0] != type) return nullptr;
+  return &it->second;
+}
+
+bool Preferences::clear() {
+  SimPlatformScope scope;
+  if (!started_ || readOnly_) return false;
+  if (mutation()) powerCut();
+  flash.nvs[name_].clear();
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  SimPlatformScope scope;
+  if (!started_ || readOnly_ || !key) return false;
+  auto* n = nvsNamespace(name_);
+  if (!n || !n->count(key)) return false;
+  if (mutation()) powerCut();
+  n->erase(key);
+  return true;
+}
+
+bool Preferences::isKey(const char* key) {
+  SimPlatformScope scope;
+  auto* n = started_ && key ? nvsNamespace(name_) : nullptr;
+  return n && n->count(key);
+}
+
+size_t Preferences::putUChar(const char* key, uint8_t value) {
+  SimPlatformScope scope;
+  return nvsPut(started_, readOnly_, name_, key, NVS_U8, &value, sizeof(value));
+}
+
+size_t Preferences::putUShort(const char* key, uint16_t value) {
+  SimPlatformScope scope;
+  return nvsPut(started_, readOnly_, name_, key, NVS_U16, &value, sizeof(value));
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+  SimPlatformScope scope;
+  return nvsPut(started_, readOnly_, name_, key, NVS_U32, &value, sizeof(value));
+}
+
+// Stored with the terminator; returns the length without it, as the core does
+size_t Preferences::putString(const char* key, const char* value) {
+  SimPlatformScope scope;
+  if (!value) return 0;
+  size_t len = strlen(value);
+  return nvsPut(started_, readOnly_, name_, key, NVS_STR, value, len + 1) ? len : 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  SimPlatformScope scope;
+  if (!value || !len) return 0;
+  return nvsPut(started_, readOnly_, name_, key, NVS_BLOB, value, len);
+}
+
+uint8_t Preferences::getUChar(const char* key, uint8_t def) {
+  SimPlatformScope scope;
+  const std::vector<uint8_t>* e = nvsGet(started_, name_, key, NVS_U8);
+  return e ? (*e)[1] : def;
+}
+
+uint16_t Preferences::getUShort(const char* key, uint16_t def) {
+  SimPlatformScope scope;
+  const std::vector<uint8_t>* e = nvsGet(started_, name_, key, NVS_U16);
+  uint16_t v = def;
+  if (e) memcpy(&v, e->data() + 1, sizeof(v));
+  return v;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t def) {
+  SimPlatformScope scope;
+  const std::vector<uint8_t>* e = nvsGet(started_, name_, key, NVS_U32);
+  uint32_t v = def;
+  if (e) memcpy(&v, e->data() + 1, sizeof(v));
+  return v;
+}
+
+// Length including the terminator, 0 if missing or longer than maxLen
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+  SimPlatformScope scope;
+  const std::vector<uint8_t>* e = nvsGet(started_, name_, key, NVS_STR);
+  if (!e || !value || e->size() - 1 > maxLen) return 0;
+  memcpy(value, e->data() + 1, e->size() - 1);
+  return e->size() - 1;
+}
+
+String Preferences::getString(const char* key, String def) {
+  SimPlatformScope scope;
+  const std::vector<uint8_t>* e = nvsGet(started_, name_, key, NVS_STR);
+  return e ? String((const char*)e->data() + 1) : def;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  SimPlatformScope scope;
+  const std::vector<uint8_t>* e = nvsGet(started_, name_, key, NVS_BLOB);
+  return e ? e->size() - 1 : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  SimPlatformScope scope;
+  const std::vector<uint8_t>* e = nvsGet(started_, name_, key, NVS_BLOB);
+  if (!e || !buf || e->size() - 1 > maxLen) return 0;
+  memcpy(buf, e->data() + 1, e->size() - 1);
+  return e->size() - 1;
+}
@@ -0,0 +1,120 @@
+// sim_tls_client.cpp
+// TlsClient (tls_client.h) on the simulated network: the TCP connect and the
+// handshake take SimNetConfig's times, the short one when the station offers
+// a session the broker still knows. The link dies with Wi-Fi or the broker.
+// No bytes are carried; PubSubClient talks to the broker directly.
+#include "sim_internal.h"
+#include "../tls_client.h"
+
+static bool pending = false;
+static bool up = false;
+static bool savedSession = false;  // offered on the next handshake
+static bool lastResumed = false;
+static uint32_t generation = 0;
+static uint32_t tlsLink = 0;
+static uint32_t nextLink = 0;
+static uint64_t tcpDoneUs = 0;
+static uint64_t doneUs = 0;
+static uint64_t deadlineUs = 0;
+
+uint32_t simTlsLink() {
+  return up && generation == simNetGeneration() && simBrokerIsUp() ? tlsLink : 0;
+}
+
+void TlsClient::setHandshakeTimeout(uint32_t seconds) {
+  handshakeTimeoutMs_ = seconds * 1000;
+}
+
+bool TlsClient::connectStart(const char* host, uint16_t port) {
+  stop();
+  if (!simWifiAssociated()) return false;
+  const SimNetConfig& cfg = simConfig().net;
+  lastResumed = savedSession && simBrokerHasSession();
+  uint64_t now = simMicros();
+  tcpDoneUs = now + (uint64_t)cfg.tcpConnectMs * 1000;
+  doneUs = tcpDoneUs + (uint64_t)(lastResumed ? cfg.tlsResumedMs : cfg.tlsFullMs) * 1000;
+  deadlineUs = now + (uint64_t)handshakeTimeoutMs_ * 1000;
+  generation = simNetGeneration();
+  pending = true;
+  return true;
+}
+
+TlsStep TlsClient::connectPoll() {
+  if (!pending) return up ? TLS_STEP_DONE : TLS_STEP_FAILED;
+  uint64_t now = simMicros();
+  bool failed = generation != simNetGeneration() || (now >= tcpDoneUs && !simBrokerIsUp()) ||
+                (doneUs > deadlineUs && now >= deadlineUs);
+  if (failed) {
+    pending = false;
+    return TLS_STEP_FAILED;
+  }
+  if (now < doneUs) return TLS_STEP_PENDING;
+  pending = false;
+  up = true;
+  tlsLink = ++nextLink;
+  savedSession = true;
+  simBrokerSessionSaved(lastResumed);
+  return TLS_STEP_DONE;
+}
+
+bool TlsClient::resumed() const {
+  return lastResumed;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+  return connect("broker", port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+  if (!connectStart(host, port)) return 0;
+  TlsStep step;
+  while ((step = connectPoll()) == TLS_STEP_PENDING) delay(10);
+  return step == TLS_STEP_DONE ? 1 : 0;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+  return connect(ip, port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+  return connect(host, port);
+}
+
+size_t TlsClient::write(uint8_t b) {
+  return connected() ? 1 : 0;
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+  return connected() ? size : 0;
+}
+
+int TlsClient::available() {
+  return 0;
+}
+
+int TlsClient::read() {
+  return -1;
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+  return -1;
+}
+
+int TlsClient::peek() {
+  return peeked_;
+}
+
+void TlsClient::flush() {}
+
+void TlsClient::stop() {
+  pending = false;
+  up = false;
+}
+
+uint8_t TlsClient::connected() {
+  return simTlsLink() != 0;
+}
+
+TlsClient::operator bool() {
+  return connected();
+}
@@ -0,0 +1,193 @@
+// sim_uart.cpp
+// HardwareSerial. A byte takes ten bit times on the wire. Writes return once
+// all but the 128-byte hardware FIFO is out, as with the core's driver
+// installed without a TX buffer. Received bytes land in the RX ring when
+// their last bit is in; what does not fit the ring is dropped.
+#include <deque>
+#include "sim_internal.h"
+#include <Arduino.h>
+
+#define UART_FIFO_LEN 128
+#define UART_DEFAULT_RX_BUFFER 256
+#define CONSOLE_BAUD 115200
+#define CONSOLE_KEEP (1u << 20)  // console output kept for simSerialTake()
+
+HardwareSerial Serial(0);
+
+struct InFlight {
+  uint64_t atUs;
+  uint8_t value;
+};
+
+struct SimUart {
+  uint32_t baud;
+  size_t rxCapacity;
+  std::deque<InFlight> wire;  // on its way in
+  std::deque<uint8_t> rx;
+  uint64_t txFreeAt;
+  uint64_t rxLineFreeAt;
+};
+
+static SimUart console;
+static SimUart sensorLink;
+static std::string consoleOut;
+static std::deque<uint8_t> consoleIn;
+
+static uint64_t byteUs(uint32_t baud) {
+  return 10000000ULL / baud;
+}
+
+static void resetUart(SimUart& u, uint32_t baud) {
+  SimPlatformScope scope;
+  u.baud = baud;
+  u.rxCapacity = UART_DEFAULT_RX_BUFFER;
+  u.wire.clear();
+  u.rx.clear();
+  u.txFreeAt = 0;
+  u.rxLineFreeAt = 0;
+}
+
+void simUartReset() {
+  resetUart(sensorLink, 57600);
+}
+
+void simConsoleReset() {
+  SimPlatformScope scope;
+  resetUart(console, CONSOLE_BAUD);
+  consoleOut.clear();
+  consoleIn.clear();
+}
+
+uint32_t simUartHostBaud() {
+  return sensorLink.baud;
+}
+
+void simUartToHost(const uint8_t* data, size_t len, uint64_t startUs, uint32_t baud) {
+  SimPlatformScope scope;
+  uint64_t t = std::max(startUs, sensorLink.rxLineFreeAt);
+  bool garbled = baud != sensorLink.baud;  // framing errors: the host reads noise
+  for (size_t i = 0; i < len; ++i) {
+    t += byteUs(baud);
+    sensorLink.wire.push_back({ t, garbled ? (uint8_t)simRandom64(SIM_RNG_SENSOR) : data[i] });
+  }
+  sensorLink.rxLineFreeAt = t;
+}
+
+static void settle(SimUart& u) {
+  SimPlatformScope scope;
+  uint64_t now = simMicros();
+  uint32_t dropped = 0;
+  while (!u.wire.empty() && u.wire.front().atUs <= now) {
+    if (u.rx.size() < u.rxCapacity) u.rx.push_back(u.wire.front().value);
+    else dropped++;
+    u.wire.pop_front();
+  }
+  if (dropped) simSensorCountOverflow(dropped);
+}
+
+// The line is busy until the last byte is out; the caller waits for the FIFO
+static uint64_t transmit(SimUart& u, size_t len) {
+  uint64_t start = std::max(simMicros(), u.txFreeAt);
+  u.txFreeAt = start + len * byteUs(u.baud);
+  uint64_t fifo = UART_FIFO_LEN * byteUs(u.baud);
+  if (u.txFreeAt > simMicros() + fifo) simSpend(u.txFreeAt - fifo - simMicros());
+  return u.txFreeAt;
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin, bool invert,
+                           unsigned long timeoutMs) {
+  SimUart& u = uart_ == 0 ? console : sensorLink;
+  SimPlatformScope scope;
+  u.baud = baud;
+  u.rx.clear();
+}
+
+void HardwareSerial::end() {
+  SimUart& u = uart_ == 0 ? console : sensorLink;
+  SimPlatformScope scope;
+  u.rx.clear();
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud) {
+  (uart_ == 0 ? console : sensorLink).baud = baud;
+}
+
+uint32_t HardwareSerial::baudRate() {
+  return (uart_ == 0 ? console : sensorLink).baud;
+}
+
+size_t HardwareSerial::setRxBufferSize(size_t size) {
+  SimUart& u = uart_ == 0 ? console : sensorLink;
+  u.rxCapacity = size > UART_FIFO_LEN ? size : UART_FIFO_LEN + 1;
+  return u.rxCapacity;
+}
+
+int HardwareSerial::available() {
+  if (uart_ == 0) return (int)consoleIn.size();
+  settle(sensorLink);
+  return (int)sensorLink.rx.size();
+}
+
+int HardwareSerial::peek() {
+  if (uart_ == 0) return consoleIn.empty() ? -1 : consoleIn.front();
+  settle(sensorLink);
+  return sensorLink.rx.empty() ? -1 : sensorLink.rx.front();
+}
+
+int HardwareSerial::read() {
+  SimPlatformScope scope;
+  std::deque<uint8_t>& q = uart_ == 0 ? consoleIn : sensorLink.rx;
+  if (uart_ != 0) settle(sensorLink);
+  if (q.empty()) return -1;
+  uint8_t b = q.front();
+  q.pop_front();
+  return b;
+}
+
+size_t HardwareSerial::read(uint8_t* buf, size_t size) {
+  SimPlatformScope scope;
+  std::deque<uint8_t>& q = uart_ == 0 ? consoleIn : sensorLink.rx;
+  if (uart_ != 0) settle(sensorLink);
+  size_t n = std::min(size, q.size());
+  std::copy(q.begin(), q.begin() + n, buf);
+  q.erase(q.begin(), q.begin() + n);
+  return n;
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size) {
+  if (size == 0) return 0;
+  if (uart_ == 0) {
+    {
+      SimPlatformScope scope;
+      if (consoleOut.size() > CONSOLE_KEEP) consoleOut.erase(0, consoleOut.size() - CONSOLE_KEEP / 2);
+      consoleOut.append((const char*)buf, size);
+      if (simConfig().echoSerial) fwrite(buf, 1, size, stdout);
+    }
+    transmit(console, size);
+    return size;
+  }
+  uint32_t baud = sensorLink.baud;
+  uint64_t start = std::max(simMicros(), sensorLink.txFreeAt);
+  simSensorReceive(buf, size, start + size * byteUs(baud), baud);
+  transmit(sensorLink, size);
+  return size;
+}
+
+void HardwareSerial::flush() {
+  SimUart& u = uart_ == 0 ? console : sensorLink;
+  if (u.txFreeAt > simMicros()) simSpend(u.txFreeAt - simMicros());
+}
+
+// --- Harness side of the console ---
+
+void simSerialInput(const char* text) {
+  SimPlatformScope scope;
+  for (const char* p = text; *p; ++p) consoleIn.push_back((uint8_t)*p);
+}
+
+std::string simSerialTake() {
+  SimPlatformScope scope;
+  std::string out;
+  out.swap(consoleOut);
+  return out;
+}
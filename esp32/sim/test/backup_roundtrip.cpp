@@ -0,0 +1,246 @@
+// backup_roundtrip.cpp
+// A full-library backup and restore over MQTT (backup.h), in each wire
+// format. One station backs up every slot of its sensor to an archive peer
+// that acknowledges each chunk the way the backend does; a second, empty
+// station is then restored from the archive with the backend's flow control
+// (four messages of two templates in flight). The second sensor must hold the
+// same 512 bytes in every slot and nothing else, the station's count and hash
+// index must match, and voters from the first library must verify on it.
+//
+//   backup_roundtrip [--quick]   quick: 40 templates, otherwise the whole sensor
+#include "../bench/bench_util.h"
+#include "../../backup.h"
+#include "../../station_store.h"
+#include "../../text_codec.h"
+#include <map>
+#include <mbedtls/sha256.h>
+#include <sys/mman.h>
+
+using namespace bench;
+
+#define TEMPLATE_BYTES 512
+#define ARCHIVE_MAX 1024
+#define RESTORE_PER_MESSAGE 2
+#define RESTORE_IN_FLIGHT (RESTORE_SLOTS / RESTORE_PER_MESSAGE)
+
+// Passed from the backed-up station's process to the restored one's
+struct Archive {
+  uint32_t count;
+  uint16_t ids[ARCHIVE_MAX];
+  uint32_t persons[ARCHIVE_MAX];
+  uint8_t data[ARCHIVE_MAX][TEMPLATE_BYTES];
+  double backupSeconds;
+  double restoreSeconds;
+};
+
+static Archive* archive;
+
+static uint16_t be16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static bool archiveAdd(uint16_t id, const uint8_t* data) {
+  if (archive->count >= ARCHIVE_MAX) return false;
+  archive->ids[archive->count] = id;
+  memcpy(archive->data[archive->count], data, TEMPLATE_BYTES);
+  archive->count++;
+  return true;
+}
+
+// One backup chunk in either format; false if it does not parse
+static bool takeChunk(const std::string& payload, uint16_t* seq, bool* done) {
+  const uint8_t* b = (const uint8_t*)payload.data();
+  size_t n = payload.size();
+  if (n >= 2 && b[0] == WIRE_BINARY_MAGIC) {
+    if (b[1] != WIRE_MSG_BACKUP || n < 8) return false;
+    *seq = be16(b + 2);
+    *done = b[6] != 0;
+    size_t at = 8;
+    for (uint8_t i = 0; i < b[7]; ++i, at += 2 + TEMPLATE_BYTES) {
+      if (at + 2 + TEMPLATE_BYTES > n || !archiveAdd(be16(b + at), b + at + 2)) return false;
+    }
+    return true;
+  }
+  *seq = (uint16_t)jsonUint(payload, "seq");
+  *done = jsonField(payload, "done") == "true";
+  for (size_t at = payload.find("{\"id\":"); at != std::string::npos; at = payload.find("{\"id\":", at + 1)) {
+    uint16_t id = (uint16_t)atoi(payload.c_str() + at + 6);
+    size_t data = payload.find("\"data\":\"", at);
+    size_t end = data == std::string::npos ? data : payload.find('"', data + 8);
+    if (end == std::string::npos) return false;
+    uint8_t tpl[TEMPLATE_BYTES];
+    if (base64Decode(payload.c_str() + data + 8, end - data - 8, tpl, sizeof(tpl)) != TEMPLATE_BYTES) return false;
+    if (!archiveAdd(id, tpl)) return false;
+  }
+  return true;
+}
+
+static std::string formatField(WireFormat format) {
+  return format == WIRE_BINARY ? "\"format\":\"binary\"" : "\"format\":\"json\"";
+}
+
+static bool backupRun(WireFormat format, uint16_t library) {
+  SimConfig config;
+  bootStation(config, [&] {
+    for (uint16_t id = 1; id <= library; ++id) simSensor().enrollDirect(id, 1000 + id);
+  });
+  Backend backend;
+  archive->count = 0;
+  bool done = false, malformed = false;
+  SimPeer store("archive");
+  store.subscribe(stationTopic("fingerprint/backup").c_str());
+  store.onMessage = [&](const SimMessage& m) {
+    uint16_t seq = 0;
+    bool last = false;
+    if (!takeChunk(m.payload, &seq, &last)) {
+      malformed = true;
+      return;
+    }
+    std::string ack = "{\"action\":\"backup-ack\",\"seq\":" + std::to_string(seq) + "}";
+    store.publish(stationTopic("fingerprint/command"), ack);
+    done |= last;
+  };
+
+  uint64_t startUs = simMicros();
+  backend.send("backup", formatField(format));
+  bool finished = simRunUntil([&] { return done || malformed; }, library * 2000 + 60000);
+  archive->backupSeconds = (simMicros() - startUs) / 1e6;
+  simRunFor(1000);
+  if (!finished || malformed) {
+    fprintf(stderr, "backup: %s after %u templates\n", malformed ? "malformed chunk" : "no last chunk",
+            archive->count);
+    return false;
+  }
+
+  // every slot exactly once, as the sensor holds it
+  std::map<uint16_t, uint32_t> seen;
+  uint32_t wrong = 0;
+  for (uint32_t i = 0; i < archive->count; ++i) {
+    uint16_t id = archive->ids[i];
+    const uint8_t* tpl = simSensor().templateAt(id);
+    seen[id]++;
+    archive->persons[i] = simSensor().personAt(id);
+    if (!tpl || memcmp(tpl, archive->data[i], TEMPLATE_BYTES) != 0) wrong++;
+  }
+  if (seen.size() != library || archive->count != library || wrong) {
+    fprintf(stderr, "backup: %u templates for %zu slots of %u, %u differ from the sensor\n", archive->count,
+            seen.size(), (unsigned)library, wrong);
+    return false;
+  }
+  return true;
+}
+
+static bool restoreRun(WireFormat format, uint16_t library) {
+  SimConfig config;
+  bootStation(config);
+  Backend backend;
+  uint32_t acked = 0, stored = 0, failed = 0;  // the counts are totals so far
+  bool done = false;
+  SimPeer store("archive");
+  store.subscribe(stationTopic("fingerprint/backup").c_str());
+  store.onMessage = [&](const SimMessage& m) {
+    const uint8_t* b = (const uint8_t*)m.payload.data();
+    if (m.payload.size() >= 9 && b[0] == WIRE_BINARY_MAGIC && b[1] == WIRE_MSG_RESTORE_ACK) {
+      acked++;
+      stored = be16(b + 4);
+      failed = be16(b + 6);
+      done |= b[8] != 0;
+    } else if (m.payload.find("\"restoreAck\"") != std::string::npos) {
+      acked++;
+      stored = jsonUint(m.payload, "stored");
+      failed = jsonUint(m.payload, "failed");
+      done |= jsonField(m.payload, "done") == "true";
+    }
+  };
+
+  // the format travels on the first restore message
+  uint64_t startUs = simMicros();
+  uint32_t messages = (archive->count + RESTORE_PER_MESSAGE - 1) / RESTORE_PER_MESSAGE;
+  char b64[BASE64_ENCODED_LEN(TEMPLATE_BYTES) + 1];
+  for (uint32_t seq = 0; seq < messages; ++seq) {
+    if (!simRunUntil([&] { return seq - acked < RESTORE_IN_FLIGHT; }, 60000)) {
+      fprintf(stderr, "restore: no ack for message %u\n", acked);
+      return false;
+    }
+    std::string extra = "\"seq\":" + std::to_string(seq) + ",\"templates\":[";
+    for (uint32_t i = seq * RESTORE_PER_MESSAGE; i < archive->count && i < (seq + 1) * RESTORE_PER_MESSAGE; ++i) {
+      b64[base64Encode(archive->data[i], TEMPLATE_BYTES, b64)] = '\0';
+      if (i % RESTORE_PER_MESSAGE) extra += ",";
+      extra += "{\"id\":" + std::to_string(archive->ids[i]) + ",\"data\":\"" + b64 + "\"}";
+    }
+    extra += std::string("],\"done\":") + (seq + 1 == messages ? "true" : "false");
+    if (seq == 0) extra += "," + formatField(format);
+    backend.send("restore", extra);
+  }
+  bool finished = simRunUntil([&] { return done; }, 60000);
+  archive->restoreSeconds = (simMicros() - startUs) / 1e6;
+  simRunFor(STORE_COMMIT_DELAY_MS + 500);
+  if (!finished || stored != library || failed) {
+    fprintf(stderr, "restore: %u stored, %u failed of %u, %u acks%s\n", stored, failed, (unsigned)library, acked,
+            finished ? "" : ", never done");
+    return false;
+  }
+
+  // the sensor holds the library and nothing else; count and hash index agree
+  uint32_t wrong = 0, extra = 0, badHash = 0;
+  std::map<uint16_t, uint32_t> index;
+  for (uint32_t i = 0; i < archive->count; ++i) index[archive->ids[i]] = i;
+  for (uint16_t id = 0; id < simConfig().sensor.capacity; ++id) {
+    auto it = index.find(id);
+    const uint8_t* tpl = simSensor().templateAt(id);
+    if (it == index.end()) {
+      extra += tpl != nullptr;
+      continue;
+    }
+    if (!tpl || memcmp(tpl, archive->data[it->second], TEMPLATE_BYTES) != 0) wrong++;
+    uint8_t digest[32];
+    mbedtls_sha256(archive->data[it->second], TEMPLATE_BYTES, digest, 0);
+    if (memcmp(storeState().slots[id], digest, sizeof(digest)) != 0) badHash++;
+  }
+  if (wrong || extra || badHash || storeState().enrolledCount != library) {
+    fprintf(stderr, "restore: %u slot(s) differ, %u extra, %u hash(es) wrong, count %u of %u\n", wrong, extra,
+            badHash, (unsigned)storeState().enrolledCount, (unsigned)library);
+    return false;
+  }
+
+  // voters enrolled on the first station are found on this one
+  Voter voter;
+  for (uint32_t k = 0; k < 5; ++k) {
+    uint32_t i = k * archive->count / 5;
+    voter.expect(archive->persons[i]);
+    uint32_t rid = backend.send("verify");
+    std::string status;
+    bool ok = backend.waitFinal(rid, 30000, &status) && status == "success" &&
+              backend.finalMessage().find("ID: " + std::to_string(archive->ids[i]) + " ") != std::string::npos;
+    simRunFor(1000);
+    if (!ok) {
+      fprintf(stderr, "restore: voter of ID %u not verified: %s %s\n", (unsigned)archive->ids[i], status.c_str(),
+              backend.finalMessage().c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool quick = hasFlag(argc, argv, "--quick");
+  // IDs start at 1: a full sensor holds capacity - 1 templates
+  const uint16_t library = quick ? 40 : SimSensorConfig().capacity - 1;
+  archive = (Archive*)mmap(nullptr, sizeof(Archive), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (archive == MAP_FAILED) return 2;
+
+  int failures = 0;
+  printf("backup_roundtrip: %u templates, simulated time\n", (unsigned)library);
+  printf("  %-8s %12s %12s %s\n", "format", "backup t/s", "restore t/s", "result");
+  for (int f = WIRE_JSON; f <= WIRE_BINARY; ++f) {
+    WireFormat format = (WireFormat)f;
+    memset(archive, 0, sizeof(Archive));
+    bool ok = isolated([&] { return backupRun(format, library); }) &&
+              isolated([&] { return restoreRun(format, library); });
+    printf("  %-8s %12.1f %12.1f %s\n", format == WIRE_BINARY ? "binary" : "json",
+           archive->backupSeconds > 0 ? archive->count / archive->backupSeconds : 0,
+           archive->restoreSeconds > 0 ? archive->count / archive->restoreSeconds : 0, ok ? "ok" : "FAILED");
+    failures += !ok;
+  }
+  return failures ? 1 : 0;
+}
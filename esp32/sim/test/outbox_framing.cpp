@@ -0,0 +1,152 @@
+// outbox_framing.cpp
+// Template batches and sync replies when the outbound queue overflows
+// (messaging.cpp, outboxPush). With the broker away, the console starts a bulk
+// download of the whole library and then asks for the sync replies of eight
+// buckets: far more than the outbox holds. After the reconnect every reply
+// must be whole or a "truncated" marker: the bulk job's entries complete or
+// marked, each sync reply listing exactly the occupied slots of its bucket or
+// marked, one reply per node asked for. A sync reply short of an entry would
+// read as an empty slot to the backend. Runs in both wire formats.
+//
+//   outbox_framing [--quick]   the same either way
+#include "../bench/bench_util.h"
+#include "../../hash_index.h"
+#include <map>
+#include <set>
+
+using namespace bench;
+
+#define LIBRARY 300
+#define SYNC_REPLIES 8
+#define FIRST_BUCKET HASH_INDEX_BUCKETS
+
+static uint16_t be16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static bool isBinary(const std::string& payload) {
+  return payload.size() >= 2 && (uint8_t)payload[0] == WIRE_BINARY_MAGIC;
+}
+
+// Slot IDs of a JSON listing, one per {"id":..} after `from`
+static std::set<uint16_t> jsonIds(const std::string& payload, size_t from) {
+  std::set<uint16_t> ids;
+  for (size_t at = payload.find("{\"id\":", from); at != std::string::npos; at = payload.find("{\"id\":", at + 1)) {
+    ids.insert((uint16_t)atoi(payload.c_str() + at + 6));
+  }
+  return ids;
+}
+
+static bool framingRun(WireFormat format) {
+  SimConfig config;
+  bootStation(config, [] {
+    for (uint16_t id = 1; id <= LIBRARY; ++id) simSensor().enrollDirect(id, 1000 + id);
+  });
+  Backend backend;
+  const char* name = format == WIRE_BINARY ? "binary" : "json";
+  uint32_t rid = backend.send("set-format", format == WIRE_BINARY ? "\"format\":\"binary\"" : "\"format\":\"json\"");
+  if (!backend.waitFinal(rid, 5000)) return false;
+  simRunFor(500);
+  backend.messages().clear();
+  simSerialTake();
+
+  simBrokerUp(false);
+  simRunUntil([] { return !simStationConnected(); }, 30000);
+  simSerialInput("download-all\n");
+  auto bulkDone = [] { return simSerialTake().find("BULK DOWNLOAD COMPLETE") != std::string::npos; };
+  if (!simRunUntil(bulkDone, LIBRARY * 1000)) {
+    fprintf(stderr, "%s: bulk download did not finish\n", name);
+    return false;
+  }
+  for (uint16_t node = FIRST_BUCKET; node < FIRST_BUCKET + SYNC_REPLIES; ++node) {
+    simSerialInput(("sync " + std::to_string(node) + "\n").c_str());
+    simRunFor(500);  // one at a time: the console queues only a few commands
+  }
+  simRunFor(5000);
+  uint32_t dropped = messagingOutboxStats().dropped;
+  simBrokerUp(true);
+  if (!simRunUntil([] { return simStationConnected(); }, 120000)) return false;
+  simRunFor(10000);
+
+  uint32_t batchEntries = 0, batchMarkers = 0;
+  std::map<uint16_t, uint32_t> replies;
+  uint32_t whole = 0, marked = 0, wrong = 0;
+  for (const SimMessage& m : backend.messages()) {
+    const std::string& p = m.payload;
+    const uint8_t* b = (const uint8_t*)p.data();
+    if (m.topic == stationTopic("fingerprint/templates")) {
+      if (isBinary(p)) {
+        uint16_t n = p.size() >= 4 ? be16(b + 2) : 0;
+        if (n == WIRE_BATCH_TRUNCATED) batchMarkers++;
+        else batchEntries += n;
+      } else if (jsonField(p, "truncated") == "true") {
+        batchMarkers++;
+      } else {
+        batchEntries += (uint32_t)jsonIds(p, 0).size();
+      }
+      continue;
+    }
+    if (m.topic != stationTopic("fingerprint/sync")) continue;
+    uint16_t node;
+    bool truncated;
+    std::set<uint16_t> ids;
+    if (isBinary(p)) {
+      if (p.size() < 40) return false;
+      node = be16(b + 2);
+      truncated = b[39] == WIRE_SYNC_TRUNCATED;
+      for (uint8_t i = 0; !truncated && i < b[39] && 40 + (i + 1) * 34u <= p.size(); ++i) {
+        ids.insert(be16(b + 40 + i * 34));
+      }
+    } else {
+      node = (uint16_t)jsonUint(p, "node");
+      truncated = jsonField(p, "truncated") == "true";
+      if (!truncated) ids = jsonIds(p, p.find("\"slots\""));
+    }
+    replies[node]++;
+    if (truncated) {
+      marked++;
+      continue;
+    }
+    std::set<uint16_t> occupied;
+    uint16_t first = (node - FIRST_BUCKET) * HASH_INDEX_BUCKET_SLOTS;
+    for (uint16_t id = first; id < first + HASH_INDEX_BUCKET_SLOTS; ++id) {
+      if (simSensor().occupied(id)) occupied.insert(id);
+    }
+    if (ids == occupied) {
+      whole++;
+    } else {
+      fprintf(stderr, "%s: sync reply for node %u lists %zu of %zu occupied slots, not marked\n", name,
+              (unsigned)node, ids.size(), occupied.size());
+      wrong++;
+    }
+  }
+
+  printf("  %-8s %8u %8u %8u %8u %8u %8u\n", name, dropped, batchEntries, batchMarkers, whole, marked, wrong);
+  bool ok = true;
+  if (batchMarkers == 0 && batchEntries != LIBRARY) {
+    fprintf(stderr, "%s: bulk job published %u of %u entries, not marked\n", name, batchEntries, LIBRARY);
+    ok = false;
+  }
+  for (uint16_t node = FIRST_BUCKET; node < FIRST_BUCKET + SYNC_REPLIES; ++node) {
+    if (replies[node] != 1) {
+      fprintf(stderr, "%s: %u replies for sync node %u\n", name, replies[node], (unsigned)node);
+      ok = false;
+    }
+  }
+  if (dropped == 0) {
+    fprintf(stderr, "%s: the outbox never overflowed\n", name);
+    ok = false;
+  }
+  return ok && wrong == 0;
+}
+
+int main() {
+  printf("outbox_framing: bulk download of %u and %u sync replies while the broker is away\n", LIBRARY, SYNC_REPLIES);
+  printf("  %-8s %8s %8s %8s %8s %8s %8s\n", "format", "dropped", "entries", "marked", "whole", "marked", "short");
+  int failures = 0;
+  for (int f = WIRE_JSON; f <= WIRE_BINARY; ++f) {
+    failures += !isolated([f] { return framingRun((WireFormat)f); });
+  }
+  if (failures) printf("FAILED\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+// work_share.cpp
+// Shared work (station_id.h): the backend floods esp32/fingerprint/work with
+// template downloads and, as server/src/mqttClient.ts does, puts every request
+// answered busy back on the queue after WORK_RETRY_MS. First the station is
+// the only one in the $share group, then two stand-in stations join it and the
+// broker hands the work round-robin. Every request must be done exactly once
+// (a station that left the group with a full backlog let the broker drop work
+// meant for it), the station must never hold more than STATION_WORK_BACKLOG
+// requests and must stay subscribed throughout.
+//
+//   work_share [--quick]   the same either way
+#include "../bench/bench_util.h"
+#include "../../station_id.h"
+#include "../../station_tasks.h"
+#include "../../command_dispatch.h"
+#include "../../connection.h"
+#include <map>
+#include <memory>
+
+using namespace bench;
+
+#define LIBRARY 20
+#define WORK_RETRY_MS 2000
+#define STAND_IN_WORK_MS 600
+#define PHASE_TIMEOUT_MS 300000
+
+// Another station in the $share group: does each request in STAND_IN_WORK_MS
+class StandIn {
+public:
+  explicit StandIn(const char* name) : name_(name), peer_(name) {
+    peer_.subscribe(STATION_WORK_SHARE);
+    peer_.onMessage = [this](const SimMessage& m) {
+      uint32_t rid = jsonUint(m.payload, "rid");
+      taken++;
+      simAfter(STAND_IN_WORK_MS, [this, rid] {
+        peer_.publish("esp32/" + name_ + "/fingerprint/status",
+                      "{\"status\":\"success\",\"message\":\"done\",\"rid\":" + std::to_string(rid) + "}");
+      });
+    };
+  }
+
+  uint32_t taken = 0;
+
+private:
+  std::string name_;
+  SimPeer peer_;
+};
+
+// The backend's work queue: final statuses from every station, busy ones queued again
+class WorkQueue {
+public:
+  WorkQueue() : peer_("work-backend") {
+    peer_.subscribe("esp32/+/fingerprint/status");
+    peer_.onMessage = [this](const SimMessage& m) {
+      StatusView v = decodeStatus(m.payload);
+      if (!v.valid || !isFinalStatus(v.status) || !body_.count(v.rid)) return;
+      if (v.status == "busy") {
+        busy++;
+        uint32_t rid = v.rid;
+        simAfter(WORK_RETRY_MS, [this, rid] { publish(rid); });
+      } else if (v.status == "success") {
+        done[v.rid]++;
+      } else {
+        fprintf(stderr, "rid %u: %s %s\n", v.rid, v.status.c_str(), v.message.c_str());
+        failed++;
+      }
+    };
+  }
+
+  void queue(uint16_t slot) {
+    uint32_t rid = ++nextRid_;
+    body_[rid] = "{\"action\":\"download-template\",\"userId\":" + std::to_string(slot) + ",\"rid\":" +
+                 std::to_string(rid) + "}";
+    publish(rid);
+  }
+
+  std::map<uint32_t, uint32_t> done;  // rid -> success statuses
+  uint32_t busy = 0;
+  uint32_t failed = 0;
+
+private:
+  void publish(uint32_t rid) { peer_.publish(STATION_WORK_TOPIC, body_[rid]); }
+
+  SimPeer peer_;
+  std::map<uint32_t, std::string> body_;
+  uint32_t nextRid_ = 0;
+};
+
+// Queues n requests at once and runs until all are done; true if each was done once
+static bool phase(const char* name, uint32_t n, uint32_t standIns) {
+  WorkQueue work;
+  std::vector<std::unique_ptr<StandIn>> others;
+  for (uint32_t i = 0; i < standIns; ++i) {
+    others.emplace_back(new StandIn(("fp-standin" + std::to_string(i + 1)).c_str()));
+  }
+  uint32_t busyBefore = commandStats().workBusy;
+  for (uint32_t i = 0; i < n; ++i) work.queue(1 + i % LIBRARY);
+
+  uint32_t maxBacklog = 0;
+  bool leftGroup = false;
+  auto allDone = [&] {
+    maxBacklog = std::max(maxBacklog, sensorBacklog());
+    if (simStationConnected() && !connectionTakingWork()) leftGroup = true;
+    return work.done.size() + work.failed >= n;
+  };
+  bool finished = simRunUntil(allDone, PHASE_TIMEOUT_MS);
+  simRunFor(STAND_IN_WORK_MS + 1000);  // late duplicates would show now
+
+  uint32_t twice = 0;
+  for (const auto& d : work.done) twice += d.second > 1;
+  uint32_t taken = 0;
+  for (const auto& s : others) taken += s->taken;
+  printf("  %-12s %6u %6u %6zu %8u %8u %8u %7u\n", name, n, standIns, work.done.size(), work.busy,
+         commandStats().workBusy - busyBefore, taken, maxBacklog);
+
+  bool ok = true;
+  if (!finished || work.done.size() != n) {
+    fprintf(stderr, "%s: %zu of %u requests done\n", name, work.done.size(), n);
+    ok = false;
+  }
+  if (twice || work.failed) {
+    fprintf(stderr, "%s: %u requests done more than once, %u failed\n", name, twice, work.failed);
+    ok = false;
+  }
+  if (maxBacklog > STATION_WORK_BACKLOG) {
+    fprintf(stderr, "%s: the station held %u requests\n", name, maxBacklog);
+    ok = false;
+  }
+  if (leftGroup) {
+    fprintf(stderr, "%s: the station left the shared subscription\n", name);
+    ok = false;
+  }
+  if (work.busy == 0) {
+    fprintf(stderr, "%s: the station never had a full backlog\n", name);
+    ok = false;
+  }
+  return ok;
+}
+
+int main() {
+  printf("work_share: work queued all at once on %s, busy answers queued again after %u ms\n", STATION_WORK_TOPIC,
+         WORK_RETRY_MS);
+  printf("  %-12s %6s %6s %6s %8s %8s %8s %7s\n", "phase", "queued", "others", "done", "busy", "station", "others",
+         "backlog");
+  bool ok = isolated([] {
+    SimConfig config;
+    bootStation(config, [] {
+      for (uint16_t id = 1; id <= LIBRARY; ++id) simSensor().enrollDirect(id, 1000 + id);
+    });
+    bool alone = phase("alone", 12, 0);
+    bool shared = phase("shared", 30, 2);
+    return alone && shared;
+  });
+  if (!ok) printf("FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+// soak.cpp
+#include <atomic>
+#include <esp_system.h>
+#include "soak.h"
+#include "command_dispatch.h"
+#include "connection.h"
+#include "messaging.h"
+#include "latency.h"
+
+extern uint16_t enrolledCount;  // from fingerprint.cpp
+
+// --- Heap trend ---
+struct HeapSample {
+  uint32_t free;
+  uint32_t largest;
+};
+
+static HeapSample samples[HEAP_SAMPLES];
+static uint16_t sampleCount = 0;  // total taken; the ring holds the last HEAP_SAMPLES
+static uint32_t lastSampleMs = 0;
+static uint32_t lowestFree = 0;
+static int32_t slopePerHour = 0;
+static bool drifting = false;
+
+static const HeapSample& sampleAt(uint16_t i) {  // 0 = oldest in the ring
+  uint16_t n = min<uint16_t>(sampleCount, HEAP_SAMPLES);
+  return samples[(sampleCount - n + i) % HEAP_SAMPLES];
+}
+
+// Least squares over the ring with x doubled and centred (dx = 2i - (n-1)),
+// so everything stays in integers: slope per sample = 2 * sum(dx*dy) / sum(dx^2)
+static int32_t fitSlopePerHour() {
+  uint16_t n = min<uint16_t>(sampleCount, HEAP_SAMPLES);
+  if (n < HEAP_DRIFT_MIN_SAMPLES) return 0;
+  uint64_t sum = 0;
+  for (uint16_t i = 0; i < n; ++i) sum += sampleAt(i).free;
+  int64_t mean = sum / n;
+  int64_t sxy = 0, sxx = 0;
+  for (uint16_t i = 0; i < n; ++i) {
+    int64_t dx = 2 * i - (n - 1);
+    sxy += dx * ((int64_t)sampleAt(i).free - mean);
+    sxx += dx * dx;
+  }
+  return (int32_t)(2 * sxy * (3600000 / HEAP_SAMPLE_MS) / sxx);
+}
+
+static void sampleHeap() {
+  samples[sampleCount % HEAP_SAMPLES] = { ESP.getFreeHeap(), ESP.getMaxAllocHeap() };
+  if (sampleCount < UINT16_MAX) sampleCount++;
+  lowestFree = ESP.getMinFreeHeap();
+  slopePerHour = fitSlopePerHour();
+
+  bool now = slopePerHour < -HEAP_DRIFT_LIMIT_PER_HOUR;
+  if (now && !drifting) {
+    Serial.printf("Heap drift: free heap falling %ld bytes/h over the last %u min\n", (long)slopePerHour,
+                  (unsigned)min<uint16_t>(sampleCount, HEAP_SAMPLES));
+    publishEnrolmentStatusf(STATUS_ERROR, "Heap drift: free heap falling %ld bytes/h over the last %u min",
+                            (long)slopePerHour, (unsigned)min<uint16_t>(sampleCount, HEAP_SAMPLES));
+  }
+  drifting = now;
+}
+
+HeapTrend heapTrend() {
+  HeapTrend t = {};
+  t.samples = min<uint16_t>(sampleCount, HEAP_SAMPLES);
+  if (t.samples == 0) return t;
+  t.firstFree = sampleAt(0).free;
+  t.lastFree = sampleAt(t.samples - 1).free;
+  t.lastLargest = sampleAt(t.samples - 1).largest;
+  t.lowestFree = lowestFree;
+  t.slopePerHour = slopePerHour;
+  t.fragmentedPct = t.lastFree ? 100 - (uint8_t)((uint64_t)t.lastLargest * 100 / t.lastFree) : 0;
+  t.drifting = drifting;
+  return t;
+}
+
+// --- Soak load ---
+enum SoakKind : uint8_t {
+  SOAK_VERIFY,
+  SOAK_COUNT,
+  SOAK_DOWNLOAD,
+  SOAK_ENROLL,
+  SOAK_CANCEL,
+  SOAK_KIND_COUNT
+};
+
+struct SoakMix {
+  const char* action;
+  uint8_t weight;  // percent
+};
+
+// Roughly a polling station's day: mostly verifies, the backend checking
+// counts and pulling templates, the odd enrolment and abandoned scan
+static const SoakMix MIX[SOAK_KIND_COUNT] = {
+  { "verify", 50 },
+  { "enrolled-count", 20 },
+  { "download-template", 20 },
+  { "enroll", 3 },
+  { "cancel", 7 },
+};
+
+#define SOAK_REQUEST_NONE UINT32_MAX
+
+static std::atomic<uint32_t> request{ SOAK_REQUEST_NONE };  // minutes << 16 | per minute
+static std::atomic<bool> active{ false };
+
+// network task
+struct SoakRun {
+  uint32_t startMs;
+  uint32_t durationMs;
+  uint32_t intervalMs;
+  uint32_t nextCommandMs;
+  uint32_t nextDropMs;
+  uint32_t sent[SOAK_KIND_COUNT];
+  uint32_t drops;           // connections dropped by the soak
+  uint32_t skipped;         // commands not sent while the broker was away
+  uint32_t lostAtStart;
+  uint32_t firstFree;
+  bool drifted;             // the trend crossed the limit during the run
+};
+static SoakRun run;
+
+static uint32_t messagesLost() {
+  return messagingOutboxStats().dropped + messagingEventDrops();
+}
+
+void soakRequest(uint16_t minutes, uint16_t perMinute) {
+  request.store((uint32_t)minutes << 16 | perMinute, std::memory_order_release);
+}
+
+bool soakActive() {
+  return active.load(std::memory_order_relaxed);
+}
+
+static void soakStart(uint16_t minutes, uint16_t perMinute) {
+  minutes = min<uint16_t>(minutes, SOAK_MINUTES_MAX);
+  perMinute = min<uint16_t>(perMinute ? perMinute : SOAK_RATE_DEFAULT, SOAK_RATE_MAX);
+  run = {};
+  run.startMs = millis();
+  run.durationMs = (uint32_t)minutes * 60000;
+  run.intervalMs = 60000 / perMinute;
+  run.nextCommandMs = run.startMs;
+  run.nextDropMs = run.startMs + SOAK_RECONNECT_MS;
+  run.lostAtStart = messagesLost();
+  run.firstFree = ESP.getFreeHeap();
+  latencyReset();  // the summary's percentiles cover the soak only
+  active.store(true, std::memory_order_relaxed);
+  Serial.printf("Soak: %u min at %u commands/min, dropping MQTT every %u min\n", (unsigned)minutes,
+                (unsigned)perMinute, (unsigned)(SOAK_RECONNECT_MS / 60000));
+  publishEnrolmentStatusf(STATUS_STARTED, "Soak started: %u min at %u commands/min", (unsigned)minutes,
+                          (unsigned)perMinute);
+}
+
+static uint32_t soakCommands() {
+  uint32_t total = 0;
+  for (uint32_t n : run.sent) total += n;
+  return total;
+}
+
+static void soakFinish(bool stopped) {
+  active.store(false, std::memory_order_relaxed);
+  HeapTrend t = heapTrend();
+  uint32_t lost = messagesLost() - run.lostAtStart;
+  bool pass = !run.drifted && !t.drifting;
+  const char* verdict = !pass ? "FAIL" : t.samples < HEAP_DRIFT_MIN_SAMPLES ? "PASS (trend too short)" : "PASS";
+  uint32_t minutes = (millis() - run.startMs) / 60000;
+
+  Serial.printf("Soak %s after %lu min: %lu commands, %lu skipped offline, %lu reconnects\n",
+                stopped ? "stopped" : "done", (unsigned long)minutes, (unsigned long)soakCommands(),
+                (unsigned long)run.skipped, (unsigned long)run.drops);
+  for (uint8_t k = 0; k < SOAK_KIND_COUNT; ++k) {
+    Serial.printf("  %-18s %lu\n", MIX[k].action, (unsigned long)run.sent[k]);
+  }
+  const LatencyMetric tails[] = { LAT_COMMAND, LAT_PUBLISH, LAT_SEARCH, LAT_TEMPLATE_HASHED };
+  for (LatencyMetric m : tails) {
+    Serial.printf("  %-14s p99 %8lu us  p99.9 %8lu us  max %8lu us  (%lu)\n", latencyName(m),
+                  (unsigned long)latencyPermille(m, 990), (unsigned long)latencyPermille(m, 999),
+                  (unsigned long)latencyHistograms[m].maxUs, (unsigned long)latencyHistograms[m].count);
+  }
+  Serial.printf("  lost %lu messages (outbox evictions and dropped events)\n", (unsigned long)lost);
+  Serial.printf("  heap free %lu -> %lu, lowest %lu, largest block %lu (%u%% fragmented), trend %ld bytes/h: %s\n",
+                (unsigned long)run.firstFree, (unsigned long)ESP.getFreeHeap(), (unsigned long)t.lowestFree,
+                (unsigned long)t.lastLargest, (unsigned)t.fragmentedPct, (long)t.slopePerHour, verdict);
+
+  publishEnrolmentStatusf(pass ? STATUS_SUCCESS : STATUS_ERROR,
+                          "Soak %s: %lu cmds/%lu min, cmd p99.9 %lu us, lost %lu, heap %lu->%lu, %ld B/h, frag %u%%",
+                          pass ? "PASS" : "FAIL", (unsigned long)soakCommands(), (unsigned long)minutes,
+                          (unsigned long)latencyPermille(LAT_COMMAND, 999), (unsigned long)lost,
+                          (unsigned long)run.firstFree, (unsigned long)ESP.getFreeHeap(), (long)t.slopePerHour,
+                          (unsigned)t.fragmentedPct);
+}
+
+static SoakKind pickKind() {
+  uint8_t r = esp_random() % 100;
+  for (uint8_t k = 0; k < SOAK_KIND_COUNT; ++k) {
+    if (r < MIX[k].weight) return (SoakKind)k;
+    r -= MIX[k].weight;
+  }
+  return SOAK_VERIFY;
+}
+
+static void soakSend() {
+  SoakKind kind = pickKind();
+  char payload[64];
+  int len;
+  if (kind == SOAK_DOWNLOAD) {
+    // a quarter past the enrolled count, so some slots are empty
+    uint16_t span = max<uint16_t>(enrolledCount + enrolledCount / 4, 8);
+    len = snprintf(payload, sizeof(payload), "{\"action\":\"%s\",\"userId\":%u}", MIX[kind].action,
+                   (unsigned)(1 + esp_random() % span));
+  } else {
+    len = snprintf(payload, sizeof(payload), "{\"action\":\"%s\"}", MIX[kind].action);
+  }
+  dispatchJsonCommand(payload, len);
+  run.sent[kind]++;
+}
+
+static void soakStep(uint32_t now) {
+  if (now - run.startMs >= run.durationMs) {
+    soakFinish(false);
+    return;
+  }
+  if ((int32_t)(now - run.nextDropMs) >= 0) {
+    run.nextDropMs = now + SOAK_RECONNECT_MS;
+    if (connectionUp()) {
+      connectionDrop();
+      run.drops++;
+    }
+  }
+  if ((int32_t)(now - run.nextCommandMs) < 0) return;
+  run.nextCommandMs += run.intervalMs;
+  if ((int32_t)(now - run.nextCommandMs) > 0) run.nextCommandMs = now;  // fell behind: no burst to catch up
+  if (connectionUp()) soakSend();
+  else run.skipped++;  // the backend could not have sent it either
+}
+
+void soakTick() {
+  uint32_t now = millis();
+  if ((sampleCount > 0 || connectionUp()) && now - lastSampleMs >= HEAP_SAMPLE_MS) {
+    lastSampleMs = now;
+    sampleHeap();
+    if (drifting && soakActive()) run.drifted = true;
+  }
+
+  uint32_t req = request.exchange(SOAK_REQUEST_NONE, std::memory_order_acquire);
+  if (req != SOAK_REQUEST_NONE) {
+    uint16_t minutes = req >> 16;
+    if (soakActive()) soakFinish(true);
+    if (minutes) soakStart(minutes, req & 0xFFFF);
+  }
+  if (soakActive()) soakStep(now);
+}
+
+void soakPrint() {
+  HeapTrend t = heapTrend();
+  if (soakActive()) {
+    Serial.printf("Soak running: %lu of %lu min, %lu commands; 'soak stop' ends it with a summary\n",
+                  (unsigned long)((millis() - run.startMs) / 60000), (unsigned long)(run.durationMs / 60000),
+                  (unsigned long)soakCommands());
+  } else {
+    Serial.printf("No soak running. soak <minutes> [per-minute] (default %u/min, bench stations only)\n",
+                  (unsigned)SOAK_RATE_DEFAULT);
+  }
+  if (t.samples == 0) {
+    Serial.println("Heap trend: no samples yet (starts with the first MQTT connect)");
+    return;
+  }
+  Serial.printf("Heap trend over %u min: free %lu -> %lu, lowest %lu, largest block %lu (%u%% fragmented)\n",
+                (unsigned)t.samples, (unsigned long)t.firstFree, (unsigned long)t.lastFree,
+                (unsigned long)t.lowestFree, (unsigned long)t.lastLargest, (unsigned)t.fragmentedPct);
+  if (t.samples < HEAP_DRIFT_MIN_SAMPLES) {
+    Serial.printf("  slope after %u samples\n", (unsigned)HEAP_DRIFT_MIN_SAMPLES);
+  } else {
+    Serial.printf("  slope %ld bytes/h (limit -%u)%s\n", (long)t.slopePerHour, (unsigned)HEAP_DRIFT_LIMIT_PER_HOUR,
+                  t.drifting ? ": DRIFTING" : "");
+  }
+}
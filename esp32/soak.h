@@ -0,0 +1,51 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <Arduino.h>
+
+// Unattended-run checks, both on the network task.
+//
+// Heap trend (always on): free heap, its low-water mark and the largest
+// allocatable block are sampled once a minute into a ring of the last hour.
+// A least-squares slope over the ring that stays below -HEAP_DRIFT_LIMIT_PER_HOUR
+// is a leak, not churn: it is reported once as an error status and in `mem`.
+// Sampling starts with the first MQTT connect, once the TLS buffers exist.
+//
+// Soak load (on request, bench stations only): `soak <minutes> [per-minute]`
+// feeds a mix of verify, enrolled-count, download-template (random slots, so
+// empty ones exercise the sensor error path), enroll and cancel commands
+// through the MQTT dispatcher, as if the backend had sent them, and drops the
+// broker connection every SOAK_RECONNECT_MS. At the end it publishes a summary
+// with p99/p99.9 command and publish latency, messages lost, the heap trend and
+// fragmentation, and PASS/FAIL on heap drift. Replies go to the real topics.
+#define HEAP_SAMPLE_MS 60000
+#define HEAP_SAMPLES 64
+#define HEAP_DRIFT_MIN_SAMPLES 30        // half an hour before a trend counts
+#define HEAP_DRIFT_LIMIT_PER_HOUR 1024   // bytes of free heap lost per hour
+#define SOAK_RATE_DEFAULT 60             // commands per minute
+#define SOAK_RATE_MAX 600
+#define SOAK_MINUTES_MAX 1440
+#define SOAK_RECONNECT_MS 600000
+
+struct HeapTrend {
+  uint16_t samples;
+  uint32_t firstFree;      // oldest sample in the ring
+  uint32_t lastFree;
+  uint32_t lowestFree;     // ESP.getMinFreeHeap() at the last sample
+  uint32_t lastLargest;
+  int32_t slopePerHour;    // bytes of free heap per hour; 0 below HEAP_DRIFT_MIN_SAMPLES
+  uint8_t fragmentedPct;   // 100 - largest block / free heap, last sample
+  bool drifting;
+};
+
+// Network task, every step
+void soakTick();
+
+// Any task; picked up by the next soakTick(). minutes = 0 stops a running soak.
+void soakRequest(uint16_t minutes, uint16_t perMinute);
+bool soakActive();
+HeapTrend heapTrend();  // approximate from the sensor task
+// Serial CLI `soak` without arguments
+void soakPrint();
+
+#endif
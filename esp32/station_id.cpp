@@ -0,0 +1,70 @@
+// station_id.cpp
+#include <Preferences.h>
+#include <esp_system.h>
+#include <ctype.h>
+#include "station_id.h"
+
+// Longest topic: "esp32/" + ID + "/fingerprint/templates"
+#define STATION_TOPIC_MAX (6 + STATION_ID_MAX + 22)
+
+static const char* const TOPIC_SUFFIXES[STATION_TOPIC_COUNT] = {
+  "fingerprint/command", "fingerprint/status", "fingerprint/count", "fingerprint/result",
+  "fingerprint/templates", "fingerprint/sync", "fingerprint/backup", "health",
+};
+
+static char id[STATION_ID_MAX];
+static char clientId[12 + STATION_ID_MAX];
+static char topics[STATION_TOPIC_COUNT][STATION_TOPIC_MAX];
+
+static bool validId(const char* s) {
+  size_t n = strlen(s);
+  if (n == 0 || n >= STATION_ID_MAX) return false;
+  for (; *s; ++s) {
+    if (!isalnum((unsigned char)*s) && *s != '-' && *s != '_') return false;
+  }
+  return true;
+}
+
+void stationIdBegin() {
+  id[0] = '\0';
+  Preferences prefs;
+  if (prefs.begin(STATION_NVS_NAMESPACE, true)) {
+    prefs.getString("id", id, sizeof(id));
+    prefs.end();
+  }
+  const char* source = "nvs";
+  if (!validId(id)) {
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(id, sizeof(id), "fp-%02x%02x%02x", mac[3], mac[4], mac[5]);
+    source = "mac";
+  }
+  snprintf(clientId, sizeof(clientId), "fingerprint-%s", id);
+  for (uint8_t t = 0; t < STATION_TOPIC_COUNT; ++t) {
+    snprintf(topics[t], sizeof(topics[t]), "esp32/%s/%s", id, TOPIC_SUFFIXES[t]);
+  }
+  Serial.printf("Station ID: %s (%s), client ID %s\n", id, source, clientId);
+}
+
+const char* stationId() {
+  return id;
+}
+
+const char* stationClientId() {
+  return clientId;
+}
+
+const char* stationTopic(StationTopic topic) {
+  return topics[topic];
+}
+
+bool stationSetId(const char* newId) {
+  if (*newId && !validId(newId)) return false;
+  Preferences prefs;
+  if (!prefs.begin(STATION_NVS_NAMESPACE, false)) return false;
+  bool ok = true;
+  if (*newId) ok = prefs.putString("id", newId) > 0;
+  else prefs.remove("id");
+  prefs.end();
+  return ok;
+}
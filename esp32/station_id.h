@@ -0,0 +1,51 @@
+#ifndef STATION_ID_H
+#define STATION_ID_H
+
+#include <Arduino.h>
+
+// Station identity for running several stations on one broker. The ID comes
+// from NVS ("station"/"id", set with the `station <id>` CLI command) or else
+// from the last three bytes of the Wi-Fi MAC ("fp-a1b2c3"). It is part of the
+// MQTT client ID, so stations no longer take over each other's session, and of
+// every topic:
+//   esp32/<station>/fingerprint/{command,status,count,result,templates,sync,backup}
+//   esp32/<station>/health
+// Besides its own command topic a station listens on
+//   esp32/fingerprint/command   every station (fleet-wide broadcast)
+//   esp32/fingerprint/work      through the shared subscription
+//                               $share/stations/esp32/fingerprint/work, so the
+//                               broker hands each message to one station, in
+//                               turn. A station that already holds
+//                               STATION_WORK_BACKLOG requests answers busy
+//                               (with the rid) and the backend queues the work
+//                               again. Stations stay subscribed throughout:
+//                               with none subscribed the broker drops work.
+#define STATION_ID_MAX 24  // including the terminator
+#define STATION_NVS_NAMESPACE "station"
+#define STATION_BROADCAST_TOPIC "esp32/fingerprint/command"
+#define STATION_WORK_TOPIC "esp32/fingerprint/work"
+#define STATION_WORK_SHARE "$share/stations/" STATION_WORK_TOPIC
+#define STATION_WORK_BACKLOG 2  // running + waiting requests at which a station answers work busy
+
+enum StationTopic : uint8_t {
+  TOPIC_FP_COMMAND,
+  TOPIC_FP_STATUS,
+  TOPIC_FP_COUNT,
+  TOPIC_FP_RESULT,
+  TOPIC_FP_TEMPLATES,
+  TOPIC_FP_SYNC,
+  TOPIC_FP_BACKUP,
+  TOPIC_HEALTH,
+  STATION_TOPIC_COUNT
+};
+
+// setup(), before the network task starts: load or derive the ID, build the topics
+void stationIdBegin();
+const char* stationId();
+const char* stationClientId();  // "fingerprint-<station>"
+const char* stationTopic(StationTopic topic);
+// Save a new ID to NVS; it takes effect after a restart. Letters, digits, '-'
+// and '_' only. An empty id goes back to the MAC-derived one.
+bool stationSetId(const char* id);
+
+#endif
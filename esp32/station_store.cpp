@@ -0,0 +1,336 @@
+// station_store.cpp
+#include <LittleFS.h>
+#include <Preferences.h>
+#include "station_store.h"
+
+#define STORE_SNAPSHOT "/state.bin"
+#define STORE_SNAPSHOT_TMP "/state.tmp"
+#define STORE_JOURNAL "/journal.bin"
+#define STORE_JOURNAL_TMP "/journal.tmp"
+#define STORE_LEGACY_HASHES "/hashidx.bin"  // hash_index.cpp before the journal
+#define STORE_SNAPSHOT_MAGIC 0x53545331UL    // "STS1"
+
+// Journal record: u8 type, u16 key, payload, u32 CRC-32 of everything before it
+enum StoreRecordType : uint8_t {
+  REC_COUNT = 1,   // key = enrolledCount
+  REC_LINK = 2,    // payload: u32 baud, u16 packet length
+  REC_SLOT = 3,    // key = slot id, payload: 32-byte leaf
+  REC_COMMIT = 4   // key = low 16 bits of the batch number
+};
+
+static StationState state;
+static StoreStats stats;
+static bool mounted = false;
+
+// pending (uncommitted) changes
+static bool countDirty = false;
+static bool linkDirty = false;
+static uint8_t slotDirty[FP_INDEX_MAX_SLOTS / 8];
+static uint16_t dirtySlots = 0;
+static uint32_t firstChangeMs = 0;
+static uint8_t commitFailures = 0;  // in a row; sets the retry backoff
+static uint32_t lastFailureMs = 0;
+
+static uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static size_t payloadSize(uint8_t type) {
+  switch (type) {
+    case REC_LINK: return 6;
+    case REC_SLOT: return STORE_SLOT_BYTES;
+    default: return 0;
+  }
+}
+
+static void noteChange() {
+  if (!countDirty && !linkDirty && dirtySlots == 0) firstChangeMs = millis();
+}
+
+// --- Setters (RAM only) ---
+
+const StationState& storeState() {
+  return state;
+}
+
+void storeSetCount(uint16_t count) {
+  if (count == state.enrolledCount) return;
+  noteChange();
+  state.enrolledCount = count;
+  countDirty = true;
+}
+
+void storeSetLink(uint32_t baud, uint16_t packetLen) {
+  if (baud == state.linkBaud && packetLen == state.linkPacketLen) return;
+  noteChange();
+  state.linkBaud = baud;
+  state.linkPacketLen = packetLen;
+  linkDirty = true;
+}
+
+void storeSetSlot(uint16_t id, const uint8_t value[STORE_SLOT_BYTES]) {
+  if (id >= FP_INDEX_MAX_SLOTS || memcmp(state.slots[id], value, STORE_SLOT_BYTES) == 0) return;
+  noteChange();
+  memcpy(state.slots[id], value, STORE_SLOT_BYTES);
+  if (!(slotDirty[id >> 3] & (1 << (id & 7)))) {
+    slotDirty[id >> 3] |= 1 << (id & 7);
+    dirtySlots++;
+  }
+}
+
+// --- Snapshot ---
+
+static bool writeSnapshot() {
+  File f = LittleFS.open(STORE_SNAPSHOT_TMP, "w");
+  if (!f) return false;
+  uint32_t magic = STORE_SNAPSHOT_MAGIC;
+  uint32_t crc = crc32((const uint8_t*)&state, sizeof(state));
+  bool ok = f.write((const uint8_t*)&magic, sizeof(magic)) == sizeof(magic) &&
+            f.write((const uint8_t*)&state, sizeof(state)) == sizeof(state) &&
+            f.write((const uint8_t*)&crc, sizeof(crc)) == sizeof(crc);
+  f.close();
+  // rename is atomic on LittleFS: either the old or the new snapshot survives
+  return ok && LittleFS.rename(STORE_SNAPSHOT_TMP, STORE_SNAPSHOT);
+}
+
+static bool readSnapshot() {
+  File f = LittleFS.open(STORE_SNAPSHOT, "r");
+  if (!f) return false;
+  uint32_t magic = 0, crc = 0;
+  bool ok = f.read((uint8_t*)&magic, sizeof(magic)) == sizeof(magic) && magic == STORE_SNAPSHOT_MAGIC &&
+            f.read((uint8_t*)&state, sizeof(state)) == sizeof(state) &&
+            f.read((uint8_t*)&crc, sizeof(crc)) == sizeof(crc) && crc == crc32((const uint8_t*)&state, sizeof(state));
+  f.close();
+  if (!ok) memset(&state, 0, sizeof(state));
+  return ok;
+}
+
+// Everything in RAM goes into a fresh snapshot; the journal is then redundant.
+static bool compact() {
+  uint32_t startUs = micros();
+  if (!writeSnapshot()) {
+    Serial.println("Store: snapshot write failed");
+    return false;
+  }
+  File j = LittleFS.open(STORE_JOURNAL, "w");  // truncate
+  j.close();
+  stats.journalBytes = 0;
+  stats.compactions++;
+  Serial.printf("Store: compacted in %lu us\n", (unsigned long)(micros() - startUs));
+  return true;
+}
+
+// --- Journal ---
+
+static bool writeRecord(File& f, uint8_t type, uint16_t key, const uint8_t* payload) {
+  uint8_t rec[3 + STORE_SLOT_BYTES + 4];
+  size_t n = payloadSize(type);
+  rec[0] = type;
+  rec[1] = key & 0xFF;
+  rec[2] = key >> 8;
+  if (n) memcpy(rec + 3, payload, n);
+  uint32_t crc = crc32(rec, 3 + n);
+  memcpy(rec + 3 + n, &crc, sizeof(crc));
+  size_t len = 3 + n + sizeof(crc);
+  if (f.write(rec, len) != len) return false;
+  stats.records++;
+  stats.journalBytes += len;
+  return true;
+}
+
+static bool pendingChanges() {
+  return countDirty || linkDirty || dirtySlots > 0;
+}
+
+// Cut the journal back to its first len bytes (the last commit record), so the
+// next batch is not appended behind a torn one that replay would stop at.
+// LittleFS files cannot be shortened in place: the committed part is copied to
+// a temp file that replaces the journal (atomic rename, like the snapshot).
+static bool truncateJournal(size_t len) {
+  File src = LittleFS.open(STORE_JOURNAL, "r");
+  if (!src) return false;
+  if (src.size() == len) {
+    src.close();
+    return true;
+  }
+  File dst = LittleFS.open(STORE_JOURNAL_TMP, "w");
+  bool ok = dst;
+  uint8_t buf[256];
+  for (size_t done = 0; ok && done < len;) {
+    size_t n = min(sizeof(buf), len - done);
+    ok = src.read(buf, n) == n && dst.write(buf, n) == n;
+    done += n;
+  }
+  src.close();
+  if (dst) dst.close();
+  return ok && LittleFS.rename(STORE_JOURNAL_TMP, STORE_JOURNAL);
+}
+
+static uint32_t commitBackoffMs() {
+  uint32_t ms = STORE_RETRY_MIN_MS;
+  for (uint8_t i = 1; i < commitFailures && ms < STORE_RETRY_MAX_MS; ++i) ms *= 2;
+  return min(ms, (uint32_t)STORE_RETRY_MAX_MS);
+}
+
+static void commitFailed(size_t committedBytes) {
+  stats.failedCommits++;
+  lastFailureMs = millis();
+  if (commitFailures < 16) commitFailures++;
+  stats.journalBytes = committedBytes;
+  if (truncateJournal(committedBytes)) return;
+  // the torn tail stays; compaction replaces the journal as a whole
+  Serial.println("Store: could not cut off the failed batch, compacting");
+  compact();
+}
+
+bool storeCommit() {
+  if (!pendingChanges()) return true;
+  if (!mounted) return false;
+  uint32_t startUs = micros();
+  size_t committedBytes = stats.journalBytes;
+  File f = LittleFS.open(STORE_JOURNAL, "a");
+  if (!f) {
+    commitFailed(committedBytes);
+    return false;
+  }
+
+  bool ok = true;
+  if (countDirty) ok = writeRecord(f, REC_COUNT, state.enrolledCount, nullptr);
+  if (ok && linkDirty) {
+    uint8_t link[6];
+    memcpy(link, &state.linkBaud, 4);
+    memcpy(link + 4, &state.linkPacketLen, 2);
+    ok = writeRecord(f, REC_LINK, 0, link);
+  }
+  for (uint16_t id = 0; ok && dirtySlots && id < FP_INDEX_MAX_SLOTS; ++id) {
+    if (slotDirty[id >> 3] & (1 << (id & 7))) ok = writeRecord(f, REC_SLOT, id, state.slots[id]);
+  }
+  ok = ok && writeRecord(f, REC_COMMIT, (uint16_t)(stats.batches + 1), nullptr);
+  f.close();
+  if (!ok) {
+    // the partial batch has no commit record; cut it off before the retry
+    commitFailed(committedBytes);
+    Serial.printf("Store: journal write failed, retry in %lu ms\n", (unsigned long)commitBackoffMs());
+    return false;
+  }
+
+  countDirty = linkDirty = false;
+  memset(slotDirty, 0, sizeof(slotDirty));
+  dirtySlots = 0;
+  commitFailures = 0;
+  stats.batches++;
+  stats.lastCommitUs = micros() - startUs;
+  return true;
+}
+
+void storeTick(bool idle) {
+  bool due = dirtySlots >= STORE_COMMIT_SLOTS || millis() - firstChangeMs >= STORE_COMMIT_DELAY_MS;
+  bool backingOff = commitFailures > 0 && millis() - lastFailureMs < commitBackoffMs();
+  if (pendingChanges() && due && !backingOff) storeCommit();
+  if (idle && mounted && !pendingChanges() && stats.journalBytes >= STORE_COMPACT_BYTES) compact();
+}
+
+// Apply records up to the last commit record; returns the bytes consumed.
+// Records of a batch are staged by re-reading: first find where the last
+// complete batch ends, then apply everything before it.
+static size_t replayJournal() {
+  File f = LittleFS.open(STORE_JOURNAL, "r");
+  if (!f) return 0;
+  size_t total = f.size();
+  size_t pos = 0, committed = 0;
+  uint8_t rec[3 + STORE_SLOT_BYTES + 4];
+
+  for (int pass = 0; pass < 2; ++pass) {
+    f.seek(0);
+    pos = 0;
+    while (pos + 3 + 4 <= total) {
+      if (pass == 1 && pos >= committed) break;
+      if (f.read(rec, 3) != 3) break;
+      size_t n = payloadSize(rec[0]);
+      if (rec[0] < REC_COUNT || rec[0] > REC_COMMIT || pos + 3 + n + 4 > total) break;
+      if (f.read(rec + 3, n + 4) != n + 4) break;
+      uint32_t crc;
+      memcpy(&crc, rec + 3 + n, sizeof(crc));
+      if (crc != crc32(rec, 3 + n)) break;
+      pos += 3 + n + 4;
+      uint16_t key = rec[1] | (rec[2] << 8);
+
+      if (pass == 0) {
+        if (rec[0] == REC_COMMIT) committed = pos;
+        continue;
+      }
+      switch (rec[0]) {
+        case REC_COUNT: state.enrolledCount = key; break;
+        case REC_LINK:
+          memcpy(&state.linkBaud, rec + 3, 4);
+          memcpy(&state.linkPacketLen, rec + 7, 2);
+          break;
+        case REC_SLOT:
+          if (key < FP_INDEX_MAX_SLOTS) memcpy(state.slots[key], rec + 3, STORE_SLOT_BYTES);
+          break;
+        default: break;
+      }
+      stats.replayed++;
+    }
+  }
+  f.close();
+  stats.tornBytes = total - committed;
+  return committed;
+}
+
+// First boot after the journal was introduced: pick up the old locations
+static void importLegacy() {
+  Preferences prefs;
+  if (prefs.begin("fingerprint", true)) {
+    state.enrolledCount = prefs.getUInt("enrolledCount", 0);
+    prefs.end();
+  }
+  if (prefs.begin("sensorlink", true)) {
+    state.linkBaud = prefs.getUInt("baud", 0);
+    state.linkPacketLen = prefs.getUShort("pkt", 0);
+    prefs.end();
+  }
+  if (LittleFS.exists(STORE_LEGACY_HASHES)) {
+    File f = LittleFS.open(STORE_LEGACY_HASHES, "r");
+    if (!f || f.read((uint8_t*)state.slots, sizeof(state.slots)) != sizeof(state.slots)) {
+      memset(state.slots, 0, sizeof(state.slots));
+    }
+    f.close();
+  }
+  Serial.printf("Store: imported legacy state (enrolledCount %u, link %lu baud)\n", (unsigned)state.enrolledCount,
+                (unsigned long)state.linkBaud);
+}
+
+bool storeBegin() {
+  uint32_t startMs = millis();
+  mounted = LittleFS.begin(true);  // format on first use
+  if (!mounted) {
+    Serial.println("Store: LittleFS unavailable, state kept in RAM only");
+    return false;
+  }
+
+  bool haveSnapshot = readSnapshot();
+  bool haveJournal = LittleFS.exists(STORE_JOURNAL);
+  if (!haveSnapshot && !haveJournal) importLegacy();
+  size_t committed = replayJournal();
+  stats.journalBytes = committed;
+
+  // a fresh, import or torn tail: start over from a clean snapshot
+  if (!haveSnapshot || stats.tornBytes > 0) {
+    compact();
+    if (LittleFS.exists(STORE_LEGACY_HASHES)) LittleFS.remove(STORE_LEGACY_HASHES);
+  }
+  Serial.printf("Store: %s, %lu record(s) replayed, %lu torn byte(s) dropped, %lu ms\n",
+                haveSnapshot ? "snapshot loaded" : "new snapshot", (unsigned long)stats.replayed,
+                (unsigned long)stats.tornBytes, (unsigned long)(millis() - startMs));
+  return true;
+}
+
+const StoreStats& storeStats() {
+  return stats;
+}
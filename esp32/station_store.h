@@ -0,0 +1,61 @@
+#ifndef STATION_STORE_H
+#define STATION_STORE_H
+
+#include <Arduino.h>
+#include "fingerprint_index.h"
+
+// Persistent station state: enrolled count, negotiated sensor link and the
+// per-slot hash leaves (which also record occupancy, see hash_index.h).
+//
+// Setters only change RAM and mark what changed. storeTick() later writes all
+// changes as one batch to an append-only journal on LittleFS, closed by a
+// commit record; recovery replays complete batches only, so a power cut
+// loses at most the uncommitted batch and never leaves a half-applied one.
+// When the journal grows past STORE_COMPACT_BYTES the whole state is written
+// to a new snapshot (atomic rename) and the journal starts over.
+//
+// Sensor task only. storeBegin() runs on the boot store task, which hands the
+// store over when it is done (boot.h).
+#define STORE_SLOT_BYTES 32
+#define STORE_COMMIT_DELAY_MS 2000   // batch window after the first change
+#define STORE_COMMIT_SLOTS 64        // commit early once this many slots changed
+#define STORE_COMPACT_BYTES 16384
+#define STORE_RETRY_MIN_MS 1000      // backoff after a failed commit, doubled per failure
+#define STORE_RETRY_MAX_MS 60000
+
+struct StationState {
+  uint16_t enrolledCount;
+  uint32_t linkBaud;       // 0 = not negotiated yet
+  uint16_t linkPacketLen;
+  uint8_t slots[FP_INDEX_MAX_SLOTS][STORE_SLOT_BYTES];
+};
+
+struct StoreStats {
+  uint32_t batches;        // journal commits
+  uint32_t records;        // records written
+  uint32_t compactions;
+  uint32_t failedCommits;  // journal writes that failed and were cut off again
+  uint32_t replayed;       // records applied at boot
+  uint32_t tornBytes;      // incomplete tail dropped at boot
+  uint32_t journalBytes;
+  uint32_t lastCommitUs;
+};
+
+// Mount, load the snapshot and replay the journal. Imports the pre-journal
+// Preferences keys and hash file on first run.
+bool storeBegin();
+const StationState& storeState();
+
+void storeSetCount(uint16_t count);
+void storeSetLink(uint32_t baud, uint16_t packetLen);
+void storeSetSlot(uint16_t id, const uint8_t value[STORE_SLOT_BYTES]);
+
+// Commit when the batch window has passed (after a failed commit, once the
+// backoff has passed as well); compact only when idle is true
+void storeTick(bool idle);
+// Commit now (e.g. before a deliberate restart)
+bool storeCommit();
+
+const StoreStats& storeStats();
+
+#endif
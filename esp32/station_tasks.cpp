@@ -0,0 +1,352 @@
+// station_tasks.cpp
+#include "station_tasks.h"
+#include <atomic>
+#include "spsc_queue.h"
+#include "messaging.h"
+#include "fingerprint.h"
+#include "connection.h"
+#include "station_store.h"
+#include "enroll_session.h"
+#include "boot.h"
+#include "soak.h"
+
+#define SENSOR_TASK_CORE 1
+#define NETWORK_TASK_CORE 0  // same core as the Wi-Fi / lwIP tasks
+#define SENSOR_TASK_STACK 8192
+#define NETWORK_TASK_STACK 8192  // TLS handshake needs the same depth as loopTask
+#define SENSOR_IDLE_WAIT_MS 20
+#define NETWORK_IDLE_WAIT_MS 10
+#define SENSOR_BUSY_WAIT_MS 1  // a flow is waiting for a finger: poll again soon
+#define PENDING_COMMANDS 8
+#define PENDING_RESERVED 2  // only verify/enroll may fill the last slots
+#define HEARTBEAT_INTERVAL_MS 30000
+
+static TaskHandle_t sensorTaskHandle = nullptr;
+static TaskHandle_t networkTaskHandle = nullptr;
+static SpscQueue<SensorCommand, 8> commandQueue;
+static uint32_t commandsSubmitted = 0;            // network task
+static std::atomic<uint32_t> commandsTaken{ 0 };  // sensor task, updated at the end of a step
+static std::atomic<uint8_t> sensorLoad{ 0 };  // running + pending, as of that step
+
+// An MQTT cancel does not wait in commandQueue, which may be full of the very
+// requests it is meant to stop: the network task leaves it here and the sensor
+// task takes it every step. cancelTag is only written while cancelState is
+// CANCEL_NONE and only cleared after it has been read.
+#define CANCEL_NONE 0
+#define CANCEL_POSTED 0x01
+#define CANCEL_ALL 0x02
+static std::atomic<uint8_t> cancelState{ CANCEL_NONE };
+static RequestTag cancelTag = {};
+
+// Sensor-task-local requests waiting for the sensor, in arrival order; the
+// highest priority is taken first, FIFO within one priority
+static SensorCommand pending[PENDING_COMMANDS];
+static size_t pendingCount = 0;
+
+// The long-running command that holds the sensor between other requests
+static BulkJob bulkJob = {};
+static bool bulkPaused = false;
+
+// Requests behind the work that outlives executeSensorCommand(), so its later
+// replies still carry their rid
+static RequestTag flowTag = {};
+static RequestTag sessionTag = {};
+static RequestTag bulkTag = {};
+
+// Runs work for the request behind tag; a flow, enroll session or bulk job it
+// starts is charged to the same request from then on
+template <typename Work>
+static void runTagged(const RequestTag& tag, Work work) {
+  bool flow = fingerprintFlowActive();
+  bool session = enrollSessionActive();
+  bool bulk = bulkJob.step != nullptr;
+  RequestTag owner = tag;  // tag may be one of the above
+  RequestScope scope(owner);
+  work();
+  if (!flow && fingerprintFlowActive()) flowTag = owner;
+  if (!session && enrollSessionActive()) sessionTag = owner;
+  if (!bulk && bulkJob.step) bulkTag = owner;
+}
+
+bool onNetworkTask() {
+  return networkTaskHandle == nullptr || xTaskGetCurrentTaskHandle() == networkTaskHandle;
+}
+
+uint32_t sensorTaskStackFree() {
+  return sensorTaskHandle ? uxTaskGetStackHighWaterMark(sensorTaskHandle) : 0;
+}
+
+uint32_t networkTaskStackFree() {
+  return networkTaskHandle ? uxTaskGetStackHighWaterMark(networkTaskHandle) : 0;
+}
+
+void notifyNetworkTask() {
+  if (networkTaskHandle) xTaskNotifyGive(networkTaskHandle);
+}
+
+bool submitSensorCommand(const SensorCommand& cmd) {
+  if (!commandQueue.push(cmd)) return false;
+  commandsSubmitted++;
+  if (sensorTaskHandle) xTaskNotifyGive(sensorTaskHandle);
+  return true;
+}
+
+void submitSensorCancel(bool all, const RequestTag& request) {
+  uint8_t bits = CANCEL_POSTED | (all ? CANCEL_ALL : 0);
+  uint8_t state = cancelState.load(std::memory_order_acquire);
+  for (;;) {
+    if (state == CANCEL_NONE) {
+      cancelTag = request;
+      cancelState.store(bits, std::memory_order_release);
+      break;
+    }
+    // the last one is not taken yet: this one rides along and is answered here
+    if (cancelState.compare_exchange_weak(state, state | bits, std::memory_order_acq_rel)) {
+      publishEnrolmentStatus(STATUS_SUCCESS, "Joined the cancel in progress");
+      break;
+    }
+  }
+  if (sensorTaskHandle) xTaskNotifyGive(sensorTaskHandle);
+}
+
+// Sensor task: runs the cancel submitSensorCancel() left, if there is one
+static void takeSensorCancel() {
+  uint8_t state = cancelState.load(std::memory_order_acquire);
+  while (state != CANCEL_NONE) {
+    RequestTag tag = cancelTag;
+    if (cancelState.compare_exchange_weak(state, CANCEL_NONE, std::memory_order_acq_rel)) {
+      tag.startedMs = millis();
+      RequestScope scope(tag);
+      cancelSensorWork(state & CANCEL_ALL);
+      return;
+    }
+  }
+}
+
+CommandPriority commandPriority(SensorCommandType type) {
+  switch (type) {
+    case CMD_VERIFY: return PRIO_VERIFY;
+    case CMD_ENROLL:
+    case CMD_ENROLL_SESSION: return PRIO_ENROLL;
+    case CMD_DOWNLOAD_ALL:
+    case CMD_PROBE:
+    case CMD_BACKUP:
+    case CMD_RESTORE: return PRIO_BULK;
+    default: return PRIO_ADMIN;
+  }
+}
+
+bool queueSensorCommand(const SensorCommand& cmd) {
+  // admission control: the last PENDING_RESERVED slots are kept for voters
+  size_t limit = commandPriority(cmd.type) <= PRIO_ENROLL ? PENDING_COMMANDS : PENDING_COMMANDS - PENDING_RESERVED;
+  if (pendingCount >= limit) return false;
+  pending[pendingCount++] = cmd;
+  if (fingerprintFlowActive() || bulkJob.step) {
+    Serial.printf("Request queued behind the active %s (%u pending)\n", bulkJob.step ? bulkJob.name : "flow",
+                  (unsigned)pendingCount);
+  }
+  return true;
+}
+
+bool acceptSensorCommand(const SensorCommand& cmd) {
+  if (cmd.type == CMD_CANCEL) {
+    cancelSensorWork(cmd.all);
+  } else if (cmd.type == CMD_END_SESSION) {
+    enrollSessionStop();
+  } else if (stationMode() == MODE_DEGRADED) {
+    publishEnrolmentStatus(STATUS_ERROR, "Fingerprint sensor unavailable (degraded mode)");
+  } else {
+    return queueSensorCommand(cmd);
+  }
+  return true;
+}
+
+// Priority of the best waiting request, PRIO_NONE if there is none
+static CommandPriority topPendingPriority() {
+  CommandPriority top = PRIO_NONE;
+  for (size_t i = 0; i < pendingCount; ++i) {
+    CommandPriority p = commandPriority(pending[i].type);
+    if (p < top) top = p;
+  }
+  return top;
+}
+
+static bool popPendingCommand(SensorCommand& cmd) {
+  if (pendingCount == 0) return false;
+  size_t best = 0;
+  for (size_t i = 1; i < pendingCount; ++i) {
+    if (commandPriority(pending[i].type) < commandPriority(pending[best].type)) best = i;
+  }
+  cmd = pending[best];
+  for (size_t i = best + 1; i < pendingCount; ++i) pending[i - 1] = pending[i];
+  pendingCount--;
+  return true;
+}
+
+size_t pendingCommandCount() {
+  return pendingCount;
+}
+
+void startBulkJob(const BulkJob& job) {
+  bulkJob = job;
+  bulkPaused = false;
+}
+
+bool bulkJobActive() {
+  return bulkJob.step != nullptr;
+}
+
+static void stopBulkJob() {
+  RequestScope scope(bulkTag);
+  if (bulkJob.abort) bulkJob.abort();
+  bulkJob = {};
+}
+
+// The cancelled work answers under its own request; the outcome of the cancel
+// itself goes to the cancel's
+void cancelSensorWork(bool all) {
+  bool cancelled;
+  {
+    RequestScope scope(flowTag);
+    cancelled = cancelFingerprintFlow();
+  }
+  size_t dropped = 0;
+  // a bulk job goes with "cancel all", or with "cancel" when nothing else was running
+  if (bulkJob.step && (all || !cancelled)) {
+    stopBulkJob();
+    cancelled = true;
+  }
+  if (all) {
+    dropped = pendingCount;
+    for (size_t i = 0; i < pendingCount; ++i) {
+      if (!pending[i].request.rid) continue;  // nobody is waiting for this one by ID
+      RequestScope scope(pending[i].request);
+      publishEnrolmentStatus(STATUS_CANCELLED, "Cancelled before it started");
+    }
+    pendingCount = 0;
+    if (enrollSessionActive()) {
+      RequestScope scope(sessionTag);
+      enrollSessionStop();
+      cancelled = true;
+    }
+  }
+  if (!cancelled && dropped == 0) {
+    publishEnrolmentStatus(STATUS_ERROR, "Nothing to cancel");
+  } else if (dropped > 0) {
+    publishEnrolmentStatusf(STATUS_CANCELLED, "Dropped %u pending request(s)", (unsigned)dropped);
+  } else {
+    publishEnrolmentStatus(STATUS_SUCCESS, "Cancelled");  // the work itself answered under its own rid
+  }
+}
+
+static void startSensorCommand(SensorCommand& cmd) {
+  cmd.request.startedMs = millis();
+  runTagged(cmd.request, [&cmd] { executeSensorCommand(cmd); });
+}
+
+void sensorTaskStep() {
+  // Staged boot: sensor bring-up (retried while degraded) until the station is ready
+  bool ready = bootSensorStep();
+
+  // Serial admin CLI (line-based, single-key shortcuts included); once the store is in
+  if (bootStoreReady()) handleSerialCommands();
+
+  SensorCommand cmd;
+  uint32_t taken = commandsTaken.load(std::memory_order_relaxed);
+  while (commandQueue.pop(cmd)) {
+    taken++;
+    RequestTag tag = cmd.request;
+    tag.startedMs = millis();  // replies from here on have waited this long
+    RequestScope scope(tag);
+    if (!acceptSensorCommand(cmd)) {
+      publishEnrolmentStatusf(STATUS_BUSY, "Station busy: %u requests pending, retry later", (unsigned)pendingCount);
+    }
+  }
+  // after the queue, so "cancel all" also drops what was submitted before it
+  takeSensorCancel();
+
+  if (!ready) {
+    // requests wait for the sensor; without one, leave the shared work queue to others
+    sensorLoad.store(stationMode() == MODE_DEGRADED ? UINT8_MAX : pendingCount + 1, std::memory_order_relaxed);
+    commandsTaken.store(taken, std::memory_order_release);
+    return;
+  }
+
+  // Advance the running enroll/verify flow by one step
+  runTagged(flowTag, fingerprintTick);
+
+  // Registration drive: next voter, or a deferred template download. A
+  // waiting verify gets the sensor between voters.
+  CommandPriority top = topPendingPriority();
+  runTagged(sessionTag, [top] { enrollSessionTick(top < PRIO_ENROLL); });
+
+  // Start the next request once the sensor is free. A bulk job only runs
+  // while nothing that outranks it is waiting, and resumes afterwards.
+  bool sensorFree = !fingerprintFlowActive() && (!enrollSessionActive() || top < PRIO_ENROLL);
+  if (sensorFree) {
+    if (bulkJob.step && top < PRIO_BULK) {
+      if (!bulkPaused && bulkJob.pause) runTagged(bulkTag, bulkJob.pause);
+      bulkPaused = true;
+      if (popPendingCommand(cmd)) startSensorCommand(cmd);
+    } else if (bulkJob.step) {
+      bulkPaused = false;
+      runTagged(bulkTag, [] {
+        if (!bulkJob.step()) bulkJob = {};
+      });
+    } else if (popPendingCommand(cmd)) {
+      startSensorCommand(cmd);
+    }
+  }
+
+  // Write-behind persistence: batch commits, compaction only while idle
+  bool idle = !fingerprintFlowActive() && !enrollSessionActive() && !bulkJob.step && pendingCount == 0;
+  storeTick(idle);
+
+  // load first, then the count: a reader that sees the new count sees at
+  // least the load that goes with it
+  sensorLoad.store(pendingCount + (idle ? 0 : 1), std::memory_order_relaxed);
+  commandsTaken.store(taken, std::memory_order_release);
+}
+
+uint32_t sensorBacklog() {
+  uint32_t queued = commandsSubmitted - commandsTaken.load(std::memory_order_acquire);
+  return queued + sensorLoad.load(std::memory_order_relaxed);
+}
+
+void networkTaskStep() {
+  // Maintain Wi-Fi/MQTT; returns straight away while backing off
+  connectionTick();
+  bootNetworkTick();
+  soakTick();
+
+  // Publish whatever the sensor task produced
+  messagingDrainEvents();
+
+  static uint32_t lastHeartbeatMs = 0;
+  if (connectionUp() && millis() - lastHeartbeatMs >= HEARTBEAT_INTERVAL_MS) {
+    lastHeartbeatMs = millis();
+    sendHeartbeat();
+  }
+}
+
+static void sensorTask(void*) {
+  for (;;) {
+    sensorTaskStep();
+    bool busy = fingerprintFlowActive() || enrollSessionActive() || bulkJobActive() ||
+                (pendingCommandCount() > 0 && stationMode() == MODE_READY);
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(busy ? SENSOR_BUSY_WAIT_MS : SENSOR_IDLE_WAIT_MS));
+  }
+}
+
+static void networkTask(void*) {
+  for (;;) {
+    networkTaskStep();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NETWORK_IDLE_WAIT_MS));
+  }
+}
+
+void startStationTasks() {
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, nullptr, 1, &networkTaskHandle, NETWORK_TASK_CORE);
+  xTaskCreatePinnedToCore(sensorTask, "sensor", SENSOR_TASK_STACK, nullptr, 1, &sensorTaskHandle, SENSOR_TASK_CORE);
+  Serial.println("Sensor and network tasks started.");
+}
@@ -0,0 +1,112 @@
+#ifndef STATION_TASKS_H
+#define STATION_TASKS_H
+
+#include <Arduino.h>
+#include "request_tag.h"
+
+// The station runs two FreeRTOS tasks:
+//  - sensor task (APP core): owns `finger`/`mySerial`, serial CLI, enroll/verify/download
+//  - network task (PRO core, next to the Wi-Fi stack): owns `client`, MQTT/TLS
+// Commands flow network -> sensor and publish events flow sensor -> network,
+// each through a lock-free SPSC queue, so neither side blocks the other.
+
+enum SensorCommandType : uint8_t {
+  CMD_VERIFY,             // id/max = search window start/count, max 0 => occupied range
+  CMD_ENROLL,             // id 0 => next free slot
+  CMD_DOWNLOAD_TEMPLATE,
+  CMD_DOWNLOAD_ALL,       // bulk job
+  CMD_PROBE,              // all => deep (load every occupied slot, bulk job)
+  CMD_RESET_ENROLLMENTS,
+  CMD_SYNC,               // id = hash-index node, 0 => root
+  CMD_ENROLL_SESSION,     // max = voters; tag != 0 => that many IDs queued under tag
+  CMD_END_SESSION,        // handled on arrival: no new voters, then the summary
+  CMD_BACKUP,             // id = first slot (resume point), bulk job
+  CMD_RESTORE,            // tag = restore whose templates to store, bulk job
+  CMD_CANCEL              // console only, handled on arrival; all => also drop pending and end the session
+};
+
+struct SensorCommand {
+  SensorCommandType type;
+  uint16_t id;
+  uint16_t max;     // download-all upper bound
+  uint8_t retries;
+  bool all;
+  uint8_t tag;      // enroll-session ID list (0 => free slots), restore
+  RequestTag request;  // rid and timing of the command (request_tag.h)
+};
+
+// Pending requests are taken highest priority first. Bulk jobs yield to
+// anything above PRIO_BULK between slots; an enroll session yields to verify
+// between voters.
+enum CommandPriority : uint8_t {
+  PRIO_VERIFY,  // a voter is at the sensor
+  PRIO_ENROLL,
+  PRIO_ADMIN,   // single template, sync, reset
+  PRIO_BULK,    // download-all, deep probe, backup, restore
+  PRIO_NONE
+};
+
+CommandPriority commandPriority(SensorCommandType type);
+
+// A long-running command split into steps of one slot each. The sensor task
+// steps it while nothing that outranks it is waiting, calls pause before
+// running other work in between, and abort on cancel.
+struct BulkJob {
+  const char* name;
+  bool (*step)();   // false once finished
+  void (*pause)();  // optional
+  void (*abort)();  // optional
+};
+
+void startStationTasks();
+
+// Network task only. False when the command queue is full.
+bool submitSensorCommand(const SensorCommand& cmd);
+// Network task only. Never refused: a cancel bypasses the command queue and the
+// sensor task runs it on its next step, after the commands queued before it. A
+// cancel that arrives before the last one was taken joins it and is answered
+// at once.
+void submitSensorCancel(bool all, const RequestTag& request);
+
+// Sensor task only. Requests wait here while an enroll/verify flow or an
+// enroll session is running.
+bool queueSensorCommand(const SensorCommand& cmd);
+// Sensor task only: cancel and end-session act at once, the rest is queued.
+// False when the pending list is full.
+bool acceptSensorCommand(const SensorCommand& cmd);
+size_t pendingCommandCount();
+// Sensor task only, one job at a time: bulk commands are not started while a
+// job is running.
+void startBulkJob(const BulkJob& job);
+bool bulkJobActive();
+// Cancel the running flow (or, if there is none, the bulk job); with all=true
+// also drop every pending request, the bulk job and the enroll session.
+void cancelSensorWork(bool all);
+
+// Network task: requests the sensor task has yet to finish (the running one,
+// pending ones, and commands not taken from the queue yet). Shared work that
+// arrives at STATION_WORK_BACKLOG is answered busy (station_id.h); a station
+// in degraded mode (boot.h) reports a full backlog.
+uint32_t sensorBacklog();
+
+// Stack high-water marks: the least free stack (bytes) each task has had, 0
+// before the tasks are started
+uint32_t sensorTaskStackFree();
+uint32_t networkTaskStackFree();
+
+// True on the network task (or before the tasks are started, from setup()).
+bool onNetworkTask();
+void notifyNetworkTask();
+
+// One iteration of each task body. The FreeRTOS tasks call these in a loop;
+// a host build can drive them from two std::threads instead.
+void sensorTaskStep();
+void networkTaskStep();
+
+// Implemented in main.ino
+void handleSerialCommands();
+void executeSensorCommand(const SensorCommand& cmd);
+bool probeFingerprintSlots(bool deep);  // true: deep pass started as a bulk job
+bool deleteTemplateId(uint16_t id);
+
+#endif
@@ -0,0 +1,65 @@
+// text_codec.cpp
+#include "text_codec.h"
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+static const char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+size_t hexEncode(const uint8_t* src, size_t len, char* out) {
+  for (size_t i = 0; i < len; ++i) {
+    out[2 * i] = HEX_DIGITS[src[i] >> 4];
+    out[2 * i + 1] = HEX_DIGITS[src[i] & 0x0F];
+  }
+  return 2 * len;
+}
+
+size_t base64Encode(const uint8_t* src, size_t len, char* out) {
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t v = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) | src[i + 2];
+    out[n++] = BASE64_DIGITS[(v >> 18) & 0x3F];
+    out[n++] = BASE64_DIGITS[(v >> 12) & 0x3F];
+    out[n++] = BASE64_DIGITS[(v >> 6) & 0x3F];
+    out[n++] = BASE64_DIGITS[v & 0x3F];
+  }
+  if (i < len) {
+    uint32_t v = (uint32_t)src[i] << 16;
+    if (i + 1 < len) v |= (uint32_t)src[i + 1] << 8;
+    out[n++] = BASE64_DIGITS[(v >> 18) & 0x3F];
+    out[n++] = BASE64_DIGITS[(v >> 12) & 0x3F];
+    out[n++] = i + 1 < len ? BASE64_DIGITS[(v >> 6) & 0x3F] : '=';
+    out[n++] = '=';
+  }
+  return n;
+}
+
+// 0..63 for a base64 digit, -1 otherwise
+static int base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+size_t base64Decode(const char* src, size_t len, uint8_t* out, size_t cap) {
+  if (len % 4 != 0) return 0;
+  size_t n = 0;
+  for (size_t i = 0; i < len; i += 4) {
+    bool last = i + 4 == len;
+    uint8_t pad = last ? (src[i + 3] == '=') + (src[i + 2] == '=') : 0;
+    uint32_t v = 0;
+    for (size_t k = 0; k < 4; ++k) {
+      int d = k >= 4u - pad ? 0 : base64Value(src[i + k]);
+      if (d < 0) return 0;
+      v = (v << 6) | (uint32_t)d;
+    }
+    size_t bytes = 3 - pad;
+    if (bytes > cap - n) return 0;
+    out[n++] = v >> 16;
+    if (bytes > 1) out[n++] = (v >> 8) & 0xFF;
+    if (bytes > 2) out[n++] = v & 0xFF;
+  }
+  return n;
+}
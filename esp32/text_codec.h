@@ -0,0 +1,20 @@
+#ifndef TEXT_CODEC_H
+#define TEXT_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hex and Base64 (RFC 4648, padded) into and out of caller buffers. No
+// Arduino dependencies and no allocation.
+// Writes 2 * len lowercase hex digits (no terminator); returns that count.
+size_t hexEncode(const uint8_t* src, size_t len, char* out);
+
+#define BASE64_ENCODED_LEN(n) ((((n) + 2) / 3) * 4)
+
+// Writes BASE64_ENCODED_LEN(len) characters (no terminator); returns that count.
+size_t base64Encode(const uint8_t* src, size_t len, char* out);
+// Decodes len characters into out. Returns the decoded length, or 0 if the
+// input is malformed or would not fit in cap bytes.
+size_t base64Decode(const char* src, size_t len, uint8_t* out, size_t cap);
+
+#endif
@@ -0,0 +1,293 @@
+// tls_client.cpp
+#include "tls_client.h"
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+
+// mbedTLS 3 hides the session fields behind this macro; 2.x has them public
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+#define TLS_IO_TIMEOUT_MS 5000  // a write the socket will not take, as WiFiClientSecure
+#define TLS_HOST_MAX 64
+
+enum TlsPhase : uint8_t {
+  PHASE_IDLE,
+  PHASE_TCP,        // non-blocking connect in progress
+  PHASE_HANDSHAKE,
+  PHASE_UP
+};
+
+static struct {
+  TlsPhase phase = PHASE_IDLE;
+  int fd = -1;
+  uint32_t deadlineMs;
+  bool sslSetUp;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config conf;
+  bool rngSeeded;
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  bool haveSession;  // kept across stop(), offered on the next handshake
+  mbedtls_ssl_session session;
+  bool resumed;
+  char host[TLS_HOST_MAX];
+} tls;
+
+static int bioSend(void*, const unsigned char* buf, size_t len) {
+  int n = lwip_send(tls.fd, buf, len, 0);
+  if (n >= 0) return n;
+  return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+static int bioRecv(void*, unsigned char* buf, size_t len) {
+  int n = lwip_recv(tls.fd, buf, len, 0);
+  if (n > 0) return n;
+  if (n == 0) return MBEDTLS_ERR_NET_CONN_RESET;
+  return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+// Wait up to ms for the socket to become readable or writable
+static bool waitSocket(bool forWrite, uint32_t ms) {
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(tls.fd, &set);
+  timeval tv = { (time_t)(ms / 1000), (suseconds_t)((ms % 1000) * 1000) };
+  return lwip_select(tls.fd + 1, forWrite ? nullptr : &set, forWrite ? &set : nullptr, nullptr, &tv) > 0;
+}
+
+static bool setUpSsl() {
+  if (!tls.rngSeeded) {
+    mbedtls_entropy_init(&tls.entropy);
+    mbedtls_ctr_drbg_init(&tls.drbg);
+    if (mbedtls_ctr_drbg_seed(&tls.drbg, mbedtls_entropy_func, &tls.entropy, nullptr, 0) != 0) return false;
+    mbedtls_ssl_session_init(&tls.session);
+    tls.rngSeeded = true;
+  }
+  mbedtls_ssl_init(&tls.ssl);
+  mbedtls_ssl_config_init(&tls.conf);
+  tls.sslSetUp = true;
+  if (mbedtls_ssl_config_defaults(&tls.conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                  MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+    return false;
+  }
+  mbedtls_ssl_conf_authmode(&tls.conf, MBEDTLS_SSL_VERIFY_NONE);
+  mbedtls_ssl_conf_rng(&tls.conf, mbedtls_ctr_drbg_random, &tls.drbg);
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+  mbedtls_ssl_conf_session_tickets(&tls.conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+  if (mbedtls_ssl_setup(&tls.ssl, &tls.conf) != 0 || mbedtls_ssl_set_hostname(&tls.ssl, tls.host) != 0) return false;
+  mbedtls_ssl_set_bio(&tls.ssl, nullptr, bioSend, bioRecv, nullptr);
+  // a session the broker no longer knows just means a full handshake
+  if (tls.haveSession) mbedtls_ssl_set_session(&tls.ssl, &tls.session);
+  return true;
+}
+
+// Keep the new session for the next connect. A resumed session carries the
+// master secret of the one offered, a new one does not.
+static void saveSession() {
+  mbedtls_ssl_session fresh;
+  mbedtls_ssl_session_init(&fresh);
+  if (mbedtls_ssl_get_session(&tls.ssl, &fresh) != 0) {
+    mbedtls_ssl_session_free(&fresh);
+    tls.resumed = false;
+    return;
+  }
+  tls.resumed = tls.haveSession && memcmp(fresh.MBEDTLS_PRIVATE(master), tls.session.MBEDTLS_PRIVATE(master),
+                                          sizeof(fresh.MBEDTLS_PRIVATE(master))) == 0;
+  mbedtls_ssl_session_free(&tls.session);
+  tls.session = fresh;  // moved: fresh is not freed
+  tls.haveSession = true;
+}
+
+void TlsClient::setHandshakeTimeout(uint32_t seconds) {
+  handshakeTimeoutMs_ = seconds * 1000;
+}
+
+bool TlsClient::connectStart(const char* host, uint16_t port) {
+  stop();
+  IPAddress ip;
+  if (!WiFi.hostByName(host, ip)) return false;
+  int fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) return false;
+  lwip_fcntl(fd, F_SETFL, lwip_fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  int one = 1;
+  lwip_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // MQTT packets are small
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  if (lwip_connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) {
+    lwip_close(fd);
+    return false;
+  }
+  tls.fd = fd;
+  tls.phase = PHASE_TCP;
+  tls.deadlineMs = millis() + handshakeTimeoutMs_;
+  strlcpy(tls.host, host, sizeof(tls.host));
+  if (setUpSsl()) return true;
+  stop();
+  return false;
+}
+
+TlsStep TlsClient::connectPoll() {
+  if (tls.phase == PHASE_UP) return TLS_STEP_DONE;
+  if (tls.phase == PHASE_IDLE) return TLS_STEP_FAILED;
+  if ((int32_t)(millis() - tls.deadlineMs) >= 0) {
+    Serial.printf("TLS: %s timed out\n", tls.phase == PHASE_TCP ? "TCP connect" : "handshake");
+    stop();
+    return TLS_STEP_FAILED;
+  }
+
+  if (tls.phase == PHASE_TCP) {
+    if (!waitSocket(true, 0)) return TLS_STEP_PENDING;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    lwip_getsockopt(tls.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err) {
+      Serial.printf("TLS: TCP connect failed, errno %d\n", err);
+      stop();
+      return TLS_STEP_FAILED;
+    }
+    tls.phase = PHASE_HANDSHAKE;
+  }
+
+  int ret = mbedtls_ssl_handshake(&tls.ssl);
+  if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) return TLS_STEP_PENDING;
+  if (ret != 0) {
+    Serial.printf("TLS: handshake failed, -0x%04x\n", (unsigned)-ret);
+    // the broker refused outright: do not offer the same session again
+    if (ret == MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE && tls.haveSession) {
+      mbedtls_ssl_session_free(&tls.session);
+      mbedtls_ssl_session_init(&tls.session);
+      tls.haveSession = false;
+    }
+    stop();
+    return TLS_STEP_FAILED;
+  }
+  saveSession();
+  tls.phase = PHASE_UP;
+  return TLS_STEP_DONE;
+}
+
+bool TlsClient::resumed() const {
+  return tls.resumed;
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+  if (!connectStart(host, port)) return 0;
+  TlsStep step;
+  while ((step = connectPoll()) == TLS_STEP_PENDING) delay(1);
+  return step == TLS_STEP_DONE;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+  handshakeTimeoutMs_ = timeoutMs;
+  return connect(host, port);
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+  handshakeTimeoutMs_ = timeoutMs;
+  return connect(ip, port);
+}
+
+size_t TlsClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+  if (tls.phase != PHASE_UP) return 0;
+  size_t done = 0;
+  uint32_t start = millis();
+  while (done < size) {
+    int n = mbedtls_ssl_write(&tls.ssl, buf + done, size - done);
+    if (n > 0) {
+      done += n;
+    } else if ((n == MBEDTLS_ERR_SSL_WANT_WRITE || n == MBEDTLS_ERR_SSL_WANT_READ) &&
+               millis() - start < TLS_IO_TIMEOUT_MS) {
+      waitSocket(n == MBEDTLS_ERR_SSL_WANT_WRITE, 10);
+    } else {
+      stop();
+      break;
+    }
+  }
+  return done;
+}
+
+int TlsClient::available() {
+  if (tls.phase != PHASE_UP) return peeked_ >= 0;
+  size_t n = mbedtls_ssl_get_bytes_avail(&tls.ssl);
+  if (n == 0) {
+    // pulls in the next record if one has arrived; also notices a close
+    int ret = mbedtls_ssl_read(&tls.ssl, nullptr, 0);
+    if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      stop();
+      return 0;
+    }
+    n = mbedtls_ssl_get_bytes_avail(&tls.ssl);
+  }
+  return n + (peeked_ >= 0);
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+  if (size == 0) return 0;
+  size_t got = 0;
+  if (peeked_ >= 0) {
+    buf[got++] = peeked_;
+    peeked_ = -1;
+  }
+  if (got < size && tls.phase == PHASE_UP) {
+    int n = mbedtls_ssl_read(&tls.ssl, buf + got, size - got);
+    if (n > 0) {
+      got += n;
+    } else if (n != MBEDTLS_ERR_SSL_WANT_READ && n != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      stop();  // closed by the peer (0 or close notify) or failed
+    }
+  }
+  return got ? (int)got : -1;
+}
+
+int TlsClient::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int TlsClient::peek() {
+  if (peeked_ < 0) peeked_ = read();
+  return peeked_;
+}
+
+void TlsClient::flush() {
+  // write() hands everything to the socket before returning
+}
+
+void TlsClient::stop() {
+  if (tls.phase == PHASE_UP) mbedtls_ssl_close_notify(&tls.ssl);  // best effort, never waits
+  if (tls.fd >= 0) lwip_close(tls.fd);
+  tls.fd = -1;
+  if (tls.sslSetUp) {
+    mbedtls_ssl_free(&tls.ssl);
+    mbedtls_ssl_config_free(&tls.conf);
+    tls.sslSetUp = false;
+  }
+  tls.phase = PHASE_IDLE;
+  peeked_ = -1;
+}
+
+uint8_t TlsClient::connected() {
+  if (tls.phase == PHASE_UP) available();  // notices a close from the broker
+  return tls.phase == PHASE_UP;
+}
+
+TlsClient::operator bool() {
+  return connected();
+}
@@ -0,0 +1,58 @@
+#ifndef TLS_CLIENT_H
+#define TLS_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+// TLS socket to the broker, used by PubSubClient in place of WiFiClientSecure:
+//  - connecting is stepped: connectStart() opens a non-blocking socket and
+//    returns, connectPoll() advances the TCP connect and the handshake as far
+//    as the data at hand allows, so the network task keeps draining events
+//    and serving the outbox while a connect is in progress
+//  - the session (ID and ticket) of the last handshake is kept and offered on
+//    the next one; a broker that still knows it skips the key exchange and the
+//    certificate, which is most of a reconnect
+// Like WiFiClientSecure after setInsecure(), the broker certificate is not
+// verified (demo only). There is one broker link, so the mbedTLS state lives
+// in tls_client.cpp rather than in the object.
+enum TlsStep : uint8_t {
+  TLS_STEP_PENDING,
+  TLS_STEP_DONE,
+  TLS_STEP_FAILED
+};
+
+class TlsClient : public Client {
+public:
+  // TCP connect plus handshake, from connectStart()
+  void setHandshakeTimeout(uint32_t seconds);
+  // Resolves host (lwIP caches the answer) and starts the TCP connect; false
+  // if not even that worked
+  bool connectStart(const char* host, uint16_t port);
+  TlsStep connectPoll();
+  bool resumed() const;  // the last handshake reused the saved session
+
+  // Client interface. connect() blocks until connectPoll() is done; the
+  // connection manager never needs it, PubSubClient only calls it when the
+  // socket is not up yet.
+  int connect(IPAddress ip, uint16_t port);
+  int connect(const char* host, uint16_t port);
+  int connect(IPAddress ip, uint16_t port, int32_t timeoutMs);
+  int connect(const char* host, uint16_t port, int32_t timeoutMs);
+  size_t write(uint8_t b);
+  size_t write(const uint8_t* buf, size_t size);
+  int available();
+  int read();
+  int read(uint8_t* buf, size_t size);
+  int peek();
+  void flush();
+  void stop();
+  uint8_t connected();
+  operator bool();
+  using Print::write;
+
+private:
+  uint32_t handshakeTimeoutMs_ = 10000;
+  int peeked_ = -1;
+};
+
+#endif
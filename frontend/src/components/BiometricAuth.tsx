@@ -5,7 +5,7 @@ import { RootState } from '@/store';
 import { closeBiometricAuth } from '@/store/slices/modalSlice';
 import { Fingerprint, Loader2 } from 'lucide-react';
 import { Dialog, DialogContent } from '@/components/ui/dialog';
-import useWebSocket, { WEBSOCKET_URL } from '@/hooks/use-websocket';
+import useWebSocket, { FINGERPRINT_STATION, WEBSOCKET_URL } from '@/hooks/use-websocket';
 
 // BiometricAuth Component
 const BiometricAuth = () => {
@@ -21,7 +21,10 @@ const BiometricAuth = () => {
   useEffect(() => {
     if (biometricAuth.isOpen) {
       // This runs immediately the component mounts
-      fetch(`${WEBSOCKET_URL}/fingerprint/verify`, { method: 'POST', headers: { 'Content-Type': 'application/json' } })
+      fetch(`${WEBSOCKET_URL}/fingerprint/verify`, {
+        method: 'POST', headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ station: FINGERPRINT_STATION })
+      })
         .then(response => {
           if (!response.ok) {
             throw new Error('Network response was not ok');
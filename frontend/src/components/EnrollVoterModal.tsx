@@ -9,7 +9,7 @@ import { toast } from '@/hooks/use-toast';
 import { contractService, VoterData } from '@/services/contractService';
 import { useSelector } from 'react-redux';
 import { RootState } from '@/store';
-import useWebSocket, { WEBSOCKET_URL } from '@/hooks/use-websocket';
+import useWebSocket, { FINGERPRINT_STATION, WEBSOCKET_URL } from '@/hooks/use-websocket';
 
 interface EnrollVoterModalProps {
   open: boolean;
@@ -50,7 +50,7 @@ const EnrollVoterModal = ({ open, onOpenChange }: EnrollVoterModalProps) => {
     if (open) {
       loadVoters();
     }
-    fetch(`${WEBSOCKET_URL}/fingerprint/enrolled`, { headers: { 'Content-Type': 'application/json' } })
+    fetch(`${WEBSOCKET_URL}/fingerprint/enrolled?station=${encodeURIComponent(FINGERPRINT_STATION)}`, { headers: { 'Content-Type': 'application/json' } })
       .then(response => {
         if (!response.ok) {
           throw new Error('Network response was not ok');
@@ -112,7 +112,8 @@ const EnrollVoterModal = ({ open, onOpenChange }: EnrollVoterModalProps) => {
     fetch(`${WEBSOCKET_URL}/fingerprint/enroll`, {
       method: 'POST', headers: { 'Content-Type': 'application/json' },
       body: JSON.stringify({
-        userId: fingerprintCount
+        userId: fingerprintCount,
+        station: FINGERPRINT_STATION
       })
     })
       .then(response => {
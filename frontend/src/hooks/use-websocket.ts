@@ -3,6 +3,9 @@ import { useEffect, useState } from "react";
 
 // export const WEBSOCKET_URL = "https://mqtt-server-d88p.onrender.com";
 export const WEBSOCKET_URL = "http://localhost:4000";
+// Station ID of the fingerprint reader at this kiosk (`station` on the ESP32's serial CLI);
+// the server refuses sensor commands that do not name one
+export const FINGERPRINT_STATION: string = import.meta.env.VITE_FINGERPRINT_STATION ?? "";
 
 export default function useWebSocket() {
    const [healthStatus, setHealthStatus] = useState("");
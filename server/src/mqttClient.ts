@@ -1,6 +1,9 @@
 import dotenv from "dotenv";
+import fs from "fs";
+import path from "path";
 // import mqtt from "mqtt";
 import { broadcastData } from "./webSocket";
+import { decodeMessage } from "./wireFormat";
 
 dotenv.config();
 
@@ -24,15 +27,113 @@ export const mqttClient = mqtt.connect(options);
 
 
 export let lastSeenTimestamp = new Date();
+export const stationLastSeen = new Map<string, Date>();
 
 // --- Topics ---
+// Every station publishes under esp32/<station>/...; commands go to one
+// station, to all of them, or to the shared work queue that the broker hands
+// to one station at a time (see esp32/station_id.h).
 const TOPICS = {
-  HEALTH: "esp32/health",
-  FP_COMMAND: "esp32/fingerprint/command",
-  FP_STATUS: "esp32/fingerprint/status",
-  FP_COUNT: "esp32/fingerprint/count",
-  FP_RESULT: "esp32/fingerprint/result",
-  FP_TEMPLATES: "esp32/fingerprint/templates",
+  HEALTH: "health",
+  FP_COMMAND: "fingerprint/command",
+  FP_STATUS: "fingerprint/status",
+  FP_COUNT: "fingerprint/count",
+  FP_RESULT: "fingerprint/result",
+  FP_TEMPLATES: "fingerprint/templates",
+  FP_SYNC: "fingerprint/sync",
+  FP_BACKUP: "fingerprint/backup",
+};
+
+const BROADCAST_COMMAND = "esp32/fingerprint/command";
+const WORK_QUEUE = "esp32/fingerprint/work";
+
+const stationTopic = (station: string, suffix: string) => `esp32/${station}/${suffix}`;
+
+// Commands that start work on a sensor or change its library go to one named
+// station; a missing station is the caller's bug, never a broadcast. Only the
+// helpers that take a Target can address every station, and only when asked
+// to with ALL_STATIONS.
+export const ALL_STATIONS = Symbol("all stations");
+type Target = string | typeof ALL_STATIONS;
+
+const commandTopic = (station: string) => {
+  if (!station) throw new Error("A station is required for this command");
+  return stationTopic(station, TOPICS.FP_COMMAND);
+};
+
+const targetTopic = (target: Target) => (target === ALL_STATIONS ? BROADCAST_COMMAND : commandTopic(target));
+
+// --- Request IDs ---
+// Commands carry a rid that the station echoes, with waitMs/execMs, on every
+// status, result and template reply, so several commands can be in flight per
+// station. A result or the one final status each rid gets settles the request
+// ("started" and "progress" are not final); its round trip goes out as a
+// "fingerprint-settled" event. Entries without an answer (count
+// replies carry no rid) expire after IN_FLIGHT_TTL_MS.
+const FINAL_STATUSES = new Set(["success", "error", "cancelled", "timeout", "busy"]);
+const IN_FLIGHT_TTL_MS = 10 * 60 * 1000;
+
+type InFlight = { action: string; sentAt: number };
+export const inFlight = new Map<number, InFlight>();
+let lastRid = 0;
+
+const sendCommand = (topic: string, body: Record<string, unknown>, options?: any) => {
+  const now = Date.now();
+  inFlight.forEach((req, rid) => {
+    if (now - req.sentAt > IN_FLIGHT_TTL_MS) inFlight.delete(rid);
+  });
+  lastRid = (lastRid % 0xffffffff) + 1; // u32 on the device, never 0
+  const rid = lastRid;
+  inFlight.set(rid, { action: String(body.action), sentAt: now });
+  mqttClient.publish(topic, JSON.stringify({ ...body, rid }), options);
+  return rid;
+};
+
+// --- Shared work ---
+// The broker hands work to the stations in turn, full or not; a station that
+// already holds its backlog (STATION_WORK_BACKLOG) answers busy with the rid.
+// Such work goes back on the queue after WORK_RETRY_MS under the same rid, so
+// it settles once, whichever station does it. Retries stop when the request
+// expires from inFlight.
+const WORK_RETRY_MS = 2000;
+const queuedWork = new Map<number, Record<string, unknown>>();
+
+const queueWork = (body: Record<string, unknown>) => {
+  const rid = sendCommand(WORK_QUEUE, body, { qos: 1 });
+  queuedWork.set(rid, body);
+  return rid;
+};
+
+// True if the busy reply was for queued work, which is sent again
+const requeueWork = (rid: number) => {
+  const body = queuedWork.get(rid);
+  if (!body) return false;
+  if (!inFlight.has(rid)) {
+    queuedWork.delete(rid);
+    return false;
+  }
+  setTimeout(() => {
+    if (queuedWork.has(rid)) mqttClient.publish(WORK_QUEUE, JSON.stringify({ ...body, rid }), { qos: 1 });
+  }, WORK_RETRY_MS);
+  return true;
+};
+
+const settle = (station: string, payload: any) => {
+  const req = payload.rid !== undefined ? inFlight.get(payload.rid) : undefined;
+  if (!req) return;
+  inFlight.delete(payload.rid);
+  queuedWork.delete(payload.rid);
+  broadcastData(
+    JSON.stringify({
+      type: "fingerprint-settled",
+      station,
+      rid: payload.rid,
+      action: req.action,
+      roundTripMs: Date.now() - req.sentAt,
+      waitMs: payload.waitMs,
+      execMs: payload.execMs,
+    })
+  );
 };
 
 // Subscribe to ESP32 topics
@@ -41,7 +142,7 @@ mqttClient.on("connect", () => {
 
   Object.values(TOPICS).forEach((t) => {
     if (t.endsWith("/command")) return; // don’t sub to command topics
-    mqttClient.subscribe(t);
+    mqttClient.subscribe(stationTopic("+", t));
   });
 });
 
@@ -50,35 +151,81 @@ mqttClient.on("error", (err: any) => {
 });
 
 mqttClient.on("message", (topic: any, message: any) => {
+  const match = /^esp32\/([^/]+)\/(.+)$/.exec(topic);
+  if (!match) {
+    console.warn(`Unhandled topic: ${topic}`);
+    return;
+  }
+  const [, station, suffix] = match;
+
   let payload: any;
   try {
-    payload = JSON.parse(message.toString());
+    payload = decodeMessage(message);
   } catch (err) {
-    console.error(`Failed to parse JSON on ${topic}:`, err);
+    console.error(`Failed to parse message on ${topic}:`, err);
     return;
   }
 
-  switch (topic) {
+  switch (suffix) {
     case TOPICS.HEALTH:
       lastSeenTimestamp = new Date();
-      broadcastData(JSON.stringify({ type: "esp32-health", status: payload.status }));
+      stationLastSeen.set(station, lastSeenTimestamp);
+      if (payload.status === "boot" || payload.status === "mem") {
+        // boot: mode, reset reason and [start, end] ms per boot phase; mem: pool, heap and stack report
+        broadcastData(JSON.stringify({ type: `esp32-${payload.status}`, station, ...payload }));
+        break;
+      }
+      broadcastData(
+        JSON.stringify({ type: "esp32-health", station, status: payload.status, uptime: payload.uptime, latency: payload.latency })
+      );
       break;
 
     // 🔐 Fingerprint updates
     case TOPICS.FP_STATUS:
-      broadcastData(JSON.stringify({ type: "fingerprint-status", ...payload }));
+      broadcastData(JSON.stringify({ type: "fingerprint-status", station, ...payload }));
+      if (payload.status === "busy" && payload.rid !== undefined) {
+        if (requeueWork(payload.rid)) break;
+        onRestoreBusy(station, payload.rid);
+      }
+      if (FINAL_STATUSES.has(payload.status)) settle(station, payload);
       break;
 
     case TOPICS.FP_COUNT:
-      broadcastData(JSON.stringify({ type: "fingerprint-count", ...payload }));
+      broadcastData(JSON.stringify({ type: "fingerprint-count", station, ...payload }));
       break;
 
     case TOPICS.FP_RESULT:
-      broadcastData(JSON.stringify({ type: "fingerprint-result", ...payload }));
+      broadcastData(JSON.stringify({ type: "fingerprint-result", station, ...payload }));
+      settle(station, payload);
       break;
 
     case TOPICS.FP_TEMPLATES:
-      broadcastData(JSON.stringify({ type: "fingerprint-templates", ...payload }));
+      // Bulk sync sends batches: { templates: [{ id, template }, ...] }. A
+      // truncated batch lost entries on the station: the job's listing is short.
+      if (payload.truncated) {
+        broadcastData(JSON.stringify({ type: "fingerprint-templates-truncated", station, rid: payload.rid }));
+      } else if (Array.isArray(payload.templates)) {
+        payload.templates.forEach((entry: any) => {
+          broadcastData(JSON.stringify({ type: "fingerprint-templates", station, rid: payload.rid, ...entry }));
+        });
+      } else {
+        broadcastData(JSON.stringify({ type: "fingerprint-templates", station, ...payload }));
+      }
+      break;
+
+    // Hash-index sync replies: { node, hash, unknown, nodes | slots: [{ id, hash }, ...] },
+    // or { node, truncated: true } when the station lost entries of it: ask for the node again
+    case TOPICS.FP_SYNC:
+      broadcastData(JSON.stringify({ type: "fingerprint-sync", station, ...payload }));
+      break;
+
+    // Backup chunks { seq, next, done, templates: [{ id, data }] } and restore acks
+    case TOPICS.FP_BACKUP:
+      if (payload.restoreAck !== undefined) {
+        onRestoreAck(station, payload);
+      } else {
+        onBackupChunk(station, payload);
+      }
       break;
 
     default:
@@ -87,31 +234,222 @@ mqttClient.on("message", (topic: any, message: any) => {
 });
 
 // --- Helper functions for publishing fingerprint commands ---
-export const requestFingerprintVerify = (userId: number | null = null) => {
-  mqttClient.publish(TOPICS.FP_COMMAND, JSON.stringify({ action: "verify", userId }));
+// Each returns the command's rid
+// start/count narrow the 1:N search to a block of slots (e.g. one polling station)
+export const requestFingerprintVerify = (station: string, userId: number | null = null, start?: number, count?: number) => {
+  return sendCommand(commandTopic(station), { action: "verify", userId, start, count });
+};
+
+export const requestFingerprintEnroll = (station: string) => {
+  return sendCommand(commandTopic(station), { action: "enroll" });
+};
+
+export const requestFingerprintEnrollWithId = (station: string, userId: number | null = null) => {
+  return sendCommand(commandTopic(station), { action: "enroll", userId });
+};
+
+// Fleet mode: one station of the $share group takes the enrollment, or answers
+// busy and it is queued again (see queueWork). QoS 1 so the broker's hand-over
+// to the station is acknowledged.
+export const queueFingerprintEnroll = (userId: number) => {
+  return queueWork({ action: "enroll", userId });
+};
+
+export const requestFingerprintTemplates = (station: string) => {
+  return sendCommand(commandTopic(station), { action: "download-templates" });
+};
+
+export const requestFingerprintTemplateById = (station: string, userId: number) => {
+  return sendCommand(commandTopic(station), { action: "download-template", userId });
 };
 
-export const requestFingerprintEnroll = () => {
-  mqttClient.publish(TOPICS.FP_COMMAND, JSON.stringify({ action: "enroll" }));
+export const requestEnrollmentCount = (target: Target) => {
+  return sendCommand(targetTopic(target), { action: "enrolled-count" });
 };
 
-export const requestFingerprintEnrollWithId = (userId: number | null = null) => {
-  mqttClient.publish(TOPICS.FP_COMMAND, JSON.stringify({ action: "enroll", userId }));
+// Registration drive: enroll the given user IDs in order, or `count` voters into free slots
+// (no count: until requestEndEnrollSession). Hashes arrive in batches on FP_TEMPLATES.
+export const requestEnrollSession = (station: string, userIds: number[] | null = null, count: number = 0) => {
+  const body = userIds ? { action: "enroll-session", userIds } : { action: "enroll-session", count };
+  return sendCommand(commandTopic(station), body);
 };
 
-export const requestFingerprintTemplates = () => {
-  mqttClient.publish(TOPICS.FP_COMMAND, JSON.stringify({ action: "download-templates" }));
+export const requestEndEnrollSession = (station: string) => {
+  return sendCommand(commandTopic(station), { action: "end-session" });
 };
 
-export const requestFingerprintTemplateById = (userId: number) => {
-  mqttClient.publish(TOPICS.FP_COMMAND, JSON.stringify({ action: "download-template", userId }));
+// Ask for a hash-index node (1 = root) and its descendants; walk down where hashes differ
+export const requestFingerprintSync = (station: string, node: number = 1) => {
+  return sendCommand(commandTopic(station), { action: "sync", node });
 };
 
-export const requestEnrollmentCount = () => {
-  mqttClient.publish(TOPICS.FP_COMMAND, JSON.stringify({ action: "enrolled-count" }))
+// Switch the device between "json" and the compact "binary" wire format
+export const requestWireFormat = (format: "json" | "binary", target: Target) => {
+  return sendCommand(targetTopic(target), { action: "set-format", format });
 };
 
 // Debug purposes
-export const requestResetTemplates = () => {
-  mqttClient.publish(TOPICS.FP_COMMAND, JSON.stringify({ action: "reset-enrollments" }));
+export const requestResetTemplates = (station: string) => {
+  return sendCommand(commandTopic(station), { action: "reset-enrollments" });
+};
+
+// --- Full-library backup / restore of raw templates ---
+// One backup at a time. The device streams chunks and keeps a few
+// unacknowledged. A chunk from the station being backed up is appended to
+// BACKUP_DIR/<station>.jsonl and synced before it is acked, so an ack means
+// the templates are on disk and a backup survives a server restart. Chunks
+// from any other station are not acked. `next` is where an interrupted backup
+// resumes (requestBackup(station, next)).
+type RawTemplate = { id: number; data: string };
+type BackupRecord = { seq: number; next: number; done: boolean; templates: RawTemplate[] };
+
+const BACKUP_DIR = process.env.BACKUP_DIR || path.join(process.cwd(), "backups");
+const backupFile = (station: string) => path.join(BACKUP_DIR, `${encodeURIComponent(station)}.jsonl`);
+
+export const backupTemplates = new Map<number, string>();
+let backupStation = "";
+let backupNext = 1;
+let backupWrites: Promise<void> = Promise.resolve(); // chunks are saved, then acked, in arrival order
+
+// A station's backup as saved so far. A line torn by a crash mid-append is
+// skipped; its chunk was never acked and comes again on resume.
+export const loadBackup = async (station: string) => {
+  const templates = new Map<number, string>();
+  let next = 1;
+  let done = false;
+  let text: string;
+  try {
+    text = await fs.promises.readFile(backupFile(station), "utf8");
+  } catch {
+    return { templates, next, done };
+  }
+  for (const line of text.split("\n")) {
+    let record: BackupRecord;
+    try {
+      record = JSON.parse(line);
+    } catch {
+      continue;
+    }
+    record.templates.forEach((t) => templates.set(t.id, t.data));
+    next = record.next;
+    done = record.done;
+  }
+  return { templates, next, done };
+};
+
+const saveBackupChunk = async (station: string, record: BackupRecord) => {
+  await fs.promises.mkdir(BACKUP_DIR, { recursive: true });
+  const file = await fs.promises.open(backupFile(station), "a");
+  try {
+    await file.write(JSON.stringify(record) + "\n");
+    await file.sync();
+  } finally {
+    await file.close();
+  }
+};
+
+// from > 1 resumes the station's saved backup, otherwise it starts over
+export const requestBackup = async (station: string, from: number = 1) => {
+  await backupWrites; // chunks of the previous backup land first
+  backupTemplates.clear();
+  if (from <= 1) {
+    await fs.promises.rm(backupFile(station), { force: true });
+  } else {
+    (await loadBackup(station)).templates.forEach((data, id) => backupTemplates.set(id, data));
+  }
+  backupStation = station;
+  backupNext = from;
+  return sendCommand(commandTopic(station), { action: "backup", from });
+};
+
+const onBackupChunk = (station: string, chunk: any) => {
+  if (station !== backupStation) return;
+  const record: BackupRecord = { seq: chunk.seq, next: chunk.next, done: !!chunk.done, templates: chunk.templates ?? [] };
+  backupWrites = backupWrites
+    .then(() => saveBackupChunk(station, record))
+    .then(() => {
+      if (station !== backupStation) return; // a new backup started meanwhile
+      record.templates.forEach((t) => backupTemplates.set(t.id, t.data));
+      backupNext = record.next;
+      // answered by nothing on the device, so no rid
+      mqttClient.publish(commandTopic(station), JSON.stringify({ action: "backup-ack", seq: record.seq }));
+      broadcastData(
+        JSON.stringify({
+          type: "fingerprint-backup",
+          station,
+          seq: record.seq,
+          next: record.next,
+          done: record.done,
+          total: backupTemplates.size,
+        })
+      );
+    })
+    .catch((err) => console.error(`Backup chunk ${record.seq} from ${station} not saved, not acked:`, err));
+};
+
+export const backupResumePoint = () => backupNext;
+
+// Restore: two templates per command (device MQTT buffer), at most
+// RESTORE_WINDOW commands unacknowledged (device holds 8 templates). Each
+// command has its own rid: its restoreAck settles it, and a "busy" reply
+// (device buffer full) sends that chunk again after RESTORE_RETRY_MS.
+const RESTORE_PER_MESSAGE = 2;
+const RESTORE_WINDOW = 3;
+const RESTORE_RETRY_MS = 1000;
+
+let restoreStation = "";
+let restoreChunks: RawTemplate[][] = [];
+let restoreSent = 0;
+let restoreAcked = 0;
+const restoreRids = new Map<number, number>(); // seq -> rid of the command that carried it
+
+const sendRestoreChunk = (seq: number) => {
+  const done = seq === restoreChunks.length - 1;
+  const rid = sendCommand(commandTopic(restoreStation), { action: "restore", seq, templates: restoreChunks[seq], done });
+  restoreRids.set(seq, rid);
+  return rid;
+};
+
+const sendRestoreChunks = () => {
+  while (restoreSent < restoreChunks.length && restoreSent - restoreAcked < RESTORE_WINDOW) {
+    sendRestoreChunk(restoreSent++);
+  }
+};
+
+// Templates default to the saved backup of `source` (the station last backed up)
+export const requestRestore = async (station: string, templates?: RawTemplate[], source: string = backupStation) => {
+  if (!templates) {
+    const saved = source === backupStation && backupTemplates.size > 0 ? backupTemplates : (await loadBackup(source)).templates;
+    templates = [...saved].map(([id, data]) => ({ id, data }));
+  }
+  restoreStation = station;
+  restoreChunks = [];
+  for (let i = 0; i < templates.length; i += RESTORE_PER_MESSAGE) {
+    restoreChunks.push(templates.slice(i, i + RESTORE_PER_MESSAGE));
+  }
+  if (restoreChunks.length === 0) restoreChunks.push([]);
+  restoreSent = 0;
+  restoreAcked = 0;
+  restoreRids.clear();
+  sendRestoreChunks();
+  return restoreRids.get(0);
+};
+
+const onRestoreAck = (station: string, ack: any) => {
+  if (station !== restoreStation) return;
+  const rid = restoreRids.get(ack.restoreAck);
+  if (rid !== undefined) {
+    restoreRids.delete(ack.restoreAck);
+    settle(station, { ...ack, rid });
+  }
+  restoreAcked = Math.max(restoreAcked, ack.restoreAck + 1);
+  broadcastData(JSON.stringify({ type: "fingerprint-restore", station, ...ack, total: restoreChunks.length }));
+  sendRestoreChunks();
+};
+
+const onRestoreBusy = (station: string, rid: number) => {
+  if (station !== restoreStation) return;
+  restoreRids.forEach((sentRid, seq) => {
+    if (sentRid === rid) setTimeout(() => restoreRids.get(seq) === rid && sendRestoreChunk(seq), RESTORE_RETRY_MS);
+  });
 };
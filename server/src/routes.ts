@@ -1,6 +1,7 @@
 import express from "express";
 import {
   lastSeenTimestamp,
+  stationLastSeen,
   requestFingerprintVerify,
   requestFingerprintEnroll,
   requestFingerprintTemplates,
@@ -8,6 +9,8 @@ import {
   requestResetTemplates,
   requestFingerprintTemplateById,
   requestFingerprintEnrollWithId,
+  queueFingerprintEnroll,
+  ALL_STATIONS,
 } from "./mqttClient";
 
 const router = express.Router();
@@ -20,42 +23,71 @@ router.get("/status", (req, res) => {
   const diff = now.getTime() - lastSeenTimestamp.getTime();
   const isOnline = diff < 15000;
 
-  res.json({ online: isOnline, lastSeen: lastSeenTimestamp });
+  const stations = [...stationLastSeen].map(([station, lastSeen]) => ({
+    station,
+    online: now.getTime() - lastSeen.getTime() < 15000,
+    lastSeen,
+  }));
+  res.json({ online: isOnline, lastSeen: lastSeenTimestamp, stations });
 });
 
+// `station` names the station a command is for. Commands that start sensor
+// work or change the library are refused without one; the enrolled count can
+// go to every station with `all=true` instead.
+const STATION_REQUIRED = { error: "station is required" };
+
+// GET requests carry it in the query string, the others in the body
+const stationOf = (req: express.Request) => String(req.query.station ?? req.body?.station ?? "");
+
 // Fingerprint endpoints
 router.post("/fingerprint/verify", (req, res) => {
   const { userId } = req.body;
-  requestFingerprintVerify(userId);
-  res.json({ message: `Verify request sent for user ${userId}` });
+  const station = stationOf(req);
+  if (!station) return res.status(400).json(STATION_REQUIRED);
+  const rid = requestFingerprintVerify(station, userId);
+  res.json({ message: `Verify request sent for user ${userId}`, rid });
 });
 
 router.post("/fingerprint/enroll", (req, res) => {
-  const { userId } = req.body;
-  userId ?
-    requestFingerprintEnrollWithId(userId)
+  const { userId, queue } = req.body;
+  const station = stationOf(req);
+  // queue: the next station with room takes it (fleet mode)
+  if (queue && userId) {
+    const rid = queueFingerprintEnroll(userId);
+    return res.json({ message: `Enroll request for user ${userId} queued for the next free station`, rid });
+  }
+  if (!station) return res.status(400).json(STATION_REQUIRED);
+  const rid = userId ?
+    requestFingerprintEnrollWithId(station, userId)
     :
-    requestFingerprintEnroll();
-  res.json({ message: `Enroll request sent for user ${userId}` });
+    requestFingerprintEnroll(station);
+  res.json({ message: `Enroll request sent for user ${userId}`, rid });
 });
 
 router.get("/fingerprint/templates", (req, res) => {
-  const { userId } = req.body;
-  userId ?
-    requestFingerprintTemplateById(userId)
+  const userId = Number(req.query.userId ?? req.body?.userId ?? 0);
+  const station = stationOf(req);
+  if (!station) return res.status(400).json(STATION_REQUIRED);
+  const rid = userId ?
+    requestFingerprintTemplateById(station, userId)
     :
-    requestFingerprintTemplates();
-  res.json({ message: "Requested fingerprint templates from ESP32" });
+    requestFingerprintTemplates(station);
+  res.json({ message: "Requested fingerprint templates from ESP32", rid });
 });
 
 router.get("/fingerprint/enrolled", (req, res) => {
-  requestEnrollmentCount();
+  const station = stationOf(req);
+  const all = String(req.query.all ?? req.body?.all ?? "") === "true";
+  if (!station && !all) return res.status(400).json({ error: "station (or all=true) is required" });
+  requestEnrollmentCount(station || ALL_STATIONS);
   res.json({ message: "Requested Enrollment Count from ESP32" });
 });
 
 // Debug Purposes
 router.get("/fingerprint/reset", (req, res) => {
-  requestResetTemplates();
+  const station = stationOf(req);
+  if (!station) return res.status(400).json(STATION_REQUIRED);
+  requestResetTemplates(station);
   res.json({ message: "Requested fingerprint Reset from ESP32" });
 });
 
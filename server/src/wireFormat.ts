@@ -0,0 +1,182 @@
+// Decoder for the ESP32's compact binary wire format (see esp32/messaging.h).
+// Binary payloads start with WIRE_BINARY_MAGIC; anything else is JSON.
+// Decoded messages have the same shape as their JSON counterparts.
+
+const WIRE_BINARY_MAGIC = 0xb1;
+
+const MSG = {
+  STATUS: 1,
+  RESULT: 2,
+  COUNT: 3,
+  TEMPLATE: 4,
+  TEMPLATE_BATCH: 5,
+  HEARTBEAT: 6,
+  SYNC: 7,
+  BACKUP: 8,
+  RESTORE_ACK: 9,
+};
+
+// Index = EnrolmentStatus value on the device
+const STATUS_NAMES = [
+  "place_finger",
+  "image_taken",
+  "remove_finger",
+  "place_finger_again",
+  "image_taken_again",
+  "model_created",
+  "stored",
+  "downloading_template",
+  "success",
+  "error",
+  "waiting_for_finger",
+  "cancelled",
+  "timeout",
+  "busy",
+  "started",
+  "progress",
+];
+
+// Index = LatencyMetric value on the device
+const LATENCY_NAMES = [
+  "getImage",
+  "image2Tz",
+  "createModel",
+  "storeModel",
+  "search",
+  "loadModel",
+  "getModel",
+  "templateRx",
+  "sha256",
+  "publish",
+  "command",
+  "templateHashed",
+];
+
+// Index = StationMode value on the device (boot.h)
+const MODE_NAMES = ["booting", "ready", "degraded"];
+
+const HASH_LEN = 32;
+const TEMPLATE_LEN = 512;
+
+// Entry counts that mark a batch or sync reply the station had to drop entries of
+const BATCH_TRUNCATED = 0xffff;
+const SYNC_TRUNCATED = 0xff;
+
+export const isBinaryMessage = (buf: Buffer) => buf.length >= 2 && buf[0] === WIRE_BINARY_MAGIC;
+
+const readText = (buf: Buffer, offset: number) => {
+  const len = buf.readUInt8(offset);
+  return buf.toString("utf8", offset + 1, offset + 1 + len);
+};
+
+// Offset just past a u8-length text field
+const afterText = (buf: Buffer, offset: number) => offset + 1 + buf.readUInt8(offset);
+
+// rid, waitMs and execMs that replies to a command end with (esp32/request_tag.h);
+// rid 0 means the command had none and is left out, as in JSON
+const readRequest = (buf: Buffer, offset: number) => {
+  if (offset + 12 > buf.length) return {};
+  const rid = buf.readUInt32BE(offset);
+  return { ...(rid ? { rid } : {}), waitMs: buf.readUInt32BE(offset + 4), execMs: buf.readUInt32BE(offset + 8) };
+};
+
+const readHash = (buf: Buffer, offset: number) => {
+  if (offset + HASH_LEN > buf.length) throw new RangeError("truncated template hash");
+  return buf.toString("hex", offset, offset + HASH_LEN);
+};
+
+export const decodeBinaryMessage = (buf: Buffer): any => {
+  switch (buf[1]) {
+    case MSG.STATUS:
+      return {
+        status: STATUS_NAMES[buf.readUInt8(2)] ?? "unknown",
+        message: readText(buf, 3),
+        ...readRequest(buf, afterText(buf, 3)),
+      };
+
+    case MSG.RESULT:
+      return {
+        id: buf.readUInt16BE(2),
+        success: buf.readUInt8(4) !== 0,
+        message: readText(buf, 5),
+        ...readRequest(buf, afterText(buf, 5)),
+      };
+
+    case MSG.COUNT:
+      return { enrolledCount: buf.readUInt16BE(2) };
+
+    case MSG.TEMPLATE:
+      return { id: buf.readUInt16BE(2), template: readHash(buf, 4), ...readRequest(buf, 4 + HASH_LEN) };
+
+    case MSG.TEMPLATE_BATCH: {
+      const count = buf.readUInt16BE(2);
+      if (count === BATCH_TRUNCATED) {
+        return buf.length >= 8 ? { rid: buf.readUInt32BE(4), truncated: true, templates: [] } : { truncated: true, templates: [] };
+      }
+      const templates = [];
+      let offset = 4;
+      for (let i = 0; i < count; i++, offset += 2 + HASH_LEN) {
+        templates.push({ id: buf.readUInt16BE(offset), template: readHash(buf, offset + 2) });
+      }
+      // the job's rid, if it was started with one
+      return offset + 4 <= buf.length ? { rid: buf.readUInt32BE(offset), templates } : { templates };
+    }
+
+    case MSG.SYNC: {
+      const node = buf.readUInt16BE(2);
+      const hash = readHash(buf, 4);
+      const slots = buf.readUInt8(36) === 1;
+      const unknown = buf.readUInt16BE(37);
+      const count = buf.readUInt8(39);
+      if (count === SYNC_TRUNCATED) return { node, truncated: true };
+      const entries = [];
+      for (let i = 0, offset = 40; i < count; i++, offset += 2 + HASH_LEN) {
+        entries.push({ id: buf.readUInt16BE(offset), hash: readHash(buf, offset + 2) });
+      }
+      return { node, hash, unknown, [slots ? "slots" : "nodes"]: entries };
+    }
+
+    // Raw templates come out base64-encoded, as in the JSON chunk
+    case MSG.BACKUP: {
+      const count = buf.readUInt8(7);
+      const templates = [];
+      for (let i = 0, offset = 8; i < count; i++, offset += 2 + TEMPLATE_LEN) {
+        if (offset + 2 + TEMPLATE_LEN > buf.length) throw new RangeError("truncated backup chunk");
+        templates.push({
+          id: buf.readUInt16BE(offset),
+          data: buf.toString("base64", offset + 2, offset + 2 + TEMPLATE_LEN),
+        });
+      }
+      return { seq: buf.readUInt16BE(2), next: buf.readUInt16BE(4), done: buf.readUInt8(6) !== 0, templates };
+    }
+
+    case MSG.RESTORE_ACK:
+      return {
+        restoreAck: buf.readUInt16BE(2),
+        stored: buf.readUInt16BE(4),
+        failed: buf.readUInt16BE(6),
+        done: buf.readUInt8(8) !== 0,
+      };
+
+    case MSG.HEARTBEAT: {
+      // [count, p50, p95, p99, max] per metric, as in the JSON heartbeat
+      // then the station mode; older firmware stops after the metrics
+      const latency: Record<string, number[]> = {};
+      const count = buf.length > 6 ? buf.readUInt8(6) : 0;
+      let offset = 7;
+      for (let i = 0; i < count; i++, offset += 21) {
+        const name = LATENCY_NAMES[buf.readUInt8(offset)] ?? `metric${buf.readUInt8(offset)}`;
+        latency[name] = [0, 1, 2, 3, 4].map((k) => buf.readUInt32BE(offset + 1 + 4 * k));
+      }
+      const mode = offset < buf.length ? MODE_NAMES[buf.readUInt8(offset)] ?? "unknown" : "ready";
+      return { status: mode === "ready" ? "alive" : mode, uptime: buf.length >= 6 ? buf.readUInt32BE(2) : 0, latency };
+    }
+
+    default:
+      throw new Error(`unknown binary message type ${buf[1]}`);
+  }
+};
+
+// Parses a payload in either format
+export const decodeMessage = (message: Buffer): any =>
+  isBinaryMessage(message) ? decodeBinaryMessage(message) : JSON.parse(message.toString());